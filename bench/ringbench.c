@@ -0,0 +1,326 @@
+/*
+ * tee for Windows -- ring buffer microbenchmark
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Microbenchmark of the chunk handoff between the reader and the writers: the lock-free ring (the
+ * very functions of the core, which is included as a whole, like in the unit tests) against the
+ * per-slot mutex/condvar handshake with the sign-flipped pending counter, which it has replaced
+ * and which is reproduced here. The reader only stamps each chunk and the consumers only check the
+ * stamp, so that the result is the cost of the handoff itself, in chunks per second.
+ */
+
+#define tee_main tee_core_main
+#include "../tee.c"
+#undef tee_main
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_CHUNK_SIZE 4096U
+#define BENCH_ROUNDS 3U
+#define MAX_CONSUMERS 63U
+
+typedef struct _consumer
+{
+    DWORD chunks, errors;
+    thread_handle_t thread;
+}
+consumer_t;
+
+static ULONGLONG now_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (((ULONGLONG)now.tv_sec) * 1000000000ULL) + ((ULONGLONG)now.tv_nsec);
+}
+
+static BOOL start_consumers(consumer_t *const consumers, const DWORD count, const DWORD chunks, const thread_routine_t routine)
+{
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        consumers[index].chunks = chunks;
+        consumers[index].errors = 0U;
+        if (!create_thread(&consumers[index].thread, routine, &consumers[index]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static DWORD join_consumers(consumer_t *const consumers, const DWORD count)
+{
+    DWORD errors = 0U;
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        join_thread(consumers[index].thread, INFINITE);
+        close_thread(consumers[index].thread);
+        errors += consumers[index].errors;
+    }
+
+    return errors;
+}
+
+// --------------------------------------------------------------------------
+// Lock-free ring
+// --------------------------------------------------------------------------
+
+static DWORD THREAD_API ring_consumer_start_routine(void *const lpThreadParameter)
+{
+    consumer_t *const consumer = (consumer_t*)lpThreadParameter;
+    DWORD myIndex = 0U, mySequence = 1U;
+
+    for (DWORD number = 0U; number < consumer->chunks; ++number)
+    {
+        slot_t *const slot = GET_SLOT(myIndex);
+        wait_for_chunk(slot, mySequence);
+        consumer->errors += (*((const DWORD*)slot->buffer) != number) ? 1U : 0U;
+        release_chunk(slot);
+        INCREMENT_INDEX(myIndex, mySequence);
+    }
+
+    return 0U;
+}
+
+static double run_ring(const DWORD consumerCount, const DWORD bufferCount, const DWORD chunks)
+{
+    consumer_t consumers[MAX_CONSUMERS];
+    DWORD myIndex = 0U, mySequence = 1U;
+    BOOL largePages = FALSE;
+
+    if (!initialize_slots(BENCH_CHUNK_SIZE, bufferCount, &largePages))
+    {
+        return -1.0;
+    }
+
+    const ULONGLONG startTime = now_nanos();
+    if (!start_consumers(consumers, consumerCount, chunks, ring_consumer_start_routine))
+    {
+        return -1.0;
+    }
+
+    for (DWORD number = 0U; number < chunks; ++number)
+    {
+        slot_t *const slot = GET_SLOT(myIndex);
+        wait_for_release(slot);
+        *((DWORD*)slot->buffer) = number;
+        slot->bytesTotal = BENCH_CHUNK_SIZE;
+        slot->pending = (LONG)consumerCount;
+        publish_chunk(slot, mySequence);
+        INCREMENT_INDEX(myIndex, mySequence);
+    }
+
+    const DWORD errors = join_consumers(consumers, consumerCount);
+    const ULONGLONG elapsed = now_nanos() - startTime;
+    release_slots();
+    return errors ? -1.0 : (((double)chunks) * 1e9 / ((double)elapsed));
+}
+
+// --------------------------------------------------------------------------
+// Mutex/condvar handshake
+// --------------------------------------------------------------------------
+
+/*
+ * The former protocol: the reader sets the pending counter to +n or -n under the mutex of the
+ * slot, alternating on each pass over the ring, and broadcasts "isReady"; each writer waits for the
+ * sign that it expects, counts the pending counter towards zero, and signals "allDone" to the
+ * reader, if it was the last one.
+ */
+
+typedef struct _locked_slot
+{
+    BYTE *buffer;
+    volatile LONG pending;
+    pthread_mutex_t mutex;
+    pthread_cond_t isReady, allDone;
+}
+locked_slot_t;
+
+static locked_slot_t *g_lockedSlots = NULL;
+static DWORD g_lockedCount = 0U;
+
+#define INCREMENT_LOCKED(INDEX, FLAG) do \
+{ \
+    if (++(INDEX) >= g_lockedCount) \
+    { \
+        (INDEX) = 0U; \
+        (FLAG) = (!(FLAG)); \
+    } \
+} \
+while (0)
+
+static DWORD THREAD_API locked_consumer_start_routine(void *const lpThreadParameter)
+{
+    consumer_t *const consumer = (consumer_t*)lpThreadParameter;
+    DWORD myIndex = 0U;
+    BOOL myFlag = TRUE;
+
+    for (DWORD number = 0U; number < consumer->chunks; ++number)
+    {
+        locked_slot_t *const slot = &g_lockedSlots[myIndex];
+        pthread_mutex_lock(&slot->mutex);
+        while (!(myFlag ? (slot->pending > 0L) : (slot->pending < 0L)))
+        {
+            pthread_cond_wait(&slot->isReady, &slot->mutex);
+        }
+        pthread_mutex_unlock(&slot->mutex);
+
+        consumer->errors += (*((const DWORD*)slot->buffer) != number) ? 1U : 0U;
+
+        if (!(myFlag ? atomic_decrement(&slot->pending) : atomic_increment(&slot->pending)))
+        {
+            pthread_mutex_lock(&slot->mutex); /*the reader either has not checked the counter yet, or it is sleeping*/
+            pthread_mutex_unlock(&slot->mutex);
+            pthread_cond_signal(&slot->allDone);
+        }
+        INCREMENT_LOCKED(myIndex, myFlag);
+    }
+
+    return 0U;
+}
+
+static double run_locked(const DWORD consumerCount, const DWORD bufferCount, const DWORD chunks)
+{
+    consumer_t consumers[MAX_CONSUMERS];
+    DWORD myIndex = 0U;
+    BOOL myFlag = TRUE, largePages = FALSE;
+
+    BYTE *const memory = alloc_pages(((SIZE_T)BENCH_CHUNK_SIZE) * bufferCount, &largePages);
+    if ((!memory) || (!(g_lockedSlots = (locked_slot_t*)alloc_memory(sizeof(locked_slot_t) * bufferCount))))
+    {
+        return -1.0;
+    }
+
+    g_lockedCount = bufferCount;
+    for (DWORD index = 0U; index < bufferCount; ++index)
+    {
+        g_lockedSlots[index].buffer = memory + (((SIZE_T)BENCH_CHUNK_SIZE) * index);
+        pthread_mutex_init(&g_lockedSlots[index].mutex, NULL);
+        pthread_cond_init(&g_lockedSlots[index].isReady, NULL);
+        pthread_cond_init(&g_lockedSlots[index].allDone, NULL);
+    }
+
+    const ULONGLONG startTime = now_nanos();
+    if (!start_consumers(consumers, consumerCount, chunks, locked_consumer_start_routine))
+    {
+        return -1.0;
+    }
+
+    for (DWORD number = 0U; number < chunks; ++number)
+    {
+        locked_slot_t *const slot = &g_lockedSlots[myIndex];
+        pthread_mutex_lock(&slot->mutex);
+        while (slot->pending)
+        {
+            pthread_cond_wait(&slot->allDone, &slot->mutex);
+        }
+        pthread_mutex_unlock(&slot->mutex);
+
+        *((DWORD*)slot->buffer) = number;
+
+        pthread_mutex_lock(&slot->mutex);
+        slot->pending = myFlag ? ((LONG)consumerCount) : (-((LONG)consumerCount));
+        pthread_mutex_unlock(&slot->mutex);
+        pthread_cond_broadcast(&slot->isReady);
+        INCREMENT_LOCKED(myIndex, myFlag);
+    }
+
+    const DWORD errors = join_consumers(consumers, consumerCount);
+    const ULONGLONG elapsed = now_nanos() - startTime;
+
+    for (DWORD index = 0U; index < bufferCount; ++index)
+    {
+        pthread_mutex_destroy(&g_lockedSlots[index].mutex);
+        pthread_cond_destroy(&g_lockedSlots[index].isReady);
+        pthread_cond_destroy(&g_lockedSlots[index].allDone);
+    }
+
+    free_memory(g_lockedSlots);
+    free_pages(memory, ((SIZE_T)BENCH_CHUNK_SIZE) * bufferCount, largePages);
+    g_lockedSlots = NULL;
+    return errors ? -1.0 : (((double)chunks) * 1e9 / ((double)elapsed));
+}
+
+// --------------------------------------------------------------------------
+// MAIN
+// --------------------------------------------------------------------------
+
+static BOOL parse_count(const wchar_t *const text, const DWORD minimum, const DWORD maximum, DWORD *const value)
+{
+    wchar_t *end = NULL;
+    const unsigned long result = wcstoul(text, &end, 10);
+    if ((end == text) || (*end != L'\0') || (result < minimum) || (result > maximum))
+    {
+        return FALSE;
+    }
+
+    *value = (DWORD)result;
+    return TRUE;
+}
+
+int tee_main(const int argc, const wchar_t *const argv[])
+{
+    static const DWORD DEFAULT_CONSUMERS[] = { 1U, 4U, 16U, 63U };
+    DWORD chunks = 20000U, bufferCount = DEFAULT_BUFFERS, consumerCounts[16U], consumerTotal = 0U;
+
+    if (((argc > 1) && (!parse_count(argv[1], 1U, MAXLONG, &chunks))) || ((argc > 2) && (!parse_count(argv[2], MIN_BUFFERS, MAX_BUFFERS, &bufferCount))) || (argc > 3 + ((int)ARRAYSIZE(consumerCounts))))
+    {
+        fprintf(stderr, "Usage:\n  ringbench [<chunks> [<buffers> [<consumers> ...]]]\n\nDefaults: 20000 chunks, %u buffers, 1 4 16 63 consumers.\n", (unsigned)DEFAULT_BUFFERS);
+        return 1;
+    }
+
+    for (int index = 3; index < argc; ++index)
+    {
+        if (!parse_count(argv[index], 1U, MAX_CONSUMERS, &consumerCounts[consumerTotal++]))
+        {
+            fputs("ringbench: Invalid number of consumers!\n", stderr);
+            return 1;
+        }
+    }
+    if (!consumerTotal)
+    {
+        for (; consumerTotal < ARRAYSIZE(DEFAULT_CONSUMERS); ++consumerTotal)
+        {
+            consumerCounts[consumerTotal] = DEFAULT_CONSUMERS[consumerTotal];
+        }
+    }
+
+    printf("consumers,buffers,chunks,cpus,mutex_condvar_chunks_s,lock_free_chunks_s\n");
+    for (DWORD index = 0U; index < consumerTotal; ++index)
+    {
+        double locked = 0.0, lockFree = 0.0;
+        for (DWORD round = 0U; round < BENCH_ROUNDS; ++round) /*best of*/
+        {
+            const double lockedRate = run_locked(consumerCounts[index], bufferCount, chunks);
+            const double lockFreeRate = run_ring(consumerCounts[index], bufferCount, chunks);
+            if ((lockedRate < 0.0) || (lockFreeRate < 0.0))
+            {
+                fputs("ringbench: The benchmark has failed!\n", stderr);
+                return 1;
+            }
+            locked = (lockedRate > locked) ? lockedRate : locked;
+            lockFree = (lockFreeRate > lockFree) ? lockFreeRate : lockFree;
+        }
+        printf("%u,%u,%u,%u,%.0f,%.0f\n", (unsigned)consumerCounts[index], (unsigned)bufferCount, (unsigned)chunks, (unsigned)get_processor_count(), locked, lockFree);
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#!/bin/sh
+# Benchmark sweep for the POSIX build of tee, compared against GNU coreutils tee.
+#
+# Build with "make bench", then run "bench/run.sh" from the repository root. All parameters are
+# passed as environment variables; the results are printed as CSV, one row per run:
+#
+#   TEE       tee binary under test                 (default: bin/posix/tee)
+#   GNU_TEE   reference tee, empty to skip it       (default: /usr/bin/tee)
+#   SIZE      total bytes per run                   (default: 256M)
+#   CHUNK     producer record size                  (default: 4K)
+#   RATE      producer rate in bytes/s, 0 = max     (default: 0)
+#   BURST     records written back to back          (default: 1)
+#   OUTPUTS   output file counts to sweep           (default: "1 2 4 8 16 32 63")
+#   BUFFERS   --buffer-size values, "-" = default   (default: "- 64K 1M")
+#   FLAGS     flag sets, "-" = none                 (default: "- -b -f")
+#   SINK      file, null or slow                    (default: file)
+#   SLOW_RATE rate of the slow sink in bytes/s      (default: 16M)
+#   BENCH_DIR scratch directory                     (default: a new directory in $TMPDIR)
+#
+# The "null" sink drains each output through a FIFO (tee skips /dev/null), the "slow" sink does the
+# same, but throttles the first output to SLOW_RATE. The latency percentiles are measured on the
+# standard output of tee, from the moment a record is produced to the moment it is consumed.
+# BUFFERS and FLAGS apply to our tee only; GNU tee runs once per output count, with its defaults.
+
+set -eu
+
+BIN_DIR=$(dirname "$0")/../bin/posix
+TEE=${TEE:-$BIN_DIR/tee}
+TEEBENCH=${TEEBENCH:-$BIN_DIR/teebench}
+GNU_TEE=${GNU_TEE-/usr/bin/tee}
+SIZE=${SIZE:-256M}
+CHUNK=${CHUNK:-4K}
+RATE=${RATE:-0}
+BURST=${BURST:-1}
+OUTPUTS=${OUTPUTS:-1 2 4 8 16 32 63}
+BUFFERS=${BUFFERS:-- 64K 1M}
+FLAGS=${FLAGS:-- -b -f}
+SINK=${SINK:-file}
+SLOW_RATE=${SLOW_RATE:-16M}
+
+for f in "$TEE" "$TEEBENCH"; do
+    if [ ! -x "$f" ]; then
+        echo "run.sh: \"$f\" not found, run \"make bench\" first!" >&2
+        exit 1
+    fi
+done
+
+case "$SINK" in
+    file|null|slow) ;;
+    *) echo "run.sh: Unknown sink \"$SINK\"!" >&2; exit 1 ;;
+esac
+
+BENCH_DIR=${BENCH_DIR:-$(mktemp -d "${TMPDIR:-/tmp}/teebench.XXXXXX")}
+mkdir -p "$BENCH_DIR"
+trap 'rm -rf "$BENCH_DIR"' EXIT INT TERM
+
+now_nanos() {
+    date +%s%N
+}
+
+# Creates the output files (or FIFOs with their consumers) and sets "files" to their names
+prepare_outputs() {
+    count=$1
+    files=
+    i=1
+    while [ "$i" -le "$count" ]; do
+        name="$BENCH_DIR/out.$i"
+        rm -f "$name"
+        if [ "$SINK" != file ]; then
+            mkfifo "$name"
+            if [ "$SINK" = slow ] && [ "$i" -eq 1 ]; then
+                "$TEEBENCH" consume -q -s "$CHUNK" -r "$SLOW_RATE" < "$name" > /dev/null &
+            else
+                "$TEEBENCH" consume -q -s "$CHUNK" < "$name" > /dev/null &
+            fi
+        fi
+        files="$files $name"
+        i=$((i + 1))
+    done
+}
+
+# run_one <impl> <outputs> <buffer> <flags> <tee command...>
+run_one() {
+    impl=$1; count=$2; buffer=$3; flags=$4
+    shift 4
+    prepare_outputs "$count"
+    start=$(now_nanos)
+    # shellcheck disable=SC2086
+    result=$("$TEEBENCH" produce -s "$CHUNK" -n "$SIZE" -r "$RATE" -b "$BURST" | "$@" $files | "$TEEBENCH" consume -s "$CHUNK")
+    wait
+    elapsed=$(($(now_nanos) - start))
+    rm -f $files
+    echo "$result" | awk -v impl="$impl" -v outputs="$count" -v buffer="$buffer" -v flags="$flags" -v sink="$SINK" -v ns="$elapsed" '
+        {
+            for (i = 1; i <= NF; ++i) { split($i, kv, "="); v[kv[1]] = kv[2] }
+            printf "%s,%s,%s,%s,%s,%.1f,%s,%s,%s,%s,%s,%s\n", impl, sink, outputs, buffer, flags,
+                (v["bytes"] / 1048576.0) / (ns / 1e9), v["p50_us"], v["p90_us"], v["p99_us"], v["p999_us"], v["max_us"], v["errors"]
+        }'
+}
+
+echo "impl,sink,outputs,buffer_size,flags,mb_per_s,p50_us,p90_us,p99_us,p999_us,max_us,errors"
+for count in $OUTPUTS; do
+    if [ -n "$GNU_TEE" ] && [ -x "$GNU_TEE" ]; then
+        run_one gnu "$count" - - "$GNU_TEE"
+    fi
+    for buffer in $BUFFERS; do
+        for flags in $FLAGS; do
+            set -- "$TEE"
+            if [ "$buffer" != - ]; then
+                set -- "$@" "--buffer-size=$buffer"
+            fi
+            if [ "$flags" != - ]; then
+                # shellcheck disable=SC2086
+                set -- "$@" $flags
+            fi
+            run_one tee "$count" "$buffer" "$flags" "$@"
+        done
+    done
+done
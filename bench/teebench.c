@@ -0,0 +1,351 @@
+/*
+ * tee for Windows -- benchmark helper
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Synthetic producer and consumer for "run.sh". The producer writes fixed-size records, each one
+ * starting with a sequence number and a CLOCK_MONOTONIC timestamp; the consumer reassembles the
+ * records (no matter how the pipeline has split or merged them) and measures, for every record,
+ * the time from being produced to being consumed. Works with any "tee", so that the results are
+ * directly comparable to GNU coreutils.
+ */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORD_MAGIC 0x544545424E434831ULL
+#define MIN_RECORD_SIZE 24U
+#define MAX_RECORD_SIZE (64U << 20)
+#define READ_SIZE (1U << 20)
+
+typedef struct
+{
+    uint64_t magic, sequence, timestamp;
+}
+header_t;
+
+// --------------------------------------------------------------------------
+// Utilities
+// --------------------------------------------------------------------------
+
+static uint64_t now_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (((uint64_t)now.tv_sec) * 1000000000ULL) + ((uint64_t)now.tv_nsec);
+}
+
+static void sleep_until(const uint64_t deadline)
+{
+    const struct timespec until = { .tv_sec = (time_t)(deadline / 1000000000ULL), .tv_nsec = (long)(deadline % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+static int parse_size(const char *const str, uint64_t *const value)
+{
+    char *end = NULL;
+    errno = 0;
+    uint64_t result = strtoull(str, &end, 10);
+    if ((end == str) || errno)
+    {
+        return 0;
+    }
+
+    switch (*end)
+    {
+    case '\0':
+        break;
+    case 'k': case 'K':
+        result <<= 10;
+        ++end;
+        break;
+    case 'm': case 'M':
+        result <<= 20;
+        ++end;
+        break;
+    case 'g': case 'G':
+        result <<= 30;
+        ++end;
+        break;
+    default:
+        return 0;
+    }
+
+    *value = result;
+    return (*end == '\0');
+}
+
+static int write_fully(const int fd, const uint8_t *buffer, size_t size)
+{
+    while (size > 0U)
+    {
+        const ssize_t result = write(fd, buffer, size);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        buffer += result;
+        size -= (size_t)result;
+    }
+
+    return 1;
+}
+
+static int compare_u64(const void *const a, const void *const b)
+{
+    const uint64_t x = *((const uint64_t*)a), y = *((const uint64_t*)b);
+    return (x > y) - (x < y);
+}
+
+// --------------------------------------------------------------------------
+// Producer
+// --------------------------------------------------------------------------
+
+/*
+ * Writes "total" bytes as records of "recordSize" bytes. With a "rate" (bytes/s), "burst" records
+ * are written back to back, then the producer sleeps until the average rate is met again.
+ */
+static int run_producer(const uint64_t recordSize, const uint64_t total, const uint64_t rate, const uint64_t burst)
+{
+    uint8_t *const record = (uint8_t*)malloc(recordSize);
+    if (!record)
+    {
+        fputs("teebench: Out of memory!\n", stderr);
+        return 1;
+    }
+
+    for (uint64_t offset = sizeof(header_t); offset < recordSize; ++offset)
+    {
+        record[offset] = (uint8_t)('A' + (offset % 26U));
+    }
+
+    const uint64_t count = total / recordSize, startTime = now_nanos();
+    for (uint64_t sequence = 0U; sequence < count; ++sequence)
+    {
+        if (rate && (sequence > 0U) && ((sequence % burst) == 0U))
+        {
+            sleep_until(startTime + (uint64_t)((((double)(sequence * recordSize)) / ((double)rate)) * 1e9));
+        }
+        const header_t header = { RECORD_MAGIC, sequence, now_nanos() };
+        memcpy(record, &header, sizeof(header_t));
+        if (!write_fully(STDOUT_FILENO, record, recordSize))
+        {
+            fprintf(stderr, "teebench: Write error: %s\n", strerror(errno));
+            free(record);
+            return 1;
+        }
+    }
+
+    free(record);
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Consumer
+// --------------------------------------------------------------------------
+
+/*
+ * Reads records from stdin and prints one line of results. With a "rate" (bytes/s), the consumer
+ * throttles itself, i.e. it acts as an artificially slow sink.
+ */
+static int run_consumer(const uint64_t recordSize, const uint64_t rate, const int quiet)
+{
+    uint8_t *const buffer = (uint8_t*)malloc(READ_SIZE);
+    uint8_t *const pending = (uint8_t*)malloc(sizeof(header_t));
+    size_t capacity = 65536U, latencyCount = 0U, pendingSize = 0U;
+    uint64_t *latencies = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    uint64_t totalBytes = 0U, errors = 0U, expected = 0U, startTime = 0U;
+
+    if ((!buffer) || (!pending) || (!latencies))
+    {
+        fputs("teebench: Out of memory!\n", stderr);
+        return 1;
+    }
+
+    for (;;)
+    {
+        const ssize_t result = read(STDIN_FILENO, buffer, READ_SIZE);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "teebench: Read error: %s\n", strerror(errno));
+            break;
+        }
+        if (!result)
+        {
+            break; /*end of input*/
+        }
+
+        const uint64_t now = now_nanos();
+        if (!totalBytes)
+        {
+            startTime = now;
+        }
+        totalBytes += (uint64_t)result;
+
+        for (size_t offset = 0U; offset < (size_t)result; )
+        {
+            const size_t chunk = ((((size_t)result) - offset) < (recordSize - pendingSize)) ? (((size_t)result) - offset) : (recordSize - pendingSize);
+            if (pendingSize < sizeof(header_t))
+            {
+                const size_t headerPart = sizeof(header_t) - pendingSize;
+                memcpy(pending + pendingSize, buffer + offset, (chunk < headerPart) ? chunk : headerPart); /*only the header is checked*/
+            }
+            offset += chunk;
+            if ((pendingSize += chunk) < recordSize)
+            {
+                continue;
+            }
+            header_t header;
+            memcpy(&header, pending, sizeof(header_t));
+            if ((header.magic != RECORD_MAGIC) || (header.sequence != expected))
+            {
+                ++errors;
+            }
+            else
+            {
+                if (latencyCount >= capacity)
+                {
+                    uint64_t *const temp = (uint64_t*)realloc(latencies, (capacity *= 2U) * sizeof(uint64_t));
+                    if (!temp)
+                    {
+                        fputs("teebench: Out of memory!\n", stderr);
+                        return 1;
+                    }
+                    latencies = temp;
+                }
+                latencies[latencyCount++] = now - header.timestamp;
+            }
+            expected = header.sequence + 1U;
+            pendingSize = 0U;
+        }
+
+        if (rate)
+        {
+            sleep_until(startTime + (uint64_t)((((double)totalBytes) / ((double)rate)) * 1e9));
+        }
+    }
+
+    if (!quiet)
+    {
+        const double seconds = (totalBytes && (now_nanos() > startTime)) ? (((double)(now_nanos() - startTime)) / 1e9) : 0.0;
+        qsort(latencies, latencyCount, sizeof(uint64_t), compare_u64);
+        #define PERCENTILE(P) (latencyCount ? (latencies[(size_t)(((double)(latencyCount - 1U)) * (P))] / 1000U) : 0U)
+        printf("bytes=%llu records=%llu errors=%llu seconds=%.3f p50_us=%llu p90_us=%llu p99_us=%llu p999_us=%llu max_us=%llu\n",
+            (unsigned long long)totalBytes, (unsigned long long)latencyCount, (unsigned long long)errors, seconds,
+            (unsigned long long)PERCENTILE(0.5), (unsigned long long)PERCENTILE(0.9), (unsigned long long)PERCENTILE(0.99),
+            (unsigned long long)PERCENTILE(0.999), (unsigned long long)PERCENTILE(1.0));
+        #undef PERCENTILE
+    }
+
+    free(latencies);
+    free(pending);
+    free(buffer);
+    return errors ? 2 : 0;
+}
+
+// --------------------------------------------------------------------------
+// MAIN
+// --------------------------------------------------------------------------
+
+static void print_usage(void)
+{
+    fputs(
+        "Usage:\n"
+        "  teebench produce [-s <record size>] [-n <total bytes>] [-r <bytes/s>] [-b <burst>]\n"
+        "  teebench consume [-s <record size>] [-r <bytes/s>] [-q]\n\n"
+        "Sizes and rates accept the suffixes K/M/G. A rate of 0 means unlimited.\n", stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t recordSize = 4096U, total = 256U << 20, rate = 0U, burst = 1U;
+    int quiet = 0, opt;
+
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "s:n:r:b:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            if ((!parse_size(optarg, &recordSize)) || (recordSize < MIN_RECORD_SIZE) || (recordSize > MAX_RECORD_SIZE))
+            {
+                fputs("teebench: Invalid record size!\n", stderr);
+                return 1;
+            }
+            break;
+        case 'n':
+            if (!parse_size(optarg, &total))
+            {
+                fputs("teebench: Invalid total size!\n", stderr);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (!parse_size(optarg, &rate))
+            {
+                fputs("teebench: Invalid rate!\n", stderr);
+                return 1;
+            }
+            break;
+        case 'b':
+            if ((!parse_size(optarg, &burst)) || (!burst))
+            {
+                fputs("teebench: Invalid burst size!\n", stderr);
+                return 1;
+            }
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (strcmp(argv[1], "produce") == 0)
+    {
+        return run_producer(recordSize, total, rate, burst);
+    }
+    else if (strcmp(argv[1], "consume") == 0)
+    {
+        return run_consumer(recordSize, rate, quiet);
+    }
+
+    print_usage();
+    return 1;
+}
@@ -0,0 +1,645 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "include/deflate.h"
+
+/*
+ * Each block is compressed as a single DEFLATE block with dynamic Huffman codes: a hash-chain
+ * LZ77 pass (greedy or with one step of lazy evaluation, depending on the level) records the
+ * literals and matches, then length-limited Huffman codes are built from the symbol frequencies.
+ * If the result would not be smaller than the input, "stored" blocks are written instead, so the
+ * output never exceeds gzip_bound(). Matches never reach back into the previous block, as each
+ * block has to be decompressible on its own.
+ */
+
+#define WINDOW_SIZE 32768U
+#define MIN_MATCH 3U
+#define MAX_MATCH 258U
+#define TOO_FAR 4096U
+#define HASH_BITS 15U
+#define HASH_SIZE (1U << HASH_BITS)
+#define MAX_STORED 65535U
+#define LITLEN_CODES 286U
+#define DIST_CODES 30U
+#define CODELEN_CODES 19U
+#define MAX_CODES LITLEN_CODES
+#define MAX_BITS 15U
+#define MAX_CODELEN_BITS 7U
+#define END_OF_BLOCK 256U
+#define GZIP_HEADER_SIZE 10U
+#define GZIP_TRAILER_SIZE 8U
+
+typedef struct
+{
+    DWORD maxChain, niceLength;
+    BOOL lazy;
+}
+level_t;
+
+static const level_t LEVELS[DEFLATE_MAX_LEVEL + 1U] =
+{
+    { 0U, 0U, FALSE }, { 4U, 16U, FALSE }, { 8U, 32U, FALSE }, { 16U, 64U, FALSE }, { 16U, 64U, TRUE },
+    { 32U, 128U, TRUE }, { 128U, 128U, TRUE }, { 256U, MAX_MATCH, TRUE }, { 1024U, MAX_MATCH, TRUE }, { 4096U, MAX_MATCH, TRUE }
+};
+
+static const WORD LENGTH_BASE[29U] = { 3U, 4U, 5U, 6U, 7U, 8U, 9U, 10U, 11U, 13U, 15U, 17U, 19U, 23U, 27U, 31U, 35U, 43U, 51U, 59U, 67U, 83U, 99U, 115U, 131U, 163U, 195U, 227U, 258U };
+static const BYTE LENGTH_EXTRA[29U] = { 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 1U, 1U, 1U, 1U, 2U, 2U, 2U, 2U, 3U, 3U, 3U, 3U, 4U, 4U, 4U, 4U, 5U, 5U, 5U, 5U, 0U };
+static const WORD DIST_BASE[DIST_CODES] = { 1U, 2U, 3U, 4U, 5U, 7U, 9U, 13U, 17U, 25U, 33U, 49U, 65U, 97U, 129U, 193U, 257U, 385U, 513U, 769U, 1025U, 1537U, 2049U, 3073U, 4097U, 6145U, 8193U, 12289U, 16385U, 24577U };
+static const BYTE DIST_EXTRA[DIST_CODES] = { 0U, 0U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 8U, 8U, 9U, 9U, 10U, 10U, 11U, 11U, 12U, 12U, 13U, 13U };
+static const BYTE CODELEN_ORDER[CODELEN_CODES] = { 16U, 17U, 18U, 0U, 8U, 7U, 9U, 6U, 10U, 5U, 11U, 4U, 12U, 3U, 13U, 2U, 14U, 1U, 15U };
+
+static DWORD g_crcTable[256U];
+static BYTE g_lengthCode[MAX_MATCH + 1U];
+static BYTE g_distCode[512U]; /*distances up to 256 directly, larger ones in steps of 128*/
+static BOOL g_tablesReady = FALSE;
+
+typedef struct
+{
+    DWORD freq[2U * MAX_CODES], parent[2U * MAX_CODES];
+    BOOL active[2U * MAX_CODES];
+}
+huffman_scratch_t;
+
+typedef struct
+{
+    BYTE lengths[MAX_CODES];
+    WORD codes[MAX_CODES];
+}
+huffman_code_t;
+
+struct _deflate_state
+{
+    DWORD maxBlockSize, symbolCount;
+    DWORD *head, *prev;
+    WORD *matchLengths, *values; /*a "matchLength" of zero means that "value" is a literal, otherwise it is the distance*/
+    DWORD litFreq[LITLEN_CODES], distFreq[DIST_CODES], codelenFreq[CODELEN_CODES];
+    huffman_code_t litCode, distCode, codelenCode;
+    BYTE runSymbols[LITLEN_CODES + DIST_CODES], runExtra[LITLEN_CODES + DIST_CODES];
+    BYTE allLengths[LITLEN_CODES + DIST_CODES];
+    huffman_scratch_t scratch;
+};
+
+typedef struct
+{
+    BYTE *output;
+    DWORD position, bitBuffer, bitCount;
+}
+bit_writer_t;
+
+// --------------------------------------------------------------------------
+// Tables
+// --------------------------------------------------------------------------
+
+static void initialize_tables(void)
+{
+    for (DWORD index = 0U; index < 256U; ++index)
+    {
+        DWORD value = index;
+        for (DWORD bit = 0U; bit < 8U; ++bit)
+        {
+            value = (value & 1U) ? (0xEDB88320U ^ (value >> 1)) : (value >> 1);
+        }
+        g_crcTable[index] = value;
+    }
+
+    for (DWORD code = 0U; code < 29U; ++code)
+    {
+        const DWORD last = (code < 28U) ? (((DWORD)LENGTH_BASE[code]) + (1U << LENGTH_EXTRA[code])) : (MAX_MATCH + 1U);
+        for (DWORD length = LENGTH_BASE[code]; (length < last) && (length <= MAX_MATCH); ++length)
+        {
+            g_lengthCode[length] = (BYTE)code;
+        }
+    }
+
+    for (DWORD code = 0U; code < DIST_CODES; ++code)
+    {
+        const DWORD first = DIST_BASE[code] - 1U, last = first + (1U << DIST_EXTRA[code]);
+        for (DWORD dist = first; dist < last; ++dist)
+        {
+            g_distCode[(dist < 256U) ? dist : (256U + (dist >> 7))] = (BYTE)code;
+        }
+    }
+
+    g_tablesReady = TRUE;
+}
+
+static __forceinline DWORD get_dist_code(const DWORD distance)
+{
+    const DWORD dist = distance - 1U;
+    return g_distCode[(dist < 256U) ? dist : (256U + (dist >> 7))];
+}
+
+static DWORD update_crc32(DWORD crc, const BYTE *const data, const DWORD size)
+{
+    crc = ~crc;
+    for (DWORD index = 0U; index < size; ++index)
+    {
+        crc = g_crcTable[(crc ^ data[index]) & 0xFFU] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+// --------------------------------------------------------------------------
+// State
+// --------------------------------------------------------------------------
+
+deflate_state_t *deflate_create(const DWORD maxBlockSize)
+{
+    if (!g_tablesReady)
+    {
+        initialize_tables(); /*the first state is created, before any compressing thread is started*/
+    }
+
+    deflate_state_t *const state = (deflate_state_t*)alloc_memory(sizeof(deflate_state_t));
+    if (!state)
+    {
+        return NULL;
+    }
+
+    state->maxBlockSize = maxBlockSize;
+    state->head = (DWORD*)alloc_memory(sizeof(DWORD) * HASH_SIZE);
+    state->prev = (DWORD*)alloc_memory(sizeof(DWORD) * (maxBlockSize + 1U));
+    state->matchLengths = (WORD*)alloc_memory(sizeof(WORD) * (maxBlockSize + 1U));
+    state->values = (WORD*)alloc_memory(sizeof(WORD) * (maxBlockSize + 1U));
+    if ((!state->head) || (!state->prev) || (!state->matchLengths) || (!state->values))
+    {
+        deflate_destroy(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+void deflate_destroy(deflate_state_t *const state)
+{
+    if (state)
+    {
+        free_memory(state->values);
+        free_memory(state->matchLengths);
+        free_memory(state->prev);
+        free_memory(state->head);
+        free_memory(state);
+    }
+}
+
+DWORD gzip_bound(const DWORD inputSize)
+{
+    return GZIP_HEADER_SIZE + inputSize + (5U * ((inputSize / MAX_STORED) + 1U)) + GZIP_TRAILER_SIZE;
+}
+
+// --------------------------------------------------------------------------
+// LZ77
+// --------------------------------------------------------------------------
+
+static __forceinline DWORD hash3(const BYTE *const data)
+{
+    return ((((DWORD)data[0U]) | (((DWORD)data[1U]) << 8) | (((DWORD)data[2U]) << 16)) * 2654435761U) >> (32U - HASH_BITS);
+}
+
+static __forceinline void insert_string(deflate_state_t *const state, const BYTE *const input, const DWORD position)
+{
+    const DWORD hash = hash3(input + position);
+    state->prev[position] = state->head[hash];
+    state->head[hash] = position + 1U; /*zero means empty*/
+}
+
+static DWORD find_match(const deflate_state_t *const state, const BYTE *const input, const DWORD inputSize, const DWORD position, const level_t *const params, DWORD *const distance)
+{
+    const DWORD limit = ((inputSize - position) < MAX_MATCH) ? (inputSize - position) : MAX_MATCH;
+    const BYTE *const current = input + position;
+    DWORD bestLength = MIN_MATCH - 1U, chain = params->maxChain;
+
+    for (DWORD candidate = state->head[hash3(current)]; candidate && chain; candidate = state->prev[candidate - 1U], --chain)
+    {
+        const DWORD offset = position - (candidate - 1U);
+        if (offset > WINDOW_SIZE)
+        {
+            break;
+        }
+        const BYTE *const match = input + (candidate - 1U);
+        if ((match[bestLength] != current[bestLength]) || (match[0U] != current[0U]))
+        {
+            continue;
+        }
+        DWORD length = 0U;
+        while ((length < limit) && (match[length] == current[length]))
+        {
+            ++length;
+        }
+        if (length > bestLength)
+        {
+            bestLength = length;
+            *distance = offset;
+            if ((length >= params->niceLength) || (length >= limit))
+            {
+                break;
+            }
+        }
+    }
+
+    return ((bestLength > MIN_MATCH) || ((bestLength == MIN_MATCH) && (*distance <= TOO_FAR))) ? bestLength : 0U;
+}
+
+static __forceinline void record_literal(deflate_state_t *const state, const BYTE value)
+{
+    state->matchLengths[state->symbolCount] = 0U;
+    state->values[state->symbolCount++] = value;
+    ++state->litFreq[value];
+}
+
+static __forceinline void record_match(deflate_state_t *const state, const DWORD length, const DWORD distance)
+{
+    state->matchLengths[state->symbolCount] = (WORD)length;
+    state->values[state->symbolCount++] = (WORD)distance;
+    ++state->litFreq[257U + g_lengthCode[length]];
+    ++state->distFreq[get_dist_code(distance)];
+}
+
+static void find_symbols(deflate_state_t *const state, const BYTE *const input, const DWORD inputSize, const level_t *const params)
+{
+    DWORD position = 0U;
+    zero_memory(state->head, sizeof(DWORD) * HASH_SIZE);
+
+    while (position < inputSize)
+    {
+        if ((inputSize - position) < MIN_MATCH)
+        {
+            record_literal(state, input[position++]);
+            continue;
+        }
+        DWORD distance = 0U, length = find_match(state, input, inputSize, position, params, &distance);
+        insert_string(state, input, position);
+        if (params->lazy && length && (length < params->niceLength) && ((inputSize - position - 1U) >= MIN_MATCH))
+        {
+            DWORD nextDistance = 0U;
+            const DWORD nextLength = find_match(state, input, inputSize, position + 1U, params, &nextDistance);
+            if (nextLength > length)
+            {
+                record_literal(state, input[position++]); /*a longer match starts at the next position*/
+                insert_string(state, input, position);
+                length = nextLength;
+                distance = nextDistance;
+            }
+        }
+        if (!length)
+        {
+            record_literal(state, input[position++]);
+            continue;
+        }
+        record_match(state, length, distance);
+        for (const DWORD end = position + length; ++position < end; )
+        {
+            if ((inputSize - position) >= MIN_MATCH)
+            {
+                insert_string(state, input, position);
+            }
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Huffman codes
+// --------------------------------------------------------------------------
+
+/*
+ * Plain Huffman construction, quadratic in the number of symbols (at most 286). If the longest code
+ * exceeds "maxBits", the frequencies are halved and the codes are built again, which converges fast
+ * and costs very little compression.
+ */
+static void build_lengths(huffman_scratch_t *const scratch, const DWORD *const frequencies, const DWORD count, const DWORD maxBits, BYTE *const lengths)
+{
+    DWORD used = 0U, shift = 0U;
+    for (DWORD symbol = 0U; symbol < count; ++symbol)
+    {
+        used += frequencies[symbol] ? 1U : 0U;
+    }
+
+    for (;;)
+    {
+        DWORD nodeCount = count, maxLength = 0U;
+        for (DWORD symbol = 0U; symbol < count; ++symbol)
+        {
+            DWORD frequency = frequencies[symbol] ? (((frequencies[symbol] - 1U) >> shift) + 1U) : 0U;
+            if ((used < 2U) && (!frequency) && (symbol < 2U))
+            {
+                frequency = 1U; /*a code needs at least two symbols to be complete*/
+            }
+            scratch->freq[symbol] = frequency;
+            scratch->active[symbol] = (frequency != 0U);
+            scratch->parent[symbol] = MAXDWORD;
+        }
+
+        for (;;)
+        {
+            DWORD first = MAXDWORD, second = MAXDWORD;
+            for (DWORD node = 0U; node < nodeCount; ++node)
+            {
+                if (!scratch->active[node])
+                {
+                    continue;
+                }
+                if ((first == MAXDWORD) || (scratch->freq[node] < scratch->freq[first]))
+                {
+                    second = first;
+                    first = node;
+                }
+                else if ((second == MAXDWORD) || (scratch->freq[node] < scratch->freq[second]))
+                {
+                    second = node;
+                }
+            }
+            if (second == MAXDWORD)
+            {
+                break; /*only the root is left*/
+            }
+            scratch->freq[nodeCount] = scratch->freq[first] + scratch->freq[second];
+            scratch->active[nodeCount] = TRUE;
+            scratch->parent[nodeCount] = MAXDWORD;
+            scratch->active[first] = scratch->active[second] = FALSE;
+            scratch->parent[first] = scratch->parent[second] = nodeCount++;
+        }
+
+        for (DWORD symbol = 0U; symbol < count; ++symbol)
+        {
+            DWORD length = 0U;
+            if (scratch->freq[symbol])
+            {
+                for (DWORD node = symbol; scratch->parent[node] != MAXDWORD; node = scratch->parent[node])
+                {
+                    ++length;
+                }
+            }
+            lengths[symbol] = (BYTE)length;
+            maxLength = (length > maxLength) ? length : maxLength;
+        }
+
+        if (maxLength <= maxBits)
+        {
+            return;
+        }
+
+        ++shift;
+    }
+}
+
+static void build_codes(huffman_code_t *const code, const DWORD count)
+{
+    DWORD lengthCount[MAX_BITS + 1U], nextCode[MAX_BITS + 1U];
+    zero_memory(lengthCount, sizeof(lengthCount));
+
+    for (DWORD symbol = 0U; symbol < count; ++symbol)
+    {
+        ++lengthCount[code->lengths[symbol]];
+    }
+
+    lengthCount[0U] = 0U;
+    nextCode[0U] = 0U;
+    for (DWORD bits = 1U; bits <= MAX_BITS; ++bits)
+    {
+        nextCode[bits] = (nextCode[bits - 1U] + lengthCount[bits - 1U]) << 1;
+    }
+
+    for (DWORD symbol = 0U; symbol < count; ++symbol)
+    {
+        const DWORD length = code->lengths[symbol];
+        if (length)
+        {
+            DWORD value = nextCode[length]++, reversed = 0U; /*Huffman codes are stored starting with the most significant bit*/
+            for (DWORD bit = 0U; bit < length; ++bit, value >>= 1)
+            {
+                reversed = (reversed << 1) | (value & 1U);
+            }
+            code->codes[symbol] = (WORD)reversed;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Output
+// --------------------------------------------------------------------------
+
+static __forceinline void write_bits(bit_writer_t *const writer, const DWORD value, const DWORD count)
+{
+    writer->bitBuffer |= value << writer->bitCount;
+    writer->bitCount += count;
+    while (writer->bitCount >= 8U)
+    {
+        writer->output[writer->position++] = (BYTE)writer->bitBuffer;
+        writer->bitBuffer >>= 8;
+        writer->bitCount -= 8U;
+    }
+}
+
+static void align_bits(bit_writer_t *const writer)
+{
+    if (writer->bitCount)
+    {
+        write_bits(writer, 0U, 8U - writer->bitCount);
+    }
+}
+
+static void write_u32(BYTE *const output, const DWORD value)
+{
+    output[0U] = (BYTE)value;
+    output[1U] = (BYTE)(value >> 8);
+    output[2U] = (BYTE)(value >> 16);
+    output[3U] = (BYTE)(value >> 24);
+}
+
+/* Run-length encodes the code lengths of both trees with the symbols 16 (repeat), 17 and 18 (zeros) */
+static DWORD encode_lengths(deflate_state_t *const state, const DWORD total)
+{
+    DWORD runCount = 0U;
+    zero_memory(state->codelenFreq, sizeof(state->codelenFreq));
+
+    #define EMIT_RUN(SYMBOL, EXTRA) do \
+    { \
+        state->runSymbols[runCount] = (BYTE)(SYMBOL); \
+        state->runExtra[runCount++] = (BYTE)(EXTRA); \
+        ++state->codelenFreq[(SYMBOL)]; \
+    } \
+    while (0)
+
+    for (DWORD index = 0U; index < total; )
+    {
+        const BYTE length = state->allLengths[index];
+        DWORD run = 1U;
+        while (((index + run) < total) && (state->allLengths[index + run] == length))
+        {
+            ++run;
+        }
+        index += run;
+        if (!length)
+        {
+            for (; run >= 11U; run -= (run < 138U) ? run : 138U)
+            {
+                EMIT_RUN(18U, ((run < 138U) ? run : 138U) - 11U);
+            }
+            if (run >= 3U)
+            {
+                EMIT_RUN(17U, run - 3U);
+                run = 0U;
+            }
+        }
+        else
+        {
+            EMIT_RUN(length, 0U);
+            for (--run; run >= 3U; run -= (run < 6U) ? run : 6U)
+            {
+                EMIT_RUN(16U, ((run < 6U) ? run : 6U) - 3U);
+            }
+        }
+        for (; run > 0U; --run)
+        {
+            EMIT_RUN(length, 0U);
+        }
+    }
+
+    #undef EMIT_RUN
+    return runCount;
+}
+
+static void write_stored(bit_writer_t *const writer, const BYTE *const input, const DWORD inputSize)
+{
+    DWORD offset = 0U;
+    do
+    {
+        const DWORD length = ((inputSize - offset) < MAX_STORED) ? (inputSize - offset) : MAX_STORED;
+        write_bits(writer, ((offset + length) >= inputSize) ? 1U : 0U, 3U); /*BFINAL, BTYPE=00*/
+        align_bits(writer);
+        write_bits(writer, length & 0xFFFFU, 16U);
+        write_bits(writer, (~length) & 0xFFFFU, 16U);
+        copy_memory(writer->output + writer->position, input + offset, length);
+        writer->position += length;
+        offset += length;
+    }
+    while (offset < inputSize);
+}
+
+DWORD gzip_compress(deflate_state_t *const state, const BYTE *const input, const DWORD inputSize, BYTE *const output, const DWORD level)
+{
+    const level_t *const params = &LEVELS[((level >= DEFLATE_MIN_LEVEL) && (level <= DEFLATE_MAX_LEVEL)) ? level : DEFLATE_DEFAULT_LEVEL];
+    bit_writer_t writer = { output, GZIP_HEADER_SIZE, 0U, 0U };
+
+    /* Header: magic, CM=8 (deflate), no flags, no time stamp, XFL, OS=unknown */
+    static const BYTE HEADER[GZIP_HEADER_SIZE] = { 0x1FU, 0x8BU, 0x08U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0xFFU };
+    copy_memory(output, HEADER, GZIP_HEADER_SIZE);
+    output[8U] = (level <= 1U) ? 4U : ((level >= DEFLATE_MAX_LEVEL) ? 2U : 0U);
+
+    /* Find the literals and matches */
+    state->symbolCount = 0U;
+    zero_memory(state->litFreq, sizeof(state->litFreq));
+    zero_memory(state->distFreq, sizeof(state->distFreq));
+    if (inputSize <= state->maxBlockSize)
+    {
+        find_symbols(state, input, inputSize, params);
+    }
+    state->litFreq[END_OF_BLOCK] = 1U;
+
+    /* Build the codes and determine the size of the compressed block */
+    build_lengths(&state->scratch, state->litFreq, LITLEN_CODES, MAX_BITS, state->litCode.lengths);
+    build_lengths(&state->scratch, state->distFreq, DIST_CODES, MAX_BITS, state->distCode.lengths);
+
+    DWORD litCount = LITLEN_CODES, distCount = DIST_CODES, codelenCount = CODELEN_CODES;
+    while ((litCount > 257U) && (!state->litCode.lengths[litCount - 1U]))
+    {
+        --litCount;
+    }
+    while ((distCount > 1U) && (!state->distCode.lengths[distCount - 1U]))
+    {
+        --distCount;
+    }
+
+    copy_memory(state->allLengths, state->litCode.lengths, litCount);
+    copy_memory(state->allLengths + litCount, state->distCode.lengths, distCount);
+    const DWORD runCount = encode_lengths(state, litCount + distCount);
+    build_lengths(&state->scratch, state->codelenFreq, CODELEN_CODES, MAX_CODELEN_BITS, state->codelenCode.lengths);
+    while ((codelenCount > 4U) && (!state->codelenCode.lengths[CODELEN_ORDER[codelenCount - 1U]]))
+    {
+        --codelenCount;
+    }
+
+    DWORD totalBits = 3U + 5U + 5U + 4U + (3U * codelenCount);
+    for (DWORD index = 0U; index < runCount; ++index)
+    {
+        const DWORD symbol = state->runSymbols[index];
+        totalBits += state->codelenCode.lengths[symbol] + ((symbol == 16U) ? 2U : ((symbol == 17U) ? 3U : ((symbol == 18U) ? 7U : 0U)));
+    }
+    for (DWORD symbol = 0U; symbol < LITLEN_CODES; ++symbol)
+    {
+        totalBits += state->litFreq[symbol] * (state->litCode.lengths[symbol] + ((symbol > END_OF_BLOCK) ? LENGTH_EXTRA[symbol - 257U] : 0U));
+    }
+    for (DWORD code = 0U; code < DIST_CODES; ++code)
+    {
+        totalBits += state->distFreq[code] * (state->distCode.lengths[code] + DIST_EXTRA[code]);
+    }
+
+    /* Write either the compressed block, or stored blocks */
+    if ((inputSize > state->maxBlockSize) || (((totalBits + 7U) >> 3) >= (gzip_bound(inputSize) - GZIP_HEADER_SIZE - GZIP_TRAILER_SIZE)))
+    {
+        write_stored(&writer, input, inputSize);
+    }
+    else
+    {
+        build_codes(&state->litCode, LITLEN_CODES);
+        build_codes(&state->distCode, DIST_CODES);
+        build_codes(&state->codelenCode, CODELEN_CODES);
+
+        write_bits(&writer, 1U, 1U); /*BFINAL*/
+        write_bits(&writer, 2U, 2U); /*BTYPE=10, dynamic Huffman codes*/
+        write_bits(&writer, litCount - 257U, 5U);
+        write_bits(&writer, distCount - 1U, 5U);
+        write_bits(&writer, codelenCount - 4U, 4U);
+        for (DWORD index = 0U; index < codelenCount; ++index)
+        {
+            write_bits(&writer, state->codelenCode.lengths[CODELEN_ORDER[index]], 3U);
+        }
+        for (DWORD index = 0U; index < runCount; ++index)
+        {
+            const DWORD symbol = state->runSymbols[index];
+            write_bits(&writer, state->codelenCode.codes[symbol], state->codelenCode.lengths[symbol]);
+            if (symbol >= 16U)
+            {
+                write_bits(&writer, state->runExtra[index], (symbol == 16U) ? 2U : ((symbol == 17U) ? 3U : 7U));
+            }
+        }
+
+        for (DWORD index = 0U; index < state->symbolCount; ++index)
+        {
+            const DWORD length = state->matchLengths[index], value = state->values[index];
+            if (!length)
+            {
+                write_bits(&writer, state->litCode.codes[value], state->litCode.lengths[value]);
+                continue;
+            }
+            const DWORD lengthCode = g_lengthCode[length], distCode = get_dist_code(value);
+            write_bits(&writer, state->litCode.codes[257U + lengthCode], state->litCode.lengths[257U + lengthCode]);
+            write_bits(&writer, length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+            write_bits(&writer, state->distCode.codes[distCode], state->distCode.lengths[distCode]);
+            write_bits(&writer, value - DIST_BASE[distCode], DIST_EXTRA[distCode]);
+        }
+
+        write_bits(&writer, state->litCode.codes[END_OF_BLOCK], state->litCode.lengths[END_OF_BLOCK]);
+        align_bits(&writer);
+    }
+
+    /* Trailer: CRC-32 and size of the uncompressed data */
+    write_u32(output + writer.position, update_crc32(0U, input, inputSize));
+    write_u32(output + writer.position + 4U, inputSize);
+    return writer.position + GZIP_TRAILER_SIZE;
+}
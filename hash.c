@@ -0,0 +1,617 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "include/hash.h"
+
+/*
+ * The long-input loop of XXH3 is vectorized with SSE2, which is available on every x64 CPU (see
+ * "scan.c"); other targets use the scalar code, which yields the very same result.
+ */
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * SHA-256 is roughly ten times faster with the SHA extensions, which are not part of any base line,
+ * so they are detected at run-time (sha256_reset).
+ */
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define HASH_SHA_NI 1
+#include <immintrin.h>
+#if defined(__GNUC__)
+#include <cpuid.h>
+#define TARGET_SHA_NI __attribute__((target("sha,ssse3,sse4.1")))
+#else
+#define TARGET_SHA_NI
+#endif
+#endif
+
+// --------------------------------------------------------------------------
+// Helper functions
+// --------------------------------------------------------------------------
+
+static __forceinline ULONGLONG read_u64(const BYTE *const ptr)
+{
+#if defined(_WIN32)
+    return *((const UNALIGNED ULONGLONG*)ptr); /*all Windows targets are little-endian*/
+#else
+    ULONGLONG value;
+    __builtin_memcpy(&value, ptr, sizeof(value));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+#endif
+}
+
+static __forceinline DWORD read_u32(const BYTE *const ptr)
+{
+#if defined(_WIN32)
+    return *((const UNALIGNED DWORD*)ptr);
+#else
+    DWORD value;
+    __builtin_memcpy(&value, ptr, sizeof(value));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+#endif
+}
+
+static __forceinline DWORD read_be32(const BYTE *const ptr)
+{
+    return (((DWORD)ptr[0U]) << 24) | (((DWORD)ptr[1U]) << 16) | (((DWORD)ptr[2U]) << 8) | ((DWORD)ptr[3U]);
+}
+
+static __forceinline ULONGLONG swap_u64(const ULONGLONG value)
+{
+    return (value << 56) | ((value << 40) & 0x00FF000000000000ULL) | ((value << 24) & 0x0000FF0000000000ULL) | ((value << 8) & 0x000000FF00000000ULL) |
+        ((value >> 8) & 0x00000000FF000000ULL) | ((value >> 24) & 0x0000000000FF0000ULL) | ((value >> 40) & 0x000000000000FF00ULL) | (value >> 56);
+}
+
+#define ROTL64(X, N) (((X) << (N)) | ((X) >> (64U - (N))))
+#define ROTR32(X, N) (((X) >> (N)) | ((X) << (32U - (N))))
+
+/* 32-Bit builds must not depend on the CRT helpers for 64-Bit multiplication (_allmul) */
+static __forceinline ULONGLONG multiply_32x32(const DWORD a, const DWORD b)
+{
+#if defined(_M_IX86)
+    return __emulu(a, b);
+#else
+    return ((ULONGLONG)a) * b;
+#endif
+}
+
+static __forceinline ULONGLONG multiply_64x64(const ULONGLONG a, const ULONGLONG b)
+{
+#if defined(_M_IX86)
+    return multiply_32x32((DWORD)a, (DWORD)b) + (((ULONGLONG)((((DWORD)a) * ((DWORD)(b >> 32))) + (((DWORD)(a >> 32)) * ((DWORD)b)))) << 32);
+#else
+    return a * b;
+#endif
+}
+
+static __forceinline ULONGLONG multiply_fold(const ULONGLONG a, const ULONGLONG b)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = ((unsigned __int128)a) * b;
+    return ((ULONGLONG)product) ^ ((ULONGLONG)(product >> 64));
+#elif defined(_M_X64)
+    ULONGLONG upper;
+    const ULONGLONG lower = _umul128(a, b, &upper);
+    return lower ^ upper;
+#elif defined(_M_ARM64)
+    return (a * b) ^ __umulh(a, b);
+#else
+    const ULONGLONG lowLow = multiply_32x32((DWORD)a, (DWORD)b);
+    const ULONGLONG highLow = multiply_32x32((DWORD)(a >> 32), (DWORD)b);
+    const ULONGLONG lowHigh = multiply_32x32((DWORD)a, (DWORD)(b >> 32));
+    const ULONGLONG cross = (lowLow >> 32) + (highLow & 0xFFFFFFFFU) + lowHigh;
+    const ULONGLONG upper = (highLow >> 32) + (cross >> 32) + multiply_32x32((DWORD)(a >> 32), (DWORD)(b >> 32));
+    return ((cross << 32) | (lowLow & 0xFFFFFFFFU)) ^ upper;
+#endif
+}
+
+// --------------------------------------------------------------------------
+// XXH3
+// --------------------------------------------------------------------------
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define PRIME_MX1 0x165667919E3779F9ULL
+#define PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define STRIPE_SIZE 64U
+#define SECRET_SIZE 192U
+#define STRIPES_PER_BLOCK ((SECRET_SIZE - STRIPE_SIZE) / 8U)
+#define BUFFER_SIZE ((DWORD)sizeof(((xxh3_state_t*)NULL)->buffer))
+#define MIDSIZE_MAX 240U
+
+static const BYTE XXH3_SECRET[SECRET_SIZE] =
+{
+    0xB8, 0xFE, 0x6C, 0x39, 0x23, 0xA4, 0x4B, 0xBE, 0x7C, 0x01, 0x81, 0x2C, 0xF7, 0x21, 0xAD, 0x1C,
+    0xDE, 0xD4, 0x6D, 0xE9, 0x83, 0x90, 0x97, 0xDB, 0x72, 0x40, 0xA4, 0xA4, 0xB7, 0xB3, 0x67, 0x1F,
+    0xCB, 0x79, 0xE6, 0x4E, 0xCC, 0xC0, 0xE5, 0x78, 0x82, 0x5A, 0xD0, 0x7D, 0xCC, 0xFF, 0x72, 0x21,
+    0xB8, 0x08, 0x46, 0x74, 0xF7, 0x43, 0x24, 0x8E, 0xE0, 0x35, 0x90, 0xE6, 0x81, 0x3A, 0x26, 0x4C,
+    0x3C, 0x28, 0x52, 0xBB, 0x91, 0xC3, 0x00, 0xCB, 0x88, 0xD0, 0x65, 0x8B, 0x1B, 0x53, 0x2E, 0xA3,
+    0x71, 0x64, 0x48, 0x97, 0xA2, 0x0D, 0xF9, 0x4E, 0x38, 0x19, 0xEF, 0x46, 0xA9, 0xDE, 0xAC, 0xD8,
+    0xA8, 0xFA, 0x76, 0x3F, 0xE3, 0x9C, 0x34, 0x3F, 0xF9, 0xDC, 0xBB, 0xC7, 0xC7, 0x0B, 0x4F, 0x1D,
+    0x8A, 0x51, 0xE0, 0x4B, 0xCD, 0xB4, 0x59, 0x31, 0xC8, 0x9F, 0x7E, 0xC9, 0xD9, 0x78, 0x73, 0x64,
+    0xEA, 0xC5, 0xAC, 0x83, 0x34, 0xD3, 0xEB, 0xC3, 0xC5, 0x81, 0xA0, 0xFF, 0xFA, 0x13, 0x63, 0xEB,
+    0x17, 0x0D, 0xDD, 0x51, 0xB7, 0xF0, 0xDA, 0x49, 0xD3, 0x16, 0x55, 0x26, 0x29, 0xD4, 0x68, 0x9E,
+    0x2B, 0x16, 0xBE, 0x58, 0x7D, 0x47, 0xA1, 0xFC, 0x8F, 0xF8, 0xB8, 0xD1, 0x7A, 0xD0, 0x31, 0xCE,
+    0x45, 0xCB, 0x3A, 0x8F, 0x95, 0x16, 0x04, 0x28, 0xAF, 0xD7, 0xFB, 0xCA, 0xBB, 0x4B, 0x40, 0x7E
+};
+
+static __forceinline ULONGLONG xxh64_avalanche(ULONGLONG hash)
+{
+    hash ^= hash >> 33;
+    hash = multiply_64x64(hash, PRIME64_2);
+    hash ^= hash >> 29;
+    hash = multiply_64x64(hash, PRIME64_3);
+    return hash ^ (hash >> 32);
+}
+
+static __forceinline ULONGLONG xxh3_avalanche(ULONGLONG hash)
+{
+    hash ^= hash >> 37;
+    hash = multiply_64x64(hash, PRIME_MX1);
+    return hash ^ (hash >> 32);
+}
+
+static __forceinline ULONGLONG mix_16(const BYTE *const input, const BYTE *const secret)
+{
+    return multiply_fold(read_u64(input) ^ read_u64(secret), read_u64(input + 8U) ^ read_u64(secret + 8U));
+}
+
+static ULONGLONG hash_short(const BYTE *const input, const DWORD size)
+{
+    const BYTE *const secret = XXH3_SECRET;
+
+    if (size > 128U)
+    {
+        ULONGLONG acc = multiply_64x64(size, PRIME64_1), accEnd;
+        for (DWORD round = 0U; round < 8U; ++round)
+        {
+            acc += mix_16(input + (16U * round), secret + (16U * round));
+        }
+        accEnd = mix_16(input + size - 16U, secret + 136U - 17U);
+        acc = xxh3_avalanche(acc);
+        for (DWORD round = 8U; round < size / 16U; ++round)
+        {
+            accEnd += mix_16(input + (16U * round), secret + (16U * (round - 8U)) + 3U);
+        }
+        return xxh3_avalanche(acc + accEnd);
+    }
+
+    if (size > 16U)
+    {
+        ULONGLONG acc = multiply_64x64(size, PRIME64_1);
+        if (size > 32U)
+        {
+            if (size > 64U)
+            {
+                if (size > 96U)
+                {
+                    acc += mix_16(input + 48U, secret + 96U);
+                    acc += mix_16(input + size - 64U, secret + 112U);
+                }
+                acc += mix_16(input + 32U, secret + 64U);
+                acc += mix_16(input + size - 48U, secret + 80U);
+            }
+            acc += mix_16(input + 16U, secret + 32U);
+            acc += mix_16(input + size - 32U, secret + 48U);
+        }
+        acc += mix_16(input, secret);
+        acc += mix_16(input + size - 16U, secret + 16U);
+        return xxh3_avalanche(acc);
+    }
+
+    if (size > 8U)
+    {
+        const ULONGLONG low = read_u64(input) ^ (read_u64(secret + 24U) ^ read_u64(secret + 32U));
+        const ULONGLONG high = read_u64(input + size - 8U) ^ (read_u64(secret + 40U) ^ read_u64(secret + 48U));
+        return xxh3_avalanche(size + swap_u64(low) + high + multiply_fold(low, high));
+    }
+
+    if (size >= 4U)
+    {
+        ULONGLONG hash = ((((ULONGLONG)read_u32(input)) << 32) + read_u32(input + size - 4U)) ^ (read_u64(secret + 8U) ^ read_u64(secret + 16U));
+        hash ^= ROTL64(hash, 49) ^ ROTL64(hash, 24);
+        hash = multiply_64x64(hash, PRIME_MX2);
+        hash ^= (hash >> 35) + size;
+        hash = multiply_64x64(hash, PRIME_MX2);
+        return hash ^ (hash >> 28);
+    }
+
+    if (size)
+    {
+        const DWORD combined = (((DWORD)input[0U]) << 16) | (((DWORD)input[size >> 1]) << 24) | ((DWORD)input[size - 1U]) | (size << 8);
+        return xxh64_avalanche(((ULONGLONG)combined) ^ (read_u32(secret) ^ read_u32(secret + 4U)));
+    }
+
+    return xxh64_avalanche(read_u64(secret + 56U) ^ read_u64(secret + 64U));
+}
+
+#if defined(HASH_SSE2)
+
+static __forceinline void accumulate_512(ULONGLONG *const acc, const BYTE *const input, const BYTE *const secret)
+{
+    for (DWORD lane = 0U; lane < 4U; ++lane)
+    {
+        const __m128i value = _mm_loadu_si128(((const __m128i*)input) + lane);
+        const __m128i key = _mm_xor_si128(value, _mm_loadu_si128(((const __m128i*)secret) + lane));
+        const __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+        const __m128i sum = _mm_add_epi64(_mm_loadu_si128(((const __m128i*)acc) + lane), _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_si128(((__m128i*)acc) + lane, _mm_add_epi64(product, sum));
+    }
+}
+
+static __forceinline void scramble(ULONGLONG *const acc, const BYTE *const secret)
+{
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (DWORD lane = 0U; lane < 4U; ++lane)
+    {
+        const __m128i value = _mm_loadu_si128(((const __m128i*)acc) + lane);
+        const __m128i key = _mm_xor_si128(_mm_xor_si128(value, _mm_srli_epi64(value, 47)), _mm_loadu_si128(((const __m128i*)secret) + lane));
+        const __m128i productHigh = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128(((__m128i*)acc) + lane, _mm_add_epi64(_mm_mul_epu32(key, prime), _mm_slli_epi64(productHigh, 32)));
+    }
+}
+
+#else
+
+static __forceinline void accumulate_512(ULONGLONG *const acc, const BYTE *const input, const BYTE *const secret)
+{
+    for (DWORD lane = 0U; lane < 8U; ++lane)
+    {
+        const ULONGLONG value = read_u64(input + (8U * lane));
+        const ULONGLONG key = value ^ read_u64(secret + (8U * lane));
+        acc[lane ^ 1U] += value;
+        acc[lane] += multiply_32x32((DWORD)key, (DWORD)(key >> 32));
+    }
+}
+
+static __forceinline void scramble(ULONGLONG *const acc, const BYTE *const secret)
+{
+    for (DWORD lane = 0U; lane < 8U; ++lane)
+    {
+        const ULONGLONG value = acc[lane];
+        acc[lane] = multiply_64x64(value ^ (value >> 47) ^ read_u64(secret + (8U * lane)), PRIME32_1);
+    }
+}
+
+#endif
+
+static const BYTE *consume_stripes(ULONGLONG *const acc, DWORD *const stripeCount, const BYTE *input, DWORD stripes)
+{
+    const BYTE *secret = XXH3_SECRET + (8U * (*stripeCount));
+    if (stripes >= STRIPES_PER_BLOCK - *stripeCount)
+    {
+        DWORD count = STRIPES_PER_BLOCK - *stripeCount;
+        do
+        {
+            for (DWORD stripe = 0U; stripe < count; ++stripe)
+            {
+                accumulate_512(acc, input + (STRIPE_SIZE * stripe), secret + (8U * stripe));
+            }
+            scramble(acc, XXH3_SECRET + SECRET_SIZE - STRIPE_SIZE);
+            input += STRIPE_SIZE * count;
+            stripes -= count;
+            count = STRIPES_PER_BLOCK;
+            secret = XXH3_SECRET;
+        }
+        while (stripes >= STRIPES_PER_BLOCK);
+        *stripeCount = 0U;
+    }
+
+    for (DWORD stripe = 0U; stripe < stripes; ++stripe)
+    {
+        accumulate_512(acc, input + (STRIPE_SIZE * stripe), secret + (8U * stripe));
+    }
+
+    *stripeCount += stripes;
+    return input + (STRIPE_SIZE * stripes);
+}
+
+void xxh3_reset(xxh3_state_t *const state)
+{
+    static const ULONGLONG INITIAL_ACC[8U] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+    copy_memory(state->acc, INITIAL_ACC, sizeof(INITIAL_ACC));
+    state->totalSize = 0U;
+    state->bufferedSize = state->stripeCount = 0U;
+}
+
+void xxh3_update(xxh3_state_t *const state, const BYTE *input, DWORD inputSize)
+{
+    const BYTE *const end = input + inputSize;
+    state->totalSize += inputSize;
+
+    if (inputSize <= BUFFER_SIZE - state->bufferedSize)
+    {
+        copy_memory(state->buffer + state->bufferedSize, input, inputSize);
+        state->bufferedSize += inputSize;
+        return;
+    }
+
+    if (state->bufferedSize)
+    {
+        const DWORD loadSize = BUFFER_SIZE - state->bufferedSize;
+        copy_memory(state->buffer + state->bufferedSize, input, loadSize);
+        input += loadSize;
+        consume_stripes(state->acc, &state->stripeCount, state->buffer, BUFFER_SIZE / STRIPE_SIZE);
+        state->bufferedSize = 0U;
+    }
+
+    /* the last stripe is always held back, because the digest has to process it differently */
+    if ((DWORD)(end - input) > BUFFER_SIZE)
+    {
+        input = consume_stripes(state->acc, &state->stripeCount, input, ((DWORD)(end - input) - 1U) / STRIPE_SIZE);
+        copy_memory(state->buffer + BUFFER_SIZE - STRIPE_SIZE, input - STRIPE_SIZE, STRIPE_SIZE); /*may be needed to complete the last stripe*/
+    }
+
+    copy_memory(state->buffer, input, (DWORD)(end - input));
+    state->bufferedSize = (DWORD)(end - input);
+}
+
+ULONGLONG xxh3_digest(const xxh3_state_t *const state)
+{
+    if (state->totalSize <= MIDSIZE_MAX)
+    {
+        return hash_short(state->buffer, (DWORD)state->totalSize);
+    }
+
+    ULONGLONG acc[8U];
+    BYTE lastStripe[STRIPE_SIZE];
+    const BYTE *lastStripePtr = lastStripe;
+    DWORD stripeCount = state->stripeCount;
+    copy_memory(acc, state->acc, sizeof(acc));
+
+    if (state->bufferedSize >= STRIPE_SIZE)
+    {
+        consume_stripes(acc, &stripeCount, state->buffer, (state->bufferedSize - 1U) / STRIPE_SIZE);
+        lastStripePtr = state->buffer + state->bufferedSize - STRIPE_SIZE;
+    }
+    else
+    {
+        const DWORD catchUp = STRIPE_SIZE - state->bufferedSize;
+        copy_memory(lastStripe, state->buffer + BUFFER_SIZE - catchUp, catchUp);
+        copy_memory(lastStripe + catchUp, state->buffer, state->bufferedSize);
+    }
+
+    accumulate_512(acc, lastStripePtr, XXH3_SECRET + SECRET_SIZE - STRIPE_SIZE - 7U);
+
+    ULONGLONG result = multiply_64x64(state->totalSize, PRIME64_1);
+    for (DWORD lane = 0U; lane < 4U; ++lane)
+    {
+        const BYTE *const secret = XXH3_SECRET + 11U + (16U * lane);
+        result += multiply_fold(acc[2U * lane] ^ read_u64(secret), acc[(2U * lane) + 1U] ^ read_u64(secret + 8U));
+    }
+
+    return xxh3_avalanche(result);
+}
+
+// --------------------------------------------------------------------------
+// SHA-256
+// --------------------------------------------------------------------------
+
+static const DWORD SHA256_ROUNDS[64U] =
+{
+    0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU, 0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U,
+    0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U, 0xC19BF174U,
+    0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU, 0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU,
+    0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U, 0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U,
+    0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU, 0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+    0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U, 0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U,
+    0x19A4C116U, 0x1E376C08U, 0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+    0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U, 0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U
+};
+
+static void sha256_compress(DWORD *const state, const BYTE *block, DWORD blockCount)
+{
+    for (; blockCount; --blockCount, block += 64U)
+    {
+        DWORD schedule[64U];
+        for (DWORD index = 0U; index < 16U; ++index)
+        {
+            schedule[index] = read_be32(block + (4U * index));
+        }
+        for (DWORD index = 16U; index < 64U; ++index)
+        {
+            const DWORD s0 = ROTR32(schedule[index - 15U], 7U) ^ ROTR32(schedule[index - 15U], 18U) ^ (schedule[index - 15U] >> 3);
+            const DWORD s1 = ROTR32(schedule[index - 2U], 17U) ^ ROTR32(schedule[index - 2U], 19U) ^ (schedule[index - 2U] >> 10);
+            schedule[index] = schedule[index - 16U] + s0 + schedule[index - 7U] + s1;
+        }
+
+        DWORD a = state[0U], b = state[1U], c = state[2U], d = state[3U], e = state[4U], f = state[5U], g = state[6U], h = state[7U];
+        for (DWORD index = 0U; index < 64U; ++index)
+        {
+            const DWORD t1 = h + (ROTR32(e, 6U) ^ ROTR32(e, 11U) ^ ROTR32(e, 25U)) + ((e & f) ^ ((~e) & g)) + SHA256_ROUNDS[index] + schedule[index];
+            const DWORD t2 = (ROTR32(a, 2U) ^ ROTR32(a, 13U) ^ ROTR32(a, 22U)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0U] += a;
+        state[1U] += b;
+        state[2U] += c;
+        state[3U] += d;
+        state[4U] += e;
+        state[5U] += f;
+        state[6U] += g;
+        state[7U] += h;
+    }
+}
+
+#if defined(HASH_SHA_NI)
+
+static BOOL sha256_detect_hardware(void)
+{
+    DWORD leaf1[4U] = { 0U, 0U, 0U, 0U }, leaf7[4U] = { 0U, 0U, 0U, 0U };
+#if defined(__GNUC__)
+    __get_cpuid_count(1U, 0U, &leaf1[0U], &leaf1[1U], &leaf1[2U], &leaf1[3U]);
+    __get_cpuid_count(7U, 0U, &leaf7[0U], &leaf7[1U], &leaf7[2U], &leaf7[3U]);
+#else
+    __cpuidex((int*)leaf1, 1, 0);
+    __cpuidex((int*)leaf7, 7, 0);
+#endif
+    return ((leaf1[2U] & (1U << 9)) && (leaf1[2U] & (1U << 19)) && (leaf7[1U] & (1U << 29))); /*SSSE3, SSE4.1 and SHA*/
+}
+
+/*
+ * The SHA extensions keep the state as "ABEF" and "CDGH", and compute the message schedule four
+ * words at a time: W[t..t+3] = msg2(msg1(W[t-16..t-13], W[t-12]) + W[t-7..t-4], W[t-4..t-1]).
+ */
+TARGET_SHA_NI static void sha256_compress_hardware(DWORD *const state, const BYTE *block, DWORD blockCount)
+{
+    const __m128i byteOrder = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xB1);
+    const __m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4U)), 0x1B);
+    __m128i abef = _mm_alignr_epi8(dcba, hgfe, 8), cdgh = _mm_blend_epi16(hgfe, dcba, 0xF0);
+
+    for (; blockCount; --blockCount, block += 64U)
+    {
+        const __m128i abefSaved = abef, cdghSaved = cdgh;
+        __m128i schedule[4U];
+        for (DWORD group = 0U; group < 16U; ++group)
+        {
+            __m128i *const words = &schedule[group & 3U];
+            if (group < 4U)
+            {
+                *words = _mm_shuffle_epi8(_mm_loadu_si128(((const __m128i*)block) + group), byteOrder);
+            }
+            else
+            {
+                const __m128i previous = schedule[(group - 1U) & 3U];
+                *words = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(*words, schedule[(group - 3U) & 3U]), _mm_alignr_epi8(previous, schedule[(group - 2U) & 3U], 4)), previous);
+            }
+            const __m128i message = _mm_add_epi32(*words, _mm_loadu_si128((const __m128i*)&SHA256_ROUNDS[4U * group]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0E));
+        }
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    const __m128i feba = _mm_shuffle_epi32(abef, 0x1B), dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*)state, _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i*)(state + 4U), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
+
+static __forceinline void sha256_blocks(const sha256_state_t *const context, DWORD *const state, const BYTE *const blocks, const DWORD blockCount)
+{
+#if defined(HASH_SHA_NI)
+    if (context->hardware)
+    {
+        sha256_compress_hardware(state, blocks, blockCount);
+        return;
+    }
+#else
+    (void)context;
+#endif
+    sha256_compress(state, blocks, blockCount);
+}
+
+
+void sha256_reset(sha256_state_t *const state)
+{
+    static const DWORD INITIAL_STATE[8U] = { 0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU, 0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U };
+    copy_memory(state->state, INITIAL_STATE, sizeof(INITIAL_STATE));
+    state->totalSize = 0U;
+    state->bufferedSize = 0U;
+#if defined(HASH_SHA_NI)
+    state->hardware = sha256_detect_hardware();
+#else
+    state->hardware = FALSE;
+#endif
+}
+
+void sha256_update(sha256_state_t *const state, const BYTE *input, DWORD inputSize)
+{
+    state->totalSize += inputSize;
+
+    if (state->bufferedSize)
+    {
+        const DWORD loadSize = (inputSize < sizeof(state->buffer) - state->bufferedSize) ? inputSize : (sizeof(state->buffer) - state->bufferedSize);
+        copy_memory(state->buffer + state->bufferedSize, input, loadSize);
+        state->bufferedSize += loadSize;
+        input += loadSize;
+        inputSize -= loadSize;
+        if (state->bufferedSize < sizeof(state->buffer))
+        {
+            return;
+        }
+        sha256_blocks(state, state->state, state->buffer, 1U);
+        state->bufferedSize = 0U;
+    }
+
+    const DWORD blockCount = inputSize / sizeof(state->buffer);
+    if (blockCount)
+    {
+        sha256_blocks(state, state->state, input, blockCount);
+        input += blockCount * sizeof(state->buffer);
+        inputSize -= blockCount * sizeof(state->buffer);
+    }
+
+    copy_memory(state->buffer, input, inputSize);
+    state->bufferedSize = inputSize;
+}
+
+void sha256_digest(const sha256_state_t *const state, BYTE *const digest)
+{
+    DWORD result[8U];
+    BYTE block[64U];
+    copy_memory(result, state->state, sizeof(result));
+    copy_memory(block, state->buffer, state->bufferedSize);
+
+    DWORD position = state->bufferedSize;
+    block[position++] = 0x80;
+    if (position > sizeof(block) - 8U)
+    {
+        zero_memory(block + position, sizeof(block) - position);
+        sha256_blocks(state, result, block, 1U);
+        position = 0U;
+    }
+
+    zero_memory(block + position, sizeof(block) - 8U - position);
+    ULONGLONG bitCount = state->totalSize << 3;
+    for (DWORD index = 1U; index <= 8U; ++index, bitCount >>= 8)
+    {
+        block[sizeof(block) - index] = (BYTE)bitCount;
+    }
+    sha256_blocks(state, result, block, 1U);
+
+    for (DWORD index = 0U; index < SHA256_SIZE; ++index)
+    {
+        digest[index] = (BYTE)(result[index >> 2] >> (24U - (8U * (index & 3U))));
+    }
+}
@@ -27,6 +27,15 @@
 #elif defined(_M_IX86)
 #define PROCESSOR_ARCHITECTURE L"x86"
 #define PROCESSOR_BITNESS 32U
+#elif defined(__aarch64__)
+#define PROCESSOR_ARCHITECTURE L"ARM64"
+#define PROCESSOR_BITNESS 64U
+#elif defined(__x86_64__)
+#define PROCESSOR_ARCHITECTURE L"AMD64"
+#define PROCESSOR_BITNESS 64U
+#elif defined(__i386__)
+#define PROCESSOR_ARCHITECTURE L"x86"
+#define PROCESSOR_BITNESS 32U
 #else
 #error Unsupported processor architecture!
 #endif
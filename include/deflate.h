@@ -0,0 +1,41 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _INC_TEEW32_DEFLATE_H
+#define _INC_TEEW32_DEFLATE_H
+
+#include "platform.h"
+
+/*
+ * Minimal DEFLATE compressor (RFC 1951) that turns a block of data into a complete, self-contained
+ * gzip member (RFC 1952). Concatenated gzip members form a valid gzip stream, so independent blocks
+ * can be compressed in parallel and simply be written one after another. Each compressing thread
+ * needs a state of its own, which limits the block size to "maxBlockSize".
+ */
+
+#define DEFLATE_MIN_LEVEL 1U
+#define DEFLATE_MAX_LEVEL 9U
+#define DEFLATE_DEFAULT_LEVEL 6U
+
+typedef struct _deflate_state deflate_state_t;
+
+deflate_state_t *deflate_create(const DWORD maxBlockSize);
+void deflate_destroy(deflate_state_t *const state);
+DWORD gzip_bound(const DWORD inputSize); /*the worst-case size of a gzip member*/
+DWORD gzip_compress(deflate_state_t *const state, const BYTE *const input, const DWORD inputSize, BYTE *const output, const DWORD level);
+
+#endif
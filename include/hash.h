@@ -0,0 +1,58 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _INC_TEEW32_HASH_H
+#define _INC_TEEW32_HASH_H
+
+#include "platform.h"
+
+/*
+ * Incremental hash functions: the 64-Bit XXH3 of xxHash 0.8 (default secret, seed zero), which is
+ * fast enough to keep up with the ring, and SHA-256 (FIPS 180-4). The input can be passed in pieces
+ * of any size, and computing the digest does not modify the state.
+ */
+
+#define SHA256_SIZE 32U
+
+typedef struct _xxh3_state
+{
+    ULONGLONG acc[8U];
+    ULONGLONG totalSize;
+    DWORD bufferedSize, stripeCount;
+    BYTE buffer[256U];
+}
+xxh3_state_t;
+
+typedef struct _sha256_state
+{
+    DWORD state[8U];
+    ULONGLONG totalSize;
+    DWORD bufferedSize;
+    BOOL hardware; /*use the SHA extensions of the CPU*/
+    BYTE buffer[64U];
+}
+sha256_state_t;
+
+void xxh3_reset(xxh3_state_t *const state);
+void xxh3_update(xxh3_state_t *const state, const BYTE *input, DWORD inputSize);
+ULONGLONG xxh3_digest(const xxh3_state_t *const state);
+
+void sha256_reset(sha256_state_t *const state);
+void sha256_update(sha256_state_t *const state, const BYTE *input, DWORD inputSize);
+void sha256_digest(const sha256_state_t *const state, BYTE *const digest);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _INC_TEEW32_MATCH_H
+#define _INC_TEEW32_MATCH_H
+
+#include "platform.h"
+
+/*
+ * Line filter for the --match option: either a plain string, or a simple regular expression with
+ * the atoms "c", ".", "[...]", "[^...]", "\d", "\w", "\s" (and "\" to escape any other character),
+ * each optionally followed by "*", "+" or "?", and the anchors "^" and "$". Patterns work on bytes,
+ * i.e. they are matched against the UTF-8 encoded input. The longest literal part of a pattern is
+ * searched for first, so that the regular expression is evaluated only for the candidate lines.
+ */
+
+typedef struct _range
+{
+    DWORD begin, end;
+}
+range_t;
+
+typedef struct _pattern pattern_t;
+
+pattern_t *pattern_create(const char *const text); /*returns NULL, if the pattern is invalid*/
+void pattern_destroy(pattern_t *const pattern);
+
+/*
+ * Finds the lines in [buffer, buffer + *limit) that match the pattern, and stores them as ranges
+ * (adjacent lines are merged). If all ranges are used up, *limit is reduced to the beginning of the
+ * first line that did not fit. Returns the number of ranges.
+ */
+DWORD pattern_scan(const pattern_t *const pattern, const BYTE *const buffer, DWORD *const limit, range_t *const ranges, const DWORD capacity);
+
+#endif
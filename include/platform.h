@@ -0,0 +1,360 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _INC_TEEW32_PLATFORM_H
+#define _INC_TEEW32_PLATFORM_H
+
+/*
+ * Thin operating system layer. The core in "tee.c" uses nothing but the types and functions that
+ * are declared here; the implementations live in "platform_win32.c" and "platform_posix.c".
+ */
+
+#if defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#include <intrin.h>
+
+typedef HANDLE file_handle_t;
+typedef HANDLE file_mapping_t;
+typedef HANDLE thread_handle_t;
+typedef HANDLE process_handle_t;
+
+#define INVALID_FILE INVALID_HANDLE_VALUE
+#define INVALID_MAPPING NULL
+#define THREAD_API WINAPI
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <wchar.h>
+
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint64_t ULONGLONG;
+typedef size_t SIZE_T;
+
+typedef int file_handle_t;
+typedef int file_mapping_t;
+typedef struct _posix_thread *thread_handle_t;
+typedef int process_handle_t;
+
+#define TRUE 1
+#define FALSE 0
+#define MAXDWORD 0xFFFFFFFFU
+#define MAXLONG 0x7FFFFFFF
+#define MINLONG (-MAXLONG - 1)
+#define MAXSIZE_T SIZE_MAX
+#define INFINITE 0xFFFFFFFFU
+#define MAXIMUM_WAIT_OBJECTS 64U
+#define ARRAYSIZE(ARRAY) (sizeof(ARRAY) / sizeof((ARRAY)[0U]))
+
+#define INVALID_FILE (-1)
+#define INVALID_MAPPING (-1)
+#define THREAD_API
+#define __forceinline inline __attribute__((always_inline))
+
+#endif
+
+#define _WIDEN(X) L##X
+#define WIDEN(X) _WIDEN(X)
+
+typedef DWORD (THREAD_API *thread_routine_t)(void *const param);
+
+// --------------------------------------------------------------------------
+// Process
+// --------------------------------------------------------------------------
+
+int tee_main(const int argc, const wchar_t *const argv[]); /*implemented by the core*/
+
+BOOL get_std_handles(file_handle_t *const hStdIn, file_handle_t *const hStdOut, file_handle_t *const hStdErr);
+void install_stop_handler(volatile BOOL *const stopFlag);
+void install_dump_handler(volatile LONG *const dumpCount); /*CTRL+BREAK (Windows) or SIGUSR1 increments the counter, instead of stopping*/
+void fatal_exit(void);
+void sleep_millis(const DWORD timeout);
+DWORD get_tick_count(void); /*milliseconds, wraps around*/
+ULONGLONG get_timestamp(void); /*high-resolution, in units of get_timestamp_frequency()*/
+ULONGLONG get_timestamp_frequency(void);
+ULONGLONG get_system_time(void); /*UTC, in 100-nanosecond units since 1970-01-01*/
+
+// --------------------------------------------------------------------------
+// Memory
+// --------------------------------------------------------------------------
+
+void *alloc_memory(const SIZE_T size);
+void free_memory(void *const buffer);
+void zero_memory(void *const buffer, const SIZE_T size);
+void copy_memory(void *const destination, const void *const source, const SIZE_T size);
+DWORD get_page_size(void);
+DWORD get_processor_count(void);
+BYTE *alloc_pages(const SIZE_T size, BOOL *const largePages);
+void free_pages(BYTE *const buffer, const SIZE_T size, const BOOL largePages);
+
+// --------------------------------------------------------------------------
+// Files
+// --------------------------------------------------------------------------
+
+file_handle_t open_file(const wchar_t *const fileName, const BOOL append);
+file_handle_t open_file_async(const wchar_t *const fileName, const BOOL append); /*for use with async_attach()*/
+file_handle_t open_file_read(const wchar_t *const fileName); /*read-only, the file may still be written by another process*/
+/*
+ * Opens the file for unbuffered (direct) I/O, bypassing the page cache: the buffer addresses, the
+ * sizes and the file offsets of all writes must then be multiples of the page size, except for the
+ * last one, which has to go through write_file_tail(). "direct" is set to FALSE, and the returned
+ * handle is a regular one, if direct I/O is not possible, e.g. for devices and pipes, or if the
+ * end of the file that is being appended to is not aligned.
+ */
+file_handle_t open_file_direct(const wchar_t *const fileName, const BOOL append, BOOL *const direct);
+BOOL write_file_tail(const file_handle_t handle, BYTE *const buffer, const DWORD size); /*"buffer" must be aligned and have room for a full page*/
+BOOL preallocate_file(const file_handle_t handle, const ULONGLONG size); /*reserves disk space beyond the end of file, without changing the file size*/
+file_handle_t open_temp_file(void); /*read/write access, deleted when closed*/
+void close_file(const file_handle_t handle);
+BOOL delete_file(const wchar_t *const fileName);
+BOOL read_file(const file_handle_t handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead);
+BOOL write_file(const file_handle_t handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten);
+/*
+ * Like read_file(), but gives up, if no input arrives within "timeout" milliseconds. In that case,
+ * the function returns TRUE and sets "timedOut"; zero bytes *without* "timedOut" is end of input.
+ */
+BOOL read_file_timeout(const file_handle_t handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead, const DWORD timeout, BOOL *const timedOut);
+BOOL read_file_at(const file_handle_t handle, const ULONGLONG offset, BYTE *const buffer, const DWORD size, DWORD *const bytesRead);
+BOOL write_file_at(const file_handle_t handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten);
+BOOL flush_file(const file_handle_t handle);
+BOOL is_terminal(const file_handle_t handle);
+BOOL is_null_device(const wchar_t *const fileName);
+void enable_escape_codes(const file_handle_t handle);
+BOOL write_text(const file_handle_t handle, const wchar_t *const text);
+char *encode_utf8(const wchar_t *const text); /*must be freed by free_memory()*/
+
+// --------------------------------------------------------------------------
+// File mapping
+// --------------------------------------------------------------------------
+
+/*
+ * Read-only mapping of a regular file, in windows. get_file_range() fails, unless the handle refers
+ * to a regular file; otherwise it returns the current file position and the remaining size. View
+ * offsets must be a multiple of get_allocation_granularity().
+ */
+BOOL get_file_range(const file_handle_t handle, ULONGLONG *const offset, ULONGLONG *const size);
+BOOL set_file_position(const file_handle_t handle, const ULONGLONG offset);
+void advise_sequential(const file_handle_t handle); /*hint for the read-ahead of the system, if supported*/
+DWORD get_allocation_granularity(void);
+file_mapping_t create_mapping(const file_handle_t handle);
+void close_mapping(const file_mapping_t mapping);
+BYTE *map_view(const file_mapping_t mapping, const ULONGLONG offset, const SIZE_T size);
+void unmap_view(BYTE *const view, const SIZE_T size);
+
+// --------------------------------------------------------------------------
+// Zero-copy
+// --------------------------------------------------------------------------
+
+/*
+ * Pipe-to-pipe duplication and pipe-to-file transfer within the kernel, i.e. tee() and splice() on
+ * Linux. can_splice() returns TRUE, if the handle is a pipe that those functions accept; it always
+ * returns FALSE on other systems (including Windows), so that the core falls back to the ring.
+ * tee_pipe() copies data from the head of "hInput" without consuming it, splice_pipe() moves it.
+ */
+BOOL can_splice(const file_handle_t handle);
+BOOL create_pipe(file_handle_t *const hRead, file_handle_t *const hWrite, const DWORD size);
+BOOL tee_pipe(const file_handle_t hInput, const file_handle_t hOutput, const DWORD size, DWORD *const bytesCopied);
+BOOL splice_pipe(const file_handle_t hInput, const file_handle_t hOutput, const DWORD size, DWORD *const bytesMoved);
+
+// --------------------------------------------------------------------------
+// Connections
+// --------------------------------------------------------------------------
+
+/*
+ * Stream connections to a local collector: "tcp://<host>:<port>", "unix:<path>" and, on Windows
+ * only, a named pipe "\\.\pipe\<name>" (a FIFO on Linux is just a file). open_connection() gives
+ * up after "timeout" milliseconds. write_connection() works like write_file(), but fails, if the
+ * collector has not taken any data within "timeout" milliseconds.
+ */
+BOOL is_connection_name(const wchar_t *const name);
+file_handle_t open_connection(const wchar_t *const name, const DWORD timeout);
+BOOL write_connection(const file_handle_t handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten, const DWORD timeout);
+void close_connection(const file_handle_t handle);
+
+// --------------------------------------------------------------------------
+// Child process
+// --------------------------------------------------------------------------
+
+/*
+ * start_process() runs the command "argv" (searched in the PATH) with two pipes of about "pipeSize"
+ * bytes as its standard output and standard error, and returns their read ends; the standard input
+ * is inherited. wait_for_input() blocks until one of the "handles" has data or has reached its end,
+ * and returns its position in "index"; INVALID_FILE entries are skipped, but at least one must be
+ * valid. The scan starts right after the previous "index", so that no stream can starve the other.
+ * wait_process() reaps the child and returns its exit code (128 + the signal number, if it has been
+ * killed by a signal).
+ */
+BOOL start_process(const wchar_t *const *const argv, const DWORD argc, const DWORD pipeSize, file_handle_t *const hStdOut, file_handle_t *const hStdErr, process_handle_t *const process);
+BOOL wait_for_input(const file_handle_t *const handles, const DWORD count, DWORD *const index); /*up to MAXIMUM_WAIT_OBJECTS handles*/
+BOOL wait_process(const process_handle_t process, DWORD *const exitCode);
+
+// --------------------------------------------------------------------------
+// Asynchronous I/O
+// --------------------------------------------------------------------------
+
+/*
+ * Asynchronous writes, i.e. an I/O completion port on Windows and io_uring on Linux. Up to
+ * "capacity" writes can be pending at a time; async_wait() returns the "context" of the next write
+ * that has completed (in any order), or NULL, if waiting has failed. Only handles that have been
+ * opened by open_file_async() can be attached. async_create() returns NULL, if the system does not
+ * support asynchronous I/O; callers then have to write synchronously.
+ */
+typedef struct _async_queue async_queue_t;
+
+#define ASYNC_NO_OFFSET ((ULONGLONG)-1) /*for handles that are not seekable*/
+
+async_queue_t *async_create(const DWORD capacity);
+void async_destroy(async_queue_t *const queue);
+BOOL async_attach(async_queue_t *const queue, const file_handle_t handle);
+BOOL async_write(async_queue_t *const queue, const file_handle_t handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, void *const context);
+void *async_wait(async_queue_t *const queue, DWORD *const bytesWritten, BOOL *const success);
+
+// --------------------------------------------------------------------------
+// Threads
+// --------------------------------------------------------------------------
+
+BOOL create_thread(thread_handle_t *const thread, const thread_routine_t routine, void *const param);
+BOOL join_thread(const thread_handle_t thread, const DWORD timeout);
+BOOL join_threads(const thread_handle_t *const threads, const DWORD count, const DWORD timeout);
+void terminate_thread(const thread_handle_t thread);
+void close_thread(const thread_handle_t thread);
+
+// --------------------------------------------------------------------------
+// Synchronization
+// --------------------------------------------------------------------------
+
+/*
+ * Address-based waiting, i.e. WaitOnAddress() on Windows 8+ and futex() on Linux. The wait returns
+ * as soon as the value at the address differs from "undesired", or when it has been woken up; it
+ * may also return spuriously. Returns FALSE, if the timeout has expired.
+ */
+BOOL wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout);
+void wake_by_address_single(volatile LONG *const address);
+void wake_by_address_all(volatile LONG *const address);
+
+#if defined(_WIN32)
+
+#pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement, _InterlockedExchange, _InterlockedCompareExchange)
+
+static __forceinline LONG atomic_load_acquire(volatile LONG *const value)
+{
+    return ReadAcquire(value);
+}
+
+static __forceinline void atomic_store_release(volatile LONG *const value, const LONG newValue)
+{
+    WriteRelease(value, newValue);
+}
+
+static __forceinline LONG atomic_exchange(volatile LONG *const value, const LONG newValue)
+{
+    return _InterlockedExchange(value, newValue);
+}
+
+static __forceinline LONG atomic_compare_exchange(volatile LONG *const value, const LONG newValue, const LONG expected)
+{
+    return _InterlockedCompareExchange(value, newValue, expected);
+}
+
+static __forceinline LONG atomic_increment(volatile LONG *const value)
+{
+    return _InterlockedIncrement(value);
+}
+
+static __forceinline LONG atomic_decrement(volatile LONG *const value)
+{
+    return _InterlockedDecrement(value);
+}
+
+static __forceinline void cpu_relax(void)
+{
+    YieldProcessor();
+}
+
+static __forceinline void counter_add(volatile ULONGLONG *const counter, const ULONGLONG value)
+{
+    *counter += value; /*single writer; a concurrent reader may see a torn value on 32-Bit*/
+}
+
+static __forceinline ULONGLONG counter_read(volatile ULONGLONG *const counter)
+{
+    return *counter;
+}
+
+#else
+
+static __forceinline LONG atomic_load_acquire(volatile LONG *const value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+static __forceinline void atomic_store_release(volatile LONG *const value, const LONG newValue)
+{
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+static __forceinline LONG atomic_exchange(volatile LONG *const value, const LONG newValue)
+{
+    return __atomic_exchange_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+static __forceinline LONG atomic_compare_exchange(volatile LONG *const value, const LONG newValue, LONG expected)
+{
+    __atomic_compare_exchange_n(value, &expected, newValue, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+static __forceinline LONG atomic_increment(volatile LONG *const value)
+{
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+static __forceinline LONG atomic_decrement(volatile LONG *const value)
+{
+    return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+static __forceinline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static __forceinline void counter_add(volatile ULONGLONG *const counter, const ULONGLONG value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED); /*single writer*/
+}
+
+static __forceinline ULONGLONG counter_read(volatile ULONGLONG *const counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+#endif
+
+#endif //_INC_TEEW32_PLATFORM_H
@@ -0,0 +1,34 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _INC_TEEW32_SCAN_H
+#define _INC_TEEW32_SCAN_H
+
+#include "platform.h"
+
+/*
+ * Vectorized search (SSE2 on x86/x64, NEON on ARM64, plain C elsewhere), used to find the line
+ * breaks in the chunks and the literals of the --match patterns. The search functions return NULL,
+ * if the value (or the string) does not occur in [begin, end); scan_count() counts the occurrences.
+ */
+
+const BYTE *scan_forward(const BYTE *begin, const BYTE *const end, const BYTE value);
+const BYTE *scan_backward(const BYTE *const begin, const BYTE *end, const BYTE value);
+const BYTE *scan_string(const BYTE *begin, const BYTE *const end, const BYTE *const string, const DWORD length);
+DWORD scan_count(const BYTE *begin, const BYTE *const end, const BYTE value);
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "include/match.h"
+#include "include/scan.h"
+
+/*
+ * Every atom of a pattern is compiled into a set of bytes (a 256-Bit map) plus a quantifier, so
+ * that characters, the wildcard and character classes are all matched the same way. The matcher
+ * does not backtrack: it keeps the set of atoms that it may be at, and advances all of them by one
+ * byte at a time, so that a line takes time proportional to its length times the number of atoms,
+ * no matter how the pattern is built (backtracking takes exponential time on "a*a*a*a*a*b").
+ */
+
+#define QUANT_ONE 0U
+#define QUANT_OPTIONAL 1U
+#define QUANT_STAR 2U
+#define QUANT_PLUS 3U
+
+#define MAX_ATOMS 256U
+
+typedef struct _atom
+{
+    BYTE set[32U];
+    DWORD quantifier;
+}
+atom_t;
+
+struct _pattern
+{
+    atom_t atoms[MAX_ATOMS];
+    DWORD atomCount, literalLength;
+    BOOL anchorBegin, anchorEnd, plain;
+    BYTE literal[MAX_ATOMS];
+};
+
+#define SET_ADD(SET, C) ((SET)[((BYTE)(C)) >> 3] |= (BYTE)(1U << (((BYTE)(C)) & 7U)))
+#define SET_HAS(SET, C) (((SET)[((BYTE)(C)) >> 3] >> (((BYTE)(C)) & 7U)) & 1U)
+
+// --------------------------------------------------------------------------
+// Compiler
+// --------------------------------------------------------------------------
+
+static void add_range(BYTE *const set, const BYTE first, const BYTE last)
+{
+    for (DWORD c = first; c <= last; ++c)
+    {
+        SET_ADD(set, c);
+    }
+}
+
+static BOOL add_escape(BYTE *const set, const char c)
+{
+    switch (c)
+    {
+    case 'd':
+        add_range(set, '0', '9');
+        return TRUE;
+    case 'w':
+        add_range(set, '0', '9');
+        add_range(set, 'A', 'Z');
+        add_range(set, 'a', 'z');
+        SET_ADD(set, '_');
+        return TRUE;
+    case 's':
+        SET_ADD(set, ' ');
+        add_range(set, '\t', '\r');
+        return TRUE;
+    case 't':
+        SET_ADD(set, '\t');
+        return TRUE;
+    case '\0':
+        return FALSE;
+    default:
+        SET_ADD(set, c);
+        return TRUE;
+    }
+}
+
+static const char *parse_class(BYTE *const set, const char *ptr)
+{
+    BYTE members[32U];
+    const BOOL negate = (*ptr == '^');
+    const char *const first = ptr + (negate ? 1U : 0U);
+    zero_memory(members, sizeof(members));
+
+    for (ptr = first; (*ptr != ']') || (ptr == first); ++ptr) /*a "]" right at the beginning is a member*/
+    {
+        if (*ptr == '\0')
+        {
+            return NULL; /*unterminated class*/
+        }
+        if (*ptr == '\\')
+        {
+            if (!add_escape(members, *(++ptr)))
+            {
+                return NULL;
+            }
+        }
+        else if ((ptr[1U] == '-') && (ptr[2U] != ']') && (ptr[2U] != '\0'))
+        {
+            if ((BYTE)ptr[2U] < (BYTE)ptr[0U])
+            {
+                return NULL;
+            }
+            add_range(members, (BYTE)ptr[0U], (BYTE)ptr[2U]);
+            ptr += 2U;
+        }
+        else
+        {
+            SET_ADD(members, *ptr);
+        }
+    }
+
+    for (DWORD index = 0U; index < 32U; ++index)
+    {
+        set[index] = negate ? ((BYTE)~members[index]) : members[index];
+    }
+
+    return ptr + 1U;
+}
+
+static DWORD single_byte(const BYTE *const set)
+{
+    DWORD count = 0U, value = 0U;
+    for (DWORD c = 0U; c < 256U; ++c)
+    {
+        if (SET_HAS(set, c))
+        {
+            value = c;
+            ++count;
+        }
+    }
+
+    return (count == 1U) ? value : MAXDWORD;
+}
+
+static void find_literal(pattern_t *const pattern)
+{
+    DWORD start = 0U, length = 0U, bestStart = 0U, bestLength = 0U;
+    for (DWORD index = 0U; index <= pattern->atomCount; ++index)
+    {
+        const atom_t *const atom = (index < pattern->atomCount) ? &pattern->atoms[index] : NULL;
+        const BOOL required = atom && (single_byte(atom->set) != MAXDWORD) && ((atom->quantifier == QUANT_ONE) || (atom->quantifier == QUANT_PLUS));
+        if (required)
+        {
+            start = length ? start : index;
+            ++length;
+        }
+        if ((!required) || (atom->quantifier == QUANT_PLUS)) /*"c+" requires one "c", but the run ends there*/
+        {
+            if (length > bestLength)
+            {
+                bestStart = start;
+                bestLength = length;
+            }
+            length = 0U;
+        }
+    }
+
+    for (DWORD index = 0U; index < bestLength; ++index)
+    {
+        pattern->literal[index] = (BYTE)single_byte(pattern->atoms[bestStart + index].set);
+    }
+
+    pattern->literalLength = bestLength;
+    pattern->plain = (bestLength == pattern->atomCount) && (!pattern->anchorBegin) && (!pattern->anchorEnd) && (pattern->atoms[pattern->atomCount - 1U].quantifier == QUANT_ONE);
+}
+
+pattern_t *pattern_create(const char *const text)
+{
+    pattern_t *const pattern = (pattern_t*)alloc_memory(sizeof(pattern_t));
+    if (!pattern)
+    {
+        return NULL;
+    }
+
+    const char *ptr = text;
+    if (*ptr == '^')
+    {
+        pattern->anchorBegin = TRUE;
+        ++ptr;
+    }
+
+    while (*ptr != '\0')
+    {
+        if ((ptr[0U] == '$') && (ptr[1U] == '\0'))
+        {
+            pattern->anchorEnd = TRUE;
+            break;
+        }
+        if (pattern->atomCount >= MAX_ATOMS)
+        {
+            goto failure;
+        }
+        atom_t *const atom = &pattern->atoms[pattern->atomCount++];
+        switch (*ptr)
+        {
+        case '.':
+            add_range(atom->set, 0U, 0xFFU);
+            atom->set['\n' >> 3] &= (BYTE)~(1U << ('\n' & 7U));
+            ++ptr;
+            break;
+        case '[':
+            if (!(ptr = parse_class(atom->set, ptr + 1U)))
+            {
+                goto failure;
+            }
+            break;
+        case '\\':
+            if (!add_escape(atom->set, ptr[1U]))
+            {
+                goto failure;
+            }
+            ptr += 2U;
+            break;
+        case '*':
+        case '+':
+        case '?':
+            goto failure; /*nothing to repeat*/
+        default:
+            SET_ADD(atom->set, *ptr);
+            ++ptr;
+        }
+        switch (*ptr)
+        {
+        case '*':
+            atom->quantifier = QUANT_STAR;
+            ++ptr;
+            break;
+        case '+':
+            atom->quantifier = QUANT_PLUS;
+            ++ptr;
+            break;
+        case '?':
+            atom->quantifier = QUANT_OPTIONAL;
+            ++ptr;
+            break;
+        }
+    }
+
+    if (!pattern->atomCount)
+    {
+        goto failure; /*would match every line*/
+    }
+
+    find_literal(pattern);
+    return pattern;
+
+failure:
+    free_memory(pattern);
+    return NULL;
+}
+
+void pattern_destroy(pattern_t *const pattern)
+{
+    free_memory(pattern);
+}
+
+// --------------------------------------------------------------------------
+// Matcher
+// --------------------------------------------------------------------------
+
+/*
+ * State "n" means that the atom "n" is to be matched next; the final state (one past the last atom)
+ * means that the pattern has been matched. A state is a bit in a set of STATE_WORDS words.
+ */
+
+#define STATE_WORDS ((MAX_ATOMS + 32U) / 32U)
+
+#define STATE_ADD(SET, N) ((SET)[(N) >> 5] |= (DWORD)(1U << ((N) & 31U)))
+#define STATE_HAS(SET, N) (((SET)[(N) >> 5] >> ((N) & 31U)) & 1U)
+
+static void skip_optional(const pattern_t *const pattern, DWORD *const states)
+{
+    for (DWORD index = 0U; index < pattern->atomCount; ++index) /*in order, so that "a?b?c" skips both*/
+    {
+        const DWORD quantifier = pattern->atoms[index].quantifier;
+        if (STATE_HAS(states, index) && ((quantifier == QUANT_OPTIONAL) || (quantifier == QUANT_STAR)))
+        {
+            STATE_ADD(states, index + 1U);
+        }
+    }
+}
+
+static BOOL match_line(const pattern_t *const pattern, const BYTE *const begin, const BYTE *end)
+{
+    DWORD sets[2U][STATE_WORDS];
+    DWORD *current = sets[0U], *next = sets[1U];
+
+    if ((end > begin) && (end[-1] == '\n'))
+    {
+        --end;
+    }
+    if ((end > begin) && (end[-1] == '\r'))
+    {
+        --end; /*"$" matches in front of a CR+LF line break, too*/
+    }
+
+    zero_memory(current, sizeof(sets[0U]));
+    STATE_ADD(current, 0U);
+    skip_optional(pattern, current);
+
+    for (const BYTE *ptr = begin; ; ++ptr)
+    {
+        if (STATE_HAS(current, pattern->atomCount) && ((!pattern->anchorEnd) || (ptr == end)))
+        {
+            return TRUE;
+        }
+        if (ptr >= end)
+        {
+            return FALSE;
+        }
+
+        BOOL alive = !pattern->anchorBegin;
+        zero_memory(next, sizeof(sets[0U]));
+        if (alive)
+        {
+            STATE_ADD(next, 0U); /*a match may also begin at the next byte*/
+        }
+        for (DWORD index = 0U; index < pattern->atomCount; ++index)
+        {
+            const atom_t *const atom = &pattern->atoms[index];
+            if (STATE_HAS(current, index) && SET_HAS(atom->set, *ptr))
+            {
+                if ((atom->quantifier == QUANT_STAR) || (atom->quantifier == QUANT_PLUS))
+                {
+                    STATE_ADD(next, index); /*the atom may repeat*/
+                }
+                if (atom->quantifier != QUANT_STAR)
+                {
+                    STATE_ADD(next, index + 1U); /*for "*", this is done by skip_optional()*/
+                }
+                alive = TRUE;
+            }
+        }
+        if (!alive)
+        {
+            return FALSE;
+        }
+
+        skip_optional(pattern, next);
+        DWORD *const swap = current;
+        current = next;
+        next = swap;
+    }
+}
+
+DWORD pattern_scan(const pattern_t *const pattern, const BYTE *const buffer, DWORD *const limit, range_t *const ranges, const DWORD capacity)
+{
+    const BYTE *ptr = buffer, *const end = buffer + (*limit);
+    DWORD count = 0U;
+
+    while (ptr < end)
+    {
+        const BYTE *lineBegin = ptr, *lineEnd;
+        if (pattern->literalLength)
+        {
+            const BYTE *const found = scan_string(ptr, end, pattern->literal, pattern->literalLength);
+            if (!found)
+            {
+                break;
+            }
+            const BYTE *const previous = scan_backward(ptr, found, '\n');
+            lineBegin = previous ? (previous + 1U) : ptr;
+            lineEnd = scan_forward(found + pattern->literalLength, end, '\n');
+        }
+        else
+        {
+            lineEnd = scan_forward(ptr, end, '\n');
+        }
+        lineEnd = lineEnd ? (lineEnd + 1U) : end;
+        if (pattern->plain || match_line(pattern, lineBegin, lineEnd))
+        {
+            const DWORD offset = (DWORD)(lineBegin - buffer);
+            if (count && (ranges[count - 1U].end == offset))
+            {
+                ranges[count - 1U].end = (DWORD)(lineEnd - buffer);
+            }
+            else if (count < capacity)
+            {
+                ranges[count].begin = offset;
+                ranges[count++].end = (DWORD)(lineEnd - buffer);
+            }
+            else
+            {
+                *limit = offset; /*out of ranges*/
+                break;
+            }
+        }
+        ptr = lineEnd;
+    }
+
+    return count;
+}
@@ -0,0 +1,1486 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE 1
+#include "include/platform.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#define HUGE_PAGE_SIZE 0x200000U
+
+// --------------------------------------------------------------------------
+// UTF-8 conversion
+// --------------------------------------------------------------------------
+
+/*
+ * Invalid UTF-8 bytes are mapped to U+DC80..U+DCFF (and back), so that arbitrary file names survive
+ * the round trip through the wide-character core unchanged.
+ */
+
+static wchar_t *utf8_to_wide(const char *const input)
+{
+    const size_t length = strlen(input);
+    wchar_t *const buffer = (wchar_t*)calloc(length + 1U, sizeof(wchar_t));
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    const unsigned char *ptr = (const unsigned char*)input;
+    wchar_t *out = buffer;
+    while (*ptr)
+    {
+        const unsigned char c = *ptr;
+        size_t count = 0U;
+        uint32_t value = 0U, minimum = 0U;
+        if (c < 0x80U)
+        {
+            *out++ = (wchar_t)(*ptr++);
+            continue;
+        }
+        else if ((c & 0xE0U) == 0xC0U)
+        {
+            count = 1U, value = c & 0x1FU, minimum = 0x80U;
+        }
+        else if ((c & 0xF0U) == 0xE0U)
+        {
+            count = 2U, value = c & 0x0FU, minimum = 0x800U;
+        }
+        else if ((c & 0xF8U) == 0xF0U)
+        {
+            count = 3U, value = c & 0x07U, minimum = 0x10000U;
+        }
+        size_t index;
+        for (index = 1U; (index <= count) && ((ptr[index] & 0xC0U) == 0x80U); ++index)
+        {
+            value = (value << 6U) | (ptr[index] & 0x3FU);
+        }
+        if ((!count) || (index <= count) || (value < minimum) || (value > 0x10FFFFU) || ((value >= 0xD800U) && (value <= 0xDFFFU)))
+        {
+            *out++ = (wchar_t)(0xDC00U | (*ptr++));
+            continue;
+        }
+        *out++ = (wchar_t)value;
+        ptr += count + 1U;
+    }
+
+    return buffer;
+}
+
+static char *wide_to_utf8(const wchar_t *const input)
+{
+    const size_t length = wcslen(input);
+    char *const buffer = (char*)malloc((4U * length) + 1U);
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    char *out = buffer;
+    for (const wchar_t *ptr = input; *ptr != L'\0'; ++ptr)
+    {
+        const uint32_t value = (uint32_t)(*ptr);
+        if (value < 0x80U)
+        {
+            *out++ = (char)value;
+        }
+        else if ((value >= 0xDC80U) && (value <= 0xDCFFU))
+        {
+            *out++ = (char)(value & 0xFFU);
+        }
+        else if (value < 0x800U)
+        {
+            *out++ = (char)(0xC0U | (value >> 6U));
+            *out++ = (char)(0x80U | (value & 0x3FU));
+        }
+        else if (value < 0x10000U)
+        {
+            *out++ = (char)(0xE0U | (value >> 12U));
+            *out++ = (char)(0x80U | ((value >> 6U) & 0x3FU));
+            *out++ = (char)(0x80U | (value & 0x3FU));
+        }
+        else
+        {
+            *out++ = (char)(0xF0U | ((value >> 18U) & 0x07U));
+            *out++ = (char)(0x80U | ((value >> 12U) & 0x3FU));
+            *out++ = (char)(0x80U | ((value >> 6U) & 0x3FU));
+            *out++ = (char)(0x80U | (value & 0x3FU));
+        }
+    }
+
+    *out = '\0';
+    return buffer;
+}
+
+// --------------------------------------------------------------------------
+// Process
+// --------------------------------------------------------------------------
+
+static volatile BOOL *g_stopFlag = NULL;
+static volatile LONG *g_dumpCount = NULL;
+
+static void signal_handler(const int signum)
+{
+    (void)signum;
+    *g_stopFlag = TRUE;
+}
+
+static void dump_signal_handler(const int signum)
+{
+    (void)signum;
+    atomic_increment(g_dumpCount);
+}
+
+BOOL get_std_handles(int *const hStdIn, int *const hStdOut, int *const hStdErr)
+{
+    *hStdIn = STDIN_FILENO;
+    *hStdOut = STDOUT_FILENO;
+    *hStdErr = STDERR_FILENO;
+
+    if (fcntl(STDERR_FILENO, F_GETFD) < 0)
+    {
+        *hStdErr = INVALID_FILE;
+        return FALSE;
+    }
+
+    return (fcntl(STDIN_FILENO, F_GETFD) >= 0) && (fcntl(STDOUT_FILENO, F_GETFD) >= 0);
+}
+
+void install_stop_handler(volatile BOOL *const stopFlag)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+
+    g_stopFlag = stopFlag;
+    action.sa_handler = signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGQUIT, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    signal(SIGPIPE, SIG_IGN); /*report write errors instead of being killed*/
+}
+
+void install_dump_handler(volatile LONG *const dumpCount)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+
+    g_dumpCount = dumpCount;
+    action.sa_handler = dump_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+void fatal_exit(void)
+{
+    abort();
+}
+
+void sleep_millis(const DWORD timeout)
+{
+    struct timespec delay = { .tv_sec = timeout / 1000U, .tv_nsec = (long)(timeout % 1000U) * 1000000L };
+    while (nanosleep(&delay, &delay) && (errno == EINTR));
+}
+
+DWORD get_tick_count(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)((((uint64_t)now.tv_sec) * 1000U) + (((uint64_t)now.tv_nsec) / 1000000U));
+}
+
+ULONGLONG get_timestamp(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (((ULONGLONG)now.tv_sec) * 1000000000U) + ((ULONGLONG)now.tv_nsec);
+}
+
+ULONGLONG get_timestamp_frequency(void)
+{
+    return 1000000000U;
+}
+
+ULONGLONG get_system_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (((ULONGLONG)now.tv_sec) * 10000000U) + (((ULONGLONG)now.tv_nsec) / 100U);
+}
+
+// --------------------------------------------------------------------------
+// Memory
+// --------------------------------------------------------------------------
+
+void *alloc_memory(const SIZE_T size)
+{
+    return calloc(1U, size);
+}
+
+void free_memory(void *const buffer)
+{
+    free(buffer);
+}
+
+void zero_memory(void *const buffer, const SIZE_T size)
+{
+    memset(buffer, 0, size);
+}
+
+void copy_memory(void *const destination, const void *const source, const SIZE_T size)
+{
+    memcpy(destination, source, size);
+}
+
+DWORD get_page_size(void)
+{
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return (pageSize > 0L) ? ((DWORD)pageSize) : 4096U;
+}
+
+DWORD get_processor_count(void)
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0L) ? ((DWORD)count) : 1U;
+}
+
+BYTE *alloc_pages(const SIZE_T size, BOOL *const largePages)
+{
+    void *buffer;
+
+    if (*largePages)
+    {
+#ifdef MAP_HUGETLB
+        buffer = mmap(NULL, (size + HUGE_PAGE_SIZE - 1U) & (~((SIZE_T)HUGE_PAGE_SIZE - 1U)), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer != MAP_FAILED)
+        {
+            return (BYTE*)buffer;
+        }
+#endif
+        *largePages = FALSE; /*fall back to regular pages*/
+    }
+
+    buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (buffer != MAP_FAILED) ? ((BYTE*)buffer) : NULL;
+}
+
+void free_pages(BYTE *const buffer, const SIZE_T size, const BOOL largePages)
+{
+    if (buffer)
+    {
+        munmap(buffer, largePages ? ((size + HUGE_PAGE_SIZE - 1U) & (~((SIZE_T)HUGE_PAGE_SIZE - 1U))) : size);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Files
+// --------------------------------------------------------------------------
+
+int open_file(const wchar_t *const fileName, const BOOL append)
+{
+    char *const path = wide_to_utf8(fileName);
+    if (!path)
+    {
+        return INVALID_FILE;
+    }
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+    free(path);
+    return (fd >= 0) ? fd : INVALID_FILE;
+}
+
+int open_file_async(const wchar_t *const fileName, const BOOL append)
+{
+    return open_file(fileName, append); /*io_uring works with any file descriptor*/
+}
+
+int open_file_read(const wchar_t *const fileName)
+{
+    char *const path = wide_to_utf8(fileName);
+    if (!path)
+    {
+        return INVALID_FILE;
+    }
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    return (fd >= 0) ? fd : INVALID_FILE;
+}
+
+int open_file_direct(const wchar_t *const fileName, const BOOL append, BOOL *const direct)
+{
+    struct stat info;
+    const int fd = open_file(fileName, append);
+    if (fd < 0)
+    {
+        return fd;
+    }
+
+    *direct = FALSE;
+    if ((fstat(fd, &info) == 0) && S_ISREG(info.st_mode) && (!(((ULONGLONG)info.st_size) & (get_page_size() - 1U))))
+    {
+        const int flags = fcntl(fd, F_GETFL);
+        *direct = (flags >= 0) && (fcntl(fd, F_SETFL, flags | O_DIRECT) == 0); /*fails, if the file system does not support it*/
+    }
+
+    return fd;
+}
+
+BOOL write_file_tail(const int handle, BYTE *const buffer, const DWORD size)
+{
+    const int flags = fcntl(handle, F_GETFL);
+    if ((flags < 0) || (fcntl(handle, F_SETFL, flags & (~O_DIRECT)) != 0))
+    {
+        return FALSE;
+    }
+
+    DWORD bytesWritten = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesWritten)
+    {
+        if ((!write_file(handle, buffer + offset, size - offset, &bytesWritten)) || (!bytesWritten))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOL preallocate_file(const int handle, const ULONGLONG size)
+{
+#ifdef __linux__
+    struct stat info;
+    if ((fstat(handle, &info) != 0) || (!S_ISREG(info.st_mode)))
+    {
+        return FALSE;
+    }
+
+    int result;
+    while (((result = fallocate(handle, FALLOC_FL_KEEP_SIZE, info.st_size, (off_t)size)) != 0) && (errno == EINTR));
+    return (result == 0);
+#else
+    (void)handle, (void)size;
+    return FALSE;
+#endif
+}
+
+int open_temp_file(void)
+{
+    static const char *const NAME = "/tee-spill.XXXXXX";
+    const char *const tempDir = getenv("TMPDIR");
+    const char *const directory = (tempDir && tempDir[0U]) ? tempDir : "/tmp";
+    char *const path = (char*)malloc(strlen(directory) + strlen(NAME) + 1U);
+    if (!path)
+    {
+        return INVALID_FILE;
+    }
+
+    strcat(strcpy(path, directory), NAME);
+    const int fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0)
+    {
+        unlink(path); /*deleted as soon as it is closed*/
+    }
+
+    free(path);
+    return (fd >= 0) ? fd : INVALID_FILE;
+}
+
+void close_file(const int handle)
+{
+    if (handle >= 0)
+    {
+        close(handle);
+    }
+}
+
+BOOL delete_file(const wchar_t *const fileName)
+{
+    char *const path = wide_to_utf8(fileName);
+    if (!path)
+    {
+        return FALSE;
+    }
+
+    const BOOL result = (unlink(path) == 0);
+    free(path);
+    return result;
+}
+
+BOOL read_file(const int handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead)
+{
+    for (;;)
+    {
+        const ssize_t result = read(handle, buffer, size);
+        if (result >= 0)
+        {
+            *bytesRead = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesRead = 0U;
+            return FALSE;
+        }
+    }
+}
+
+BOOL write_file(const int handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten)
+{
+    for (;;)
+    {
+        const ssize_t result = write(handle, buffer, size);
+        if (result >= 0)
+        {
+            *bytesWritten = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesWritten = 0U;
+            return FALSE;
+        }
+    }
+}
+
+BOOL read_file_timeout(const int handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead, const DWORD timeout, BOOL *const timedOut)
+{
+    struct pollfd pollFd = { .fd = handle, .events = POLLIN, .revents = 0 };
+    *timedOut = FALSE;
+
+    for (;;)
+    {
+        const int result = poll(&pollFd, 1U, (timeout < INFINITE) ? ((int)timeout) : (-1));
+        if (!result)
+        {
+            *bytesRead = 0U;
+            *timedOut = TRUE;
+            return TRUE;
+        }
+        if ((result > 0) || (errno != EINTR))
+        {
+            return read_file(handle, buffer, size, bytesRead);
+        }
+    }
+}
+
+BOOL read_file_at(const int handle, const ULONGLONG offset, BYTE *const buffer, const DWORD size, DWORD *const bytesRead)
+{
+    for (;;)
+    {
+        const ssize_t result = pread(handle, buffer, size, (off_t)offset);
+        if (result >= 0)
+        {
+            *bytesRead = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesRead = 0U;
+            return FALSE;
+        }
+    }
+}
+
+BOOL write_file_at(const int handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten)
+{
+    for (;;)
+    {
+        const ssize_t result = pwrite(handle, buffer, size, (off_t)offset);
+        if (result >= 0)
+        {
+            *bytesWritten = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesWritten = 0U;
+            return FALSE;
+        }
+    }
+}
+
+BOOL flush_file(const int handle)
+{
+#ifdef __linux__
+    return (fdatasync(handle) == 0); /*the file size is still synchronized, other metadata is not*/
+#else
+    return (fsync(handle) == 0);
+#endif
+}
+
+BOOL is_terminal(const int handle)
+{
+    return isatty(handle);
+}
+
+BOOL is_null_device(const wchar_t *const fileName)
+{
+    return (wcscmp(fileName, L"/dev/null") == 0);
+}
+
+void enable_escape_codes(const int handle)
+{
+    (void)handle; /*terminals process escape codes anyway*/
+}
+
+BOOL write_text(const int handle, const wchar_t *const text)
+{
+    char *const utf8_text = wide_to_utf8(text);
+    if (!utf8_text)
+    {
+        return FALSE;
+    }
+
+    BOOL result = TRUE;
+    const size_t length = strlen(utf8_text);
+    for (size_t offset = 0U; offset < length;)
+    {
+        const ssize_t written = write(handle, utf8_text + offset, length - offset);
+        if (written <= 0)
+        {
+            if ((written < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            result = FALSE;
+            break;
+        }
+        offset += (size_t)written;
+    }
+
+    free(utf8_text);
+    return result;
+}
+
+char *encode_utf8(const wchar_t *const text)
+{
+    return wide_to_utf8(text);
+}
+
+// --------------------------------------------------------------------------
+// File mapping
+// --------------------------------------------------------------------------
+
+BOOL get_file_range(const int handle, ULONGLONG *const offset, ULONGLONG *const size)
+{
+    struct stat info;
+    if ((fstat(handle, &info) != 0) || (!S_ISREG(info.st_mode)))
+    {
+        return FALSE;
+    }
+
+    const off_t position = lseek(handle, 0, SEEK_CUR);
+    if ((position < 0) || (position > info.st_size))
+    {
+        return FALSE;
+    }
+
+    *offset = (ULONGLONG)position;
+    *size = (ULONGLONG)(info.st_size - position);
+    return TRUE;
+}
+
+BOOL set_file_position(const int handle, const ULONGLONG offset)
+{
+    return (lseek(handle, (off_t)offset, SEEK_SET) >= 0);
+}
+
+void advise_sequential(const int handle)
+{
+    posix_fadvise(handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+DWORD get_allocation_granularity(void)
+{
+    return get_page_size();
+}
+
+int create_mapping(const int handle)
+{
+    return handle; /*mmap() works on the file descriptor*/
+}
+
+void close_mapping(const int mapping)
+{
+    (void)mapping;
+}
+
+BYTE *map_view(const int mapping, const ULONGLONG offset, const SIZE_T size)
+{
+    void *const view = mmap(NULL, size, PROT_READ, MAP_SHARED, mapping, (off_t)offset);
+    if (view == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    madvise(view, size, MADV_SEQUENTIAL);
+    madvise(view, size, MADV_WILLNEED); /*start reading the whole window ahead*/
+    return (BYTE*)view;
+}
+
+void unmap_view(BYTE *const view, const SIZE_T size)
+{
+    munmap(view, size);
+}
+
+// --------------------------------------------------------------------------
+// Zero-copy
+// --------------------------------------------------------------------------
+
+#ifdef __linux__
+
+BOOL can_splice(const int handle)
+{
+    struct stat info;
+    return (fstat(handle, &info) == 0) && S_ISFIFO(info.st_mode);
+}
+
+BOOL create_pipe(int *const hRead, int *const hWrite, const DWORD size)
+{
+    int fds[2U];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        *hRead = *hWrite = INVALID_FILE;
+        return FALSE;
+    }
+
+    const int capacity = fcntl(fds[1U], F_GETPIPE_SZ);
+    if ((capacity > 0) && (size > (DWORD)capacity) && (size <= MAXLONG))
+    {
+        fcntl(fds[1U], F_SETPIPE_SZ, (int)size); /*best effort, limited by "pipe-max-size"*/
+    }
+
+    *hRead = fds[0U];
+    *hWrite = fds[1U];
+    return TRUE;
+}
+
+BOOL tee_pipe(const int hInput, const int hOutput, const DWORD size, DWORD *const bytesCopied)
+{
+    for (;;)
+    {
+        const ssize_t result = tee(hInput, hOutput, size, 0U);
+        if (result >= 0)
+        {
+            *bytesCopied = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesCopied = 0U;
+            return FALSE;
+        }
+    }
+}
+
+BOOL splice_pipe(const int hInput, const int hOutput, const DWORD size, DWORD *const bytesMoved)
+{
+    for (;;)
+    {
+        const ssize_t result = splice(hInput, NULL, hOutput, NULL, size, SPLICE_F_MOVE);
+        if (result >= 0)
+        {
+            *bytesMoved = (DWORD)result;
+            return TRUE;
+        }
+        if (errno != EINTR)
+        {
+            *bytesMoved = 0U;
+            return FALSE;
+        }
+    }
+}
+
+#else
+
+BOOL can_splice(const int handle)
+{
+    (void)handle;
+    return FALSE;
+}
+
+BOOL create_pipe(int *const hRead, int *const hWrite, const DWORD size)
+{
+    (void)size;
+    *hRead = *hWrite = INVALID_FILE;
+    return FALSE;
+}
+
+BOOL tee_pipe(const int hInput, const int hOutput, const DWORD size, DWORD *const bytesCopied)
+{
+    (void)hInput, (void)hOutput, (void)size;
+    *bytesCopied = 0U;
+    return FALSE;
+}
+
+BOOL splice_pipe(const int hInput, const int hOutput, const DWORD size, DWORD *const bytesMoved)
+{
+    (void)hInput, (void)hOutput, (void)size;
+    *bytesMoved = 0U;
+    return FALSE;
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+// Connections
+// --------------------------------------------------------------------------
+
+static BOOL has_prefix(const wchar_t *const name, const wchar_t *const prefix)
+{
+    return wcsncmp(name, prefix, wcslen(prefix)) == 0;
+}
+
+BOOL is_connection_name(const wchar_t *const name)
+{
+    return has_prefix(name, L"tcp://") || has_prefix(name, L"unix:");
+}
+
+static BOOL wait_for_socket(const int handle, const DWORD timeout)
+{
+    struct pollfd descriptor = { .fd = handle, .events = POLLOUT, .revents = 0 };
+    int result;
+    while (((result = poll(&descriptor, 1U, (int)timeout)) < 0) && (errno == EINTR));
+    if (!result)
+    {
+        errno = ETIMEDOUT;
+    }
+
+    return (result > 0);
+}
+
+static int connect_socket(const int family, const struct sockaddr *const address, const socklen_t length, const DWORD timeout)
+{
+    const int handle = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (handle < 0)
+    {
+        return INVALID_FILE;
+    }
+
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if ((connect(handle, address, length) != 0) && (!((errno == EINPROGRESS) && wait_for_socket(handle, timeout) && (getsockopt(handle, SOL_SOCKET, SO_ERROR, &error, &errorSize) == 0) && (!error))))
+    {
+        close(handle);
+        return INVALID_FILE;
+    }
+
+    if (family != AF_UNIX)
+    {
+        const int noDelay = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); /*the stream is forwarded live*/
+    }
+
+    return handle;
+}
+
+int open_connection(const wchar_t *const name, const DWORD timeout)
+{
+    int handle = INVALID_FILE;
+    char *const address = wide_to_utf8(name);
+    if (!address)
+    {
+        return INVALID_FILE;
+    }
+
+    if (has_prefix(name, L"unix:"))
+    {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        const char *const path = address + 5U;
+        if (strlen(path) < sizeof(local.sun_path))
+        {
+            strcpy(local.sun_path, path);
+            handle = connect_socket(AF_UNIX, (const struct sockaddr*)&local, sizeof(local), timeout);
+        }
+    }
+    else
+    {
+        char *host = address + 6U, *const port = strrchr(host, ':');
+        if (port)
+        {
+            *port = '\0';
+            if ((host[0U] == '[') && (port[-1] == ']'))
+            {
+                port[-1] = '\0'; /*an IPv6 address, e.g. "[::1]:5170"*/
+                ++host;
+            }
+            struct addrinfo hints, *result = NULL;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host, port + 1U, &hints, &result) == 0)
+            {
+                for (const struct addrinfo *info = result; info && (handle == INVALID_FILE); info = info->ai_next)
+                {
+                    handle = connect_socket(info->ai_family, info->ai_addr, info->ai_addrlen, timeout);
+                }
+                freeaddrinfo(result);
+            }
+        }
+    }
+
+    free(address);
+    return handle;
+}
+
+BOOL write_connection(const int handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten, const DWORD timeout)
+{
+    for (;;)
+    {
+        const ssize_t result = send(handle, buffer, size, MSG_NOSIGNAL);
+        if (result >= 0)
+        {
+            *bytesWritten = (DWORD)result;
+            return TRUE;
+        }
+        if (!(((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) && wait_for_socket(handle, timeout)))
+        {
+            *bytesWritten = 0U;
+            return FALSE;
+        }
+    }
+}
+
+void close_connection(const int handle)
+{
+    close(handle);
+}
+
+// --------------------------------------------------------------------------
+// Child process
+// --------------------------------------------------------------------------
+
+extern char **environ;
+
+static BOOL create_child_pipe(int *const fds, const DWORD size)
+{
+    if (pipe2(fds, O_CLOEXEC) != 0) /*atomically, so that no other spawn inherits them; the copies that the child gets via dup2() are inherited*/
+    {
+        fds[0U] = fds[1U] = INVALID_FILE;
+        return FALSE;
+    }
+
+#ifdef F_SETPIPE_SZ
+    for (DWORD capacity = (size <= 0x40000000U) ? size : 0x40000000U; capacity > 0x10000U; capacity >>= 1)
+    {
+        if ((fcntl(fds[1U], F_SETPIPE_SZ, (int)capacity) >= 0) || (errno != EPERM))
+        {
+            break; /*unprivileged processes are limited by "pipe-max-size"*/
+        }
+    }
+#else
+    (void)size;
+#endif
+
+    return TRUE;
+}
+
+static BOOL spawn_child(char *const *const args, const int hStdOut, const int hStdErr, pid_t *const pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    BOOL success = FALSE;
+
+    if (posix_spawn_file_actions_init(&actions) != 0)
+    {
+        return FALSE;
+    }
+
+    if (posix_spawnattr_init(&attributes) == 0)
+    {
+        sigset_t signals;
+        sigemptyset(&signals);
+        posix_spawnattr_setsigmask(&attributes, &signals);
+        sigaddset(&signals, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attributes, &signals); /*tee ignores SIGPIPE, but the child must not*/
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+        success = (posix_spawn_file_actions_adddup2(&actions, hStdOut, STDOUT_FILENO) == 0) && (posix_spawn_file_actions_adddup2(&actions, hStdErr, STDERR_FILENO) == 0) && (posix_spawnp(pid, args[0U], &actions, &attributes, args, environ) == 0);
+        posix_spawnattr_destroy(&attributes);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    return success;
+}
+
+BOOL start_process(const wchar_t *const *const argv, const DWORD argc, const DWORD pipeSize, int *const hStdOut, int *const hStdErr, process_handle_t *const process)
+{
+    int outPipe[2U] = { INVALID_FILE, INVALID_FILE }, errPipe[2U] = { INVALID_FILE, INVALID_FILE };
+    BOOL success = FALSE;
+    pid_t pid = 0;
+
+    char **const args = (char**)calloc((size_t)argc + 1U, sizeof(char*));
+    if (!args)
+    {
+        return FALSE;
+    }
+
+    DWORD count = 0U;
+    while ((count < argc) && (args[count] = wide_to_utf8(argv[count])))
+    {
+        ++count;
+    }
+
+    if ((count == argc) && create_child_pipe(outPipe, pipeSize) && create_child_pipe(errPipe, pipeSize))
+    {
+        success = spawn_child(args, outPipe[1U], errPipe[1U], &pid);
+    }
+
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        free(args[index]);
+    }
+
+    free(args);
+
+    for (DWORD index = 0U; index < 2U; ++index)
+    {
+        if ((outPipe[index] >= 0) && (index || (!success)))
+        {
+            close(outPipe[index]); /*the child holds the write ends now*/
+        }
+        if ((errPipe[index] >= 0) && (index || (!success)))
+        {
+            close(errPipe[index]);
+        }
+    }
+
+    if (success)
+    {
+        *hStdOut = outPipe[0U];
+        *hStdErr = errPipe[0U];
+        *process = (int)pid;
+    }
+
+    return success;
+}
+
+BOOL wait_for_input(const int *const handles, const DWORD count, DWORD *const index)
+{
+    struct pollfd pollFds[MAXIMUM_WAIT_OBJECTS];
+    for (DWORD handleId = 0U; handleId < count; ++handleId)
+    {
+        pollFds[handleId].fd = handles[handleId]; /*poll() ignores negative descriptors*/
+        pollFds[handleId].events = POLLIN;
+        pollFds[handleId].revents = 0;
+    }
+
+    for (;;)
+    {
+        const int result = poll(pollFds, count, -1);
+        if (result > 0)
+        {
+            for (DWORD offset = 1U; offset <= count; ++offset)
+            {
+                const DWORD candidate = (*index + offset) % count;
+                if (pollFds[candidate].revents)
+                {
+                    *index = candidate; /*data or end of stream, read_file() tells which*/
+                    return TRUE;
+                }
+            }
+        }
+        else if ((result < 0) && (errno != EINTR))
+        {
+            return FALSE;
+        }
+    }
+}
+
+BOOL wait_process(const int process, DWORD *const exitCode)
+{
+    int status = 0;
+    while (waitpid((pid_t)process, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return FALSE;
+        }
+    }
+
+    *exitCode = WIFEXITED(status) ? ((DWORD)WEXITSTATUS(status)) : (WIFSIGNALED(status) ? (128U + ((DWORD)WTERMSIG(status))) : 1U);
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Asynchronous I/O
+// --------------------------------------------------------------------------
+
+#ifdef __linux__
+
+/*
+ * Minimal io_uring, without liburing: the writes are queued in the submission ring and submitted
+ * in a single system call, when the caller starts waiting for the completions.
+ */
+
+struct _async_queue
+{
+    int ringFd;
+    unsigned entries, unsubmitted;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+};
+
+#define RING_PTR(BASE, OFFSET) ((unsigned*)(((BYTE*)(BASE)) + (OFFSET)))
+
+async_queue_t *async_create(const DWORD capacity)
+{
+    struct io_uring_params params;
+    unsigned entries = 1U;
+    while (entries < capacity)
+    {
+        if ((entries <<= 1) > 32768U)
+        {
+            return NULL;
+        }
+    }
+
+    async_queue_t *const queue = (async_queue_t*)alloc_memory(sizeof(async_queue_t));
+    if (!queue)
+    {
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    if ((queue->ringFd = (int)syscall(__NR_io_uring_setup, entries, &params)) < 0)
+    {
+        free_memory(queue);
+        return NULL;
+    }
+
+    if (!(params.features & IORING_FEAT_FAST_POLL))
+    {
+        async_destroy(queue); /*IORING_OP_WRITE requires Linux 5.6, this flag was added in 5.7*/
+        return NULL;
+    }
+
+    queue->entries = params.sq_entries;
+    queue->sqRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    queue->cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    queue->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (((queue->sqRing = mmap(NULL, queue->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->ringFd, IORING_OFF_SQ_RING)) == MAP_FAILED) ||
+        ((queue->cqRing = mmap(NULL, queue->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->ringFd, IORING_OFF_CQ_RING)) == MAP_FAILED) ||
+        ((queue->sqes = (struct io_uring_sqe*)mmap(NULL, queue->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->ringFd, IORING_OFF_SQES)) == MAP_FAILED))
+    {
+        async_destroy(queue);
+        return NULL;
+    }
+
+    queue->sqHead = RING_PTR(queue->sqRing, params.sq_off.head);
+    queue->sqTail = RING_PTR(queue->sqRing, params.sq_off.tail);
+    queue->sqMask = RING_PTR(queue->sqRing, params.sq_off.ring_mask);
+    queue->sqArray = RING_PTR(queue->sqRing, params.sq_off.array);
+    queue->cqHead = RING_PTR(queue->cqRing, params.cq_off.head);
+    queue->cqTail = RING_PTR(queue->cqRing, params.cq_off.tail);
+    queue->cqMask = RING_PTR(queue->cqRing, params.cq_off.ring_mask);
+    queue->cqes = (struct io_uring_cqe*)(((BYTE*)queue->cqRing) + params.cq_off.cqes);
+    return queue;
+}
+
+void async_destroy(async_queue_t *const queue)
+{
+    if (queue)
+    {
+        if (queue->sqes && (queue->sqes != MAP_FAILED))
+        {
+            munmap(queue->sqes, queue->sqesSize);
+        }
+        if (queue->cqRing && (queue->cqRing != MAP_FAILED))
+        {
+            munmap(queue->cqRing, queue->cqRingSize);
+        }
+        if (queue->sqRing && (queue->sqRing != MAP_FAILED))
+        {
+            munmap(queue->sqRing, queue->sqRingSize);
+        }
+        close(queue->ringFd);
+        free_memory(queue);
+    }
+}
+
+BOOL async_attach(async_queue_t *const queue, const int handle)
+{
+    (void)queue;
+    return (handle >= 0);
+}
+
+static BOOL async_submit(async_queue_t *const queue, const unsigned waitCount)
+{
+    for (;;)
+    {
+        const long result = syscall(__NR_io_uring_enter, queue->ringFd, queue->unsubmitted, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0U, NULL, 0);
+        if (result >= 0)
+        {
+            queue->unsubmitted -= (unsigned)result;
+            return TRUE;
+        }
+        if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+        {
+            return FALSE;
+        }
+    }
+}
+
+BOOL async_write(async_queue_t *const queue, const int handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, void *const context)
+{
+    const unsigned tail = *queue->sqTail;
+    if ((tail - __atomic_load_n(queue->sqHead, __ATOMIC_ACQUIRE)) >= queue->entries)
+    {
+        if (!async_submit(queue, 0U))
+        {
+            return FALSE;
+        }
+        if ((tail - __atomic_load_n(queue->sqHead, __ATOMIC_ACQUIRE)) >= queue->entries)
+        {
+            return FALSE; /*more writes than the capacity of the queue*/
+        }
+    }
+
+    const unsigned index = tail & (*queue->sqMask);
+    struct io_uring_sqe *const sqe = &queue->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = handle;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = size;
+    sqe->off = (offset != ASYNC_NO_OFFSET) ? offset : ((__u64)-1); /*-1 means the current file position*/
+    sqe->user_data = (uintptr_t)context;
+    queue->sqArray[index] = index;
+    __atomic_store_n(queue->sqTail, tail + 1U, __ATOMIC_RELEASE);
+    ++queue->unsubmitted;
+    return TRUE;
+}
+
+void *async_wait(async_queue_t *const queue, DWORD *const bytesWritten, BOOL *const success)
+{
+    for (;;)
+    {
+        const unsigned head = *queue->cqHead;
+        if (head != __atomic_load_n(queue->cqTail, __ATOMIC_ACQUIRE))
+        {
+            const struct io_uring_cqe *const cqe = &queue->cqes[head & (*queue->cqMask)];
+            void *const context = (void*)(uintptr_t)cqe->user_data;
+            *success = (cqe->res >= 0);
+            *bytesWritten = (cqe->res > 0) ? ((DWORD)cqe->res) : 0U;
+            __atomic_store_n(queue->cqHead, head + 1U, __ATOMIC_RELEASE);
+            return context;
+        }
+        if (!async_submit(queue, 1U))
+        {
+            return NULL;
+        }
+    }
+}
+
+#else
+
+async_queue_t *async_create(const DWORD capacity)
+{
+    (void)capacity;
+    return NULL;
+}
+
+void async_destroy(async_queue_t *const queue)
+{
+    (void)queue;
+}
+
+BOOL async_attach(async_queue_t *const queue, const int handle)
+{
+    (void)queue, (void)handle;
+    return FALSE;
+}
+
+BOOL async_write(async_queue_t *const queue, const int handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, void *const context)
+{
+    (void)queue, (void)handle, (void)offset, (void)buffer, (void)size, (void)context;
+    return FALSE;
+}
+
+void *async_wait(async_queue_t *const queue, DWORD *const bytesWritten, BOOL *const success)
+{
+    (void)queue;
+    *bytesWritten = 0U;
+    *success = FALSE;
+    return NULL;
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+// Threads
+// --------------------------------------------------------------------------
+
+struct _posix_thread
+{
+    pthread_t thread;
+    thread_routine_t routine;
+    void *param;
+    BOOL finished, joined, detached;
+};
+
+static pthread_mutex_t g_threadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_threadExited = PTHREAD_COND_INITIALIZER;
+
+static void get_deadline(struct timespec *const deadline, const DWORD timeout)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout / 1000U;
+    deadline->tv_nsec += (long)(timeout % 1000U) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *thread_start_routine(void *const param)
+{
+    struct _posix_thread *const thread = (struct _posix_thread*)param;
+    thread->routine(thread->param);
+
+    pthread_mutex_lock(&g_threadMutex);
+    thread->finished = TRUE;
+    pthread_cond_broadcast(&g_threadExited);
+    pthread_mutex_unlock(&g_threadMutex);
+
+    return NULL;
+}
+
+static BOOL wait_thread(struct _posix_thread *const thread, const struct timespec *const deadline)
+{
+    if (thread->joined)
+    {
+        return TRUE;
+    }
+
+    pthread_mutex_lock(&g_threadMutex);
+    while (!thread->finished)
+    {
+        if (deadline ? pthread_cond_timedwait(&g_threadExited, &g_threadMutex, deadline) : pthread_cond_wait(&g_threadExited, &g_threadMutex))
+        {
+            break;
+        }
+    }
+    const BOOL finished = thread->finished;
+    pthread_mutex_unlock(&g_threadMutex);
+
+    if (finished)
+    {
+        pthread_join(thread->thread, NULL);
+        thread->joined = TRUE;
+    }
+
+    return finished;
+}
+
+BOOL create_thread(thread_handle_t *const thread, const thread_routine_t routine, void *const param)
+{
+    struct _posix_thread *const context = (struct _posix_thread*)calloc(1U, sizeof(struct _posix_thread));
+    if (!context)
+    {
+        return FALSE;
+    }
+
+    context->routine = routine;
+    context->param = param;
+    if (pthread_create(&context->thread, NULL, thread_start_routine, context) != 0)
+    {
+        free(context);
+        return FALSE;
+    }
+
+    *thread = context;
+    return TRUE;
+}
+
+BOOL join_thread(const thread_handle_t thread, const DWORD timeout)
+{
+    struct timespec deadline;
+    if (timeout != INFINITE)
+    {
+        get_deadline(&deadline, timeout);
+    }
+
+    return wait_thread(thread, (timeout != INFINITE) ? &deadline : NULL);
+}
+
+BOOL join_threads(const thread_handle_t *const threads, const DWORD count, const DWORD timeout)
+{
+    struct timespec deadline;
+    BOOL result = TRUE;
+    if (timeout != INFINITE)
+    {
+        get_deadline(&deadline, timeout);
+    }
+
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        if (!wait_thread(threads[index], (timeout != INFINITE) ? &deadline : NULL))
+        {
+            result = FALSE;
+        }
+    }
+
+    return result;
+}
+
+void terminate_thread(const thread_handle_t thread)
+{
+    if (!(thread->joined || thread->detached))
+    {
+        pthread_cancel(thread->thread);
+        pthread_detach(thread->thread);
+        thread->detached = TRUE;
+    }
+}
+
+void close_thread(const thread_handle_t thread)
+{
+    if (thread && thread->joined)
+    {
+        free(thread); /*a detached thread may still be using its context*/
+    }
+}
+
+// --------------------------------------------------------------------------
+// Synchronization
+// --------------------------------------------------------------------------
+
+#ifdef __linux__
+
+BOOL wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout)
+{
+    struct timespec relative = { .tv_sec = timeout / 1000U, .tv_nsec = (long)(timeout % 1000U) * 1000000L };
+    if (syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, undesired, (timeout != INFINITE) ? &relative : NULL, NULL, 0) != 0)
+    {
+        return (errno != ETIMEDOUT);
+    }
+
+    return TRUE;
+}
+
+void wake_by_address_single(volatile LONG *const address)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+void wake_by_address_all(volatile LONG *const address)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+}
+
+#else
+
+static pthread_mutex_t g_addressMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_addressCondVar = PTHREAD_COND_INITIALIZER;
+
+BOOL wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout)
+{
+    int error = 0;
+    pthread_mutex_lock(&g_addressMutex);
+    if (atomic_load_acquire(address) == undesired)
+    {
+        if (timeout != INFINITE)
+        {
+            struct timespec deadline;
+            get_deadline(&deadline, timeout);
+            error = pthread_cond_timedwait(&g_addressCondVar, &g_addressMutex, &deadline);
+        }
+        else
+        {
+            error = pthread_cond_wait(&g_addressCondVar, &g_addressMutex);
+        }
+    }
+    pthread_mutex_unlock(&g_addressMutex);
+    return (error != ETIMEDOUT);
+}
+
+void wake_by_address_single(volatile LONG *const address)
+{
+    wake_by_address_all(address); /*the fallback can not tell the waiters apart*/
+}
+
+void wake_by_address_all(volatile LONG *const address)
+{
+    (void)address;
+    pthread_mutex_lock(&g_addressMutex);
+    pthread_mutex_unlock(&g_addressMutex);
+    pthread_cond_broadcast(&g_addressCondVar);
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+// Startup
+// --------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    wchar_t **const wargv = (wchar_t**)calloc((size_t)argc + 1U, sizeof(wchar_t*));
+    if (!wargv)
+    {
+        return -1;
+    }
+
+    for (int index = 0; index < argc; ++index)
+    {
+        if (!(wargv[index] = utf8_to_wide(argv[index])))
+        {
+            return -1;
+        }
+    }
+
+    const int retval = tee_main(argc, (const wchar_t *const *)wargv);
+
+    for (int index = 0; index < argc; ++index)
+    {
+        free(wargv[index]);
+    }
+
+    free(wargv);
+    return retval;
+}
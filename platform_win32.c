@@ -0,0 +1,1265 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "include/platform.h"
+#include <ShellAPI.h>
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <afunix.h>
+
+// --------------------------------------------------------------------------
+// Utilities
+// --------------------------------------------------------------------------
+
+static wchar_t to_lower(const wchar_t c)
+{
+    return ((c >= L'A') && (c <= L'Z')) ? (L'a' + (c - L'A')) : c;
+}
+
+static const wchar_t *get_filename(const wchar_t *filePath)
+{
+    for (const wchar_t *ptr = filePath; *ptr != L'\0'; ++ptr)
+    {
+        if ((*ptr == L'\\') || (*ptr == L'/'))
+        {
+            filePath = ptr + 1U;
+        }
+    }
+
+    return filePath;
+}
+
+// --------------------------------------------------------------------------
+// Process
+// --------------------------------------------------------------------------
+
+static volatile BOOL *g_stopFlag = NULL;
+static volatile LONG *g_dumpCount = NULL;
+
+static BOOL WINAPI console_handler(const DWORD ctrlType)
+{
+    switch (ctrlType)
+    {
+    case CTRL_BREAK_EVENT:
+        if (g_dumpCount)
+        {
+            atomic_increment(g_dumpCount); /*dump the flight recorders, instead of stopping*/
+            return TRUE;
+        }
+        /* fall through */
+    case CTRL_C_EVENT:
+    case CTRL_CLOSE_EVENT:
+        *g_stopFlag = TRUE;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+BOOL get_std_handles(HANDLE *const hStdIn, HANDLE *const hStdOut, HANDLE *const hStdErr)
+{
+    *hStdIn = GetStdHandle(STD_INPUT_HANDLE);
+    *hStdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    *hStdErr = GetStdHandle(STD_ERROR_HANDLE);
+
+    if (!((*hStdErr != NULL) && (*hStdErr != INVALID_HANDLE_VALUE)))
+    {
+        *hStdErr = INVALID_HANDLE_VALUE;
+        return FALSE;
+    }
+
+    return (*hStdIn != NULL) && (*hStdIn != INVALID_HANDLE_VALUE) && (*hStdOut != NULL) && (*hStdOut != INVALID_HANDLE_VALUE);
+}
+
+void install_stop_handler(volatile BOOL *const stopFlag)
+{
+    g_stopFlag = stopFlag;
+    SetConsoleCtrlHandler(console_handler, TRUE);
+}
+
+void install_dump_handler(volatile LONG *const dumpCount)
+{
+    g_dumpCount = dumpCount; /*the console handler has already been installed*/
+}
+
+void fatal_exit(void)
+{
+    FatalExit(-1);
+}
+
+void sleep_millis(const DWORD timeout)
+{
+    Sleep(timeout);
+}
+
+DWORD get_tick_count(void)
+{
+    return GetTickCount();
+}
+
+ULONGLONG get_timestamp(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (ULONGLONG)counter.QuadPart;
+}
+
+ULONGLONG get_timestamp_frequency(void)
+{
+    LARGE_INTEGER frequency;
+    return QueryPerformanceFrequency(&frequency) ? ((ULONGLONG)frequency.QuadPart) : 1U;
+}
+
+ULONGLONG get_system_time(void)
+{
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return ((((ULONGLONG)now.dwHighDateTime) << 32) | now.dwLowDateTime) - 116444736000000000ULL; /*1601 -> 1970*/
+}
+
+// --------------------------------------------------------------------------
+// Memory
+// --------------------------------------------------------------------------
+
+void *alloc_memory(const SIZE_T size)
+{
+    return (void*)LocalAlloc(LPTR, size);
+}
+
+void free_memory(void *const buffer)
+{
+    if (buffer)
+    {
+        LocalFree((HLOCAL)buffer);
+    }
+}
+
+void zero_memory(void *const buffer, const SIZE_T size)
+{
+    SecureZeroMemory(buffer, size);
+}
+
+void copy_memory(void *const destination, const void *const source, const SIZE_T size)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    __movsb((BYTE*)destination, (const BYTE*)source, size);
+#else
+    volatile BYTE *dst = (volatile BYTE*)destination; /*volatile, so that no call to memcpy() is emitted*/
+    for (const BYTE *src = (const BYTE*)source; src < ((const BYTE*)source) + size; ++src)
+    {
+        *dst++ = *src;
+    }
+#endif
+}
+
+DWORD get_page_size(void)
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+}
+
+DWORD get_processor_count(void)
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwNumberOfProcessors;
+}
+
+static BOOL enable_lock_memory_privilege(void)
+{
+    HANDLE hToken;
+    TOKEN_PRIVILEGES privileges;
+    BOOL result = FALSE;
+
+    if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+    {
+        privileges.PrivilegeCount = 1U;
+        privileges.Privileges[0U].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0U].Luid))
+        {
+            result = AdjustTokenPrivileges(hToken, FALSE, &privileges, 0U, NULL, NULL) && (GetLastError() == ERROR_SUCCESS);
+        }
+        CloseHandle(hToken);
+    }
+
+    return result;
+}
+
+BYTE *alloc_pages(const SIZE_T size, BOOL *const largePages)
+{
+    if (*largePages)
+    {
+        const SIZE_T largePageSize = GetLargePageMinimum();
+        if ((largePageSize > 0U) && enable_lock_memory_privilege())
+        {
+            BYTE *const buffer = (BYTE*)VirtualAlloc(NULL, (size + largePageSize - 1U) & (~(largePageSize - 1U)), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (buffer)
+            {
+                return buffer;
+            }
+        }
+        *largePages = FALSE; /*fall back to regular pages*/
+    }
+
+    return (BYTE*)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void free_pages(BYTE *const buffer, const SIZE_T size, const BOOL largePages)
+{
+    UNREFERENCED_PARAMETER(size);
+    UNREFERENCED_PARAMETER(largePages);
+    if (buffer)
+    {
+        VirtualFree(buffer, 0U, MEM_RELEASE);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Files
+// --------------------------------------------------------------------------
+
+static HANDLE create_file(const wchar_t *const fileName, const BOOL append, const DWORD flags)
+{
+    const HANDLE hFile = CreateFileW(fileName, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, append ? OPEN_ALWAYS : CREATE_ALWAYS, flags, NULL); /*allow external tools to rename or delete the file*/
+    if ((hFile != INVALID_HANDLE_VALUE) && append)
+    {
+        LARGE_INTEGER offset = { .QuadPart = 0LL };
+        if (!SetFilePointerEx(hFile, offset, NULL, FILE_END))
+        {
+            CloseHandle(hFile);
+            return INVALID_HANDLE_VALUE;
+        }
+    }
+
+    return hFile;
+}
+
+HANDLE open_file(const wchar_t *const fileName, const BOOL append)
+{
+    return create_file(fileName, append, 0U);
+}
+
+HANDLE open_file_async(const wchar_t *const fileName, const BOOL append)
+{
+    return create_file(fileName, append, FILE_FLAG_OVERLAPPED);
+}
+
+HANDLE open_file_read(const wchar_t *const fileName)
+{
+    return CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0U, NULL);
+}
+
+HANDLE open_file_direct(const wchar_t *const fileName, const BOOL append, BOOL *const direct)
+{
+    LARGE_INTEGER fileSize;
+    const HANDLE hFile = create_file(fileName, append, FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    if ((GetFileType(hFile) == FILE_TYPE_DISK) && GetFileSizeEx(hFile, &fileSize) && (!(fileSize.QuadPart & (get_page_size() - 1U))))
+    {
+        *direct = TRUE;
+        return hFile;
+    }
+
+    CloseHandle(hFile);
+    *direct = FALSE;
+    return create_file(fileName, append, 0U);
+}
+
+BOOL write_file_tail(const HANDLE handle, BYTE *const buffer, const DWORD size)
+{
+    /* The flags can not be changed on an open handle, so write a full page and cut off the padding */
+    const DWORD pageSize = get_page_size();
+    const DWORD paddedSize = (size + pageSize - 1U) & (~(pageSize - 1U));
+    DWORD bytesWritten = 0U;
+    zero_memory(buffer + size, paddedSize - size);
+
+    if (!(WriteFile(handle, buffer, paddedSize, &bytesWritten, NULL) && (bytesWritten == paddedSize)))
+    {
+        return FALSE;
+    }
+
+    LARGE_INTEGER offset = { .QuadPart = -((LONGLONG)(paddedSize - size)) };
+    return SetFilePointerEx(handle, offset, NULL, FILE_CURRENT) && SetEndOfFile(handle);
+}
+
+BOOL preallocate_file(const HANDLE handle, const ULONGLONG size)
+{
+    FILE_ALLOCATION_INFO info;
+    if ((GetFileType(handle) != FILE_TYPE_DISK) || (!GetFileSizeEx(handle, &info.AllocationSize)))
+    {
+        return FALSE;
+    }
+
+    info.AllocationSize.QuadPart += (LONGLONG)size;
+    return SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(FILE_ALLOCATION_INFO));
+}
+
+HANDLE open_temp_file(void)
+{
+    wchar_t tempPath[MAX_PATH + 1U], fileName[MAX_PATH + 1U];
+    const DWORD length = GetTempPathW(ARRAYSIZE(tempPath), tempPath);
+    if ((!length) || (length >= ARRAYSIZE(tempPath)) || (!GetTempFileNameW(tempPath, L"tee", 0U, fileName)))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    const HANDLE hFile = CreateFileW(fileName, GENERIC_READ | GENERIC_WRITE, 0U, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileW(fileName);
+    }
+
+    return hFile;
+}
+
+void close_file(const HANDLE handle)
+{
+    if ((handle != NULL) && (handle != INVALID_HANDLE_VALUE))
+    {
+        CloseHandle(handle);
+    }
+}
+
+BOOL delete_file(const wchar_t *const fileName)
+{
+    return DeleteFileW(fileName);
+}
+
+BOOL read_file(const HANDLE handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead)
+{
+    for (;;)
+    {
+        if (!ReadFile(handle, buffer, size, bytesRead, NULL))
+        {
+            if (GetLastError() == ERROR_BROKEN_PIPE)
+            {
+                *bytesRead = 0U;
+                return TRUE; /*end of input*/
+            }
+            return FALSE;
+        }
+        if ((*bytesRead) || (GetFileType(handle) != FILE_TYPE_PIPE))
+        {
+            return TRUE;
+        }
+        /*pipes may return zero bytes, even when more data can become available later!*/
+    }
+}
+
+BOOL write_file(const HANDLE handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten)
+{
+    return WriteFile(handle, buffer, size, bytesWritten, NULL);
+}
+
+typedef struct _read_timeout
+{
+    HANDLE hThread;
+    volatile LONG done;
+}
+read_timeout_t;
+
+static VOID CALLBACK read_timeout_callback(PVOID lpParameter, BOOLEAN timerOrWaitFired)
+{
+    read_timeout_t *const context = (read_timeout_t*)lpParameter;
+    UNREFERENCED_PARAMETER(timerOrWaitFired);
+
+    /*the reader may not have entered ReadFile() yet, so keep trying until it is done*/
+    while ((!ReadAcquire(&context->done)) && (!CancelSynchronousIo(context->hThread)))
+    {
+        if (GetLastError() != ERROR_NOT_FOUND)
+        {
+            break;
+        }
+        SwitchToThread();
+    }
+}
+
+BOOL read_file_timeout(const HANDLE handle, BYTE *const buffer, const DWORD size, DWORD *const bytesRead, const DWORD timeout, BOOL *const timedOut)
+{
+    static HANDLE hReaderThread = NULL;
+    DWORD available = 0U;
+    *timedOut = FALSE;
+
+    const DWORD fileType = GetFileType(handle);
+    if (fileType != FILE_TYPE_PIPE)
+    {
+        if ((fileType == FILE_TYPE_CHAR) && (WaitForSingleObject(handle, timeout) == WAIT_TIMEOUT))
+        {
+            *bytesRead = 0U;
+            *timedOut = TRUE;
+            return TRUE; /*console input*/
+        }
+        return read_file(handle, buffer, size, bytesRead);
+    }
+
+    if ((!PeekNamedPipe(handle, NULL, 0U, NULL, &available, NULL)) || available)
+    {
+        return read_file(handle, buffer, size, bytesRead); /*no need to wait*/
+    }
+
+    /*anonymous pipes can not be waited for, so a timer cancels the blocking read instead*/
+    if (!hReaderThread)
+    {
+        if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &hReaderThread, 0U, FALSE, DUPLICATE_SAME_ACCESS))
+        {
+            return read_file(handle, buffer, size, bytesRead);
+        }
+    }
+
+    HANDLE hTimer = NULL;
+    read_timeout_t context = { hReaderThread, FALSE };
+    if (!CreateTimerQueueTimer(&hTimer, NULL, read_timeout_callback, &context, timeout, 0U, WT_EXECUTEONLYONCE | WT_EXECUTEINTIMERTHREAD))
+    {
+        return read_file(handle, buffer, size, bytesRead);
+    }
+
+    const BOOL result = ReadFile(handle, buffer, size, bytesRead, NULL);
+    const DWORD error = result ? ERROR_SUCCESS : GetLastError();
+    WriteRelease(&context.done, TRUE);
+    DeleteTimerQueueTimer(NULL, hTimer, INVALID_HANDLE_VALUE);
+
+    if (!result)
+    {
+        switch (error)
+        {
+        case ERROR_OPERATION_ABORTED:
+            *timedOut = TRUE;
+            /*fall through*/
+        case ERROR_BROKEN_PIPE:
+            *bytesRead = 0U;
+            return TRUE;
+        default:
+            return FALSE;
+        }
+    }
+
+    if (!(*bytesRead))
+    {
+        *timedOut = TRUE; /*a zero-byte read on a pipe is not the end of input*/
+    }
+
+    return TRUE;
+}
+
+BOOL read_file_at(const HANDLE handle, const ULONGLONG offset, BYTE *const buffer, const DWORD size, DWORD *const bytesRead)
+{
+    OVERLAPPED overlapped;
+    SecureZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    if (!ReadFile(handle, buffer, size, bytesRead, &overlapped))
+    {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+        {
+            *bytesRead = 0U;
+            return TRUE; /*end of file*/
+        }
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOL write_file_at(const HANDLE handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten)
+{
+    OVERLAPPED overlapped;
+    SecureZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    return WriteFile(handle, buffer, size, bytesWritten, &overlapped);
+}
+
+BOOL flush_file(const HANDLE handle)
+{
+    return FlushFileBuffers(handle);
+}
+
+BOOL is_terminal(const HANDLE handle)
+{
+    DWORD mode;
+    return GetConsoleMode(handle, &mode);
+}
+
+BOOL is_null_device(const wchar_t *fileName)
+{
+    fileName = get_filename(fileName);
+    if ((to_lower(fileName[0U]) == L'n') && (to_lower(fileName[1U]) == L'u') && (to_lower(fileName[2U]) == L'l'))
+    {
+        return ((fileName[3U] == L'\0') || (fileName[3U] == L'.'));
+    }
+
+    return FALSE;
+}
+
+void enable_escape_codes(const HANDLE handle)
+{
+    DWORD mode = 0U;
+    if (GetConsoleMode(handle, &mode))
+    {
+        SetConsoleMode(handle, mode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+}
+
+static char *utf16_to_utf8(const wchar_t *const input)
+{
+    const int buff_size = WideCharToMultiByte(CP_UTF8, 0, input, -1, NULL, 0, NULL, NULL);
+    if (buff_size > 0)
+    {
+        char *const buffer = (char*)LocalAlloc(LPTR, buff_size);
+        if (buffer)
+        {
+            const int result = WideCharToMultiByte(CP_UTF8, 0, input, -1, buffer, buff_size, NULL, NULL);
+            if ((result > 0) && (result <= buff_size))
+            {
+                return buffer;
+            }
+            LocalFree(buffer);
+        }
+    }
+
+    return NULL;
+}
+
+BOOL write_text(const HANDLE handle, const wchar_t *const text)
+{
+    BOOL result = FALSE;
+    DWORD written;
+
+    if (GetConsoleMode(handle, &written))
+    {
+        result = WriteConsoleW(handle, text, lstrlenW(text), &written, NULL);
+    }
+    else
+    {
+        char *const utf8_text = utf16_to_utf8(text);
+        if (utf8_text)
+        {
+            result = WriteFile(handle, utf8_text, lstrlenA(utf8_text), &written, NULL);
+            LocalFree(utf8_text);
+        }
+    }
+
+    return result;
+}
+
+char *encode_utf8(const wchar_t *const text)
+{
+    return utf16_to_utf8(text);
+}
+
+// --------------------------------------------------------------------------
+// File mapping
+// --------------------------------------------------------------------------
+
+BOOL get_file_range(const HANDLE handle, ULONGLONG *const offset, ULONGLONG *const size)
+{
+    LARGE_INTEGER fileSize, position, zero;
+    if (GetFileType(handle) != FILE_TYPE_DISK)
+    {
+        return FALSE;
+    }
+
+    zero.QuadPart = 0;
+    if ((!GetFileSizeEx(handle, &fileSize)) || (!SetFilePointerEx(handle, zero, &position, FILE_CURRENT)) || (position.QuadPart > fileSize.QuadPart))
+    {
+        return FALSE;
+    }
+
+    *offset = (ULONGLONG)position.QuadPart;
+    *size = (ULONGLONG)(fileSize.QuadPart - position.QuadPart);
+    return TRUE;
+}
+
+BOOL set_file_position(const HANDLE handle, const ULONGLONG offset)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    return SetFilePointerEx(handle, position, NULL, FILE_BEGIN);
+}
+
+void advise_sequential(const HANDLE handle)
+{
+    UNREFERENCED_PARAMETER(handle); /*FILE_FLAG_SEQUENTIAL_SCAN can only be set by CreateFile()*/
+}
+
+DWORD get_allocation_granularity(void)
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwAllocationGranularity;
+}
+
+HANDLE create_mapping(const HANDLE handle)
+{
+    return CreateFileMappingW(handle, NULL, PAGE_READONLY, 0U, 0U, NULL);
+}
+
+void close_mapping(const HANDLE mapping)
+{
+    if (mapping)
+    {
+        CloseHandle(mapping);
+    }
+}
+
+BYTE *map_view(const HANDLE mapping, const ULONGLONG offset, const SIZE_T size)
+{
+    return (BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, size);
+}
+
+void unmap_view(BYTE *const view, const SIZE_T size)
+{
+    UNREFERENCED_PARAMETER(size);
+    UnmapViewOfFile(view);
+}
+
+// --------------------------------------------------------------------------
+// Zero-copy
+// --------------------------------------------------------------------------
+
+BOOL can_splice(const HANDLE handle)
+{
+    UNREFERENCED_PARAMETER(handle);
+    return FALSE; /*there is no tee()/splice() equivalent for pipes on Windows*/
+}
+
+BOOL create_pipe(HANDLE *const hRead, HANDLE *const hWrite, const DWORD size)
+{
+    UNREFERENCED_PARAMETER(size);
+    *hRead = *hWrite = INVALID_HANDLE_VALUE;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL tee_pipe(const HANDLE hInput, const HANDLE hOutput, const DWORD size, DWORD *const bytesCopied)
+{
+    UNREFERENCED_PARAMETER(hInput);
+    UNREFERENCED_PARAMETER(hOutput);
+    UNREFERENCED_PARAMETER(size);
+    *bytesCopied = 0U;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL splice_pipe(const HANDLE hInput, const HANDLE hOutput, const DWORD size, DWORD *const bytesMoved)
+{
+    UNREFERENCED_PARAMETER(hInput);
+    UNREFERENCED_PARAMETER(hOutput);
+    UNREFERENCED_PARAMETER(size);
+    *bytesMoved = 0U;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+// --------------------------------------------------------------------------
+// Connections
+// --------------------------------------------------------------------------
+
+static BOOL has_prefix(const wchar_t *name, const wchar_t *prefix)
+{
+    for (; *prefix != L'\0'; ++prefix, ++name)
+    {
+        if (to_lower(*name) != *prefix)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOL is_connection_name(const wchar_t *const name)
+{
+    return has_prefix(name, L"tcp://") || has_prefix(name, L"unix:") || has_prefix(name, L"\\\\.\\pipe\\");
+}
+
+static HANDLE connect_socket(const int family, const struct sockaddr *const address, const int length, const DWORD timeout)
+{
+    const SOCKET handle = WSASocketW(family, SOCK_STREAM, 0, NULL, 0U, WSA_FLAG_OVERLAPPED | WSA_FLAG_NO_HANDLE_INHERIT);
+    if (handle == INVALID_SOCKET)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    /* Connect in non-blocking mode, so that the timeout can be applied */
+    u_long nonBlocking = 1UL;
+    BOOL connected = (ioctlsocket(handle, FIONBIO, &nonBlocking) == 0) && ((connect(handle, address, length) == 0) || (WSAGetLastError() == WSAEWOULDBLOCK));
+    if (connected)
+    {
+        fd_set writable, failed;
+        const struct timeval limit = { .tv_sec = (long)(timeout / 1000U), .tv_usec = (long)((timeout % 1000U) * 1000U) };
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        FD_SET(handle, &writable);
+        FD_SET(handle, &failed);
+        connected = (select(0, NULL, &writable, &failed, &limit) > 0) && FD_ISSET(handle, &writable);
+    }
+
+    nonBlocking = 0UL;
+    if (!(connected && (ioctlsocket(handle, FIONBIO, &nonBlocking) == 0)))
+    {
+        closesocket(handle);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    if (family != AF_UNIX)
+    {
+        const DWORD noDelay = 1U;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay)); /*the stream is forwarded live*/
+    }
+
+    return (HANDLE)handle;
+}
+
+static HANDLE open_socket(const wchar_t *const name, const DWORD timeout)
+{
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    if (has_prefix(name, L"unix:"))
+    {
+        SOCKADDR_UN local;
+        zero_memory(&local, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (WideCharToMultiByte(CP_UTF8, 0U, name + 5U, -1, local.sun_path, sizeof(local.sun_path), NULL, NULL) > 0)
+        {
+            handle = connect_socket(AF_UNIX, (const struct sockaddr*)&local, sizeof(local), timeout);
+        }
+        return handle;
+    }
+
+    wchar_t host[256U];
+    const wchar_t *const start = name + 6U, *port = NULL;
+    for (const wchar_t *ptr = start; *ptr != L'\0'; ++ptr)
+    {
+        port = (*ptr == L':') ? ptr : port;
+    }
+
+    const SIZE_T hostLength = port ? ((SIZE_T)(port - start)) : ARRAYSIZE(host);
+    if (hostLength >= ARRAYSIZE(host))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    copy_memory(host, start, sizeof(wchar_t) * hostLength);
+    host[hostLength] = L'\0';
+    wchar_t *hostName = host;
+    if ((hostLength > 1U) && (host[0U] == L'[') && (host[hostLength - 1U] == L']'))
+    {
+        host[hostLength - 1U] = L'\0'; /*an IPv6 address, e.g. "[::1]:5170"*/
+        ++hostName;
+    }
+
+    ADDRINFOW hints, *result = NULL;
+    zero_memory(&hints, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (GetAddrInfoW(hostName, port + 1U, &hints, &result) == 0)
+    {
+        for (const ADDRINFOW *info = result; info && (handle == INVALID_HANDLE_VALUE); info = info->ai_next)
+        {
+            handle = connect_socket(info->ai_family, info->ai_addr, (int)info->ai_addrlen, timeout);
+        }
+        FreeAddrInfoW(result);
+    }
+
+    return handle;
+}
+
+HANDLE open_connection(const wchar_t *const name, const DWORD timeout)
+{
+    if (has_prefix(name, L"\\\\.\\pipe\\"))
+    {
+        HANDLE handle = CreateFileW(name, GENERIC_WRITE, 0U, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+        if ((handle == INVALID_HANDLE_VALUE) && (GetLastError() == ERROR_PIPE_BUSY) && WaitNamedPipeW(name, timeout))
+        {
+            handle = CreateFileW(name, GENERIC_WRITE, 0U, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL); /*an instance has become available*/
+        }
+        return handle;
+    }
+
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    const HANDLE handle = open_socket(name, timeout);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        WSACleanup(); /*each socket holds a reference*/
+    }
+
+    return handle;
+}
+
+BOOL write_connection(const HANDLE handle, const BYTE *const buffer, const DWORD size, DWORD *const bytesWritten, const DWORD timeout)
+{
+    OVERLAPPED overlapped;
+    zero_memory(&overlapped, sizeof(overlapped));
+    *bytesWritten = 0U;
+    if (!(overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL)))
+    {
+        return FALSE;
+    }
+
+    BOOL result = WriteFile(handle, buffer, size, NULL, &overlapped) || (GetLastError() == ERROR_IO_PENDING);
+    if (result && (!GetOverlappedResultEx(handle, &overlapped, bytesWritten, timeout, FALSE)))
+    {
+        if (GetLastError() == WAIT_TIMEOUT)
+        {
+            CancelIoEx(handle, &overlapped); /*the collector is stalled*/
+            GetOverlappedResult(handle, &overlapped, bytesWritten, TRUE);
+        }
+        result = FALSE;
+    }
+
+    CloseHandle(overlapped.hEvent);
+    return result;
+}
+
+void close_connection(const HANDLE handle)
+{
+    if (GetNamedPipeInfo(handle, NULL, NULL, NULL, NULL))
+    {
+        CloseHandle(handle);
+        return;
+    }
+
+    closesocket((SOCKET)handle);
+    WSACleanup();
+}
+
+// --------------------------------------------------------------------------
+// Child process
+// --------------------------------------------------------------------------
+
+static DWORD quote_argument(wchar_t *const buffer, const wchar_t *const argument)
+{
+    DWORD length = 0U;
+    BOOL quote = (argument[0U] == L'\0');
+    for (const wchar_t *ptr = argument; *ptr != L'\0'; ++ptr)
+    {
+        quote = quote || (*ptr == L' ') || (*ptr == L'\t') || (*ptr == L'"');
+    }
+
+    if (!quote)
+    {
+        for (const wchar_t *ptr = argument; *ptr != L'\0'; ++ptr)
+        {
+            buffer[length++] = *ptr;
+        }
+        return length;
+    }
+
+    /* Quote the argument, so that CommandLineToArgvW() and the CRT restore it as it is */
+    buffer[length++] = L'"';
+    for (const wchar_t *ptr = argument;; ++ptr)
+    {
+        DWORD backslashes = 0U;
+        for (; *ptr == L'\\'; ++ptr)
+        {
+            ++backslashes;
+        }
+        for (DWORD count = ((*ptr == L'"') || (*ptr == L'\0')) ? (2U * backslashes) : backslashes; count > 0U; --count)
+        {
+            buffer[length++] = L'\\'; /*only backslashes in front of a quote are escaped*/
+        }
+        if (*ptr == L'\0')
+        {
+            break;
+        }
+        if (*ptr == L'"')
+        {
+            buffer[length++] = L'\\';
+        }
+        buffer[length++] = *ptr;
+    }
+
+    buffer[length++] = L'"';
+    return length;
+}
+
+static wchar_t *build_command_line(const wchar_t *const *const argv, const DWORD argc)
+{
+    SIZE_T capacity = 1U;
+    for (DWORD index = 0U; index < argc; ++index)
+    {
+        capacity += (2U * (SIZE_T)lstrlenW(argv[index])) + 3U; /*every character may be escaped*/
+    }
+
+    wchar_t *const commandLine = (wchar_t*)alloc_memory(sizeof(wchar_t) * capacity);
+    if (commandLine)
+    {
+        DWORD length = 0U;
+        for (DWORD index = 0U; index < argc; ++index)
+        {
+            if (index)
+            {
+                commandLine[length++] = L' ';
+            }
+            length += quote_argument(commandLine + length, argv[index]);
+        }
+        commandLine[length] = L'\0';
+    }
+
+    return commandLine;
+}
+
+static void close_pipe_ends(HANDLE *const handles, const DWORD count)
+{
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        if (handles[index])
+        {
+            CloseHandle(handles[index]);
+            handles[index] = NULL;
+        }
+    }
+}
+
+BOOL start_process(const wchar_t *const *const argv, const DWORD argc, const DWORD pipeSize, HANDLE *const hStdOut, HANDLE *const hStdErr, HANDLE *const process)
+{
+    HANDLE hReadEnds[2U] = { NULL, NULL }, hWriteEnds[3U] = { NULL, NULL, NULL };
+    SECURITY_ATTRIBUTES inherit;
+    STARTUPINFOW startupInfo;
+    PROCESS_INFORMATION processInfo;
+    BOOL success = FALSE;
+
+    wchar_t *const commandLine = build_command_line(argv, argc);
+    if (!commandLine)
+    {
+        return FALSE;
+    }
+
+    zero_memory(&inherit, sizeof(inherit));
+    inherit.nLength = sizeof(inherit);
+    inherit.bInheritHandle = TRUE;
+
+    /* Only the write ends are inheritable, plus a duplicate of our standard input */
+    if (CreatePipe(&hReadEnds[0U], &hWriteEnds[0U], &inherit, pipeSize) && CreatePipe(&hReadEnds[1U], &hWriteEnds[1U], &inherit, pipeSize) && SetHandleInformation(hReadEnds[0U], HANDLE_FLAG_INHERIT, 0U) && SetHandleInformation(hReadEnds[1U], HANDLE_FLAG_INHERIT, 0U))
+    {
+        const HANDLE hStdIn = GetStdHandle(STD_INPUT_HANDLE);
+        if ((!hStdIn) || (hStdIn == INVALID_HANDLE_VALUE) || (!DuplicateHandle(GetCurrentProcess(), hStdIn, GetCurrentProcess(), &hWriteEnds[2U], 0U, TRUE, DUPLICATE_SAME_ACCESS)))
+        {
+            hWriteEnds[2U] = NULL; /*the child runs without standard input*/
+        }
+
+        zero_memory(&startupInfo, sizeof(startupInfo));
+        startupInfo.cb = sizeof(startupInfo);
+        startupInfo.dwFlags = STARTF_USESTDHANDLES;
+        startupInfo.hStdOutput = hWriteEnds[0U];
+        startupInfo.hStdError = hWriteEnds[1U];
+        startupInfo.hStdInput = hWriteEnds[2U];
+        success = CreateProcessW(NULL, commandLine, NULL, NULL, TRUE, 0U, NULL, NULL, &startupInfo, &processInfo);
+        if (success)
+        {
+            CloseHandle(processInfo.hThread);
+            *process = processInfo.hProcess;
+            *hStdOut = hReadEnds[0U];
+            *hStdErr = hReadEnds[1U];
+        }
+    }
+
+    close_pipe_ends(hWriteEnds, 3U); /*the child holds its own copies now*/
+    if (!success)
+    {
+        close_pipe_ends(hReadEnds, 2U);
+    }
+
+    free_memory(commandLine);
+    return success;
+}
+
+BOOL wait_for_input(const HANDLE *const handles, const DWORD count, DWORD *const index)
+{
+    for (DWORD round = 0U;; ++round)
+    {
+        for (DWORD offset = 1U; offset <= count; ++offset)
+        {
+            const DWORD candidate = (*index + offset) % count;
+            DWORD available = 0U;
+            if ((handles[candidate] != INVALID_HANDLE_VALUE) && ((!PeekNamedPipe(handles[candidate], NULL, 0U, NULL, &available, NULL)) || available))
+            {
+                *index = candidate; /*data or end of stream, read_file() tells which*/
+                return TRUE;
+            }
+        }
+        Sleep((round < 64U) ? 0U : 1U); /*anonymous pipes can not be waited for*/
+    }
+}
+
+BOOL wait_process(const HANDLE process, DWORD *const exitCode)
+{
+    const BOOL result = (WaitForSingleObject(process, INFINITE) == WAIT_OBJECT_0) && GetExitCodeProcess(process, exitCode);
+    CloseHandle(process);
+    return result;
+}
+
+// --------------------------------------------------------------------------
+// Asynchronous I/O
+// --------------------------------------------------------------------------
+
+typedef struct _async_request
+{
+    OVERLAPPED overlapped; /*must be the first member*/
+    void *context;
+    struct _async_request *next;
+}
+async_request_t;
+
+struct _async_queue
+{
+    HANDLE hPort;
+    async_request_t *free;
+    async_request_t requests[];
+};
+
+async_queue_t *async_create(const DWORD capacity)
+{
+    if ((!capacity) || (capacity > MAXWORD))
+    {
+        return NULL;
+    }
+
+    async_queue_t *const queue = (async_queue_t*)alloc_memory(sizeof(async_queue_t) + (sizeof(async_request_t) * capacity));
+    if (!queue)
+    {
+        return NULL;
+    }
+
+    if (!(queue->hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0U, 1U)))
+    {
+        free_memory(queue);
+        return NULL;
+    }
+
+    for (DWORD index = 0U; index < capacity; ++index)
+    {
+        queue->requests[index].next = queue->free;
+        queue->free = &queue->requests[index];
+    }
+
+    return queue;
+}
+
+void async_destroy(async_queue_t *const queue)
+{
+    if (queue)
+    {
+        CloseHandle(queue->hPort);
+        free_memory(queue);
+    }
+}
+
+BOOL async_attach(async_queue_t *const queue, const HANDLE handle)
+{
+    return (CreateIoCompletionPort(handle, queue->hPort, 0U, 0U) == queue->hPort);
+}
+
+BOOL async_write(async_queue_t *const queue, const HANDLE handle, const ULONGLONG offset, const BYTE *const buffer, const DWORD size, void *const context)
+{
+    async_request_t *const request = queue->free;
+    if (!request)
+    {
+        return FALSE;
+    }
+
+    queue->free = request->next;
+    zero_memory(&request->overlapped, sizeof(OVERLAPPED));
+    if (offset != ASYNC_NO_OFFSET)
+    {
+        request->overlapped.Offset = (DWORD)offset;
+        request->overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    }
+
+    request->context = context;
+    if ((!WriteFile(handle, buffer, size, NULL, &request->overlapped)) && (GetLastError() != ERROR_IO_PENDING))
+    {
+        request->next = queue->free;
+        queue->free = request;
+        return FALSE;
+    }
+
+    return TRUE; /*the completion is queued, even if the write has completed synchronously*/
+}
+
+void *async_wait(async_queue_t *const queue, DWORD *const bytesWritten, BOOL *const success)
+{
+    ULONG_PTR key;
+    OVERLAPPED *overlapped = NULL;
+    *success = GetQueuedCompletionStatus(queue->hPort, bytesWritten, &key, &overlapped, INFINITE);
+    if (!overlapped)
+    {
+        return NULL;
+    }
+
+    async_request_t *const request = (async_request_t*)overlapped;
+    request->next = queue->free;
+    queue->free = request;
+    return request->context;
+}
+
+// --------------------------------------------------------------------------
+// Threads
+// --------------------------------------------------------------------------
+
+BOOL create_thread(HANDLE *const thread, const thread_routine_t routine, void *const param)
+{
+    return ((*thread = CreateThread(NULL, 0U, routine, param, 0U, NULL)) != NULL);
+}
+
+BOOL join_thread(const HANDLE thread, const DWORD timeout)
+{
+    return (WaitForSingleObject(thread, timeout) == WAIT_OBJECT_0);
+}
+
+BOOL join_threads(const HANDLE *const threads, const DWORD count, const DWORD timeout)
+{
+    if (count > 0U)
+    {
+        const DWORD result = WaitForMultipleObjects(count, threads, TRUE, timeout);
+        return (result >= WAIT_OBJECT_0) && (result < WAIT_OBJECT_0 + count);
+    }
+
+    return TRUE;
+}
+
+void terminate_thread(const HANDLE thread)
+{
+    TerminateThread(thread, 1U);
+}
+
+void close_thread(const HANDLE thread)
+{
+    if (thread != NULL)
+    {
+        CloseHandle(thread);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Synchronization
+// --------------------------------------------------------------------------
+
+typedef BOOL (WINAPI *wait_on_address_t)(volatile VOID*, PVOID, SIZE_T, DWORD);
+typedef VOID (WINAPI *wake_by_address_t)(PVOID);
+
+static volatile LONG g_waitOnAddressState = 0L;
+static wait_on_address_t g_waitOnAddress = NULL;
+static wake_by_address_t g_wakeByAddressSingle = NULL, g_wakeByAddressAll = NULL;
+
+/* Fallback for Windows Vista and Windows 7, which do not have WaitOnAddress() yet */
+static SRWLOCK g_fallbackLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE g_fallbackCondVar = CONDITION_VARIABLE_INIT;
+
+static BOOL have_wait_on_address(void)
+{
+    LONG state = atomic_load_acquire(&g_waitOnAddressState);
+    if (!state)
+    {
+        const HMODULE hModule = LoadLibraryW(L"api-ms-win-core-synch-l1-2-0.dll");
+        if (hModule)
+        {
+            g_waitOnAddress = (wait_on_address_t)GetProcAddress(hModule, "WaitOnAddress");
+            g_wakeByAddressSingle = (wake_by_address_t)GetProcAddress(hModule, "WakeByAddressSingle");
+            g_wakeByAddressAll = (wake_by_address_t)GetProcAddress(hModule, "WakeByAddressAll");
+        }
+        state = (g_waitOnAddress && g_wakeByAddressSingle && g_wakeByAddressAll) ? 1L : 2L;
+        atomic_store_release(&g_waitOnAddressState, state);
+    }
+
+    return (state == 1L);
+}
+
+BOOL wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout)
+{
+    if (have_wait_on_address())
+    {
+        LONG compare = undesired;
+        return g_waitOnAddress(address, &compare, sizeof(LONG), timeout) || (GetLastError() != ERROR_TIMEOUT);
+    }
+
+    BOOL result = TRUE;
+    AcquireSRWLockExclusive(&g_fallbackLock);
+    if (atomic_load_acquire(address) == undesired)
+    {
+        result = SleepConditionVariableSRW(&g_fallbackCondVar, &g_fallbackLock, timeout, 0U) || (GetLastError() != ERROR_TIMEOUT);
+    }
+    ReleaseSRWLockExclusive(&g_fallbackLock);
+    return result;
+}
+
+void wake_by_address_single(volatile LONG *const address)
+{
+    if (have_wait_on_address())
+    {
+        g_wakeByAddressSingle((PVOID)address);
+        return;
+    }
+
+    wake_by_address_all(address); /*the fallback can not tell the waiters apart*/
+}
+
+void wake_by_address_all(volatile LONG *const address)
+{
+    if (have_wait_on_address())
+    {
+        g_wakeByAddressAll((PVOID)address);
+        return;
+    }
+
+    AcquireSRWLockExclusive(&g_fallbackLock);
+    ReleaseSRWLockExclusive(&g_fallbackLock);
+    WakeAllConditionVariable(&g_fallbackCondVar);
+}
+
+// --------------------------------------------------------------------------
+// CRT Startup
+// --------------------------------------------------------------------------
+
+int wmain(const int argc, const wchar_t *const argv[])
+{
+    return tee_main(argc, argv);
+}
+
+#ifndef _DEBUG
+#pragma warning(disable: 4702)
+
+int _startup(void)
+{
+    SetErrorMode(SEM_FAILCRITICALERRORS);
+
+    int nArgs;
+    LPWSTR *const szArglist = CommandLineToArgvW(GetCommandLineW(), &nArgs);
+    if (!szArglist)
+    {
+        OutputDebugStringA("[tee-win32] System error: Failed to initialize command-line arguments!\n");
+        ExitProcess((UINT)-1);
+    }
+
+    const int retval = tee_main(nArgs, (const wchar_t *const *)szArglist);
+    LocalFree(szArglist);
+    ExitProcess((UINT)retval);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * tee for Windows
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "include/scan.h"
+
+/*
+ * SSE2 is part of the x64 base line (and the default target of 32-Bit MSVC builds), so no run-time
+ * dispatch is required. Wider vectors (AVX2) would need a CPUID check, but do not pay off here: the
+ * search is bound by memory bandwidth, and most lines are short anyway.
+ */
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define SCAN_SSE2 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define VECTOR_SIZE 16U
+
+#if defined(SCAN_SSE2)
+
+static __forceinline DWORD lowest_bit(const DWORD mask)
+{
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (DWORD)index;
+#else
+    return (DWORD)__builtin_ctz(mask);
+#endif
+}
+
+static __forceinline DWORD highest_bit(const DWORD mask)
+{
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (DWORD)index;
+#else
+    return 31U - (DWORD)__builtin_clz(mask);
+#endif
+}
+
+static __forceinline DWORD match_mask(const BYTE *const ptr, const __m128i pattern)
+{
+    return (DWORD)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)ptr), pattern));
+}
+
+#elif defined(SCAN_NEON)
+
+/* NEON has no "movemask": narrowing each 16-Bit lane by 4 bits yields a 64-Bit mask with 4 bits per byte */
+static __forceinline ULONGLONG match_mask(const BYTE *const ptr, const uint8x16_t pattern)
+{
+    const uint8x16_t equal = vceqq_u8(vld1q_u8(ptr), pattern);
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+}
+
+static __forceinline DWORD lowest_bit(const ULONGLONG mask)
+{
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (DWORD)index;
+#else
+    return (DWORD)__builtin_ctzll(mask);
+#endif
+}
+
+static __forceinline DWORD highest_bit(const ULONGLONG mask)
+{
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return (DWORD)index;
+#else
+    return 63U - (DWORD)__builtin_clzll(mask);
+#endif
+}
+
+#endif
+
+const BYTE *scan_forward(const BYTE *begin, const BYTE *const end, const BYTE value)
+{
+#if defined(SCAN_SSE2)
+    const __m128i pattern = _mm_set1_epi8((char)value);
+    for (; (SIZE_T)(end - begin) >= (2U * VECTOR_SIZE); begin += 2U * VECTOR_SIZE)
+    {
+        const DWORD mask = match_mask(begin, pattern) | (match_mask(begin + VECTOR_SIZE, pattern) << VECTOR_SIZE);
+        if (mask)
+        {
+            return begin + lowest_bit(mask);
+        }
+    }
+#elif defined(SCAN_NEON)
+    const uint8x16_t pattern = vdupq_n_u8(value);
+    for (; (SIZE_T)(end - begin) >= VECTOR_SIZE; begin += VECTOR_SIZE)
+    {
+        const ULONGLONG mask = match_mask(begin, pattern);
+        if (mask)
+        {
+            return begin + (lowest_bit(mask) >> 2);
+        }
+    }
+#endif
+
+    for (; begin < end; ++begin)
+    {
+        if (*begin == value)
+        {
+            return begin;
+        }
+    }
+
+    return NULL;
+}
+
+const BYTE *scan_backward(const BYTE *const begin, const BYTE *end, const BYTE value)
+{
+#if defined(SCAN_SSE2)
+    const __m128i pattern = _mm_set1_epi8((char)value);
+    for (; (SIZE_T)(end - begin) >= (2U * VECTOR_SIZE); end -= 2U * VECTOR_SIZE)
+    {
+        const DWORD mask = match_mask(end - (2U * VECTOR_SIZE), pattern) | (match_mask(end - VECTOR_SIZE, pattern) << VECTOR_SIZE);
+        if (mask)
+        {
+            return end - (2U * VECTOR_SIZE) + highest_bit(mask);
+        }
+    }
+#elif defined(SCAN_NEON)
+    const uint8x16_t pattern = vdupq_n_u8(value);
+    for (; (SIZE_T)(end - begin) >= VECTOR_SIZE; end -= VECTOR_SIZE)
+    {
+        const ULONGLONG mask = match_mask(end - VECTOR_SIZE, pattern);
+        if (mask)
+        {
+            return end - VECTOR_SIZE + (highest_bit(mask) >> 2);
+        }
+    }
+#endif
+
+    while (end > begin)
+    {
+        if (*(--end) == value)
+        {
+            return end;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Counts the matches in byte-wise counters: each comparison yields 0xFF (i.e. -1) for every match,
+ * which is subtracted, and the counters are summed up before they can overflow.
+ */
+DWORD scan_count(const BYTE *begin, const BYTE *const end, const BYTE value)
+{
+    DWORD count = 0U;
+
+#if defined(SCAN_SSE2)
+    const __m128i pattern = _mm_set1_epi8((char)value), zero = _mm_setzero_si128();
+    while ((SIZE_T)(end - begin) >= VECTOR_SIZE)
+    {
+        __m128i counters = zero;
+        for (DWORD round = 0U; (round < 255U) && ((SIZE_T)(end - begin) >= VECTOR_SIZE); ++round, begin += VECTOR_SIZE)
+        {
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)begin), pattern));
+        }
+        const __m128i sums = _mm_sad_epu8(counters, zero); /*two 16-Bit sums, one per half*/
+        count += (DWORD)_mm_cvtsi128_si32(sums) + (DWORD)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+#elif defined(SCAN_NEON)
+    const uint8x16_t pattern = vdupq_n_u8(value);
+    while ((SIZE_T)(end - begin) >= VECTOR_SIZE)
+    {
+        uint8x16_t counters = vdupq_n_u8(0U);
+        for (DWORD round = 0U; (round < 255U) && ((SIZE_T)(end - begin) >= VECTOR_SIZE); ++round, begin += VECTOR_SIZE)
+        {
+            counters = vsubq_u8(counters, vceqq_u8(vld1q_u8(begin), pattern));
+        }
+        count += (DWORD)vaddlvq_u8(counters);
+    }
+#endif
+
+    for (; begin < end; ++begin)
+    {
+        count += (*begin == value) ? 1U : 0U;
+    }
+
+    return count;
+}
+
+static __forceinline BOOL equal_bytes(const BYTE *ptr1, const BYTE *ptr2, DWORD length)
+{
+    for (; length > 0U; --length)
+    {
+        if (*(ptr1++) != *(ptr2++))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Compares the first and the last byte of the string at 16 positions at once, and verifies only the
+ * candidates where both of them match. This rarely hits a false positive, even for common letters.
+ */
+const BYTE *scan_string(const BYTE *begin, const BYTE *const end, const BYTE *const string, const DWORD length)
+{
+    if (length <= 1U)
+    {
+        return length ? scan_forward(begin, end, string[0U]) : begin;
+    }
+
+    if ((SIZE_T)(end - begin) < length)
+    {
+        return NULL;
+    }
+
+    const BYTE *const last = end - length; /*the last possible start position*/
+
+#if defined(SCAN_SSE2)
+    const __m128i first = _mm_set1_epi8((char)string[0U]), final = _mm_set1_epi8((char)string[length - 1U]);
+    for (; (SIZE_T)(end - begin) >= length + VECTOR_SIZE - 1U; begin += VECTOR_SIZE)
+    {
+        for (DWORD mask = match_mask(begin, first) & match_mask(begin + length - 1U, final); mask; mask &= mask - 1U)
+        {
+            const BYTE *const candidate = begin + lowest_bit(mask);
+            if (equal_bytes(candidate + 1U, string + 1U, length - 2U))
+            {
+                return candidate;
+            }
+        }
+    }
+#elif defined(SCAN_NEON)
+    const uint8x16_t first = vdupq_n_u8(string[0U]), final = vdupq_n_u8(string[length - 1U]);
+    for (; (SIZE_T)(end - begin) >= length + VECTOR_SIZE - 1U; begin += VECTOR_SIZE)
+    {
+        for (ULONGLONG mask = match_mask(begin, first) & match_mask(begin + length - 1U, final); mask; mask &= ~(0xFULL << (lowest_bit(mask) & (~3U))))
+        {
+            const BYTE *const candidate = begin + (lowest_bit(mask) >> 2);
+            if (equal_bytes(candidate + 1U, string + 1U, length - 2U))
+            {
+                return candidate;
+            }
+        }
+    }
+#endif
+
+    for (; begin <= last; ++begin)
+    {
+        if ((begin[0U] == string[0U]) && equal_bytes(begin + 1U, string + 1U, length - 1U))
+        {
+            return begin;
+        }
+    }
+
+    return NULL;
+}
@@ -15,19 +15,44 @@
  * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
  * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
-#define WIN32_LEAN_AND_MEAN 1
-#include <Windows.h>
-#include <ShellAPI.h>
-#include <intrin.h>
+#include "include/platform.h"
+#include "include/deflate.h"
+#include "include/hash.h"
+#include "include/match.h"
+#include "include/scan.h"
 #include <stdarg.h>
 #include "include/cpu.h"
 #include "include/version.h"
 
-#pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement)
-
-#define BUFFER_SIZE (PROCESSOR_BITNESS * 128U)
-#define BUFFERS 3U
+#define DEFAULT_BUFFER_SIZE (PROCESSOR_BITNESS * 128U)
+#define DEFAULT_FILE_BUFFER_SIZE (PROCESSOR_BITNESS * 16384U)
+#define DEFAULT_BUFFERS 3U
+#define DEFAULT_BUFFERS_DECOUPLED 16U
+#define DEFAULT_DECOUPLED_BYTES 0x1000000U /*the ring that a decoupled output may lag behind, up to MAX_BUFFERS*/
+#define MIN_BUFFER_SIZE 512U
+#define MAX_BUFFER_SIZE 0x10000000U
+#define MIN_BUFFERS 2U
+#define MAX_BUFFERS 256U
 #define MAX_THREADS MAXIMUM_WAIT_OBJECTS
+#define MAX_OUTPUTS 4096U
+#define MAX_WRITERS 32U
+#define DEFAULT_MAX_DELAY 10U
+#define MAX_MAX_DELAY 60000U
+#define DEFAULT_STATS_PERIOD 1000U
+#define MIN_STATS_PERIOD 10U
+#define MAX_STATS_PERIOD 3600000U
+#define MAX_FLUSH_INTERVAL 3600000U
+#define MAX_COMPRESSORS 32U
+#define MAX_ROTATE_INTERVAL 2000000U
+#define MAX_FRAME_INTERVAL 1000U
+#define DEFAULT_FRAME_BUDGET 0x100000U
+#define MIN_FRAME_BUDGET 0x1000U
+#define MAX_FRAME_BUDGET 0x10000000U
+#define DEFAULT_FRAME_LINES 100U
+#define DEFAULT_MAP_WINDOW (PROCESSOR_BITNESS * 0x100000U)
+#define DEFAULT_PIPE_SIZE 0x100000U
+#define MAX_PIPE_SIZE 0x40000000U
+#define MAX_MAP_WINDOW (PROCESSOR_BITNESS * 0x1000000U)
 
 // --------------------------------------------------------------------------
 // Assertions
@@ -38,7 +63,7 @@
     static const wchar_t *const _message = L"[tee] Assertion Failed: " MESSAGE L"\n"; \
     if (!(CONDIATION)) { \
         write_text((HANDLE_OUT), _message); \
-        FatalExit(-1); \
+        fatal_exit(); \
     } \
 } while(0)
 #else
@@ -54,60 +79,96 @@ static wchar_t to_lower(const wchar_t c)
     return ((c >= L'A') && (c <= L'Z')) ? (L'a' + (c - L'A')) : c;
 }
 
-static BOOL is_terminal(const HANDLE handle)
+static SIZE_T string_length(const wchar_t *const str)
+{
+    const wchar_t *ptr = str;
+    while (*ptr != L'\0')
+    {
+        ++ptr;
+    }
+
+    return (SIZE_T)(ptr - str);
+}
+
+static int compare_nocase(const wchar_t *str1, const wchar_t *str2)
+{
+    for (; (*str1 != L'\0') && (to_lower(*str1) == to_lower(*str2)); ++str1, ++str2);
+    return (int)to_lower(*str1) - (int)to_lower(*str2);
+}
+
+static int compare_string(const wchar_t *str1, const wchar_t *str2)
 {
-    DWORD mode;
-    return GetConsoleMode(handle, &mode);
+    for (; (*str1 != L'\0') && (*str1 == *str2); ++str1, ++str2);
+    return (int)*str1 - (int)*str2;
 }
 
-static DWORD count_handles(const HANDLE *const array, const size_t maximum)
+static const wchar_t *format_number(wchar_t *const buffer, DWORD value)
 {
-    DWORD counter;
-    for (counter = 0U; counter < maximum; ++counter)
+    wchar_t *ptr = buffer + 10U;
+    *ptr = L'\0';
+    do
     {
-        if (!array[counter])
-        {
-            break;
-        }
+        *(--ptr) = L'0' + (wchar_t)(value % 10U);
     }
+    while (value /= 10U);
 
-    return counter;
+    return ptr;
 }
 
-static const wchar_t *get_filename(const wchar_t *filePath)
+/*
+ * 64-Bit arithmetic by shift-and-add, because 32-Bit builds must not depend on the CRT helpers
+ * (_aulldiv and friends). Only used for reporting, so speed does not matter.
+ */
+static ULONGLONG divide_u64(ULONGLONG dividend, const ULONGLONG divisor, ULONGLONG *const rest)
 {
-    for (const wchar_t *ptr = filePath; *ptr != L'\0'; ++ptr)
+    ULONGLONG quotient = 0U, remainder = 0U;
+    for (DWORD bit = 0U; (bit < 64U) && divisor; ++bit)
     {
-        if ((*ptr == L'\\') || (*ptr == L'/'))
+        remainder = (remainder << 1) | (dividend >> 63);
+        dividend <<= 1;
+        quotient <<= 1;
+        if (remainder >= divisor)
         {
-            filePath = ptr + 1U;
+            remainder -= divisor;
+            quotient |= 1U;
         }
     }
 
-    return filePath;
+    if (rest)
+    {
+        *rest = remainder;
+    }
+
+    return quotient;
 }
 
-static BOOL is_null_device(const wchar_t *filePath)
+static ULONGLONG multiply_u64(ULONGLONG value, DWORD factor)
 {
-    filePath = get_filename(filePath);
-    if ((to_lower(filePath[0U]) == L'n') && (to_lower(filePath[1U]) == L'u') && (to_lower(filePath[2U]) == L'l'))
+    ULONGLONG result = 0U;
+    for (; factor; factor >>= 1, value <<= 1)
     {
-        return ((filePath[3U] == L'\0') || (filePath[3U] == L'.'));
+        if (factor & 1U)
+        {
+            result += value;
+        }
     }
 
-    return FALSE;
+    return result;
 }
 
-static wchar_t *format_string(const wchar_t *const format, ...)
+static const wchar_t *format_number64(wchar_t *const buffer, ULONGLONG value)
 {
-    wchar_t* buffer = NULL;
-    va_list ap;
-
-    va_start(ap, format);
-    const DWORD result = FormatMessageW(FORMAT_MESSAGE_FROM_STRING | FORMAT_MESSAGE_ALLOCATE_BUFFER, format, 0U, 0U, (LPWSTR)&buffer, 1U, &ap);
-    va_end(ap);
+    wchar_t *ptr = buffer + 20U;
+    *ptr = L'\0';
+    do
+    {
+        ULONGLONG digit;
+        value = divide_u64(value, 10U, &digit);
+        *(--ptr) = L'0' + (wchar_t)digit;
+    }
+    while (value);
 
-    return result ? buffer : NULL;
+    return ptr;
 }
 
 static wchar_t *concat_va(const wchar_t *const first, ...)
@@ -116,22 +177,27 @@ static wchar_t *concat_va(const wchar_t *const first, ...)
     va_list ap;
 
     va_start(ap, first);
-    size_t len = 0U;
+    SIZE_T len = 0U;
     for (ptr = first; ptr != NULL; ptr = va_arg(ap, const wchar_t*))
     {
-        len = lstrlenW(ptr);
+        len += string_length(ptr);
     }
     va_end(ap);
 
-    wchar_t *const buffer = (wchar_t*)LocalAlloc(LPTR, sizeof(wchar_t) * (len + 1U));
+    wchar_t *const buffer = (wchar_t*)alloc_memory(sizeof(wchar_t) * (len + 1U));
     if (buffer)
     {
+        wchar_t *out = buffer;
         va_start(ap, first);
         for (ptr = first; ptr != NULL; ptr = va_arg(ap, const wchar_t*))
         {
-            lstrcatW(buffer, ptr);
+            for (const wchar_t *src = ptr; *src != L'\0'; ++src)
+            {
+                *out++ = *src;
+            }
         }
         va_end(ap);
+        *out = L'\0';
     }
 
     return buffer;
@@ -139,7 +205,40 @@ static wchar_t *concat_va(const wchar_t *const first, ...)
 
 #define CONCAT(...) concat_va(__VA_ARGS__, NULL)
 
-#define VALID_HANDLE(HANDLE) (((HANDLE) != NULL) && ((HANDLE) != INVALID_HANDLE_VALUE))
+static wchar_t *segment_name(const wchar_t *const name, const DWORD segment)
+{
+    wchar_t number[11U];
+    if (!segment)
+    {
+        return CONCAT(name);
+    }
+
+    SIZE_T dot = string_length(name);
+    for (SIZE_T pos = dot; pos > 1U; --pos)
+    {
+        const wchar_t c = name[pos - 1U];
+        if ((c == L'/') || (c == L'\\') || (c == L':'))
+        {
+            break;
+        }
+        if ((c == L'.') && (name[pos - 2U] != L'/') && (name[pos - 2U] != L'\\'))
+        {
+            dot = pos - 1U; /*a leading dot does not start an extension*/
+            break;
+        }
+    }
+
+    wchar_t *const prefix = (wchar_t*)alloc_memory(sizeof(wchar_t) * (dot + 1U));
+    if (!prefix)
+    {
+        return NULL;
+    }
+
+    copy_memory(prefix, name, sizeof(wchar_t) * dot);
+    wchar_t *const result = CONCAT(prefix, L".", format_number(number, segment), name + dot);
+    free_memory(prefix);
+    return result;
+}
 
 #define FILL_ARRAY(ARRAY, VALUE) do \
 { \
@@ -150,12 +249,12 @@ static wchar_t *concat_va(const wchar_t *const first, ...)
 } \
 while (0)
 
-#define CLOSE_HANDLE(HANDLE) do \
+#define CLOSE_FILE(HANDLE) do \
 { \
-    if (VALID_HANDLE(HANDLE)) \
+    if ((HANDLE) != INVALID_FILE) \
     { \
-        CloseHandle((HANDLE)); \
-        (HANDLE) = NULL; \
+        close_file((HANDLE)); \
+        (HANDLE) = INVALID_FILE; \
     } \
 } \
 while (0)
@@ -164,470 +263,4678 @@ while (0)
 // Console CTRL+C handler
 // --------------------------------------------------------------------------
 
-static volatile BOOL g_stop = FALSE;
-
-static BOOL WINAPI console_handler(const DWORD ctrlType)
-{
-    switch (ctrlType)
-    {
-    case CTRL_C_EVENT:
-    case CTRL_BREAK_EVENT:
-    case CTRL_CLOSE_EVENT:
-        g_stop = TRUE;
-        return TRUE;
-    default:
-        return FALSE;
-    }
-}
+static volatile BOOL g_stop = FALSE; /*set by the handler that install_stop_handler() installs*/
+static volatile LONG g_dumpSignals = 0L; /*counted by the handler that install_dump_handler() installs*/
 
 // --------------------------------------------------------------------------
 // Text output
 // --------------------------------------------------------------------------
 
-static char *utf16_to_utf8(const wchar_t *const input)
-{
-    const int buff_size = WideCharToMultiByte(CP_UTF8, 0, input, -1, NULL, 0, NULL, NULL);
-    if (buff_size > 0)
-    {
-        char *const buffer = (char*)LocalAlloc(LPTR, buff_size);
-        if (buffer)
-        {
-            const int result = WideCharToMultiByte(CP_UTF8, 0, input, -1, buffer, buff_size, NULL, NULL);
-            if ((result > 0) && (result <= buff_size))
-            {
-                return buffer;
-            }
-            LocalFree(buffer);
-        }
-    }
-
-    return NULL;
-}
-
-static BOOL write_text(const HANDLE handle, const wchar_t *const text)
-{
-    BOOL result = FALSE;
-    DWORD written;
-
-    if (GetConsoleMode(handle, &written))
-    {
-        result = WriteConsoleW(handle, text, lstrlenW(text), &written, NULL);
-    }
-    else
-    {
-        char *const utf8_text = utf16_to_utf8(text);
-        if (utf8_text)
-        {
-            result = WriteFile(handle, utf8_text, lstrlenA(utf8_text), &written, NULL);
-            LocalFree(utf8_text);
-        }
-    }
-
-    return result;
-}
-
 #define WRITE_TEXT(...) do \
 { \
     wchar_t* const _message = CONCAT(__VA_ARGS__); \
     if (_message) \
     { \
         write_text(hStdErr, _message); \
-        LocalFree(_message); \
+        free_memory(_message); \
     } \
 } \
 while (0)
 
 // --------------------------------------------------------------------------
-// Condition variables
+// Ring buffer
 // --------------------------------------------------------------------------
 
-static __forceinline void sleep_condvar_srw(const HANDLE hStdErr, const PCONDITION_VARIABLE condvar, const PSRWLOCK lock, const DWORD timeout, const BOOL sharedMode)
-{
-    const ULONG flags = sharedMode ? CONDITION_VARIABLE_LOCKMODE_SHARED : 0U;
-    if (!SleepConditionVariableSRW(condvar, lock, timeout, flags))
-    {
-        if (GetLastError() != ERROR_TIMEOUT)
-        {
-            write_text(hStdErr, L"[tee] Operating system error: SleepConditionVariableSRW() has failed!\n");
-            TerminateProcess(GetCurrentProcess(), 1U);
-        }
-    }
-}
+/*
+ * Lock-free single-producer/multi-consumer ring. The reader publishes chunk number "n" by storing
+ * "n" into the slot's sequence number, after it has set up the byte count and the pending counter.
+ * Each writer waits until the sequence number of its next slot has reached its own chunk number,
+ * and decrements the pending counter when done. The reader waits for the pending counter to drop to
+ * zero, before it refills the slot. Threads spin briefly and then wait on the address; the wake-up
+ * calls are skipped, unless somebody is actually waiting.
+ */
 
-// --------------------------------------------------------------------------
-// Writer thread
-// --------------------------------------------------------------------------
+#define SPIN_COUNT 128U
+
+static DWORD g_spinCount = 0U; /*spinning is pointless on a uni-processor system*/
 
-#define INCREMENT_INDEX(INDEX, FLAG) do \
+#define INCREMENT_INDEX(INDEX, SEQUENCE) do \
 { \
-    if (++(INDEX) >= BUFFERS) \
+    if (++(INDEX) >= g_bufferCount) \
     { \
         (INDEX) = 0U; \
-        (FLAG) = (!(FLAG)); \
     } \
+    ++(SEQUENCE); \
 } \
 while (0)
 
-typedef struct _thread
+#define SEQUENCE_DIFF(A, B) ((LONG)(((DWORD)(A)) - ((DWORD)(B)))) /*wrap-around safe*/
+
+#define MATCH_CAPACITY 1024U
+
+typedef struct _match
 {
-    HANDLE hOutput, hError;
-    BOOL flush;
+    DWORD count;
+    range_t ranges[MATCH_CAPACITY];
 }
-thread_t;
+match_t;
+
+typedef struct _slot
+{
+    BYTE *buffer, *memory; /*the chunk is either in the slot's own memory, or in the mapped input*/
+    DWORD bytesTotal, stream; /*the stream of the child process that the chunk has been read from*/
+    ULONGLONG timestamp; /*only with timestamped outputs*/
+    match_t *matches; /*the matching lines, one entry per pattern*/
+    volatile LONG sequence, pending, waiters, readerWaiting;
+}
+slot_t;
 
-static BYTE g_buffer[BUFFERS][BUFFER_SIZE];
-static DWORD g_bytesTotal[BUFFERS] = { 0U, 0U, 0U };
-static volatile LONG g_pending[BUFFERS] = { 0L, 0L, 0L };
-static SRWLOCK g_rwLocks[BUFFERS];
-static CONDITION_VARIABLE g_condIsReady[BUFFERS], g_condAllDone[BUFFERS];
+#define SLOT_ALIGNMENT 64U
+#define SLOT_SIZE ((sizeof(slot_t) + SLOT_ALIGNMENT - 1U) & (~(SLOT_ALIGNMENT - 1U)))
+#define GET_SLOT(INDEX) ((slot_t*)(g_slots + (SLOT_SIZE * (INDEX))))
 
-static DWORD WINAPI writer_thread_start_routine(const LPVOID lpThreadParameter)
+static BYTE *g_slots = NULL;
+static SIZE_T g_ringSize = 0U;
+static DWORD g_bufferSize = 0U, g_bufferCount = 0U;
+static BOOL g_largePages = FALSE;
+
+static BOOL initialize_slots(const DWORD bufferSize, const DWORD bufferCount, BOOL *const largePages)
 {
-    DWORD bytesWritten = 0U, myIndex = 0U;
-    LONG pending = 0L;
-    BOOL myFlag = TRUE, writeErrors = FALSE;
-    PSRWLOCK rwLock = NULL;
-    const thread_t *const param = (const thread_t*)lpThreadParameter;
+    const DWORD pageSize = get_page_size();
+    const DWORD slotSize = (bufferSize + pageSize - 1U) & (~(pageSize - 1U));
+    const SIZE_T headerSize = ((SLOT_SIZE * bufferCount) + pageSize - 1U) & (~((SIZE_T)pageSize - 1U));
+    if ((!bufferCount) || (slotSize > (MAXSIZE_T - headerSize) / bufferCount))
+    {
+        return FALSE;
+    }
 
-    for (;;)
+    const SIZE_T ringSize = headerSize + (((SIZE_T)slotSize) * bufferCount);
+    if (!(g_slots = alloc_pages(ringSize, largePages)))
     {
-        ASSERT(myIndex < BUFFERS, param->hError, L"Current buffer index is out of range!");
+        return FALSE;
+    }
 
-        AcquireSRWLockShared(rwLock = &g_rwLocks[myIndex]);
+    for (DWORD index = 0U; index < bufferCount; ++index)
+    {
+        slot_t *const slot = GET_SLOT(index);
+        zero_memory(slot, sizeof(slot_t));
+        slot->buffer = slot->memory = g_slots + headerSize + (((SIZE_T)slotSize) * index);
+    }
 
-        pending = g_pending[myIndex];
+    g_spinCount = (get_processor_count() > 1U) ? SPIN_COUNT : 0U;
+    g_ringSize = ringSize;
+    g_bufferSize = slotSize;
+    g_bufferCount = bufferCount;
+    g_largePages = *largePages;
+    return TRUE;
+}
 
-        while (!(myFlag ? (pending > 0L) : (pending < 0L)))
+static void release_slots(void)
+{
+    if (g_slots)
+    {
+        for (DWORD index = 0U; index < g_bufferCount; ++index)
         {
-            sleep_condvar_srw(param->hError, &g_condIsReady[myIndex], rwLock, INFINITE, TRUE);
-            pending = g_pending[myIndex];
+            free_memory(GET_SLOT(index)->matches);
         }
+        free_pages(g_slots, g_ringSize, g_largePages);
+        g_slots = NULL;
+    }
+}
 
-        const DWORD bytesTotal = g_bytesTotal[myIndex];
-        if (bytesTotal > BUFFER_SIZE)
+static __forceinline void wait_for_chunk(slot_t *const slot, const DWORD sequence)
+{
+    LONG current;
+    for (DWORD spin = 0U; SEQUENCE_DIFF(current = atomic_load_acquire(&slot->sequence), sequence) < 0L; ++spin)
+    {
+        if (spin < g_spinCount)
         {
-            ReleaseSRWLockShared(rwLock);
-            if (writeErrors)
-            {
-                write_text(param->hError, L"[tee] I/O error: Not all data could be written!\n");
-            }
-            return 0U;
+            cpu_relax();
+            continue;
         }
-
-        for (DWORD offset = 0U; offset < bytesTotal; offset += bytesWritten)
+        atomic_increment(&slot->waiters);
+        if (SEQUENCE_DIFF(current = atomic_load_acquire(&slot->sequence), sequence) < 0L)
         {
-            const BOOL result = WriteFile(param->hOutput, g_buffer[myIndex] + offset, g_bytesTotal[myIndex] - offset, &bytesWritten, NULL);
-            if ((!result) || (!bytesWritten))
-            {
-                writeErrors = TRUE;
-                break;
-            }
+            wait_on_address(&slot->sequence, current, INFINITE);
         }
+        atomic_decrement(&slot->waiters);
+    }
+}
 
-        ASSERT(g_pending > 0U, param->hError, L"Pending threads counter must be a positive value!");
+static BOOL wait_for_chunk_timeout(slot_t *const slot, const DWORD sequence, const DWORD timeout)
+{
+    const DWORD startTick = get_tick_count();
+    LONG current;
+    while (SEQUENCE_DIFF(current = atomic_load_acquire(&slot->sequence), sequence) < 0L)
+    {
+        const DWORD elapsed = get_tick_count() - startTick;
+        if (elapsed >= timeout)
+        {
+            return FALSE;
+        }
+        atomic_increment(&slot->waiters);
+        if (SEQUENCE_DIFF(current = atomic_load_acquire(&slot->sequence), sequence) < 0L)
+        {
+            wait_on_address(&slot->sequence, current, timeout - elapsed);
+        }
+        atomic_decrement(&slot->waiters);
+    }
 
-        pending = myFlag ? _InterlockedDecrement(&g_pending[myIndex]) : _InterlockedIncrement(&g_pending[myIndex]);
+    return TRUE;
+}
 
-        ReleaseSRWLockShared(rwLock);
+static __forceinline void publish_chunk(slot_t *const slot, const DWORD sequence)
+{
+    atomic_exchange(&slot->sequence, (LONG)sequence);
+    if (atomic_load_acquire(&slot->waiters))
+    {
+        wake_by_address_all(&slot->sequence);
+    }
+}
 
-        if (!pending)
+static __forceinline void wait_for_release(slot_t *const slot)
+{
+    LONG pending;
+    for (DWORD spin = 0U; (pending = atomic_load_acquire(&slot->pending)) != 0L; ++spin)
+    {
+        if (spin < g_spinCount)
         {
-            WakeConditionVariable(&g_condAllDone[myIndex]);
+            cpu_relax();
+            continue;
         }
+        atomic_exchange(&slot->readerWaiting, TRUE);
+        if ((pending = atomic_load_acquire(&slot->pending)) != 0L)
+        {
+            wait_on_address(&slot->pending, pending, INFINITE);
+        }
+        atomic_exchange(&slot->readerWaiting, FALSE);
+    }
+}
 
-        INCREMENT_INDEX(myIndex, myFlag);
-
-        if (param->flush)
+static __forceinline void release_chunk(slot_t *const slot)
+{
+    if (!atomic_decrement(&slot->pending))
+    {
+        if (atomic_load_acquire(&slot->readerWaiting))
         {
-            FlushFileBuffers(param->hOutput);
+            wake_by_address_single(&slot->pending);
         }
     }
 }
 
 // --------------------------------------------------------------------------
-// Options
+// Statistics
 // --------------------------------------------------------------------------
 
-typedef struct
-{
-    BOOL append, buffer, delay, escape, flush, help, ignore, version;
-}
-options_t;
+/*
+ * Each thread updates only its own counters, and the counters of each thread are padded to a full
+ * cache line, so that enabling the statistics does not add any contention. For the reader, "calls"
+ * are the read operations and "waitTicks" is the time spent waiting for the outputs; for a writer,
+ * "calls" are the write operations and "waitTicks" is the time spent idle, waiting for input.
+ */
 
-#define PARSE_OPTION(SHRT, NAME) do \
-{ \
-    if ((lc == L##SHRT) || (name && (lstrcmpiW(name, L#NAME) == 0))) \
-    { \
-        options->NAME = TRUE; \
-        return TRUE; \
-    } \
-} \
-while (0)
+#define READ_HISTOGRAM_SIZE 10U
 
-static BOOL parse_option(options_t *const options, const wchar_t c, const wchar_t *const name)
+static const wchar_t *const READ_HISTOGRAM_LABELS[READ_HISTOGRAM_SIZE] = { L"<64", L"<256", L"<1K", L"<4K", L"<16K", L"<64K", L"<256K", L"<1M", L"<4M", L">=4M" };
+
+typedef struct _stats
 {
-    const wchar_t lc = to_lower(c);
+    volatile ULONGLONG bytes, chunks, calls, callTicks, maxCallTicks, waitTicks;
+    volatile ULONGLONG histogram[READ_HISTOGRAM_SIZE];
+}
+stats_t;
 
-    PARSE_OPTION('a', append);
-    PARSE_OPTION('b', buffer);
-    PARSE_OPTION('d', delay);
-    PARSE_OPTION('e', escape);
-    PARSE_OPTION('f', flush);
-    PARSE_OPTION('h', help);
-    PARSE_OPTION('i', ignore);
-    PARSE_OPTION('v', version);
+#define STATS_SIZE ((sizeof(stats_t) + SLOT_ALIGNMENT - 1U) & (~(SLOT_ALIGNMENT - 1U)))
+#define GET_STATS(INDEX) ((stats_t*)(g_stats + (STATS_SIZE * (INDEX))))
+#define STATS_COUNT (MAX_OUTPUTS + 1U)
 
-    return FALSE;
-}
+static BYTE *g_stats = NULL;
+static ULONGLONG g_timestampFrequency = 1U;
 
-static BOOL parse_argument(options_t *const options, const wchar_t *const argument)
+static BOOL initialize_stats(void)
 {
-    if ((argument[0U] != L'-') || (argument[1U] == L'\0'))
+    BOOL largePages = FALSE;
+    if (!(g_stats = alloc_pages(STATS_SIZE * STATS_COUNT, &largePages)))
     {
         return FALSE;
     }
 
-    if (argument[1U] == L'-')
-    {
-        return (argument[2U] != L'\0') && parse_option(options, L'\0', argument + 2U);
-    }
-    else
+    zero_memory(g_stats, STATS_SIZE * STATS_COUNT);
+    g_timestampFrequency = get_timestamp_frequency();
+    return TRUE;
+}
+
+static void release_stats(void)
+{
+    if (g_stats)
     {
-        for (const wchar_t* ptr = argument + 1U; *ptr != L'\0'; ++ptr)
-        {
-            if (!parse_option(options, *ptr, NULL))
-            {
-                return FALSE;
-            }
-        }
-        return TRUE;
+        free_pages(g_stats, STATS_SIZE * STATS_COUNT, FALSE);
+        g_stats = NULL;
     }
 }
 
-// --------------------------------------------------------------------------
-// Help screen
-// --------------------------------------------------------------------------
-
-static void print_helpscreen(const HANDLE hStdErr, const BOOL full)
+static __forceinline void stats_record_call(stats_t *const stats, const ULONGLONG startTime, const DWORD bytes)
 {
-    wchar_t* const versionString = format_string(L"tee for Windows v%1!u!.%2!u!.%3!u! [%4!s!] [%5!s!]\n", APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_PATCH, PROCESSOR_ARCHITECTURE, TEXT(__DATE__));
-    write_text(hStdErr, versionString ? versionString : L"tee for Windows\n");
-    if (full)
+    const ULONGLONG ticks = get_timestamp() - startTime;
+    counter_add(&stats->calls, 1U);
+    counter_add(&stats->bytes, bytes);
+    counter_add(&stats->callTicks, ticks);
+    if (ticks > counter_read(&stats->maxCallTicks))
     {
-        write_text(hStdErr, L"\n"
-            L"Copy standard input to output file(s), and also to standard output.\n\n"
-            L"Usage:\n"
-            L"  gizmo.exe [...] | tee.exe [options] <file_1> ... <file_n>\n\n"
-            L"Options:\n"
-            L"  -a --append  Append to the existing file, instead of truncating\n"
-            L"  -b --buffer  Enable write combining, i.e. buffer small chunks\n"
-            L"  -e --escape  Enable standard output ANSI escape code processing\n"
-            L"  -f --flush   Flush output file after each write operation\n"
-            L"  -i --ignore  Ignore the interrupt signal (SIGINT), e.g. CTRL+C\n"
-            L"  -d --delay   Add a small delay after each read operation\n\n");
+        counter_add(&stats->maxCallTicks, ticks - counter_read(&stats->maxCallTicks));
     }
-    if (versionString)
+}
+
+static __forceinline void stats_record_read(stats_t *const stats, const ULONGLONG startTime, const DWORD bytes)
+{
+    DWORD index = 0U;
+    for (DWORD value = bytes >> 6; value && (index < READ_HISTOGRAM_SIZE - 1U); value >>= 2)
     {
-        LocalFree(versionString);
+        ++index;
     }
+
+    counter_add(&stats->histogram[index], 1U);
+    stats_record_call(stats, startTime, bytes);
+}
+
+static ULONGLONG ticks_to_micros(const ULONGLONG ticks)
+{
+    ULONGLONG fraction;
+    const ULONGLONG seconds = divide_u64(ticks, g_timestampFrequency, &fraction);
+    return multiply_u64(seconds, 1000000U) + divide_u64(multiply_u64(fraction, 1000000U), g_timestampFrequency, NULL);
+}
+
+static ULONGLONG g_clockBase = 0U, g_clockStart = 0U;
+
+static void initialize_clock(void)
+{
+    g_timestampFrequency = get_timestamp_frequency();
+    g_clockStart = get_timestamp();
+    g_clockBase = divide_u64(get_system_time(), 10U, NULL); /*microseconds since 1970*/
+}
+
+static ULONGLONG clock_micros(const ULONGLONG timestamp)
+{
+    return g_clockBase + ticks_to_micros(timestamp - g_clockStart); /*wall-clock time of a high-resolution timestamp*/
 }
 
 // --------------------------------------------------------------------------
-// MAIN
+// Output cursors
 // --------------------------------------------------------------------------
 
-int wmain(const int argc, const wchar_t *const argv[])
-{
-    HANDLE hThreads[MAX_THREADS], hMyFiles[MAX_THREADS - 1U];
-    int exitCode = 1, argOff = 1;
-    BOOL myFlag = TRUE, readErrors = FALSE;
-    DWORD fileCount = 0U, threadCount = 0U, myIndex = 0U, bytesRead = 0U, totalBytes = 0U;
-    PSRWLOCK rwLock = NULL;
-    options_t options;
-    static thread_t threadData[MAX_THREADS];
+/*
+ * With the "block" policy, the reader simply waits for the output. With the "drop" and the
+ * "disconnect" policy, the output has a cursor of its own: the writer claims each chunk by moving
+ * its cursor forward, copies the chunk to a private buffer and releases the slot right away, so
+ * that even a write that hangs can not pin the ring. If an output falls more than "maxLag" chunks
+ * behind, the reader moves the cursor forward on behalf of that output, i.e. the oldest chunks are
+ * dropped (and counted), or the output is disconnected.
+ *
+ * With the "spill" policy, the reader appends those chunks to a temporary spill file instead, and
+ * the writer drains the spill file sequentially, until it has caught up with the ring. Once the
+ * writer has drained everything, the reader starts over at the beginning of the spill file, so
+ * that the file does not grow beyond the peak backlog.
+ */
 
-    /* Initialize local variables */
-    FILL_ARRAY(hMyFiles, INVALID_HANDLE_VALUE);
-    FILL_ARRAY(hThreads, NULL);
-    SecureZeroMemory(&options, sizeof(options));
-    SecureZeroMemory(&threadData, sizeof(threadData));
+#define OVERFLOW_BLOCK 0U
+#define OVERFLOW_DROP 1U
+#define OVERFLOW_DISCONNECT 2U
+#define OVERFLOW_SPILL 3U
 
-    /* Initialize standard streams */
-    const HANDLE hStdIn = GetStdHandle(STD_INPUT_HANDLE), hStdOut = GetStdHandle(STD_OUTPUT_HANDLE), hStdErr = GetStdHandle(STD_ERROR_HANDLE);
-    if (!(VALID_HANDLE(hStdIn) && VALID_HANDLE(hStdOut) && VALID_HANDLE(hStdErr)))
-    {
-        if (VALID_HANDLE(hStdErr))
-        {
-            write_text(hStdErr, L"[tee] Operating system error: GetStdHandle() has failed!\n");
-        }
-        return -1;
-    }
+static const wchar_t *const OVERFLOW_POLICIES[] = { L"block", L"drop", L"disconnect", L"spill", NULL };
 
-    /* Initialize read/write locks and condition variables */
-    for (DWORD index = 0; index < BUFFERS; ++index)
-    {
-        InitializeSRWLock(&g_rwLocks[index]);
-        InitializeConditionVariable(&g_condIsReady[index]);
-        InitializeConditionVariable(&g_condAllDone[index]);
-    }
+#define COMPRESS_NONE 0U
+#define COMPRESS_GZIP 1U
 
-    /* Set up CRTL+C handler */
-    SetConsoleCtrlHandler(console_handler, TRUE);
+static const wchar_t *const COMPRESSION_METHODS[] = { L"none", L"gzip", NULL };
 
-    /* Parse command-line options */
-    while ((argOff < argc) && (argv[argOff][0U] == L'-') && (argv[argOff][1U] != L'\0'))
-    {
-        const wchar_t *const argValue= argv[argOff++];
-        if ((argValue[1U] == L'-') && (argValue[2U] == L'\0'))
-        {
-            break; /*stop!*/
-        }
-        else if (!parse_argument(&options, argValue))
-        {
-            WRITE_TEXT(L"[tee] Error: Invalid option \"", argValue, L"\" encountered!\n");
-            return 1;
-        }
-    }
+#define SPLIT_NONE 0U
+#define SPLIT_ROUND_ROBIN 1U
+#define SPLIT_LEAST_LOADED 2U
 
-    /* Print manual page */
-    if (options.help || options.version)
-    {
-        print_helpscreen(hStdErr, options.help);
-        return 0;
-    }
+static const wchar_t *const SPLIT_MODES[] = { L"none", L"round-robin", L"least-loaded", NULL };
 
-    /* Check output file name */
-    if (argOff >= argc)
-    {
-        write_text(hStdErr, L"[tee] Error: Output file name is missing. Type \"tee --help\" for details!\n");
-        return 1;
-    }
+#define STREAM_ALL 0U
+#define STREAM_STDOUT 1U
+#define STREAM_STDERR 2U
 
-    /* Determine input type */
-    const DWORD inputType = GetFileType(hStdIn);
-    if (inputType == FILE_TYPE_UNKNOWN)
-    {
-        if (GetLastError() != NO_ERROR)
-        {
-            write_text(hStdErr, L"[tee] Operating system error: GetFileType(hStdIn) has failed!\n");
-            return -1;
-        }
-    }
+static const wchar_t *const CHILD_STREAMS[] = { L"all", L"stdout", L"stderr", NULL };
+
+#define TIMESTAMP_LENGTH 28U /*"YYYY-MM-DDThh:mm:ss.uuuuuuZ "*/
+#define TAG_LENGTH 6U /*"[out] " or "[err] "*/
+#define PREFIX_LENGTH (TIMESTAMP_LENGTH + TAG_LENGTH)
+
+typedef struct _compress_job
+{
+    BYTE *input, *output;
+    DWORD inputSize, outputSize;
+    volatile LONG state;
+}
+compress_job_t;
+
+#define INDEX_CAPACITY 128U /*entries that are collected, before they are written to the index file*/
+
+typedef struct _index_entry
+{
+    ULONGLONG offset, line, time; /*the number of line breaks in front of "offset", the wall-clock time in microseconds since 1970*/
+}
+index_entry_t;
+
+typedef struct _seek_index
+{
+    file_handle_t hIndex;
+    ULONGLONG step, offset, lines, next, timestamp;
+    DWORD fill;
+    BYTE last;
+    BOOL writeErrors;
+    index_entry_t entries[INDEX_CAPACITY];
+}
+seek_index_t;
+
+#define NOTICE_SIZE 96U /*room in front of each frame, for the notice of skipped lines*/
+
+typedef struct _console
+{
+    file_handle_t hOutput, hError;
+    stats_t *stats;
+    BYTE *fill, *spare; /*the frame that is being filled, and the one that is (or was last) being written*/
+    const BYTE *frame;
+    DWORD fillSize, frameSize, budget, tailLines, presented;
+    ULONGLONG skippedLines, skippedBytes, totalLines, totalBytes;
+    volatile LONG state;
+    BOOL lineOpen, writeErrors; /*the last frame ended within a line*/
+}
+console_t;
+
+typedef struct _recorder
+{
+    BYTE *memory;
+    SIZE_T capacity, head; /*the next byte is recorded at "head", which is also the oldest byte, once the ring is full*/
+    ULONGLONG total, requestEnd; /*guarded by the lock*/
+    ULONGLONG dumped, lostBytes; /*owned by the dumper*/
+    DWORD dumps;
+    volatile LONG lock;
+}
+recorder_t;
+
+typedef struct _thread
+{
+    file_handle_t hOutput, hError, hSpill, hPipeRead, hPipeWrite;
+    const wchar_t *name, *match, *trigger;
+    BOOL flush;
+    DWORD flushInterval, flushBytes, flushStart;
+    ULONGLONG unflushed;
+    BOOL detached, spliceErrors; /*owned by the reader*/
+    BOOL async, writeErrors; /*owned by the writer*/
+    DWORD overflow, maxLag, dropped, spilledChunks, written, stagedBytes;
+    DWORD compress, jobCount, jobFill, jobWrite, jobsQueued, blockCount, fillStart, pattern;
+    DWORD stream, stampStream; /*the stream of the child process that the output is restricted to, and the one of the last tag*/
+    BOOL rotate, timestamps, lineOpen, strip, connection, tagged;
+    BYTE escapeState; /*carried over from one chunk to the next*/
+    DWORD rotateInterval, rotateKeep, segment, segmentStart;
+    ULONGLONG rotateSize, segmentBytes;
+    file_handle_t hNext, hRetired; /*handed over to/from the rotator*/
+    ULONGLONG spillOffset, spillPeak, drainOffset, writeOffset, writeStart, stampTime;
+    BYTE *buffer, *staging, *lines;
+    BYTE stamp[PREFIX_LENGTH]; /*the timestamp, followed by the tag*/
+    compress_job_t *jobs;
+    DWORD *queue; /*only in split mode*/
+    slot_t queued; /*"sequence" is the number of chunks that have been queued for this output*/
+    ULONGLONG indexStep;
+    seek_index_t *index;
+    console_t *console; /*only the standard output, with --frame*/
+    ULONGLONG ringSize;
+    recorder_t *recorder;
+    DWORD triggerPattern;
+    DWORD connectStart, reconnects; /*only connections*/
+    BOOL gap, inputLineOpen, peerLineOpen; /*data has been lost; the input so far, or what the peer has received, ends in the middle of a line*/
+    ULONGLONG unsentBytes;
+    stats_t *stats;
+    volatile LONG position, disconnected, spilled, drained, rewound, rotateState;
+}
+thread_t;
+
+static __forceinline BOOL claim_chunk(thread_t *const output, const DWORD sequence)
+{
+    const LONG previous = (LONG)(sequence - 1U);
+    return atomic_compare_exchange(&output->position, (LONG)sequence, previous) == previous;
+}
+
+static BOOL write_spill(thread_t *const output, const BYTE *const buffer, const DWORD size)
+{
+    DWORD bytesWritten = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesWritten)
+    {
+        if ((!write_file_at(output->hSpill, output->spillOffset, buffer + offset, size - offset, &bytesWritten)) || (!bytesWritten))
+        {
+            return FALSE;
+        }
+        output->spillOffset += bytesWritten;
+    }
+
+    return TRUE;
+}
+
+static BOOL read_spill(thread_t *const output, BYTE *const buffer, const DWORD size)
+{
+    DWORD bytesRead = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesRead)
+    {
+        if ((!read_file_at(output->hSpill, output->drainOffset, buffer + offset, size - offset, &bytesRead)) || (!bytesRead))
+        {
+            return FALSE;
+        }
+        output->drainOffset += bytesRead;
+    }
+
+    return TRUE;
+}
+
+static BOOL spill_chunk(thread_t *const output, const slot_t *const slot)
+{
+    if (output->hSpill == INVALID_FILE)
+    {
+        if ((output->hSpill = open_temp_file()) == INVALID_FILE)
+        {
+            return FALSE;
+        }
+    }
+
+    const BOOL routed = (!output->stream) || (slot->stream == output->stream); /*the other stream of the child is spilled as an empty chunk*/
+    const match_t *const match = output->match ? &slot->matches[output->pattern] : NULL;
+    DWORD bytesTotal = (match || (!routed)) ? 0U : slot->bytesTotal;
+    for (DWORD rangeId = 0U; routed && match && (rangeId < match->count); ++rangeId)
+    {
+        bytesTotal += match->ranges[rangeId].end - match->ranges[rangeId].begin; /*spill the matching lines only*/
+    }
+
+    if (!(write_spill(output, (const BYTE*)&bytesTotal, sizeof(DWORD)) && write_spill(output, (const BYTE*)&slot->stream, sizeof(DWORD)) && write_spill(output, (const BYTE*)&slot->timestamp, sizeof(ULONGLONG))))
+    {
+        return FALSE;
+    }
+
+    if (match)
+    {
+        for (DWORD rangeId = 0U; routed && (rangeId < match->count); ++rangeId)
+        {
+            if (!write_spill(output, slot->buffer + match->ranges[rangeId].begin, match->ranges[rangeId].end - match->ranges[rangeId].begin))
+            {
+                return FALSE;
+            }
+        }
+    }
+    else if (!write_spill(output, slot->buffer, bytesTotal))
+    {
+        return FALSE;
+    }
+
+    if (output->spillOffset > output->spillPeak)
+    {
+        output->spillPeak = output->spillOffset;
+    }
+
+    ++output->spilledChunks;
+    return TRUE;
+}
+
+static DWORD revoke_chunks(thread_t *const output, const DWORD index, const DWORD sequence, const DWORD target)
+{
+    for (;;)
+    {
+        const LONG position = atomic_load_acquire(&output->position);
+        const LONG count = SEQUENCE_DIFF(target, position);
+        if (count <= 0L)
+        {
+            return 0U; /*the output has caught up in the meantime*/
+        }
+        if (atomic_compare_exchange(&output->position, (LONG)target, position) == position)
+        {
+            BOOL spill = (output->overflow == OVERFLOW_SPILL) && (!output->disconnected);
+            if (spill && (atomic_load_acquire(&output->drained) == output->spilled))
+            {
+                output->spillOffset = 0U; /*the writer has drained everything, start over*/
+                atomic_exchange(&output->rewound, TRUE);
+            }
+            for (DWORD chunk = ((DWORD)position) + 1U; SEQUENCE_DIFF(chunk, target) <= 0L; ++chunk)
+            {
+                const DWORD distance = sequence - chunk;
+                slot_t *const slot = GET_SLOT((index + g_bufferCount - distance) % g_bufferCount);
+                if (spill && (!spill_chunk(output, slot)))
+                {
+                    atomic_exchange(&output->disconnected, TRUE);
+                    spill = FALSE;
+                }
+                release_chunk(slot);
+            }
+            if (output->overflow == OVERFLOW_SPILL)
+            {
+                atomic_store_release(&output->spilled, (LONG)target);
+                wake_by_address_all(&output->spilled);
+            }
+            return (DWORD)count;
+        }
+    }
+}
+
+static BOOL drain_chunk(thread_t *const output, const DWORD sequence, DWORD *const bytesTotal, DWORD *const stream, ULONGLONG *const timestamp)
+{
+    LONG spilled;
+    while (SEQUENCE_DIFF(spilled = atomic_load_acquire(&output->spilled), sequence) < 0L)
+    {
+        wait_on_address(&output->spilled, spilled, INFINITE);
+    }
+
+    if (atomic_load_acquire(&output->disconnected))
+    {
+        return FALSE;
+    }
+
+    if (atomic_exchange(&output->rewound, FALSE))
+    {
+        output->drainOffset = 0U;
+    }
+
+    const BOOL success = read_spill(output, (BYTE*)bytesTotal, sizeof(DWORD)) && ((*bytesTotal) <= g_bufferSize) && read_spill(output, (BYTE*)stream, sizeof(DWORD)) && read_spill(output, (BYTE*)timestamp, sizeof(ULONGLONG)) && read_spill(output, output->buffer, *bytesTotal);
+    atomic_store_release(&output->drained, (LONG)sequence);
+    return success;
+}
+
+// --------------------------------------------------------------------------
+// Seek index
+// --------------------------------------------------------------------------
+
+/*
+ * An output file with a seek index gets a sidecar "<file>.idx": a 16-Byte header (the magic and the
+ * index step), followed by fixed-size entries of three 64-Bit values (little-endian), i.e. a byte
+ * offset, the number of line breaks in front of it, and the wall-clock time at which the data has
+ * been read. The writer counts the line breaks of everything it writes, and records an entry at the
+ * first line start after every "step" bytes (or at twice that distance, if no line ends in between).
+ * The entries are collected in memory, and appended to the index file in batches, or whenever the
+ * output is flushed. So the index costs a vectorized count of the line breaks, plus one small write
+ * per 128 entries.
+ */
+
+#define INDEX_HEADER_SIZE 16U
+
+static const BYTE INDEX_MAGIC[8U] = { 'T','E','E','I','N','D','X','1' };
+
+static BOOL write_index(seek_index_t *const index)
+{
+    DWORD bytesWritten = 0U;
+    const DWORD size = index->fill * ((DWORD)sizeof(index_entry_t));
+    for (DWORD offset = 0U; (!index->writeErrors) && (offset < size); offset += bytesWritten)
+    {
+        if ((!write_file(index->hIndex, ((const BYTE*)index->entries) + offset, size - offset, &bytesWritten)) || (!bytesWritten))
+        {
+            index->writeErrors = TRUE; /*the index is abandoned, the output continues*/
+        }
+    }
+
+    index->fill = 0U;
+    return !index->writeErrors;
+}
+
+static seek_index_t *create_index(const wchar_t *const name, const ULONGLONG step)
+{
+    BYTE header[INDEX_HEADER_SIZE];
+    DWORD bytesWritten = 0U;
+    seek_index_t *const index = (seek_index_t*)alloc_memory(sizeof(seek_index_t));
+    wchar_t *const fileName = CONCAT(name, L".idx");
+    if (!(index && fileName && ((index->hIndex = open_file(fileName, FALSE)) != INVALID_FILE)))
+    {
+        free_memory(fileName);
+        free_memory(index);
+        return NULL;
+    }
+
+    free_memory(fileName);
+    copy_memory(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    copy_memory(header + sizeof(INDEX_MAGIC), &step, sizeof(ULONGLONG));
+    if (!(write_file(index->hIndex, header, INDEX_HEADER_SIZE, &bytesWritten) && (bytesWritten == INDEX_HEADER_SIZE)))
+    {
+        close_file(index->hIndex);
+        free_memory(index);
+        return NULL;
+    }
+
+    index->step = step;
+    return index;
+}
+
+static void record_entry(seek_index_t *const index)
+{
+    index_entry_t *const entry = &index->entries[index->fill++];
+    entry->offset = index->offset;
+    entry->line = index->lines;
+    entry->time = clock_micros(index->timestamp);
+
+    index->next = index->offset + index->step;
+    if (index->fill >= INDEX_CAPACITY)
+    {
+        write_index(index);
+    }
+}
+
+static void index_data(seek_index_t *const index, const BYTE *buffer, const DWORD size)
+{
+    const BYTE *const end = buffer + size;
+    BYTE previous = index->last;
+
+    while (buffer < end)
+    {
+        const DWORD available = (DWORD)(end - buffer);
+        if (index->offset < index->next)
+        {
+            const ULONGLONG distance = index->next - index->offset;
+            const DWORD length = (distance < available) ? ((DWORD)distance) : available;
+            index->lines += scan_count(buffer, buffer + length, '\n');
+            index->offset += length;
+            previous = (buffer += length)[-1];
+            continue;
+        }
+        if (index->offset && (previous != '\n'))
+        {
+            const ULONGLONG distance = index->next + index->step - index->offset; /*up to where a line start is awaited*/
+            const DWORD limit = (distance < available) ? ((DWORD)distance) : available;
+            const BYTE *const newline = scan_forward(buffer, buffer + limit, '\n');
+            const DWORD length = newline ? ((DWORD)(newline - buffer) + 1U) : limit;
+            index->lines += newline ? 1U : 0U;
+            index->offset += length;
+            previous = (buffer += length)[-1];
+            if ((!newline) && (limit < distance))
+            {
+                continue; /*the line goes on in the next chunk*/
+            }
+        }
+        record_entry(index);
+    }
+
+    index->last = previous;
+}
+
+// --------------------------------------------------------------------------
+// Console renderer
+// --------------------------------------------------------------------------
+
+/*
+ * A console renders text much slower than tee can read it. With --frame, the writer of the standard
+ * output merely appends the data to a frame buffer, and hands the frame over to the renderer thread
+ * once per frame interval, which writes it to the console in one go. While the renderer is busy,
+ * the next frame keeps growing; once it exceeds the budget, the older part is skipped and only the
+ * most recent lines are kept (at most half the budget), so the writer never waits for the console,
+ * and the backlog is bounded. The next frame then starts with a notice of how much has been skipped.
+ * The frames are paced by the group commit: the frame interval is the flush interval of the output,
+ * and "flushing" it presents the frame.
+ */
+
+#define CONSOLE_IDLE 0L
+#define CONSOLE_BUSY 1L
+#define CONSOLE_STOP 2L
+
+static const BYTE *find_tail(const BYTE *const begin, const BYTE *end, DWORD *const lines)
+{
+    while (*lines)
+    {
+        const BYTE *const newline = scan_backward(begin, end, '\n');
+        if (!newline)
+        {
+            return NULL;
+        }
+        end = newline;
+        --(*lines);
+    }
+
+    return end + 1U; /*right behind the line break in front of the tail*/
+}
+
+static void skip_backlog(console_t *const console, const BYTE *const buffer, const DWORD size)
+{
+    const DWORD limit = console->budget / 2U;
+    DWORD lines = console->tailLines, keepOld = 0U, keepNew;
+
+    /* Find the most recent lines, a line break at the very end does not start another line */
+    const BYTE *const end = (size && (buffer[size - 1U] == '\n')) ? (buffer + size - 1U) : (buffer + size);
+    const BYTE *const tail = find_tail(buffer, end, &lines);
+    if (tail)
+    {
+        keepNew = (DWORD)((buffer + size) - tail);
+    }
+    else
+    {
+        const BYTE *const oldTail = find_tail(console->fill, console->fill + console->fillSize, &lines);
+        keepNew = size;
+        keepOld = oldTail ? ((DWORD)((console->fill + console->fillSize) - oldTail)) : console->fillSize;
+    }
+
+    if (keepNew >= limit)
+    {
+        keepNew = limit;
+        keepOld = 0U;
+    }
+    else if (keepOld > limit - keepNew)
+    {
+        keepOld = limit - keepNew;
+    }
+
+    const DWORD skipOld = console->fillSize - keepOld, skipNew = size - keepNew;
+    console->skippedLines += scan_count(console->fill, console->fill + skipOld, '\n') + scan_count(buffer, buffer + skipNew, '\n');
+    console->skippedBytes += skipOld + skipNew;
+
+    /* Move the lines that are kept to the front, the areas may overlap */
+    for (DWORD offset = 0U; skipOld && (offset < keepOld); offset += skipOld)
+    {
+        copy_memory(console->fill + offset, console->fill + skipOld + offset, ((keepOld - offset) < skipOld) ? (keepOld - offset) : skipOld);
+    }
+
+    copy_memory(console->fill + keepOld, buffer + skipNew, keepNew);
+    console->fillSize = keepOld + keepNew;
+}
+
+static void queue_frame(console_t *const console, const BYTE *const buffer, const DWORD size)
+{
+    if (console->fillSize + size > console->budget)
+    {
+        skip_backlog(console, buffer, size);
+        return;
+    }
+
+    copy_memory(console->fill + console->fillSize, buffer, size);
+    console->fillSize += size;
+}
+
+static DWORD format_notice(BYTE *const buffer, const ULONGLONG lines, const ULONGLONG bytes, const BOOL lineOpen)
+{
+    wchar_t lineText[21U], byteText[21U];
+    const wchar_t *const parts[] = { lineOpen ? L"\n[tee] ... " : L"[tee] ... ", format_number64(lineText, lines), L" line(s) skipped, ", format_number64(byteText, bytes), L" bytes ...\n" };
+    DWORD length = 0U;
+
+    for (DWORD partId = 0U; partId < ARRAYSIZE(parts); ++partId)
+    {
+        for (const wchar_t *ptr = parts[partId]; *ptr != L'\0'; ++ptr)
+        {
+            buffer[length++] = (BYTE)(*ptr);
+        }
+    }
+
+    return length;
+}
+
+static void present_frame(thread_t *const output)
+{
+    console_t *const console = output->console;
+    if (atomic_load_acquire(&console->state) != CONSOLE_IDLE)
+    {
+        output->flushStart = get_tick_count(); /*the previous frame is still being written, try again in one frame*/
+        return;
+    }
+
+    output->unflushed = 0U;
+    if ((!console->fillSize) && (!console->skippedBytes))
+    {
+        return;
+    }
+
+    DWORD noticeSize = 0U;
+    if (console->skippedBytes)
+    {
+        BYTE notice[NOTICE_SIZE];
+        noticeSize = format_notice(notice, console->skippedLines, console->skippedBytes, console->lineOpen);
+        copy_memory(console->fill - noticeSize, notice, noticeSize);
+        console->totalLines += console->skippedLines;
+        console->totalBytes += console->skippedBytes;
+        console->skippedLines = console->skippedBytes = 0U;
+    }
+
+    BYTE *const frame = console->fill;
+    console->lineOpen = console->fillSize ? (frame[console->fillSize - 1U] != '\n') : (console->lineOpen && (!noticeSize));
+    console->frame = frame - noticeSize;
+    console->frameSize = noticeSize + console->fillSize;
+    console->fill = console->spare;
+    console->spare = frame;
+    console->fillSize = 0U;
+    console->presented = get_tick_count();
+
+    atomic_store_release(&console->state, CONSOLE_BUSY);
+    wake_by_address_single(&console->state);
+}
+
+static DWORD THREAD_API console_thread_start_routine(void *const lpThreadParameter)
+{
+    console_t *const console = (console_t*)lpThreadParameter;
+
+    for (;;)
+    {
+        LONG state;
+        while ((state = atomic_load_acquire(&console->state)) == CONSOLE_IDLE)
+        {
+            wait_on_address(&console->state, CONSOLE_IDLE, INFINITE);
+        }
+
+        if (state == CONSOLE_STOP)
+        {
+            return 0U;
+        }
+
+        DWORD bytesWritten = 0U;
+        for (DWORD offset = 0U; (!console->writeErrors) && (offset < console->frameSize); offset += bytesWritten)
+        {
+            const ULONGLONG writeStart = console->stats ? get_timestamp() : 0U;
+            const BOOL result = write_file(console->hOutput, console->frame + offset, console->frameSize - offset, &bytesWritten);
+            if (console->stats)
+            {
+                stats_record_call(console->stats, writeStart, result ? bytesWritten : 0U);
+            }
+            console->writeErrors = (!result) || (!bytesWritten);
+        }
+
+        atomic_store_release(&console->state, CONSOLE_IDLE);
+        wake_by_address_all(&console->state);
+    }
+}
+
+static void wait_for_console(console_t *const console)
+{
+    LONG state;
+    while ((state = atomic_load_acquire(&console->state)) != CONSOLE_IDLE)
+    {
+        wait_on_address(&console->state, state, INFINITE);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Flight recorder
+// --------------------------------------------------------------------------
+
+/*
+ * An output with --ring keeps only the most recent bytes, in a ring of the given size in memory,
+ * and writes them to its file only when a dump is triggered: by a line that matches the --dump-on
+ * pattern, by CTRL+BREAK (Windows) or SIGUSR1 (Linux), and at exit. The writer merely copies each
+ * chunk into the ring, while the dumper thread writes the dumps, so neither the reader nor the
+ * writer ever waits for the disk. Each dump contains the bytes that have been recorded since the
+ * previous one, but no more than the ring holds. The first dump goes to the given file, the next
+ * ones get a number in front of the extension, like the segments of a rotated output. The ring is
+ * guarded by a lock that is held only while a chunk (or a piece of a dump) is being copied; bytes
+ * that the writer overwrites before the dumper has copied them are lost for the dump.
+ */
+
+#define DUMP_PIECE_SIZE 0x100000U
+#define DUMP_POLL_INTERVAL 250U /*the signal handler merely counts, it can not wake the dumper*/
+
+#define LOCK_FREE 0L
+#define LOCK_HELD 1L
+#define LOCK_CONTENDED 2L
+
+typedef struct _dumper
+{
+    thread_t *outputs;
+    DWORD outputCount;
+    BOOL append;
+    BYTE *buffer;
+    file_handle_t hError;
+    volatile LONG stop;
+}
+dumper_t;
+
+static volatile LONG g_dumpGeneration = 0L;
+
+static void lock_recorder(recorder_t *const recorder)
+{
+    LONG state = atomic_compare_exchange(&recorder->lock, LOCK_HELD, LOCK_FREE);
+    while (state != LOCK_FREE)
+    {
+        if ((state == LOCK_CONTENDED) || (atomic_compare_exchange(&recorder->lock, LOCK_CONTENDED, LOCK_HELD) != LOCK_FREE))
+        {
+            wait_on_address(&recorder->lock, LOCK_CONTENDED, INFINITE);
+        }
+        state = atomic_compare_exchange(&recorder->lock, LOCK_CONTENDED, LOCK_FREE); /*somebody else may still be waiting*/
+    }
+}
+
+static void unlock_recorder(recorder_t *const recorder)
+{
+    if (atomic_exchange(&recorder->lock, LOCK_FREE) == LOCK_CONTENDED)
+    {
+        wake_by_address_single(&recorder->lock);
+    }
+}
+
+static void record_data(recorder_t *const recorder, const BYTE *buffer, const DWORD size)
+{
+    SIZE_T length = size;
+    if (length > recorder->capacity)
+    {
+        buffer += length - recorder->capacity; /*only the end of the chunk fits*/
+        length = recorder->capacity;
+    }
+
+    lock_recorder(recorder);
+    const SIZE_T room = recorder->capacity - recorder->head;
+    if (length < room)
+    {
+        copy_memory(recorder->memory + recorder->head, buffer, length);
+        recorder->head += length;
+    }
+    else
+    {
+        copy_memory(recorder->memory + recorder->head, buffer, room);
+        copy_memory(recorder->memory, buffer + room, length - room);
+        recorder->head = length - room;
+    }
+    recorder->total += size;
+    unlock_recorder(recorder);
+}
+
+static void request_dump(recorder_t *const recorder)
+{
+    lock_recorder(recorder);
+    recorder->requestEnd = recorder->total; /*up to the end of the chunk that has triggered the dump*/
+    unlock_recorder(recorder);
+
+    atomic_increment(&g_dumpGeneration);
+    wake_by_address_single(&g_dumpGeneration);
+}
+
+static DWORD copy_recorded(recorder_t *const recorder, BYTE *const buffer, ULONGLONG *const position, const ULONGLONG end)
+{
+    DWORD length = 0U;
+    lock_recorder(recorder);
+
+    const ULONGLONG oldest = (recorder->total > recorder->capacity) ? (recorder->total - recorder->capacity) : 0U;
+    if (*position < oldest)
+    {
+        recorder->lostBytes += ((oldest < end) ? oldest : end) - (*position); /*overwritten in the meantime*/
+        *position = oldest;
+    }
+
+    if (*position < end)
+    {
+        length = ((end - (*position)) < DUMP_PIECE_SIZE) ? ((DWORD)(end - (*position))) : DUMP_PIECE_SIZE;
+        const SIZE_T back = (SIZE_T)(recorder->total - (*position)), first = recorder->capacity - ((recorder->head >= back) ? (recorder->head - back) : (recorder->head + (recorder->capacity - back)));
+        const BYTE *const source = recorder->memory + (recorder->capacity - first);
+        copy_memory(buffer, source, (length < first) ? length : first);
+        if (length > first)
+        {
+            copy_memory(buffer + first, recorder->memory, length - first);
+        }
+        *position += length;
+    }
+
+    unlock_recorder(recorder);
+    return length;
+}
+
+static void dump_recorder(const dumper_t *const dumper, thread_t *const output, const BOOL immediate)
+{
+    const file_handle_t hStdErr = dumper->hError; /*used by WRITE_TEXT*/
+    recorder_t *const recorder = output->recorder;
+
+    lock_recorder(recorder);
+    if (immediate)
+    {
+        recorder->requestEnd = recorder->total;
+    }
+    const ULONGLONG end = recorder->requestEnd;
+    unlock_recorder(recorder);
+
+    if (end <= recorder->dumped)
+    {
+        return; /*nothing new has been recorded*/
+    }
+
+    wchar_t *const name = segment_name(output->name, recorder->dumps++);
+    const file_handle_t hDump = (recorder->dumps > 1U) ? (name ? open_file(name, dumper->append) : INVALID_FILE) : output->hOutput; /*the first dump goes to the file that has been opened at startup*/
+    if (hDump == INVALID_FILE)
+    {
+        WRITE_TEXT(L"[tee] Error: Failed to open the dump file \"", name ? name : output->name, L"\" for writing!\n");
+        free_memory(name);
+        return;
+    }
+
+    ULONGLONG position = ((end - recorder->dumped) > recorder->capacity) ? (end - recorder->capacity) : recorder->dumped;
+    BOOL writeErrors = FALSE;
+    DWORD length;
+    while ((!writeErrors) && ((length = copy_recorded(recorder, dumper->buffer, &position, end)) > 0U))
+    {
+        DWORD bytesWritten = 0U;
+        for (DWORD offset = 0U; (!writeErrors) && (offset < length); offset += bytesWritten)
+        {
+            writeErrors = (!write_file(hDump, dumper->buffer + offset, length - offset, &bytesWritten)) || (!bytesWritten);
+        }
+    }
+
+    if (writeErrors)
+    {
+        WRITE_TEXT(L"[tee] I/O error: Failed to write the dump file \"", name ? name : output->name, L"\"!\n");
+    }
+
+    if (hDump != output->hOutput)
+    {
+        close_file(hDump);
+    }
+
+    recorder->dumped = end;
+    free_memory(name);
+}
+
+static DWORD THREAD_API dumper_thread_start_routine(void *const lpThreadParameter)
+{
+    dumper_t *const param = (dumper_t*)lpThreadParameter;
+    LONG signals = 0L;
+
+    for (;;)
+    {
+        const LONG generation = atomic_load_acquire(&g_dumpGeneration);
+        const BOOL stop = atomic_load_acquire(&param->stop);
+        const LONG signalCount = atomic_load_acquire(&g_dumpSignals);
+        for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+        {
+            if (param->outputs[outputId].recorder)
+            {
+                dump_recorder(param, &param->outputs[outputId], stop || (signalCount != signals));
+            }
+        }
+        if (stop)
+        {
+            return 0U;
+        }
+        signals = signalCount;
+        wait_on_address(&g_dumpGeneration, generation, DUMP_POLL_INTERVAL);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Group commit
+// --------------------------------------------------------------------------
+
+/*
+ * With "-f" alone, the output is flushed after every chunk. With a flush interval and/or a byte
+ * threshold, the writer counts the bytes that have been written since the last flush, and flushes
+ * once the threshold has been reached, or once the oldest unflushed byte is older than the interval,
+ * whichever comes first. The flush always happens after the slot has been released, and a writer
+ * that is idle waits for the next chunk only until the interval expires, so the data that can get
+ * lost in a crash is bounded by the interval, even if the input stalls.
+ */
+
+static void flush_output(thread_t *const output)
+{
+    if (output->console)
+    {
+        present_frame(output);
+        return;
+    }
+
+    flush_file(output->hOutput);
+    output->unflushed = 0U;
+    if (output->index)
+    {
+        write_index(output->index); /*after the data it refers to*/
+    }
+}
+
+static DWORD flush_timeout(const thread_t *const output)
+{
+    if ((!output->unflushed) || (!output->flushInterval))
+    {
+        return INFINITE;
+    }
+
+    const DWORD elapsed = get_tick_count() - output->flushStart;
+    return (elapsed < output->flushInterval) ? (output->flushInterval - elapsed) : 0U;
+}
+
+static void commit_output(thread_t *const output, const DWORD bytes)
+{
+    if (!output->flush)
+    {
+        return;
+    }
+
+    if (!output->unflushed)
+    {
+        output->flushStart = output->console ? output->console->presented : get_tick_count(); /*a frame is due one interval after the previous one*/
+    }
+
+    output->unflushed += bytes;
+    if (((!output->flushInterval) && (!output->flushBytes)) || (output->flushBytes && (output->unflushed >= output->flushBytes)) || (!flush_timeout(output)))
+    {
+        flush_output(output);
+    }
+}
+
+static void wait_for_chunk_or_flush(slot_t *const slot, const DWORD sequence, thread_t *const *const outputs, const DWORD outputCount)
+{
+    for (;;)
+    {
+        DWORD timeout = INFINITE;
+        for (DWORD outputId = 0U; outputId < outputCount; ++outputId)
+        {
+            const DWORD remaining = flush_timeout(outputs[outputId]);
+            timeout = (remaining < timeout) ? remaining : timeout;
+        }
+        if (timeout == INFINITE)
+        {
+            wait_for_chunk(slot, sequence);
+            return;
+        }
+        if (timeout && wait_for_chunk_timeout(slot, sequence, timeout))
+        {
+            return;
+        }
+        for (DWORD outputId = 0U; outputId < outputCount; ++outputId)
+        {
+            if (!flush_timeout(outputs[outputId]))
+            {
+                flush_output(outputs[outputId]); /*the interval has expired while idle*/
+            }
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Connections
+// --------------------------------------------------------------------------
+
+/*
+ * An output name like "tcp://127.0.0.1:5170", "unix:/run/collector.sock" or "\\.\pipe\collector"
+ * forwards the stream to a local collector. A collector must never stall the reader or the other
+ * outputs: a connection is decoupled (with the "drop" policy, unless another one is given), so the
+ * ring slots that it may fall behind form its bounded queue, and a write gives up, if the collector
+ * has not taken any data for CONNECTION_TIMEOUT. The writer then closes the connection, discards
+ * the rest of the chunk, and tries to reconnect at most once per RECONNECT_INTERVAL, discarding
+ * the chunks in between. The same applies, if the collector is not available at startup. Once data
+ * has been lost, the stream resumes at the next line boundary, behind a marker line, so that the
+ * collector never sees a record that has been cut, nor two pieces joined across a gap.
+ */
+
+#define CONNECTION_TIMEOUT 5000U
+#define RECONNECT_INTERVAL 1000U
+
+static DWORD send_data(thread_t *const output, const BYTE *const buffer, const DWORD size)
+{
+    DWORD bytesWritten = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesWritten)
+    {
+        const ULONGLONG writeStart = output->stats ? get_timestamp() : 0U;
+        const BOOL result = write_connection(output->hOutput, buffer + offset, size - offset, &bytesWritten, CONNECTION_TIMEOUT);
+        if (output->stats)
+        {
+            stats_record_call(output->stats, writeStart, result ? bytesWritten : 0U);
+        }
+        if ((!result) || (!bytesWritten))
+        {
+            close_connection(output->hOutput);
+            output->hOutput = INVALID_FILE;
+            output->connectStart = get_tick_count();
+            output->peerLineOpen = FALSE; /*the next connection starts afresh*/
+            output->gap = TRUE;
+            return size - offset;
+        }
+    }
+
+    if (size)
+    {
+        output->peerLineOpen = (buffer[size - 1U] != '\n');
+    }
+
+    return 0U;
+}
+
+static BOOL send_output(thread_t *const output, const BYTE *const buffer, const DWORD size)
+{
+    static const char GAP_MARKER[] = "\n[tee] Warning: Data has been lost at this point!\n";
+
+    const BOOL lineOpen = output->inputLineOpen;
+    if (size)
+    {
+        output->inputLineOpen = (buffer[size - 1U] != '\n'); /*whether or not the data gets sent*/
+    }
+
+    if (output->hOutput == INVALID_FILE)
+    {
+        if ((get_tick_count() - output->connectStart) < RECONNECT_INTERVAL)
+        {
+            output->unsentBytes += size;
+            output->gap = output->gap || (size > 0U);
+            return TRUE;
+        }
+        output->connectStart = get_tick_count();
+        if ((output->hOutput = open_connection(output->name, CONNECTION_TIMEOUT)) == INVALID_FILE)
+        {
+            output->unsentBytes += size;
+            output->gap = output->gap || (size > 0U);
+            return TRUE;
+        }
+        ++output->reconnects;
+    }
+
+    DWORD offset = 0U;
+    if (output->gap)
+    {
+        if (lineOpen)
+        {
+            const BYTE *const lineEnd = scan_forward(buffer, buffer + size, '\n');
+            offset = lineEnd ? ((DWORD)(lineEnd - buffer) + 1U) : size; /*the rest of the line that has been cut*/
+            output->unsentBytes += offset;
+        }
+        if (offset >= size)
+        {
+            return TRUE;
+        }
+        const DWORD markerOffset = output->peerLineOpen ? 0U : 1U;
+        if (send_data(output, (const BYTE*)GAP_MARKER + markerOffset, (DWORD)(sizeof(GAP_MARKER) - 1U - markerOffset)))
+        {
+            output->unsentBytes += size - offset;
+            return TRUE;
+        }
+        output->gap = FALSE;
+    }
+
+    output->unsentBytes += send_data(output, buffer + offset, size - offset);
+    return TRUE; /*not a write error, the output carries on once it has reconnected*/
+}
+
+// --------------------------------------------------------------------------
+// Direct I/O
+// --------------------------------------------------------------------------
+
+/*
+ * With direct I/O, only whole pages can be written. The writer passes the page-aligned part of a
+ * chunk straight through, if the chunk starts on a page boundary (which is always the case with
+ * mapped input), and collects everything else in the "staging" buffer of the output, until at least
+ * one full page is available. The final partial page is written at the end, via write_file_tail().
+ */
+
+static DWORD g_pageMask = 0U;
+
+static BOOL write_output(thread_t *const output, const BYTE *const buffer, const DWORD size)
+{
+    if (output->connection)
+    {
+        return send_output(output, buffer, size);
+    }
+
+    DWORD bytesWritten = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesWritten)
+    {
+        const ULONGLONG writeStart = output->stats ? get_timestamp() : 0U;
+        const BOOL result = write_file(output->hOutput, buffer + offset, size - offset, &bytesWritten);
+        if (output->stats)
+        {
+            stats_record_call(output->stats, writeStart, result ? bytesWritten : 0U);
+        }
+        if ((!result) || (!bytesWritten))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL write_direct(thread_t *const output, const BYTE *buffer, DWORD size)
+{
+    while (size > 0U)
+    {
+        if ((!output->stagedBytes) && (!(((SIZE_T)buffer) & g_pageMask)) && (size > g_pageMask))
+        {
+            const DWORD length = size & (~g_pageMask);
+            if (!write_output(output, buffer, length))
+            {
+                return FALSE;
+            }
+            buffer += length;
+            size -= length;
+            continue;
+        }
+        const DWORD length = (size < (g_bufferSize - output->stagedBytes)) ? size : (g_bufferSize - output->stagedBytes);
+        copy_memory(output->staging + output->stagedBytes, buffer, length);
+        buffer += length;
+        size -= length;
+        const DWORD aligned = (output->stagedBytes += length) & (~g_pageMask);
+        if (aligned)
+        {
+            if (!write_output(output, output->staging, aligned))
+            {
+                return FALSE;
+            }
+            copy_memory(output->staging, output->staging + aligned, output->stagedBytes -= aligned); /*less than a page, does not overlap*/
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL finish_direct(thread_t *const output)
+{
+    if (!output->stagedBytes)
+    {
+        return TRUE;
+    }
+
+    const ULONGLONG writeStart = output->stats ? get_timestamp() : 0U;
+    const BOOL result = write_file_tail(output->hOutput, output->staging, output->stagedBytes);
+    if (output->stats)
+    {
+        stats_record_call(output->stats, writeStart, result ? output->stagedBytes : 0U);
+    }
+
+    output->stagedBytes = 0U;
+    return result;
+}
+
+// --------------------------------------------------------------------------
+// Rotation
+// --------------------------------------------------------------------------
+
+/*
+ * An output file with a size and/or time limit is split into segments. The first segment has the
+ * given file name; the following ones get the segment number inserted in front of the extension,
+ * e.g. "server.log", "server.1.log", "server.2.log". The rotator thread opens (and preallocates)
+ * the next segment of every rotated output in advance, so the writer merely swaps the handles when
+ * the limit is reached, and hands the previous segment back to the rotator. The rotator flushes and
+ * closes it, and deletes the segments that exceed the retention count, all off the hot path.
+ */
+
+#define ROTATE_PENDING 0L
+#define ROTATE_READY 1L
+#define ROTATE_FAILED 2L
+
+typedef struct _rotator
+{
+    thread_t *outputs;
+    DWORD outputCount;
+    BOOL append;
+    ULONGLONG preallocate;
+    file_handle_t hError;
+    volatile LONG stop;
+}
+rotator_t;
+
+static volatile LONG g_rotateGeneration = 0L;
+
+static void wake_rotator(void)
+{
+    atomic_increment(&g_rotateGeneration);
+    wake_by_address_single(&g_rotateGeneration);
+}
+
+static void rotate_output(thread_t *const output)
+{
+    const file_handle_t hStdErr = output->hError; /*used by WRITE_TEXT*/
+    LONG state;
+    while ((state = atomic_load_acquire(&output->rotateState)) == ROTATE_PENDING)
+    {
+        wait_on_address(&output->rotateState, state, INFINITE); /*the next segment is still being opened*/
+    }
+
+    output->segmentBytes = 0U;
+    output->segmentStart = get_tick_count();
+
+    if (state == ROTATE_FAILED)
+    {
+        WRITE_TEXT(L"[tee] Warning: Failed to open the next segment of \"", output->name, L"\", continuing with the current one!\n");
+        atomic_store_release(&output->rotateState, ROTATE_PENDING);
+        wake_rotator();
+        return;
+    }
+
+    if (output->staging && (!output->writeErrors))
+    {
+        output->writeErrors = !finish_direct(output); /*the final partial page of the segment*/
+    }
+
+    output->stagedBytes = 0U;
+    output->unflushed = 0U; /*the rotator flushes the previous segment*/
+    output->hRetired = output->hOutput;
+    output->hOutput = output->hNext;
+    output->hNext = INVALID_FILE;
+    ++output->segment;
+
+    atomic_store_release(&output->rotateState, ROTATE_PENDING);
+    wake_rotator();
+}
+
+static BOOL write_segment(thread_t *const output, const BYTE *const buffer, const DWORD size)
+{
+    if (output->console)
+    {
+        queue_frame(output->console, buffer, size);
+        return TRUE;
+    }
+
+    if (output->recorder)
+    {
+        record_data(output->recorder, buffer, size);
+        return TRUE;
+    }
+
+    if (output->rotate)
+    {
+        if ((output->rotateSize && output->segmentBytes && ((output->segmentBytes + size) > output->rotateSize)) || (output->rotateInterval && ((get_tick_count() - output->segmentStart) >= output->rotateInterval)))
+        {
+            rotate_output(output);
+        }
+        output->segmentBytes += size;
+    }
+
+    if (!(output->staging ? write_direct(output, buffer, size) : write_output(output, buffer, size)))
+    {
+        return FALSE;
+    }
+
+    if (output->index)
+    {
+        index_data(output->index, buffer, size);
+    }
+
+    return TRUE;
+}
+
+static void retire_segment(const rotator_t *const rotator, thread_t *const output)
+{
+    const file_handle_t hStdErr = rotator->hError; /*used by WRITE_TEXT*/
+    if (output->hRetired == INVALID_FILE)
+    {
+        return;
+    }
+
+    if (output->flush)
+    {
+        flush_file(output->hRetired);
+    }
+
+    close_file(output->hRetired);
+    output->hRetired = INVALID_FILE;
+
+    if (output->rotateKeep && (output->segment > output->rotateKeep))
+    {
+        wchar_t *const name = segment_name(output->name, output->segment - output->rotateKeep - 1U);
+        if (!(name && delete_file(name)))
+        {
+            WRITE_TEXT(L"[tee] Warning: Failed to delete an old segment of \"", output->name, L"\"!\n");
+        }
+        free_memory(name);
+    }
+}
+
+static void prepare_segment(const rotator_t *const rotator, thread_t *const output)
+{
+    wchar_t *const name = segment_name(output->name, output->segment + 1U);
+    file_handle_t hFile = INVALID_FILE;
+    if (name)
+    {
+        BOOL direct = FALSE;
+        hFile = output->staging ? open_file_direct(name, rotator->append, &direct) : open_file(name, rotator->append);
+        free_memory(name);
+    }
+
+    if ((hFile != INVALID_FILE) && rotator->preallocate)
+    {
+        preallocate_file(hFile, rotator->preallocate);
+    }
+
+    output->hNext = hFile;
+    atomic_store_release(&output->rotateState, (hFile != INVALID_FILE) ? ROTATE_READY : ROTATE_FAILED);
+    wake_by_address_all(&output->rotateState);
+}
+
+static DWORD THREAD_API rotator_thread_start_routine(void *const lpThreadParameter)
+{
+    rotator_t *const param = (rotator_t*)lpThreadParameter;
+
+    for (;;)
+    {
+        const LONG generation = atomic_load_acquire(&g_rotateGeneration);
+        const BOOL stop = atomic_load_acquire(&param->stop);
+        for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+        {
+            thread_t *const output = &param->outputs[outputId];
+            if (output->rotate && (atomic_load_acquire(&output->rotateState) == ROTATE_PENDING))
+            {
+                retire_segment(param, output);
+                if (!stop)
+                {
+                    prepare_segment(param, output);
+                }
+            }
+        }
+        if (stop)
+        {
+            break;
+        }
+        wait_on_address(&g_rotateGeneration, generation, INFINITE);
+    }
+
+    /* Remove the segments that have been prepared, but are not needed anymore */
+    for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+    {
+        thread_t *const output = &param->outputs[outputId];
+        if (output->rotate && (output->hNext != INVALID_FILE))
+        {
+            ULONGLONG position, size = 0U;
+            const BOOL empty = (!param->append) || (get_file_range(output->hNext, &position, &size) && (!size));
+            close_file(output->hNext);
+            output->hNext = INVALID_FILE;
+            if (empty)
+            {
+                wchar_t *const name = segment_name(output->name, output->segment + 1U);
+                if (name)
+                {
+                    delete_file(name);
+                    free_memory(name);
+                }
+            }
+        }
+    }
+
+    return 0U;
+}
+
+// --------------------------------------------------------------------------
+// Compression
+// --------------------------------------------------------------------------
+
+/*
+ * Compressed outputs are written by their writer thread as usual, but instead of writing the chunks,
+ * the writer collects them in blocks of COMPRESS_BLOCK_SIZE bytes and queues each full block as a
+ * compression job. A pool of compressor threads, shared by all compressed outputs, picks up the
+ * jobs in parallel and turns each block into a complete gzip member; the writer then writes the
+ * members strictly in the order of the blocks, and concatenated gzip members form a valid stream.
+ * Each output has a small ring of jobs, so a writer only waits for the compressors when all of its
+ * jobs are in flight. If the input is idle, a partial block is queued after COMPRESS_MAX_DELAY.
+ */
+
+#define COMPRESS_BLOCK_SIZE 0x40000U
+#define COMPRESS_MAX_DELAY 1000U
+#define COMPRESS_POLL_INTERVAL 10U
+
+#define JOB_FREE 0L
+#define JOB_QUEUED 1L
+#define JOB_BUSY 2L
+#define JOB_DONE 3L
+
+typedef struct _compressor
+{
+    deflate_state_t *state;
+    DWORD level;
+}
+compressor_t;
+
+static compress_job_t *g_compressJobs = NULL;
+static DWORD g_compressJobCount = 0U;
+static volatile LONG g_compressActive = 0L, g_compressGeneration = 0L;
+
+static void submit_block(thread_t *const output)
+{
+    compress_job_t *const job = &output->jobs[output->jobFill];
+    atomic_store_release(&job->state, JOB_QUEUED);
+    output->jobFill = (output->jobFill + 1U) % output->jobCount;
+    ++output->jobsQueued;
+    ++output->blockCount;
+
+    atomic_increment(&g_compressGeneration);
+    wake_by_address_single(&g_compressGeneration);
+}
+
+static void write_blocks(thread_t *const output, const DWORD maxQueued)
+{
+    while (output->jobsQueued > 0U)
+    {
+        compress_job_t *const job = &output->jobs[output->jobWrite];
+        LONG state;
+        while ((state = atomic_load_acquire(&job->state)) != JOB_DONE)
+        {
+            if (output->jobsQueued <= maxQueued)
+            {
+                return; /*still being compressed*/
+            }
+            wait_on_address(&job->state, state, INFINITE);
+        }
+        if (!output->writeErrors)
+        {
+            if (write_segment(output, job->output, job->outputSize))
+            {
+                commit_output(output, job->outputSize);
+            }
+            else
+            {
+                output->writeErrors = TRUE; /*the following members must not be written, or the stream would be corrupted*/
+            }
+        }
+        job->inputSize = 0U;
+        atomic_store_release(&job->state, JOB_FREE);
+        output->jobWrite = (output->jobWrite + 1U) % output->jobCount;
+        --output->jobsQueued;
+    }
+}
+
+static void compress_chunk(thread_t *const output, const BYTE *buffer, DWORD size)
+{
+    while (size > 0U)
+    {
+        compress_job_t *const job = &output->jobs[output->jobFill];
+        if (!job->inputSize)
+        {
+            output->fillStart = get_tick_count();
+        }
+        const DWORD length = (size < (COMPRESS_BLOCK_SIZE - job->inputSize)) ? size : (COMPRESS_BLOCK_SIZE - job->inputSize);
+        copy_memory(job->input + job->inputSize, buffer, length);
+        buffer += length;
+        size -= length;
+        if ((job->inputSize += length) >= COMPRESS_BLOCK_SIZE)
+        {
+            submit_block(output);
+            write_blocks(output, output->jobCount - 1U); /*the next job must be free*/
+        }
+    }
+}
+
+static void finish_compression(thread_t *const output)
+{
+    if (output->jobs[output->jobFill].inputSize || (!output->blockCount))
+    {
+        submit_block(output); /*an empty input still needs an (empty) gzip member*/
+    }
+
+    write_blocks(output, 0U);
+
+    if (!atomic_decrement(&g_compressActive))
+    {
+        atomic_increment(&g_compressGeneration);
+        wake_by_address_all(&g_compressGeneration); /*let the compressors exit*/
+    }
+}
+
+static void wait_for_chunk_or_idle(slot_t *const slot, const DWORD sequence, thread_t *const output)
+{
+    if (!output->jobs)
+    {
+        wait_for_chunk_or_flush(slot, sequence, &output, 1U);
+        return;
+    }
+
+    for (;;)
+    {
+        DWORD timeout = flush_timeout(output), blockTimeout = INFINITE;
+        if (output->jobs[output->jobFill].inputSize)
+        {
+            const DWORD elapsed = get_tick_count() - output->fillStart;
+            blockTimeout = (elapsed < COMPRESS_MAX_DELAY) ? (COMPRESS_MAX_DELAY - elapsed) : 0U;
+            timeout = (blockTimeout < timeout) ? blockTimeout : timeout;
+        }
+        if (output->jobsQueued && (timeout > COMPRESS_POLL_INTERVAL))
+        {
+            timeout = COMPRESS_POLL_INTERVAL; /*write the blocks as they are completed*/
+        }
+        if (timeout == INFINITE)
+        {
+            wait_for_chunk(slot, sequence);
+            return;
+        }
+        if (timeout && wait_for_chunk_timeout(slot, sequence, timeout))
+        {
+            return;
+        }
+        if (!blockTimeout)
+        {
+            submit_block(output); /*do not hold back a partial block while the input is idle*/
+        }
+        write_blocks(output, output->jobCount);
+        if (!flush_timeout(output))
+        {
+            flush_output(output);
+        }
+    }
+}
+
+static DWORD THREAD_API compressor_thread_start_routine(void *const lpThreadParameter)
+{
+    compressor_t *const param = (compressor_t*)lpThreadParameter;
+
+    for (;;)
+    {
+        const LONG generation = atomic_load_acquire(&g_compressGeneration);
+        BOOL found = FALSE;
+        for (DWORD jobId = 0U; jobId < g_compressJobCount; ++jobId)
+        {
+            compress_job_t *const job = &g_compressJobs[jobId];
+            if ((atomic_load_acquire(&job->state) == JOB_QUEUED) && (atomic_compare_exchange(&job->state, JOB_BUSY, JOB_QUEUED) == JOB_QUEUED))
+            {
+                job->outputSize = gzip_compress(param->state, job->input, job->inputSize, job->output, param->level);
+                atomic_store_release(&job->state, JOB_DONE);
+                wake_by_address_all(&job->state);
+                found = TRUE;
+            }
+        }
+        if (!found)
+        {
+            if (!atomic_load_acquire(&g_compressActive))
+            {
+                return 0U;
+            }
+            wait_on_address(&g_compressGeneration, generation, INFINITE);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Escape stripping
+// --------------------------------------------------------------------------
+
+/*
+ * Outputs with --strip-ansi receive the data without the ANSI/VT escape sequences, i.e. without the
+ * colors. Runs of plain text are found by a vectorized search for the ESC character and copied as a
+ * whole; only the sequences themselves are parsed byte by byte (ECMA-48): CSI "ESC [" up to a final
+ * byte, the control strings OSC, DCS, SOS, PM and APC up to BEL or ST, and any other "ESC" with its
+ * intermediate and final bytes. The parser state is kept per output, so a sequence may be split
+ * across chunks. Control characters within a sequence are passed on, as a terminal would execute
+ * them, except for CAN and SUB, which cancel the sequence.
+ */
+
+#define ESCAPE_NONE 0U
+#define ESCAPE_START 1U
+#define ESCAPE_INTERMEDIATE 2U
+#define ESCAPE_CSI 3U
+#define ESCAPE_STRING 4U
+
+static DWORD strip_escapes(BYTE *const state, BYTE *const output, const BYTE *input, const DWORD size)
+{
+    const BYTE *const end = input + size;
+    BYTE *ptr = output, current = *state;
+
+    while (input < end)
+    {
+        if (current == ESCAPE_NONE)
+        {
+            const BYTE *const escape = scan_forward(input, end, 0x1B);
+            const DWORD length = (DWORD)((escape ? escape : end) - input);
+            copy_memory(ptr, input, length);
+            ptr += length;
+            input += length;
+            if (escape)
+            {
+                current = ESCAPE_START;
+                ++input;
+            }
+            continue;
+        }
+
+        const BYTE c = *(input++);
+        if ((c == 0x1B) || (c == 0x18) || (c == 0x1A))
+        {
+            current = (c == 0x1B) ? ESCAPE_START : ESCAPE_NONE; /*ST ("ESC \") ends a string as a sequence of its own*/
+            continue;
+        }
+        if (current == ESCAPE_STRING)
+        {
+            current = (c == 0x07) ? ESCAPE_NONE : ESCAPE_STRING;
+            continue;
+        }
+        if (c < 0x20)
+        {
+            *(ptr++) = c;
+            continue;
+        }
+
+        switch (current)
+        {
+        case ESCAPE_START:
+            if (c == '[')
+            {
+                current = ESCAPE_CSI;
+            }
+            else if ((c == ']') || (c == 'P') || (c == 'X') || (c == '^') || (c == '_'))
+            {
+                current = ESCAPE_STRING;
+            }
+            else
+            {
+                current = (c < 0x30) ? ESCAPE_INTERMEDIATE : ESCAPE_NONE;
+            }
+            break;
+        case ESCAPE_INTERMEDIATE:
+            current = ((c >= 0x30) && (c <= 0x7E)) ? ESCAPE_NONE : ESCAPE_INTERMEDIATE;
+            break;
+        default:
+            current = ((c >= 0x40) && (c <= 0x7E)) ? ESCAPE_NONE : ESCAPE_CSI;
+        }
+    }
+
+    *state = current;
+    return (DWORD)(ptr - output);
+}
+
+// --------------------------------------------------------------------------
+// Line mode
+// --------------------------------------------------------------------------
+
+/*
+ * In line mode, the reader publishes whole lines only: the partial line at the end of a chunk is
+ * carried over into the next slot (or, for mapped input, the next chunk simply starts there). A line
+ * is only split, if it does not fit into a buffer, or if it is not completed within "maxDelay". The
+ * reader stamps each chunk with the time it was published, and the writer of a timestamped output
+ * copies the lines into a buffer of its own, each prefixed with the wall-clock time of its chunk.
+ * In child mode, each chunk comes from one stream of the child, so a tagged output prefixes the
+ * lines with the tag of that stream in the same way (after the timestamp, if any).
+ */
+
+static const BYTE TIMESTAMP_TEMPLATE[TIMESTAMP_LENGTH] = { '0','0','0','0','-','0','0','-','0','0','T','0','0',':','0','0',':','0','0','.','0','0','0','0','0','0','Z',' ' };
+static const BYTE STREAM_TAGS[2U][TAG_LENGTH] = { { '[','o','u','t',']',' ' }, { '[','e','r','r',']',' ' } };
+
+static void put_digits(BYTE *const buffer, DWORD value, DWORD count)
+{
+    while (count > 0U)
+    {
+        buffer[--count] = (BYTE)('0' + (value % 10U));
+        value /= 10U;
+    }
+}
+
+static void format_timestamp(BYTE *const buffer, const ULONGLONG timestamp)
+{
+    ULONGLONG micros, seconds;
+    const DWORD days = (DWORD)divide_u64(divide_u64(clock_micros(timestamp), 1000000U, &micros), 86400U, &seconds);
+
+    /* Civil date from the number of days since 1970-01-01 (proleptic Gregorian calendar) */
+    const DWORD dayNumber = days + 719468U, era = dayNumber / 146097U, dayOfEra = dayNumber - (era * 146097U);
+    const DWORD yearOfEra = (dayOfEra - (dayOfEra / 1460U) + (dayOfEra / 36524U) - (dayOfEra / 146096U)) / 365U;
+    const DWORD dayOfYear = dayOfEra - ((365U * yearOfEra) + (yearOfEra / 4U) - (yearOfEra / 100U)), monthIndex = ((5U * dayOfYear) + 2U) / 153U;
+    const DWORD month = (monthIndex < 10U) ? (monthIndex + 3U) : (monthIndex - 9U);
+
+    copy_memory(buffer, TIMESTAMP_TEMPLATE, TIMESTAMP_LENGTH);
+    put_digits(buffer, yearOfEra + (era * 400U) + ((month <= 2U) ? 1U : 0U), 4U);
+    put_digits(buffer + 5U, month, 2U);
+    put_digits(buffer + 8U, dayOfYear - (((153U * monthIndex) + 2U) / 5U) + 1U, 2U);
+    put_digits(buffer + 11U, ((DWORD)seconds) / 3600U, 2U);
+    put_digits(buffer + 14U, (((DWORD)seconds) / 60U) % 60U, 2U);
+    put_digits(buffer + 17U, ((DWORD)seconds) % 60U, 2U);
+    put_digits(buffer + 20U, (DWORD)micros, 6U);
+}
+
+static BOOL emit_lines(thread_t *const output, const DWORD size)
+{
+    if (output->jobs)
+    {
+        compress_chunk(output, output->lines, size);
+        return TRUE;
+    }
+
+    return write_segment(output, output->lines, size);
+}
+
+static BOOL write_lines(thread_t *const output, const BYTE *const buffer, const range_t *const ranges, const DWORD rangeCount, const ULONGLONG timestamp, const DWORD stream)
+{
+    const DWORD stampStart = output->timestamps ? 0U : TIMESTAMP_LENGTH, stampLength = (output->timestamps ? TIMESTAMP_LENGTH : 0U) + (output->tagged ? TAG_LENGTH : 0U);
+    DWORD fill = 0U;
+
+    if (output->timestamps && (timestamp != output->stampTime))
+    {
+        format_timestamp(output->stamp, timestamp);
+        output->stampTime = timestamp;
+    }
+
+    if (output->tagged && (stream != output->stampStream))
+    {
+        copy_memory(output->stamp + TIMESTAMP_LENGTH, STREAM_TAGS[(stream == STREAM_STDERR) ? 1U : 0U], TAG_LENGTH);
+        output->stampStream = stream;
+        output->lineOpen = FALSE; /*a line that the other stream has left open gets a tag, too*/
+    }
+
+    for (DWORD rangeId = 0U; rangeId < rangeCount; ++rangeId)
+    {
+        const BYTE *ptr = buffer + ranges[rangeId].begin, *const end = buffer + ranges[rangeId].end;
+        if (ranges[rangeId].begin)
+        {
+            output->lineOpen = FALSE; /*the range starts right after a line break*/
+            output->escapeState = ESCAPE_NONE;
+        }
+        while (ptr < end)
+        {
+            const BYTE *const newline = stampLength ? scan_forward(ptr, end, '\n') : NULL; /*without a prefix, the range is copied as a whole*/
+            const DWORD length = newline ? ((DWORD)(newline - ptr) + 1U) : ((DWORD)(end - ptr));
+            const DWORD prefix = output->lineOpen ? 0U : stampLength; /*a line that has been split is not stamped twice*/
+            if (fill + prefix + length > g_bufferSize + PREFIX_LENGTH)
+            {
+                if (!emit_lines(output, fill))
+                {
+                    return FALSE;
+                }
+                fill = 0U;
+            }
+            copy_memory(output->lines + fill, output->stamp + stampStart, prefix);
+            if (output->strip)
+            {
+                fill += prefix + strip_escapes(&output->escapeState, output->lines + fill + prefix, ptr, length);
+            }
+            else
+            {
+                copy_memory(output->lines + fill + prefix, ptr, length);
+                fill += prefix + length;
+            }
+            ptr += length;
+            output->lineOpen = (ptr[-1] != '\n');
+        }
+    }
+
+    return (!fill) || emit_lines(output, fill);
+}
+
+// --------------------------------------------------------------------------
+// Line routing
+// --------------------------------------------------------------------------
+
+/*
+ * Outputs with a --match pattern receive only the matching lines. The reader classifies each chunk
+ * once, right before it is published: for every distinct pattern, it records the ranges of the
+ * matching lines in the slot, so all outputs with the same pattern share the result. The writers
+ * then copy just those ranges; decoupled outputs do so already when they claim the chunk (or when
+ * it is spilled), so that only the matching lines take up space. If a chunk has more matching runs
+ * of lines than a slot can record, the reader publishes it partially and carries over the rest.
+ */
+
+static pattern_t *g_patterns[2U * MAX_THREADS]; /*the --match and the --dump-on patterns*/
+static const wchar_t *g_patternTexts[2U * MAX_THREADS];
+static DWORD g_patternCount = 0U;
+
+static BOOL register_pattern(const wchar_t *const pattern, DWORD *const patternId)
+{
+    for (*patternId = 0U; *patternId < g_patternCount; ++(*patternId))
+    {
+        if (!compare_string(g_patternTexts[*patternId], pattern))
+        {
+            return TRUE; /*same pattern as a previous output*/
+        }
+    }
+
+    char *const text = encode_utf8(pattern);
+    if (!(text && (g_patterns[g_patternCount] = pattern_create(text))))
+    {
+        free_memory(text);
+        return FALSE;
+    }
+
+    free_memory(text);
+    g_patternTexts[g_patternCount++] = pattern;
+    return TRUE;
+}
+
+static DWORD classify_chunk(slot_t *const slot, const BYTE *const buffer, DWORD limit)
+{
+    for (DWORD patternId = 0U; patternId < g_patternCount; ++patternId)
+    {
+        match_t *const match = &slot->matches[patternId];
+        match->count = pattern_scan(g_patterns[patternId], buffer, &limit, match->ranges, MATCH_CAPACITY);
+    }
+
+    for (DWORD patternId = 0U; patternId < g_patternCount; ++patternId)
+    {
+        match_t *const match = &slot->matches[patternId];
+        while (match->count && (match->ranges[match->count - 1U].begin >= limit))
+        {
+            --match->count; /*the chunk has been cut short by a later pattern*/
+        }
+        if (match->count && (match->ranges[match->count - 1U].end > limit))
+        {
+            match->ranges[match->count - 1U].end = limit;
+        }
+    }
+
+    return limit;
+}
+
+static DWORD gather_matches(const match_t *const match, const BYTE *const buffer, BYTE *const output)
+{
+    DWORD size = 0U;
+    for (DWORD rangeId = 0U; rangeId < match->count; ++rangeId)
+    {
+        const DWORD length = match->ranges[rangeId].end - match->ranges[rangeId].begin;
+        copy_memory(output + size, buffer + match->ranges[rangeId].begin, length);
+        size += length;
+    }
+
+    return size;
+}
+
+// --------------------------------------------------------------------------
+// Split mode
+// --------------------------------------------------------------------------
+
+/*
+ * With --split, each chunk goes to exactly one output. The reader sets the pending counter of the
+ * slot to one and appends the index of the slot to the queue of the chosen output, so it waits for
+ * that output only. Each output has a queue of "g_bufferCount" entries, which is always enough,
+ * because every queued chunk pins a slot. The writer waits on the "queued" counter of its queue in
+ * the same way as it would wait on a slot, and publishes the number of chunks it has completed in
+ * its "position" field, so that the reader can tell how many chunks are still queued.
+ */
+
+static thread_t *select_output(thread_t *const *const outputs, const DWORD outputCount, const DWORD mode, DWORD *const cursor)
+{
+    DWORD selected = *cursor;
+    if (mode == SPLIT_LEAST_LOADED)
+    {
+        LONG minimum = MAXLONG;
+        for (DWORD offset = 0U; offset < outputCount; ++offset)
+        {
+            const DWORD outputId = (*cursor + offset) % outputCount; /*ties are broken round-robin*/
+            const LONG load = SEQUENCE_DIFF(outputs[outputId]->queued.sequence, atomic_load_acquire(&outputs[outputId]->position));
+            if (load < minimum)
+            {
+                minimum = load;
+                selected = outputId;
+            }
+        }
+    }
+
+    *cursor = (selected + 1U) % outputCount;
+    return outputs[selected];
+}
+
+static __forceinline void queue_chunk(thread_t *const output, const DWORD index)
+{
+    const DWORD queued = (DWORD)output->queued.sequence; /*only the reader ever modifies it*/
+    output->queue[queued % g_bufferCount] = index;
+    publish_chunk(&output->queued, queued + 1U);
+}
+
+// --------------------------------------------------------------------------
+// Writer thread
+// --------------------------------------------------------------------------
+
+static DWORD THREAD_API writer_thread_start_routine(void *const lpThreadParameter)
+{
+    DWORD myIndex = 0U, mySequence = 1U;
+    thread_t *const param = (thread_t*)lpThreadParameter;
+    stats_t *const stats = param->stats;
+    const BOOL decoupled = (param->overflow != OVERFLOW_BLOCK);
+
+    for (;;)
+    {
+        ASSERT(myIndex < g_bufferCount, param->hError, L"Current buffer index is out of range!");
+
+        slot_t *const next = param->queue ? &param->queued : GET_SLOT(myIndex);
+        if (stats)
+        {
+            const ULONGLONG waitStart = get_timestamp();
+            wait_for_chunk_or_idle(next, mySequence, param);
+            counter_add(&stats->waitTicks, get_timestamp() - waitStart);
+        }
+        else
+        {
+            wait_for_chunk_or_idle(next, mySequence, param);
+        }
+
+        slot_t *const slot = param->queue ? GET_SLOT(param->queue[(mySequence - 1U) % g_bufferCount]) : next;
+
+        const BYTE *buffer = NULL; /*decoupled outputs must not touch the slot, before they have claimed it*/
+        ULONGLONG timestamp = 0U;
+        DWORD bytesTotal, stream = STREAM_ALL;
+
+        if (decoupled)
+        {
+            if (atomic_load_acquire(&param->disconnected))
+            {
+                if (param->jobs)
+                {
+                    finish_compression(param);
+                }
+                return 0U;
+            }
+            if (claim_chunk(param, mySequence))
+            {
+                if ((bytesTotal = slot->bytesTotal) <= g_bufferSize)
+                {
+                    stream = slot->stream;
+                    if (param->stream && (stream != param->stream))
+                    {
+                        bytesTotal = 0U; /*the other stream of the child process*/
+                    }
+                    else if (param->match)
+                    {
+                        bytesTotal = gather_matches(&slot->matches[param->pattern], slot->buffer, param->buffer);
+                    }
+                    else
+                    {
+                        copy_memory(param->buffer, slot->buffer, bytesTotal);
+                    }
+                    timestamp = slot->timestamp;
+                    buffer = param->buffer;
+                }
+                release_chunk(slot);
+            }
+            else if (param->overflow == OVERFLOW_SPILL)
+            {
+                if (!drain_chunk(param, mySequence, &bytesTotal, &stream, &timestamp))
+                {
+                    atomic_exchange(&param->disconnected, TRUE);
+                    if (param->jobs)
+                    {
+                        finish_compression(param);
+                    }
+                    return 0U;
+                }
+                buffer = param->buffer;
+            }
+            else
+            {
+                const DWORD skipped = ((DWORD)atomic_load_acquire(&param->position)) - (mySequence - 1U);
+                myIndex = (myIndex + (skipped % g_bufferCount)) % g_bufferCount;
+                mySequence += skipped;
+                if (param->connection)
+                {
+                    param->gap = param->inputLineOpen = TRUE; /*where the skipped chunks ended is unknown*/
+                }
+                continue; /*chunks have been dropped*/
+            }
+        }
+        else
+        {
+            buffer = slot->buffer;
+            bytesTotal = slot->bytesTotal;
+            stream = slot->stream;
+            timestamp = slot->timestamp;
+        }
+
+        if (bytesTotal > g_bufferSize)
+        {
+            if (param->jobs)
+            {
+                finish_compression(param); /*the final block*/
+            }
+            if (param->staging && (!param->writeErrors))
+            {
+                param->writeErrors = !finish_direct(param); /*the final partial page*/
+            }
+            if (param->writeErrors)
+            {
+                write_text(param->hError, L"[tee] I/O error: Not all data could be written!\n");
+            }
+            return 0U;
+        }
+
+        if (param->index)
+        {
+            param->index->timestamp = timestamp; /*for the entries that are recorded within this chunk*/
+        }
+
+        const BOOL routed = (!param->stream) || (stream == param->stream);
+        if (!routed)
+        {
+            bytesTotal = 0U; /*the chunk belongs to the other stream of the child process*/
+        }
+        else if (param->lines)
+        {
+            const range_t chunk = { 0U, bytesTotal };
+            const match_t *const match = (param->match && (!decoupled)) ? &slot->matches[param->pattern] : NULL; /*decoupled outputs have copied the matching lines only*/
+            if (!(match ? write_lines(param, buffer, match->ranges, match->count, timestamp, stream) : write_lines(param, buffer, &chunk, 1U, timestamp, stream)))
+            {
+                param->writeErrors = TRUE;
+            }
+        }
+        else if (param->jobs)
+        {
+            compress_chunk(param, buffer, bytesTotal);
+        }
+        else if (!write_segment(param, buffer, bytesTotal))
+        {
+            param->writeErrors = TRUE;
+        }
+
+        if (param->trigger && routed && slot->matches[param->triggerPattern].count)
+        {
+            request_dump(param->recorder); /*a flight recorder is never decoupled, so the slot is still pinned*/
+        }
+
+        if (stats)
+        {
+            counter_add(&stats->chunks, 1U);
+        }
+
+        if (!decoupled)
+        {
+            ASSERT(atomic_load_acquire(&slot->pending) > 0L, param->hError, L"Pending threads counter must be a positive value!");
+            release_chunk(slot);
+            if (param->queue)
+            {
+                atomic_store_release(&param->position, (LONG)mySequence); /*the completed chunks*/
+            }
+        }
+
+        INCREMENT_INDEX(myIndex, mySequence);
+
+        if (param->jobs)
+        {
+            write_blocks(param, param->jobCount); /*the blocks that have been completed in the meantime*/
+        }
+        else
+        {
+            commit_output(param, bytesTotal);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Writer pool
+// --------------------------------------------------------------------------
+
+/*
+ * When there are too many outputs for one thread each (or with --writers), the output files with
+ * the "block" policy are distributed over a small pool of writer threads instead. Each writer submits the current chunk to all of its outputs as
+ * asynchronous writes (I/O completion port on Windows, io_uring on Linux), collects the completions
+ * in whatever order they arrive, and resubmits the rest of any short write. Only then it releases
+ * the slot, i.e. each pool writer counts as one pending consumer of every chunk. Outputs that can
+ * not be attached to the queue (or all of them, if asynchronous I/O is not available at all) are
+ * written synchronously by the same thread.
+ */
+
+typedef struct _writer
+{
+    thread_t **outputs;
+    DWORD outputCount;
+    async_queue_t *queue;
+    file_handle_t hError;
+    BOOL timedFlush; /*the outputs have a flush interval*/
+}
+writer_t;
+
+static BOOL can_pool(const thread_t *const output)
+{
+    return (output->overflow == OVERFLOW_BLOCK) && (output->compress == COMPRESS_NONE) && (!output->rotate) && (!output->timestamps) && (!output->match) && (!output->strip) && (!output->indexStep) && (!output->ringSize) && (!output->connection) && (!output->stream) && (!output->tagged);
+}
+
+static BOOL submit_write(const writer_t *const writer, thread_t *const output, const BYTE *const buffer, const DWORD bytesTotal)
+{
+    output->writeStart = output->stats ? get_timestamp() : 0U;
+    if (!async_write(writer->queue, output->hOutput, output->writeOffset, buffer + output->written, bytesTotal - output->written, output))
+    {
+        output->writeErrors = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static DWORD THREAD_API pool_thread_start_routine(void *const lpThreadParameter)
+{
+    DWORD bytesWritten = 0U, myIndex = 0U, mySequence = 1U;
+    writer_t *const param = (writer_t*)lpThreadParameter;
+
+    for (;;)
+    {
+        ASSERT(myIndex < g_bufferCount, param->hError, L"Current buffer index is out of range!");
+
+        slot_t *const slot = GET_SLOT(myIndex);
+        const ULONGLONG waitStart = g_stats ? get_timestamp() : 0U;
+        if (param->timedFlush)
+        {
+            wait_for_chunk_or_flush(slot, mySequence, param->outputs, param->outputCount);
+        }
+        else
+        {
+            wait_for_chunk(slot, mySequence);
+        }
+        if (g_stats)
+        {
+            const ULONGLONG waitTicks = get_timestamp() - waitStart;
+            for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+            {
+                counter_add(&param->outputs[outputId]->stats->waitTicks, waitTicks);
+            }
+        }
+
+        const BYTE *const buffer = slot->buffer;
+        const DWORD bytesTotal = slot->bytesTotal;
+        DWORD pending = 0U;
+
+        if (bytesTotal > g_bufferSize)
+        {
+            for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+            {
+                thread_t *const output = param->outputs[outputId];
+                if (output->staging && (!output->writeErrors))
+                {
+                    output->writeErrors = !finish_direct(output); /*the final partial page*/
+                }
+                if (output->writeErrors)
+                {
+                    write_text(param->hError, L"[tee] I/O error: Not all data could be written!\n");
+                }
+            }
+            return 0U;
+        }
+
+        /* Submit the asynchronous writes first, so that they overlap with the synchronous ones */
+        for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+        {
+            thread_t *const output = param->outputs[outputId];
+            output->written = 0U;
+            if (output->async && (!output->writeErrors) && submit_write(param, output, buffer, bytesTotal))
+            {
+                ++pending;
+            }
+        }
+
+        for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+        {
+            thread_t *const output = param->outputs[outputId];
+            if (output->async || output->writeErrors)
+            {
+                continue;
+            }
+            if (!(output->staging ? write_direct(output, buffer, bytesTotal) : write_output(output, buffer, bytesTotal)))
+            {
+                output->writeErrors = TRUE;
+            }
+            if (output->stats)
+            {
+                counter_add(&output->stats->chunks, 1U);
+            }
+        }
+
+        /* Collect the completions, the buffer must not be released before all writes are done */
+        while (pending > 0U)
+        {
+            BOOL success = FALSE;
+            thread_t *const output = (thread_t*)async_wait(param->queue, &bytesWritten, &success);
+            if (!output)
+            {
+                write_text(param->hError, L"[tee] Operating system error: Failed to wait for the pending write operations!\n");
+                fatal_exit(); /*the buffer may still be in use, so it can not be released*/
+            }
+            if (output->stats)
+            {
+                stats_record_call(output->stats, output->writeStart, success ? bytesWritten : 0U);
+            }
+            if (output->writeOffset != ASYNC_NO_OFFSET)
+            {
+                output->writeOffset += bytesWritten;
+            }
+            if ((!success) || (!bytesWritten))
+            {
+                output->writeErrors = TRUE;
+            }
+            else if ((output->written += bytesWritten) < bytesTotal)
+            {
+                if (submit_write(param, output, buffer, bytesTotal))
+                {
+                    continue; /*short write*/
+                }
+            }
+            if (output->stats)
+            {
+                counter_add(&output->stats->chunks, 1U);
+            }
+            --pending;
+        }
+
+        ASSERT(atomic_load_acquire(&slot->pending) > 0L, param->hError, L"Pending threads counter must be a positive value!");
+        release_chunk(slot);
+
+        INCREMENT_INDEX(myIndex, mySequence);
+
+        for (DWORD outputId = 0U; outputId < param->outputCount; ++outputId)
+        {
+            commit_output(param->outputs[outputId], bytesTotal);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Zero-copy engine
+// --------------------------------------------------------------------------
+
+/*
+ * If the input is a pipe (Linux only), the data does not have to pass through the ring at all: the
+ * reader duplicates the pipe pages into all but the last output with tee(), and then moves them
+ * into the last output with splice(), which also consumes them from the input. Outputs that are
+ * pipes themselves receive the pages directly; any other output gets an intermediate pipe, from
+ * which a splicing thread moves the pages into the file. If the file does not support splicing,
+ * that thread falls back to reading the intermediate pipe into a buffer.
+ *
+ * tee() copies less than requested, if the target pipe is full. As it always starts at the head of
+ * the input, the missing tail can not be duplicated later. In that case, the reader consumes the
+ * chunk with a regular read operation and writes the missing parts from the buffer instead.
+ */
+
+#define SPLICE_TARGET(OUTPUT) (((OUTPUT)->hPipeWrite != INVALID_FILE) ? (OUTPUT)->hPipeWrite : (OUTPUT)->hOutput)
+
+static BOOL read_chunk(const file_handle_t hInput, BYTE *const buffer, const DWORD size)
+{
+    DWORD bytesRead = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesRead)
+    {
+        if ((!read_file(hInput, buffer + offset, size - offset, &bytesRead)) || (!bytesRead))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL write_chunk(const file_handle_t hOutput, const BYTE *const buffer, const DWORD size)
+{
+    DWORD bytesWritten = 0U;
+    for (DWORD offset = 0U; offset < size; offset += bytesWritten)
+    {
+        if ((!write_file(hOutput, buffer + offset, size - offset, &bytesWritten)) || (!bytesWritten))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static DWORD THREAD_API splice_thread_start_routine(void *const lpThreadParameter)
+{
+    thread_t *const param = (thread_t*)lpThreadParameter;
+    stats_t *const stats = param->stats;
+    BOOL buffered = FALSE;
+    DWORD bytesTotal = 0U;
+
+    for (;;)
+    {
+        const ULONGLONG writeStart = stats ? get_timestamp() : 0U;
+        BOOL result;
+        if (!buffered)
+        {
+            if (!(result = splice_pipe(param->hPipeRead, param->hOutput, g_bufferSize, &bytesTotal)))
+            {
+                BOOL largePages = FALSE;
+                if (!(param->buffer = alloc_pages(g_bufferSize, &largePages)))
+                {
+                    write_text(param->hError, L"[tee] Error: Failed to allocate the buffer memory!\n");
+                    break;
+                }
+                buffered = TRUE; /*the output does not support splicing*/
+                continue;
+            }
+        }
+        else if ((result = read_file(param->hPipeRead, param->buffer, g_bufferSize, &bytesTotal)) && bytesTotal)
+        {
+            result = write_chunk(param->hOutput, param->buffer, bytesTotal);
+        }
+        if (stats && ((!result) || bytesTotal))
+        {
+            stats_record_call(stats, writeStart, result ? bytesTotal : 0U);
+            counter_add(&stats->chunks, result ? 1U : 0U);
+        }
+        if (!result)
+        {
+            write_text(param->hError, L"[tee] I/O error: Not all data could be written!\n");
+            break;
+        }
+        if (!bytesTotal)
+        {
+            return 0U; /*end of input*/
+        }
+        commit_output(param, bytesTotal);
+    }
+
+    CLOSE_FILE(param->hPipeRead); /*the reader will see a broken pipe and give up on this output*/
+    return 0U;
+}
+
+static __forceinline void splice_record(thread_t *const output, const ULONGLONG startTime, const DWORD bytes)
+{
+    if (output->stats && (output->hPipeWrite == INVALID_FILE))
+    {
+        stats_record_call(output->stats, startTime, bytes); /*direct output, otherwise counted by the splicing thread*/
+        counter_add(&output->stats->chunks, 1U);
+    }
+}
+
+static BOOL splice_input(const file_handle_t hInput, thread_t *const outputs, const DWORD outputCount, stats_t *const stats, const BOOL ignore)
+{
+    BYTE *const buffer = GET_SLOT(0U)->memory;
+    DWORD copied[MAX_THREADS];
+
+    do
+    {
+        DWORD first = MAXDWORD, last = MAXDWORD, chunkSize = 0U, bytesMoved = 0U;
+        BOOL shortCopies = FALSE;
+        const ULONGLONG readStart = stats ? get_timestamp() : 0U;
+
+        for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+        {
+            if (!outputs[threadId].spliceErrors)
+            {
+                first = (first != MAXDWORD) ? first : threadId;
+                last = threadId;
+            }
+        }
+
+        if (first == MAXDWORD)
+        {
+            /* All outputs have failed, keep consuming the input */
+            if (!read_file(hInput, buffer, g_bufferSize, &chunkSize))
+            {
+                return FALSE;
+            }
+            if (!chunkSize)
+            {
+                break; /*end of input*/
+            }
+            continue;
+        }
+
+        /* Duplicate the chunk into all but the last output */
+        for (DWORD threadId = first; threadId < last; ++threadId)
+        {
+            thread_t *const output = &outputs[threadId];
+            if (output->spliceErrors)
+            {
+                continue;
+            }
+            const ULONGLONG callStart = output->stats ? get_timestamp() : 0U;
+            if (!tee_pipe(hInput, SPLICE_TARGET(output), chunkSize ? chunkSize : g_bufferSize, &copied[threadId]))
+            {
+                output->spliceErrors = TRUE;
+                continue;
+            }
+            if (!chunkSize)
+            {
+                if (!(chunkSize = copied[threadId]))
+                {
+                    return TRUE; /*end of input*/
+                }
+            }
+            else if (copied[threadId] < chunkSize)
+            {
+                shortCopies = TRUE;
+            }
+            splice_record(output, callStart, copied[threadId]);
+        }
+
+        /* Move the chunk into the last output, or read it, if there were short copies */
+        thread_t *const output = &outputs[last];
+        const ULONGLONG callStart = output->stats ? get_timestamp() : 0U;
+        if (!shortCopies)
+        {
+            for (DWORD offset = 0U; (!offset) || (offset < chunkSize); offset += bytesMoved)
+            {
+                if (!splice_pipe(hInput, SPLICE_TARGET(output), chunkSize ? (chunkSize - offset) : g_bufferSize, &bytesMoved))
+                {
+                    output->spliceErrors = TRUE;
+                    if ((offset < chunkSize) && (!read_chunk(hInput, buffer, chunkSize - offset)))
+                    {
+                        return FALSE; /*consume the rest of the chunk*/
+                    }
+                    break;
+                }
+                if (!bytesMoved)
+                {
+                    if (!chunkSize)
+                    {
+                        return TRUE; /*end of input*/
+                    }
+                    return FALSE; /*the input has been truncated*/
+                }
+                chunkSize = chunkSize ? chunkSize : bytesMoved;
+            }
+            splice_record(output, callStart, output->spliceErrors ? 0U : chunkSize);
+        }
+        else
+        {
+            if (!read_chunk(hInput, buffer, chunkSize))
+            {
+                return FALSE;
+            }
+            for (DWORD threadId = first; threadId <= last; ++threadId)
+            {
+                thread_t *const target = &outputs[threadId];
+                const DWORD offset = (threadId < last) ? copied[threadId] : 0U;
+                if ((!target->spliceErrors) && (offset < chunkSize) && (!write_chunk(SPLICE_TARGET(target), buffer + offset, chunkSize - offset)))
+                {
+                    target->spliceErrors = TRUE;
+                }
+            }
+            splice_record(output, callStart, chunkSize);
+        }
+
+        if (stats && chunkSize)
+        {
+            stats_record_read(stats, readStart, chunkSize);
+            counter_add(&stats->chunks, 1U);
+        }
+    }
+    while ((!g_stop) || ignore);
+
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Mapped input
+// --------------------------------------------------------------------------
+
+/*
+ * If the input is a regular file, the reader maps it into memory, one window at a time, and points
+ * the slots right into the current window, instead of reading the data into the ring. A window
+ * spans more chunks than the ring has slots, so by the time that the current window is exhausted,
+ * the reader has waited for the release of every chunk in the previous window, which can then be
+ * unmapped safely. Data that is appended to the file after it has been mapped, as well as the rest
+ * of a file that could not be mapped completely, is picked up by regular read operations. A chunk
+ * never crosses the end of a window, the next window is rather mapped a little early, starting at
+ * the current position.
+ */
+
+typedef struct _input_map
+{
+    file_mapping_t hMapping;
+    BYTE *view, *previous;
+    SIZE_T viewSize, previousSize, windowSize;
+    ULONGLONG viewOffset, position, end, granularity;
+}
+input_map_t;
+
+static BOOL open_input_map(input_map_t *const map, const file_handle_t hInput, const ULONGLONG offset, const ULONGLONG size)
+{
+    const DWORD granularity = get_allocation_granularity();
+    ULONGLONG windowSize = multiply_u64(g_bufferSize, g_bufferCount + 1U) + granularity; /*at least one chunk more than the ring has slots*/
+    if (windowSize < DEFAULT_MAP_WINDOW)
+    {
+        windowSize = DEFAULT_MAP_WINDOW;
+    }
+
+    windowSize = (windowSize + granularity - 1U) & (~((ULONGLONG)granularity - 1U));
+    if ((!size) || (windowSize > MAX_MAP_WINDOW))
+    {
+        return FALSE;
+    }
+
+    if ((map->hMapping = create_mapping(hInput)) == INVALID_MAPPING)
+    {
+        return FALSE;
+    }
+
+    map->windowSize = (SIZE_T)windowSize;
+    map->granularity = granularity;
+    map->position = offset;
+    map->end = offset + size;
+    return TRUE;
+}
+
+static void close_input_map(input_map_t *const map)
+{
+    if (map->previous)
+    {
+        unmap_view(map->previous, map->previousSize);
+        map->previous = NULL;
+    }
+
+    if (map->view)
+    {
+        unmap_view(map->view, map->viewSize);
+        map->view = NULL;
+    }
+
+    if (map->hMapping != INVALID_MAPPING)
+    {
+        close_mapping(map->hMapping);
+        map->hMapping = INVALID_MAPPING;
+    }
+}
+
+static BYTE *next_mapped_chunk(input_map_t *const map, DWORD *const length)
+{
+    if (map->position >= map->end)
+    {
+        return NULL;
+    }
+
+    const ULONGLONG viewEnd = map->viewOffset + map->viewSize;
+    if ((!map->view) || (map->position >= viewEnd) || ((map->position + g_bufferSize > viewEnd) && (viewEnd < map->end)))
+    {
+        if (map->previous)
+        {
+            unmap_view(map->previous, map->previousSize);
+        }
+        map->previous = map->view;
+        map->previousSize = map->viewSize;
+        const ULONGLONG viewOffset = map->position & (~(map->granularity - 1U));
+        const ULONGLONG remaining = map->end - viewOffset;
+        const SIZE_T viewSize = (remaining < map->windowSize) ? ((SIZE_T)remaining) : map->windowSize;
+        if (!(map->view = map_view(map->hMapping, viewOffset, viewSize)))
+        {
+            return NULL;
+        }
+        map->viewOffset = viewOffset;
+        map->viewSize = viewSize;
+    }
+
+    const ULONGLONG available = (map->viewOffset + map->viewSize) - map->position;
+    BYTE *const chunk = map->view + ((SIZE_T)(map->position - map->viewOffset));
+    *length = (available < g_bufferSize) ? ((DWORD)available) : g_bufferSize;
+    map->position += *length;
+    return chunk;
+}
+
+// --------------------------------------------------------------------------
+// Stream hashing
+// --------------------------------------------------------------------------
+
+/*
+ * With --hash, one more consumer of the ring computes the digests of the input stream, so that the
+ * output files do not have to be read once again just to checksum them. The hasher behaves like an
+ * output without a file: it is included in the pending counter of every chunk (in split mode, too).
+ * With --hash-piece, it also computes the digests of the consecutive pieces of the given size, so
+ * that corrupted data can be pinpointed. The data is hashed in steps of HASH_STEP bytes, so the
+ * second pass over each step (for the piece digests) hits the cache.
+ */
+
+#define HASH_XXH3 1U
+#define HASH_SHA256 2U
+#define HASH_STEP 0x10000U
+
+static const wchar_t *const HASH_ALGORITHMS[] = { L"none", L"xxh3", L"sha256", L"all", NULL };
+
+typedef struct _digest
+{
+    ULONGLONG xxh3;
+    BYTE sha256[SHA256_SIZE];
+}
+digest_t;
+
+typedef struct _hasher
+{
+    DWORD algorithms, pieceCount, pieceCapacity;
+    ULONGLONG pieceSize, pieceFill, totalSize;
+    BOOL outOfMemory;
+    xxh3_state_t xxh3, pieceXxh3;
+    sha256_state_t sha256, pieceSha256;
+    digest_t *pieces;
+}
+hasher_t;
+
+static void reset_hasher(hasher_t *const hasher)
+{
+    xxh3_reset(&hasher->xxh3);
+    xxh3_reset(&hasher->pieceXxh3);
+    sha256_reset(&hasher->sha256);
+    sha256_reset(&hasher->pieceSha256);
+}
+
+static void finish_piece(hasher_t *const hasher)
+{
+    if ((hasher->pieceCount >= hasher->pieceCapacity) && (!hasher->outOfMemory))
+    {
+        const DWORD capacity = hasher->pieceCapacity ? (hasher->pieceCapacity * 2U) : 64U;
+        digest_t *const pieces = (digest_t*)alloc_memory(sizeof(digest_t) * capacity);
+        if (pieces)
+        {
+            if (hasher->pieces)
+            {
+                copy_memory(pieces, hasher->pieces, sizeof(digest_t) * hasher->pieceCount);
+                free_memory(hasher->pieces);
+            }
+            hasher->pieces = pieces;
+            hasher->pieceCapacity = capacity;
+        }
+        else
+        {
+            hasher->outOfMemory = TRUE; /*the digests of the whole stream are still computed*/
+        }
+    }
+
+    if (hasher->pieceCount < hasher->pieceCapacity)
+    {
+        digest_t *const digest = &hasher->pieces[hasher->pieceCount++];
+        digest->xxh3 = xxh3_digest(&hasher->pieceXxh3);
+        sha256_digest(&hasher->pieceSha256, digest->sha256);
+    }
+
+    xxh3_reset(&hasher->pieceXxh3);
+    sha256_reset(&hasher->pieceSha256);
+    hasher->pieceFill = 0U;
+}
+
+static void hash_data(hasher_t *const hasher, const BYTE *buffer, DWORD size)
+{
+    while (size > 0U)
+    {
+        DWORD length = (size < HASH_STEP) ? size : HASH_STEP;
+        if (hasher->pieceSize && (hasher->pieceSize - hasher->pieceFill < length))
+        {
+            length = (DWORD)(hasher->pieceSize - hasher->pieceFill);
+        }
+        if (hasher->algorithms & HASH_XXH3)
+        {
+            xxh3_update(&hasher->xxh3, buffer, length);
+            if (hasher->pieceSize)
+            {
+                xxh3_update(&hasher->pieceXxh3, buffer, length);
+            }
+        }
+        if (hasher->algorithms & HASH_SHA256)
+        {
+            sha256_update(&hasher->sha256, buffer, length);
+            if (hasher->pieceSize)
+            {
+                sha256_update(&hasher->pieceSha256, buffer, length);
+            }
+        }
+        buffer += length;
+        size -= length;
+        hasher->totalSize += length;
+        if (hasher->pieceSize && ((hasher->pieceFill += length) >= hasher->pieceSize))
+        {
+            finish_piece(hasher);
+        }
+    }
+}
+
+static DWORD THREAD_API hasher_thread_start_routine(void *const lpThreadParameter)
+{
+    DWORD myIndex = 0U, mySequence = 1U;
+    hasher_t *const hasher = (hasher_t*)lpThreadParameter;
+
+    for (;;)
+    {
+        slot_t *const slot = GET_SLOT(myIndex);
+        wait_for_chunk(slot, mySequence);
+
+        if (slot->bytesTotal > g_bufferSize)
+        {
+            if (hasher->pieceFill)
+            {
+                finish_piece(hasher); /*the final partial piece*/
+            }
+            return 0U;
+        }
+
+        hash_data(hasher, slot->buffer, slot->bytesTotal);
+        release_chunk(slot);
+        INCREMENT_INDEX(myIndex, mySequence);
+    }
+}
+
+/*
+ * The digests are written in the format of "sha256sum" and "xxhsum", so the files can be verified
+ * with "sha256sum -c" or "xxhsum -c". The digests of the pieces come first, as comment lines.
+ */
+static const wchar_t *format_hex(wchar_t *const buffer, const BYTE *const data, const DWORD size)
+{
+    static const wchar_t DIGITS[] = L"0123456789abcdef";
+    for (DWORD index = 0U; index < size; ++index)
+    {
+        buffer[2U * index] = DIGITS[data[index] >> 4];
+        buffer[(2U * index) + 1U] = DIGITS[data[index] & 0xFU];
+    }
+
+    buffer[2U * size] = L'\0';
+    return buffer;
+}
+
+static const wchar_t *format_digest(wchar_t *const buffer, const digest_t *const digest, const DWORD algorithm)
+{
+    if (algorithm == HASH_XXH3)
+    {
+        BYTE canonical[8U];
+        ULONGLONG value = digest->xxh3;
+        for (DWORD index = 1U; index <= sizeof(canonical); ++index, value >>= 8)
+        {
+            canonical[sizeof(canonical) - index] = (BYTE)value; /*big-endian, like xxhsum*/
+        }
+        buffer[0U] = L'X';
+        buffer[1U] = L'X';
+        buffer[2U] = L'H';
+        buffer[3U] = L'3';
+        buffer[4U] = L'_';
+        format_hex(buffer + 5U, canonical, sizeof(canonical));
+        return buffer;
+    }
+
+    return format_hex(buffer, digest->sha256, SHA256_SIZE);
+}
+
+static BOOL write_digests(const file_handle_t hOutput, const hasher_t *const hasher, const DWORD algorithm, const wchar_t *const name)
+{
+    wchar_t text[(2U * SHA256_SIZE) + 1U], offset[21U], size[21U];
+    BOOL success = TRUE;
+
+    const wchar_t *fileName = name;
+    for (const wchar_t *ptr = name; *ptr != L'\0'; ++ptr)
+    {
+        if ((*ptr == L'/') || (*ptr == L'\\') || (*ptr == L':'))
+        {
+            fileName = ptr + 1U; /*the digest refers to the file next to it*/
+        }
+    }
+
+    ULONGLONG pieceStart = 0U;
+    for (DWORD pieceIndex = 0U; success && (pieceIndex < hasher->pieceCount); ++pieceIndex, pieceStart += hasher->pieceSize)
+    {
+        const ULONGLONG pieceSize = (hasher->totalSize - pieceStart < hasher->pieceSize) ? (hasher->totalSize - pieceStart) : hasher->pieceSize;
+        wchar_t *const line = CONCAT(L"# ", format_number64(offset, pieceStart), L"+", format_number64(size, pieceSize), L" ", format_digest(text, &hasher->pieces[pieceIndex], algorithm), L"\n");
+        success = line && write_text(hOutput, line);
+        free_memory(line);
+    }
+
+    digest_t digest;
+    digest.xxh3 = (algorithm == HASH_XXH3) ? xxh3_digest(&hasher->xxh3) : 0U;
+    if (algorithm == HASH_SHA256)
+    {
+        sha256_digest(&hasher->sha256, digest.sha256);
+    }
+
+    wchar_t *const line = CONCAT(format_digest(text, &digest, algorithm), L"  ", fileName, L"\n");
+    success = success && line && write_text(hOutput, line);
+    free_memory(line);
+    return success;
+}
+
+// --------------------------------------------------------------------------
+// Statistics reporter
+// --------------------------------------------------------------------------
+
+typedef struct _reporter
+{
+    file_handle_t hOutput;
+    DWORD interval, outputCount;
+    const thread_t *outputs;
+    ULONGLONG startTime;
+    volatile LONG stop;
+}
+reporter_t;
+
+#define FORMAT_COUNTER(BUFFER, STATS, NAME) format_number64((BUFFER), counter_read(&(STATS)->NAME))
+#define FORMAT_MICROS(BUFFER, STATS, NAME) format_number64((BUFFER), ticks_to_micros(counter_read(&(STATS)->NAME)))
+
+static void write_stats_lines(const reporter_t *const reporter)
+{
+    wchar_t elapsed[21U], index[11U], bytes[21U], chunks[21U], calls[21U], callTime[21U], maxCallTime[21U], waitTime[21U];
+    wchar_t histogram[READ_HISTOGRAM_SIZE][21U];
+    const wchar_t *histogramText[READ_HISTOGRAM_SIZE];
+    const file_handle_t hStdErr = reporter->hOutput; /*used by WRITE_TEXT*/
+
+    const wchar_t *const elapsedText = format_number64(elapsed, divide_u64(ticks_to_micros(get_timestamp() - reporter->startTime), 1000U, NULL));
+
+    stats_t *const input = GET_STATS(0U);
+    for (DWORD bucket = 0U; bucket < READ_HISTOGRAM_SIZE; ++bucket)
+    {
+        histogramText[bucket] = format_number64(histogram[bucket], counter_read(&input->histogram[bucket]));
+    }
+
+    WRITE_TEXT(L"stats time_ms=", elapsedText, L" thread=input bytes=", FORMAT_COUNTER(bytes, input, bytes), L" chunks=", FORMAT_COUNTER(chunks, input, chunks),
+        L" reads=", FORMAT_COUNTER(calls, input, calls), L" read_us=", FORMAT_MICROS(callTime, input, callTicks), L" max_read_us=", FORMAT_MICROS(maxCallTime, input, maxCallTicks),
+        L" blocked_us=", FORMAT_MICROS(waitTime, input, waitTicks), L" histogram=", histogramText[0U], L",", histogramText[1U], L",", histogramText[2U], L",", histogramText[3U], L",",
+        histogramText[4U], L",", histogramText[5U], L",", histogramText[6U], L",", histogramText[7U], L",", histogramText[8U], L",", histogramText[9U], L"\n");
+
+    for (DWORD outputIndex = 0U; outputIndex < reporter->outputCount; ++outputIndex)
+    {
+        stats_t *const output = reporter->outputs[outputIndex].stats;
+        WRITE_TEXT(L"stats time_ms=", elapsedText, L" thread=output index=", format_number(index, outputIndex), L" bytes=", FORMAT_COUNTER(bytes, output, bytes), L" chunks=", FORMAT_COUNTER(chunks, output, chunks),
+            L" writes=", FORMAT_COUNTER(calls, output, calls), L" write_us=", FORMAT_MICROS(callTime, output, callTicks), L" max_write_us=", FORMAT_MICROS(maxCallTime, output, maxCallTicks),
+            L" idle_us=", FORMAT_MICROS(waitTime, output, waitTicks), L" name=", reporter->outputs[outputIndex].name, L"\n");
+    }
+}
+
+static void write_stats_summary(const file_handle_t hStdErr, const reporter_t *const reporter)
+{
+    wchar_t elapsed[21U], bytes[21U], chunks[21U], calls[21U], callTime[21U], maxCallTime[21U], waitTime[21U], count[21U];
+
+    write_text(hStdErr, L"\n");
+    WRITE_TEXT(L"[tee] Statistics after ", format_number64(elapsed, divide_u64(ticks_to_micros(get_timestamp() - reporter->startTime), 1000U, NULL)), L" ms:\n");
+
+    stats_t *const input = GET_STATS(0U);
+    WRITE_TEXT(L"[tee] Input: ", FORMAT_COUNTER(bytes, input, bytes), L" bytes in ", FORMAT_COUNTER(chunks, input, chunks), L" chunk(s), ", FORMAT_COUNTER(calls, input, calls),
+        L" read(s), ", format_number64(callTime, divide_u64(ticks_to_micros(counter_read(&input->callTicks)), 1000U, NULL)), L" ms reading, ",
+        format_number64(waitTime, divide_u64(ticks_to_micros(counter_read(&input->waitTicks)), 1000U, NULL)), L" ms blocked by the outputs\n");
+
+    write_text(hStdErr, L"[tee] Read sizes:");
+    for (DWORD bucket = 0U; bucket < READ_HISTOGRAM_SIZE; ++bucket)
+    {
+        WRITE_TEXT(L" ", READ_HISTOGRAM_LABELS[bucket], L"=", format_number64(count, counter_read(&input->histogram[bucket])));
+    }
+    write_text(hStdErr, L"\n");
+
+    for (DWORD outputIndex = 0U; outputIndex < reporter->outputCount; ++outputIndex)
+    {
+        stats_t *const output = reporter->outputs[outputIndex].stats;
+        const ULONGLONG writes = counter_read(&output->calls);
+        WRITE_TEXT(L"[tee] Output \"", reporter->outputs[outputIndex].name, L"\": ", FORMAT_COUNTER(bytes, output, bytes), L" bytes in ", FORMAT_COUNTER(chunks, output, chunks), L" chunk(s), ",
+            format_number64(calls, writes), L" write(s), ", format_number64(callTime, writes ? divide_u64(ticks_to_micros(counter_read(&output->callTicks)), writes, NULL) : 0U), L" us average, ",
+            FORMAT_MICROS(maxCallTime, output, maxCallTicks), L" us maximum, ", format_number64(waitTime, divide_u64(ticks_to_micros(counter_read(&output->waitTicks)), 1000U, NULL)), L" ms idle\n");
+    }
+}
+
+static DWORD THREAD_API reporter_thread_start_routine(void *const lpThreadParameter)
+{
+    reporter_t *const reporter = (reporter_t*)lpThreadParameter;
+    DWORD nextTick = get_tick_count() + reporter->interval;
+
+    while (!atomic_load_acquire(&reporter->stop))
+    {
+        const LONG remaining = (LONG)(nextTick - get_tick_count());
+        if (remaining <= 0L)
+        {
+            write_stats_lines(reporter);
+            nextTick += reporter->interval;
+            continue;
+        }
+        wait_on_address(&reporter->stop, FALSE, (DWORD)remaining);
+    }
+
+    return 0U;
+}
+
+// --------------------------------------------------------------------------
+// Options
+// --------------------------------------------------------------------------
+
+typedef struct
+{
+    BOOL append, buffer, delay, direct, escape, flush, help, ignore, largePages, lines, noMmap, noSplice, stats, stripAnsi, tagStreams, timestamps, version;
+    DWORD bufferSize, bufferCount, overflow, maxLag, chunkSize, maxDelay, statsPeriod, writers, flushInterval, flushBytes, compress, compressLevel, compressors, rotateInterval, rotateKeep, split, hash, frame, frameBudget, frameLines, stream, pipeSize;
+    ULONGLONG preallocate, rotateSize, hashPiece, index, ring;
+    const wchar_t *statsFile, *match, *dumpOn, *lookup, *from, *to;
+}
+options_t;
+
+#define PARSE_OPTION(SHRT, NAME) do \
+{ \
+    if ((lc == L##SHRT) || (name && (compare_nocase(name, WIDEN(#NAME)) == 0))) \
+    { \
+        options->NAME = TRUE; \
+        return TRUE; \
+    } \
+} \
+while (0)
+
+#define PARSE_FLAG(NAME, FIELD) do \
+{ \
+    if (name && (compare_nocase(name, (NAME)) == 0)) \
+    { \
+        options->FIELD = TRUE; \
+        return TRUE; \
+    } \
+} \
+while (0)
+
+#define PARSE_VALUE(NAME, FIELD, MIN, MAX) do \
+{ \
+    const wchar_t *const _value = name ? get_option_value(name, (NAME)) : NULL; \
+    if (_value) \
+    { \
+        return parse_number(_value, &options->FIELD) && (options->FIELD >= (MIN)) && (options->FIELD <= (MAX)); \
+    } \
+} \
+while (0)
+
+#define PARSE_VALUE64(NAME, FIELD) do \
+{ \
+    const wchar_t *const _value = name ? get_option_value(name, (NAME)) : NULL; \
+    if (_value) \
+    { \
+        return parse_number64(_value, &options->FIELD); \
+    } \
+} \
+while (0)
+
+#define PARSE_CHOICE(NAME, FIELD, CHOICES) do \
+{ \
+    const wchar_t *const _value = name ? get_option_value(name, (NAME)) : NULL; \
+    if (_value) \
+    { \
+        return parse_choice(_value, (CHOICES), &options->FIELD); \
+    } \
+} \
+while (0)
+
+#define PARSE_STRING(NAME, FIELD) do \
+{ \
+    const wchar_t *const _value = name ? get_option_value(name, (NAME)) : NULL; \
+    if (_value) \
+    { \
+        options->FIELD = _value; \
+        return TRUE; \
+    } \
+} \
+while (0)
+
+static const wchar_t *get_option_value(const wchar_t *const name, const wchar_t *const prefix)
+{
+    const wchar_t *ptr = name;
+    for (const wchar_t *ref = prefix; *ref != L'\0'; ++ref, ++ptr)
+    {
+        if (to_lower(*ptr) != *ref)
+        {
+            return NULL;
+        }
+    }
+
+    return ((ptr[0U] == L'=') && (ptr[1U] != L'\0')) ? (ptr + 1U) : NULL;
+}
+
+static BOOL parse_number64(const wchar_t *str, ULONGLONG *const value)
+{
+    ULONGLONG result = 0U;
+    DWORD shift = 0U;
+
+    for (; (*str >= L'0') && (*str <= L'9'); ++str)
+    {
+        const DWORD digit = (DWORD)(*str - L'0');
+        if ((result > (((ULONGLONG)-1) / 10U)) || ((((result << 3) + (result << 1)) + digit) < digit))
+        {
+            return FALSE;
+        }
+        result = ((result << 3) + (result << 1)) + digit; /*no 64-Bit multiplication in 32-Bit builds*/
+    }
+
+    switch (to_lower(*str))
+    {
+    case L'\0':
+        break;
+    case L'k':
+        shift = 10U;
+        ++str;
+        break;
+    case L'm':
+        shift = 20U;
+        ++str;
+        break;
+    case L'g':
+        shift = 30U;
+        ++str;
+        break;
+    case L't':
+        shift = 40U;
+        ++str;
+        break;
+    default:
+        return FALSE;
+    }
+
+    if ((*str != L'\0') || (result > (((ULONGLONG)-1) >> shift)))
+    {
+        return FALSE;
+    }
+
+    *value = result << shift;
+    return TRUE;
+}
+
+static BOOL parse_number(const wchar_t *const str, DWORD *const value)
+{
+    ULONGLONG result;
+    if ((!parse_number64(str, &result)) || (result > MAXDWORD))
+    {
+        return FALSE;
+    }
+
+    *value = (DWORD)result;
+    return TRUE;
+}
+
+static BOOL parse_choice(const wchar_t *const str, const wchar_t *const *const choices, DWORD *const value)
+{
+    for (DWORD index = 0U; choices[index]; ++index)
+    {
+        if (compare_nocase(str, choices[index]) == 0)
+        {
+            *value = index;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static BOOL parse_option(options_t *const options, const wchar_t c, const wchar_t *const name)
+{
+    const wchar_t lc = to_lower(c);
+
+    PARSE_OPTION('a', append);
+    PARSE_OPTION('b', buffer);
+    PARSE_OPTION('d', delay);
+    PARSE_OPTION('e', escape);
+    PARSE_OPTION('f', flush);
+    PARSE_OPTION('h', help);
+    PARSE_OPTION('i', ignore);
+    PARSE_OPTION('v', version);
+
+    PARSE_FLAG(L"direct", direct);
+    PARSE_FLAG(L"large-pages", largePages);
+    PARSE_FLAG(L"stats", stats);
+    PARSE_FLAG(L"no-mmap", noMmap);
+    PARSE_FLAG(L"no-splice", noSplice);
+    PARSE_FLAG(L"lines", lines);
+    PARSE_FLAG(L"timestamps", timestamps);
+    PARSE_FLAG(L"strip-ansi", stripAnsi);
+    PARSE_FLAG(L"tag-streams", tagStreams);
+
+    PARSE_VALUE(L"buffer-size", bufferSize, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+    PARSE_VALUE(L"buffers", bufferCount, MIN_BUFFERS, MAX_BUFFERS);
+    PARSE_VALUE(L"max-lag", maxLag, 1U, MAX_BUFFERS - 1U);
+    PARSE_VALUE(L"chunk-size", chunkSize, 1U, MAX_BUFFER_SIZE);
+    PARSE_VALUE(L"max-delay", maxDelay, 1U, MAX_MAX_DELAY);
+    PARSE_VALUE(L"stats-period", statsPeriod, MIN_STATS_PERIOD, MAX_STATS_PERIOD);
+    PARSE_VALUE(L"writers", writers, 1U, MAX_WRITERS);
+    PARSE_VALUE(L"flush-interval", flushInterval, 1U, MAX_FLUSH_INTERVAL);
+    PARSE_VALUE(L"flush-bytes", flushBytes, 1U, MAXDWORD);
+    PARSE_VALUE(L"compress-level", compressLevel, DEFLATE_MIN_LEVEL, DEFLATE_MAX_LEVEL);
+    PARSE_VALUE(L"compressors", compressors, 1U, MAX_COMPRESSORS);
+    PARSE_VALUE(L"rotate-interval", rotateInterval, 1U, MAX_ROTATE_INTERVAL);
+    PARSE_VALUE(L"rotate-keep", rotateKeep, 1U, MAXDWORD);
+    PARSE_VALUE(L"frame", frame, 1U, MAX_FRAME_INTERVAL);
+    PARSE_VALUE(L"frame-budget", frameBudget, MIN_FRAME_BUDGET, MAX_FRAME_BUDGET);
+    PARSE_VALUE(L"frame-lines", frameLines, 1U, MAXDWORD);
+    PARSE_VALUE(L"pipe-size", pipeSize, MIN_BUFFER_SIZE, MAX_PIPE_SIZE);
+    PARSE_VALUE64(L"preallocate", preallocate);
+    PARSE_VALUE64(L"rotate-size", rotateSize);
+    PARSE_VALUE64(L"hash-piece", hashPiece);
+    PARSE_VALUE64(L"index", index);
+    PARSE_VALUE64(L"ring", ring);
+
+    PARSE_STRING(L"stats-file", statsFile);
+    PARSE_STRING(L"match", match);
+    PARSE_STRING(L"dump-on", dumpOn);
+    PARSE_STRING(L"lookup", lookup);
+    PARSE_STRING(L"from", from);
+    PARSE_STRING(L"to", to);
+
+    PARSE_CHOICE(L"overflow", overflow, OVERFLOW_POLICIES);
+    PARSE_CHOICE(L"compress", compress, COMPRESSION_METHODS);
+    PARSE_CHOICE(L"split", split, SPLIT_MODES);
+    PARSE_CHOICE(L"hash", hash, HASH_ALGORITHMS);
+    PARSE_CHOICE(L"stream", stream, CHILD_STREAMS);
+
+    return FALSE;
+}
+
+static BOOL parse_argument(options_t *const options, const wchar_t *const argument)
+{
+    if ((argument[0U] != L'-') || (argument[1U] == L'\0'))
+    {
+        return FALSE;
+    }
+
+    if (argument[1U] == L'-')
+    {
+        return (argument[2U] != L'\0') && parse_option(options, L'\0', argument + 2U);
+    }
+    else
+    {
+        for (const wchar_t* ptr = argument + 1U; *ptr != L'\0'; ++ptr)
+        {
+            if (!parse_option(options, *ptr, NULL))
+            {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Index lookup
+// --------------------------------------------------------------------------
+
+/*
+ * With --lookup, tee copies a range of an indexed file to the standard output, instead of copying
+ * its input. The range begins with --from and ends with --to, each of which is either a line number
+ * (counting from 1), or a UTC time "YYYY-MM-DD[Thh:mm[:ss[.uuuuuu]]][Z]". The index is bisected, so
+ * only a few entries have to be read. Line numbers are exact, the lines between the closest entry
+ * and the requested one are skipped; times are rounded outward to the closest entries, because the
+ * index does not know the time of each individual line.
+ */
+
+#define LOOKUP_BUFFER_SIZE 0x100000U
+
+typedef struct _position
+{
+    BOOL time;
+    ULONGLONG value; /*the number of line breaks in front of the line, or microseconds since 1970*/
+}
+position_t;
+
+static BOOL parse_digits(const wchar_t **const str, const DWORD count, DWORD *const value)
+{
+    *value = 0U;
+    for (DWORD digitId = 0U; digitId < count; ++digitId, ++(*str))
+    {
+        if ((**str < L'0') || (**str > L'9'))
+        {
+            return FALSE;
+        }
+        *value = (*value * 10U) + ((DWORD)(**str - L'0'));
+    }
+
+    return TRUE;
+}
+
+static BOOL parse_position(const wchar_t *str, position_t *const position)
+{
+    DWORD year, month, day, hour = 0U, minute = 0U, second = 0U, micros = 0U;
+    const wchar_t *ptr = str;
+    while ((*ptr >= L'0') && (*ptr <= L'9'))
+    {
+        ++ptr;
+    }
+
+    if (*ptr != L'-')
+    {
+        position->time = FALSE;
+        if (!(parse_number64(str, &position->value) && position->value))
+        {
+            return FALSE;
+        }
+        --position->value; /*the line breaks in front of the line*/
+        return TRUE;
+    }
+
+    if (!(parse_digits(&str, 4U, &year) && (*(str++) == L'-') && parse_digits(&str, 2U, &month) && (*(str++) == L'-') && parse_digits(&str, 2U, &day)))
+    {
+        return FALSE;
+    }
+
+    if ((*str == L'T') || (*str == L't') || (*str == L' '))
+    {
+        ++str;
+        if (!(parse_digits(&str, 2U, &hour) && (*(str++) == L':') && parse_digits(&str, 2U, &minute)))
+        {
+            return FALSE;
+        }
+        if (*str == L':')
+        {
+            ++str;
+            if (!parse_digits(&str, 2U, &second))
+            {
+                return FALSE;
+            }
+        }
+        if (*str == L'.')
+        {
+            DWORD scale = 100000U;
+            for (++str; (*str >= L'0') && (*str <= L'9'); ++str)
+            {
+                micros += ((DWORD)(*str - L'0')) * scale; /*digits beyond microseconds are ignored*/
+                scale /= 10U;
+            }
+        }
+    }
+
+    if ((*str == L'Z') || (*str == L'z'))
+    {
+        ++str;
+    }
+
+    if ((*str != L'\0') || (year < 1970U) || (month < 1U) || (month > 12U) || (day < 1U) || (day > 31U) || (hour > 23U) || (minute > 59U) || (second > 60U))
+    {
+        return FALSE;
+    }
+
+    /* Days since 1970-01-01 from the civil date (proleptic Gregorian calendar) */
+    const DWORD shiftedYear = year - ((month <= 2U) ? 1U : 0U), era = shiftedYear / 400U, yearOfEra = shiftedYear - (era * 400U);
+    const DWORD dayOfYear = (((153U * ((month > 2U) ? (month - 3U) : (month + 9U))) + 2U) / 5U) + day - 1U;
+    const DWORD days = (era * 146097U) + (yearOfEra * 365U) + (yearOfEra / 4U) - (yearOfEra / 100U) + dayOfYear - 719468U;
+
+    position->time = TRUE;
+    position->value = multiply_u64(multiply_u64(days, 86400U) + (hour * 3600U) + (minute * 60U) + second, 1000000U) + micros;
+    return TRUE;
+}
+
+static BOOL read_entry(const file_handle_t hIndex, const ULONGLONG entryId, index_entry_t *const entry)
+{
+    DWORD bytesRead = 0U;
+    return read_file_at(hIndex, INDEX_HEADER_SIZE + multiply_u64(entryId, (DWORD)sizeof(index_entry_t)), (BYTE*)entry, sizeof(index_entry_t), &bytesRead) && (bytesRead == sizeof(index_entry_t));
+}
+
+static BOOL search_index(const file_handle_t hIndex, const ULONGLONG entryCount, const position_t *const position, const BOOL inclusive, ULONGLONG *const result)
+{
+    ULONGLONG lower = 0U, upper = entryCount; /*the result is the number of entries in front of the position*/
+    while (lower < upper)
+    {
+        index_entry_t entry;
+        const ULONGLONG middle = lower + ((upper - lower) >> 1);
+        if (!read_entry(hIndex, middle, &entry))
+        {
+            return FALSE;
+        }
+        const ULONGLONG key = position->time ? entry.time : entry.line;
+        if ((key < position->value) || (inclusive && (key == position->value)))
+        {
+            lower = middle + 1U;
+        }
+        else
+        {
+            upper = middle;
+        }
+    }
+
+    *result = lower;
+    return TRUE;
+}
+
+static BOOL locate_range(const file_handle_t hIndex, const position_t *const from, const position_t *const to, index_entry_t *const start, ULONGLONG *const limit)
+{
+    BYTE header[INDEX_HEADER_SIZE];
+    ULONGLONG position, indexSize, count;
+    DWORD bytesRead = 0U;
+    index_entry_t entry;
+
+    if (!(read_file_at(hIndex, 0U, header, INDEX_HEADER_SIZE, &bytesRead) && (bytesRead == INDEX_HEADER_SIZE) && get_file_range(hIndex, &position, &indexSize)))
+    {
+        return FALSE;
+    }
+
+    for (DWORD byteId = 0U; byteId < sizeof(INDEX_MAGIC); ++byteId)
+    {
+        if (header[byteId] != INDEX_MAGIC[byteId])
+        {
+            return FALSE;
+        }
+    }
+
+    const ULONGLONG entryCount = divide_u64(position + indexSize - INDEX_HEADER_SIZE, sizeof(index_entry_t), NULL); /*the index may still be growing*/
+    start->offset = start->line = 0U;
+    *limit = (ULONGLONG)-1;
+
+    /* Start at the last entry in front of the first line (or the first time), if any */
+    if (!search_index(hIndex, entryCount, from, !from->time, &count))
+    {
+        return FALSE;
+    }
+    if (count && (!read_entry(hIndex, count - 1U, start)))
+    {
+        return FALSE;
+    }
+
+    /* Stop at the first entry behind the last time */
+    if (to->time)
+    {
+        if (!search_index(hIndex, entryCount, to, TRUE, &count))
+        {
+            return FALSE;
+        }
+        if (count < entryCount)
+        {
+            if (!read_entry(hIndex, count, &entry))
+            {
+                return FALSE;
+            }
+            *limit = entry.offset;
+        }
+    }
+
+    return TRUE;
+}
+
+static const BYTE *skip_lines(const BYTE *ptr, const BYTE *const end, ULONGLONG *const count)
+{
+    const DWORD total = scan_count(ptr, end, '\n');
+    if (total < (*count))
+    {
+        *count -= total;
+        return NULL;
+    }
+
+    for (; *count; --(*count))
+    {
+        ptr = scan_forward(ptr, end, '\n') + 1U;
+    }
+
+    return ptr; /*right behind the last line break that was to be skipped*/
+}
+
+static int lookup_range(const file_handle_t hStdOut, const file_handle_t hStdErr, const wchar_t *const name, const wchar_t *const fromText, const wchar_t *const toText)
+{
+    position_t from = { FALSE, 0U }, to = { FALSE, (ULONGLONG)-1 };
+    index_entry_t start;
+    ULONGLONG limit, skip, lineCount = (ULONGLONG)-1;
+    file_handle_t hInput = INVALID_FILE, hIndex = INVALID_FILE;
+    BYTE *buffer = NULL;
+    int exitCode = 1;
+
+    if (fromText && (!parse_position(fromText, &from)))
+    {
+        WRITE_TEXT(L"[tee] Error: Invalid position \"", fromText, L"\" encountered!\n");
+        return 1;
+    }
+
+    if (toText && (!parse_position(toText, &to)))
+    {
+        WRITE_TEXT(L"[tee] Error: Invalid position \"", toText, L"\" encountered!\n");
+        return 1;
+    }
+
+    wchar_t *const indexName = CONCAT(name, L".idx");
+    if (!indexName)
+    {
+        write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+        return 1;
+    }
+
+    if (((hInput = open_file_read(name)) == INVALID_FILE) || ((hIndex = open_file_read(indexName)) == INVALID_FILE))
+    {
+        WRITE_TEXT(L"[tee] Error: Failed to open the file \"", (hInput == INVALID_FILE) ? name : indexName, L"\" for reading!\n");
+        goto cleanUp;
+    }
+
+    if (!locate_range(hIndex, &from, &to, &start, &limit))
+    {
+        WRITE_TEXT(L"[tee] Error: The index \"", indexName, L"\" is invalid or could not be read!\n");
+        goto cleanUp;
+    }
+
+    if (!(buffer = (BYTE*)alloc_memory(LOOKUP_BUFFER_SIZE)))
+    {
+        write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+        goto cleanUp;
+    }
+
+    /* Skip the lines in front of the first line, and count the lines up to the last one */
+    skip = ((!from.time) && (from.value > start.line)) ? (from.value - start.line) : 0U;
+    if (!to.time)
+    {
+        if ((to.value != ((ULONGLONG)-1)) && (to.value < start.line + skip))
+        {
+            exitCode = 0; /*the range is empty*/
+            goto cleanUp;
+        }
+        lineCount = (to.value != ((ULONGLONG)-1)) ? (to.value + 1U - (start.line + skip)) : lineCount;
+    }
+
+    for (ULONGLONG offset = start.offset; offset < limit;)
+    {
+        DWORD bytesRead = 0U;
+        const ULONGLONG remaining = limit - offset;
+        if (!read_file_at(hInput, offset, buffer, (remaining < LOOKUP_BUFFER_SIZE) ? ((DWORD)remaining) : LOOKUP_BUFFER_SIZE, &bytesRead))
+        {
+            WRITE_TEXT(L"[tee] I/O error: Failed to read the file \"", name, L"\"!\n");
+            goto cleanUp;
+        }
+        if (!bytesRead)
+        {
+            break; /*end of file*/
+        }
+        offset += bytesRead;
+        const BYTE *ptr = buffer, *end = buffer + bytesRead;
+        if (skip && (!(ptr = skip_lines(ptr, end, &skip))))
+        {
+            continue;
+        }
+        if (lineCount != ((ULONGLONG)-1))
+        {
+            const BYTE *const last = skip_lines(ptr, end, &lineCount);
+            end = last ? last : end;
+        }
+        if (!write_chunk(hStdOut, ptr, (DWORD)(end - ptr)))
+        {
+            write_text(hStdErr, L"[tee] I/O error: Failed to write to the standard output!\n");
+            goto cleanUp;
+        }
+        if (!lineCount)
+        {
+            break; /*the last line has been copied*/
+        }
+    }
+
+    exitCode = 0;
+
+cleanUp:
+    CLOSE_FILE(hInput);
+    CLOSE_FILE(hIndex);
+    free_memory(buffer);
+    free_memory(indexName);
+    return exitCode;
+}
+
+// --------------------------------------------------------------------------
+// Help screen
+// --------------------------------------------------------------------------
+
+static void print_helpscreen(const file_handle_t hStdErr, const BOOL full)
+{
+    wchar_t major[11U], minor[11U], patch[11U];
+    WRITE_TEXT(L"tee for Windows v", format_number(major, APP_VERSION_MAJOR), L".", format_number(minor, APP_VERSION_MINOR), L".", format_number(patch, APP_VERSION_PATCH), L" [" PROCESSOR_ARCHITECTURE L"] [" WIDEN(__DATE__) L"]\n");
+    if (full)
+    {
+        write_text(hStdErr, L"\n"
+            L"Copy standard input to output file(s), and also to standard output.\n\n"
+            L"Usage:\n"
+            L"  gizmo.exe [...] | tee.exe [options] <file_1> ... <file_n>\n"
+            L"  tee.exe [options] <file_1> ... <file_n> -- gizmo.exe [...]\n\n"
+            L"Options:\n"
+            L"  -a --append         Append to the existing file, instead of truncating\n"
+            L"  -b --buffer         Enable write combining, same as --chunk-size=<buffer size/8>\n"
+            L"  -e --escape         Enable standard output ANSI escape code processing\n"
+            L"  -f --flush          Flush output file after each write operation\n"
+            L"  --flush-interval=<ms>\n"
+            L"                      Flush the output files at least every <ms> milliseconds (group commit)\n"
+            L"  --flush-bytes=<n>   Flush the output files whenever <n> bytes have been written (group commit)\n"
+            L"  -i --ignore         Ignore the interrupt signal (SIGINT), e.g. CTRL+C\n"
+            L"  -d --delay          Coalesce the reads for up to 1 ms, unless --max-delay is given\n"
+            L"  --buffer-size=<n>   Size of each buffer, in bytes (suffixes K/M/G are allowed)\n"
+            L"  --buffers=<n>       Number of buffers in the ring, default is 3, or 16 MiB worth with --overflow\n"
+            L"  --large-pages       Allocate the buffers from large pages, if possible\n"
+            L"  --direct            Write the output files with direct I/O, bypassing the file system cache\n"
+            L"  --preallocate=<n>   Reserve disk space for <n> bytes in each output file (suffixes K/M/G/T)\n"
+            L"  --no-mmap           Do not map the input into memory when it is a regular file\n"
+            L"  --no-splice         Do not use zero-copy (tee/splice) when the input is a pipe (Linux only)\n"
+            L"  --chunk-size=<n>    Coalesce small reads, until <n> bytes are available (write combining)\n"
+            L"  --max-delay=<ms>    Maximum latency added by write combining, default is 10 ms\n"
+            L"  --stats             Print statistics (throughput, latency, wait times) at exit\n"
+            L"  --stats-period=<ms> Also print machine-readable statistics periodically\n"
+            L"  --stats-file=<file> Write the periodic statistics to a file, instead of stderr\n"
+            L"  --overflow=<policy> Policy for outputs that fall behind: block, drop, disconnect or spill\n"
+            L"  --max-lag=<n>       Number of chunks an output may fall behind, default is the ring size - 1\n"
+            L"  --writers=<n>       Write the output files with a pool of <n> threads, default is one thread\n"
+            L"                      per file, or one per CPU with more than 63 files\n"
+            L"  --compress=<method> Compress the output: none or gzip (parallel, in independent blocks)\n"
+            L"  --compress-level=<n>\n"
+            L"                      Compression level, from 1 (fastest) to 9 (best), default is 6\n"
+            L"  --compressors=<n>   Number of compressing threads, default is one per CPU\n"
+            L"  --rotate-size=<n>   Continue with a new segment of the output file after <n> bytes\n"
+            L"  --rotate-interval=<s>\n"
+            L"                      Continue with a new segment of the output file every <s> seconds\n"
+            L"  --rotate-keep=<n>   Keep only the <n> most recent old segments, default is to keep all\n"
+            L"  --lines             Pass on whole lines only, a partial line is held back up to --max-delay\n"
+            L"  --timestamps        Prefix each line with the time it was read (UTC), implies --lines\n"
+            L"  --match=<pattern>   Write only the lines that contain <pattern> (string or simple regex)\n"
+            L"  --strip-ansi        Remove the ANSI escape sequences (colors etc.) from the output\n"
+            L"  --split=<mode>      Send each chunk to one output only: none, round-robin or least-loaded\n"
+            L"  --hash=<algorithm>  Write the digest of the input to <file>.xxh3/.sha256: xxh3, sha256 or all\n"
+            L"  --hash-piece=<n>    Also record the digests of the pieces of <n> bytes (suffixes K/M/G/T)\n"
+            L"  --index=<n>         Write a seek index <file>.idx, with an entry about every <n> bytes\n"
+            L"  --ring=<n>          Keep only the last <n> bytes in memory, dump them at exit or on CTRL+BREAK\n"
+            L"  --dump-on=<pattern> Dump the --ring outputs, when a line contains <pattern>\n"
+            L"  --frame=<ms>        Write to the console once per frame of <ms> milliseconds, e.g. 16\n"
+            L"  --frame-budget=<n>  Skip ahead, when more than <n> bytes are waiting for the console\n"
+            L"  --frame-lines=<n>   Number of most recent lines to keep when skipping, default is 100\n"
+            L"  --stream=<stream>   Write only one stream of the command: all, stdout or stderr\n"
+            L"  --tag-streams       Prefix each line with the stream of the command, implies --lines\n"
+            L"  --pipe-size=<n>     Size of the pipes of the command, in bytes, default is 1M\n\n"
+            L"The options --overflow, --max-lag, --compress, --rotate-*, --timestamps, --match, --strip-ansi,\n"
+            L"--index, --ring, --dump-on, --stream and --tag-streams apply to all files that follow them. The\n"
+            L"file name \"-\" stands for the standard output; if it is not given, the standard output is configured\n"
+            L"by the options in front of the first file name. A file name \"tcp://<host>:<port>\", \"unix:<path>\" or\n"
+            L"\"\\\\.\\pipe\\<name>\" streams to a log collector, which may reconnect and never blocks the input.\n\n"
+            L"With \"-- <command>\" after the file names, tee runs the command and captures its standard output and\n"
+            L"standard error, instead of reading the standard input; the exit code of the command is passed on.\n\n"
+            L"Lookup:\n"
+            L"  tee.exe --lookup=<file> [--from=<line|time>] [--to=<line|time>]\n\n"
+            L"Copies the lines from --from to --to (inclusive) of an indexed file to the standard output. A\n"
+            L"line is given by its number, counting from 1, a time as \"YYYY-MM-DD[Thh:mm[:ss[.uuuuuu]]]\" (UTC).\n\n");
+    }
+}
+
+// --------------------------------------------------------------------------
+// MAIN
+// --------------------------------------------------------------------------
+
+int tee_main(const int argc, const wchar_t *const argv[])
+{
+    thread_handle_t hThreads[MAX_THREADS];
+    file_handle_t hStdIn, hStdOut, hStdErr, hStatsFile = INVALID_FILE;
+    int exitCode = 1, argOff = 1;
+    BOOL readErrors = FALSE, endOfOptions = FALSE, tooManyFiles = FALSE, stdOutNamed = FALSE, decoupled = FALSE, spill = FALSE, mapped = FALSE, timestamps = FALSE, filtered = FALSE, indexed = FALSE, stripped = FALSE, recorded = FALSE, connected = FALSE, tagged = FALSE, childRunning = FALSE;
+    ULONGLONG inputOffset = 0U, inputSize = 0U;
+    DWORD nameCount = 0U, fileCount = 0U, threadCount = 0U, writerCount = 0U, poolCount = 0U, compressCount = 0U, compressorCount = 0U, rotateCount = 0U, jobsPerOutput = 0U, pendingCount = 0U, splitCount = 0U, splitCursor = 0U, myIndex = 0U, mySequence = 1U, bytesRead = 0U, totalBytes = 0U, carry = 0U, carryTick = 0U, commandCount = 0U, streamId = 0U, openStreams = 0U, childExit = 0U;
+    const BYTE *carryFrom = NULL;
+    const wchar_t *const *command = NULL;
+    file_handle_t hStreams[2U] = { INVALID_FILE, INVALID_FILE }; /*the standard output and standard error of the child process*/
+    process_handle_t hChild;
+    slot_t *slot = NULL;
+    stats_t *myStats = NULL;
+    thread_handle_t hReporter = NULL, hRotator = NULL, hRenderer = NULL, hDumper = NULL;
+    options_t options;
+    static file_handle_t hMyFiles[MAX_OUTPUTS - 1U];
+    static thread_t threadData[MAX_OUTPUTS];
+    static thread_t *poolOutputs[MAX_OUTPUTS];
+    static thread_t *splitOutputs[MAX_OUTPUTS];
+    static writer_t writers[MAX_WRITERS];
+    static compressor_t compressors[MAX_COMPRESSORS];
+    static reporter_t reporter;
+    static hasher_t hasher;
+    static console_t console;
+    static rotator_t rotator;
+    static dumper_t dumper;
+    static input_map_t inputMap;
+
+    /* Initialize local variables */
+    FILL_ARRAY(hMyFiles, INVALID_FILE);
+    zero_memory(&hThreads, sizeof(hThreads));
+    zero_memory(&options, sizeof(options));
+    zero_memory(&threadData, sizeof(threadData));
+    zero_memory(&writers, sizeof(writers));
+    zero_memory(&compressors, sizeof(compressors));
+    zero_memory(&reporter, sizeof(reporter));
+    zero_memory(&rotator, sizeof(rotator));
+    zero_memory(&inputMap, sizeof(inputMap));
+    zero_memory(&hChild, sizeof(hChild));
+    inputMap.hMapping = INVALID_MAPPING;
+    for (DWORD threadId = 0U; threadId < MAX_OUTPUTS; ++threadId)
+    {
+        threadData[threadId].hOutput = threadData[threadId].hSpill = threadData[threadId].hPipeRead = threadData[threadId].hPipeWrite = INVALID_FILE;
+        threadData[threadId].hNext = threadData[threadId].hRetired = INVALID_FILE;
+    }
+
+    /* Initialize standard streams */
+    if (!get_std_handles(&hStdIn, &hStdOut, &hStdErr))
+    {
+        if (hStdErr != INVALID_FILE)
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to get the standard handles!\n");
+        }
+        return -1;
+    }
+
+    /* Set up CRTL+C handler */
+    install_stop_handler(&g_stop);
+
+    /* Parse command-line options and output file names */
+    for (; argOff < argc; ++argOff)
+    {
+        const wchar_t *const argValue = argv[argOff];
+        if (nameCount && (argValue[0U] == L'-') && (argValue[1U] == L'-') && (argValue[2U] == L'\0'))
+        {
+            command = &argv[argOff + 1];
+            commandCount = (DWORD)(argc - (argOff + 1));
+            break; /*the rest is the command line of the child process*/
+        }
+        if ((!endOfOptions) && (argValue[0U] == L'-') && (argValue[1U] != L'\0'))
+        {
+            if ((argValue[1U] == L'-') && (argValue[2U] == L'\0'))
+            {
+                endOfOptions = TRUE; /*stop!*/
+            }
+            else if (!parse_argument(&options, argValue))
+            {
+                WRITE_TEXT(L"[tee] Error: Invalid option \"", argValue, L"\" encountered!\n");
+                return 1;
+            }
+            continue;
+        }
+        const BOOL isStdOut = (argValue[0U] == L'-') && (argValue[1U] == L'\0');
+        if ((!(nameCount++)) || isStdOut)
+        {
+            if (!stdOutNamed)
+            {
+                threadData[0U].overflow = options.overflow;
+                threadData[0U].maxLag = options.maxLag;
+                threadData[0U].timestamps = options.timestamps;
+                threadData[0U].compress = isStdOut ? options.compress : COMPRESS_NONE; /*only if it is named explicitly*/
+                threadData[0U].match = isStdOut ? options.match : NULL;
+                threadData[0U].strip = isStdOut && options.stripAnsi;
+                threadData[0U].stream = isStdOut ? options.stream : STREAM_ALL;
+                threadData[0U].tagged = isStdOut && options.tagStreams;
+            }
+            stdOutNamed = stdOutNamed || isStdOut;
+        }
+        if ((!isStdOut) && (!is_null_device(argValue)))
+        {
+            if (fileCount >= ARRAYSIZE(hMyFiles))
+            {
+                tooManyFiles = TRUE;
+                continue;
+            }
+            thread_t *const output = &threadData[++fileCount];
+            output->name = argValue;
+            output->overflow = options.overflow;
+            output->maxLag = options.maxLag;
+            output->compress = options.compress;
+            output->rotate = (options.rotateSize || options.rotateInterval);
+            output->rotateSize = options.rotateSize;
+            output->rotateInterval = options.rotateInterval * 1000U;
+            output->rotateKeep = options.rotateKeep;
+            output->timestamps = options.timestamps;
+            output->match = options.match;
+            output->strip = options.stripAnsi;
+            output->indexStep = options.index;
+            output->ringSize = options.ring;
+            output->trigger = options.ring ? options.dumpOn : NULL;
+            output->connection = is_connection_name(argValue);
+            output->stream = options.stream;
+            output->tagged = options.tagStreams;
+        }
+    }
+
+    /* Print manual page */
+    if (options.help || options.version)
+    {
+        print_helpscreen(hStdErr, options.help);
+        return 0;
+    }
+
+    /* Copy a range of an indexed file, instead of the input */
+    if (options.lookup)
+    {
+        return lookup_range(hStdOut, hStdErr, options.lookup, options.from, options.to);
+    }
+    else if (options.from || options.to)
+    {
+        write_text(hStdErr, L"[tee] Error: The --from and --to options require the --lookup option!\n");
+        return 1;
+    }
+
+    /* Check output file name */
+    if (!nameCount)
+    {
+        write_text(hStdErr, L"[tee] Error: Output file name is missing. Type \"tee --help\" for details!\n");
+        return 1;
+    }
+
+    /* Check the command, the interrupt signal reaches the child process as well, so its output is captured until it exits */
+    if (command)
+    {
+        if (!commandCount)
+        {
+            write_text(hStdErr, L"[tee] Error: The command is missing after \"--\"!\n");
+            return 1;
+        }
+        options.ignore = TRUE;
+    }
+
+    /* Determine number of outputs */
+    const DWORD outputCount = fileCount + 1U;
+    for (DWORD threadId = 1U; threadId < outputCount; ++threadId)
+    {
+        thread_t *const output = &threadData[threadId];
+        if (output->connection && (output->rotate || output->indexStep || output->ringSize))
+        {
+            WRITE_TEXT(L"[tee] Warning: The connection \"", output->name, L"\" is not a file, ignoring the --rotate-*, --index and --ring options!\n");
+            output->rotate = FALSE;
+            output->indexStep = output->ringSize = 0U;
+            output->trigger = NULL;
+        }
+        if (output->connection && (output->overflow == OVERFLOW_BLOCK) && (!options.split))
+        {
+            output->overflow = OVERFLOW_DROP; /*a collector must not stall the reader*/
+        }
+        if (output->ringSize && ((output->compress != COMPRESS_NONE) || output->rotate || output->indexStep))
+        {
+            WRITE_TEXT(L"[tee] Warning: The flight recorder \"", output->name, L"\" is dumped as it is, ignoring the --compress, --rotate-* and --index options!\n");
+            output->compress = COMPRESS_NONE;
+            output->rotate = FALSE;
+            output->indexStep = 0U;
+        }
+        if (output->ringSize)
+        {
+            output->overflow = OVERFLOW_BLOCK; /*copying into memory never falls behind*/
+        }
+        if (output->indexStep && (options.append || (output->compress != COMPRESS_NONE) || output->rotate))
+        {
+            WRITE_TEXT(L"[tee] Warning: No index can be built for the compressed, rotated or appended file \"", output->name, L"\"!\n");
+            output->indexStep = 0U; /*the offsets would not refer to the file as it is*/
+        }
+    }
+    if (!command)
+    {
+        BOOL streamOptions = FALSE;
+        for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+        {
+            streamOptions = streamOptions || threadData[threadId].stream || threadData[threadId].tagged;
+            threadData[threadId].stream = STREAM_ALL; /*without a command, there is only one stream*/
+            threadData[threadId].tagged = FALSE;
+        }
+        if (streamOptions)
+        {
+            write_text(hStdErr, L"[tee] Warning: There is no command, ignoring the --stream and --tag-streams options!\n");
+        }
+    }
+    for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+    {
+        decoupled = decoupled || (threadData[threadId].overflow != OVERFLOW_BLOCK);
+        spill = spill || (threadData[threadId].overflow == OVERFLOW_SPILL);
+        compressCount += (threadData[threadId].compress != COMPRESS_NONE) ? 1U : 0U;
+        rotateCount += threadData[threadId].rotate ? 1U : 0U;
+        timestamps = timestamps || threadData[threadId].timestamps;
+        tagged = tagged || threadData[threadId].tagged;
+        filtered = filtered || (threadData[threadId].match != NULL) || (threadData[threadId].trigger != NULL);
+        indexed = indexed || (threadData[threadId].indexStep != 0U);
+        stripped = stripped || threadData[threadId].strip;
+        recorded = recorded || (threadData[threadId].ringSize != 0U);
+        connected = connected || threadData[threadId].connection;
+        poolCount += ((threadId > 0U) && can_pool(&threadData[threadId])) ? 1U : 0U;
+    }
+
+    /* In split mode, every output takes its share of the chunks, so the reader must not skip an output that falls behind */
+    if (options.split && decoupled)
+    {
+        write_text(hStdErr, L"[tee] Error: The --split option can only be used with the \"block\" overflow policy!\n");
+        return 1;
+    }
+
+    /* The digests of the pieces are an addition to the digests of the whole stream */
+    if (options.hashPiece && (!options.hash))
+    {
+        write_text(hStdErr, L"[tee] Error: The --hash-piece option requires the --hash option!\n");
+        return 1;
+    }
+
+    /* A pattern can only trigger the dump of a flight recorder */
+    if (options.dumpOn && (!recorded))
+    {
+        write_text(hStdErr, L"[tee] Warning: There is no flight recorder (--ring) to dump, ignoring the --dump-on option!\n");
+    }
+
+    /* Pace the console output in frames; skipping ahead is only acceptable for a console, not for a pipe or a file */
+    const BOOL framed = options.frame && is_terminal(hStdOut) && (threadData[0U].compress == COMPRESS_NONE) && (!(options.split && fileCount && (!stdOutNamed)));
+    if (options.frame && (!framed))
+    {
+        write_text(hStdErr, L"[tee] Warning: The standard output is not an uncompressed console, ignoring the --frame option!\n");
+    }
+
+    /* Use the zero-copy engine, if the input is a pipe that supports it (write combining, direct I/O, timed flushes, compression, rotation, line mode, escape stripping, split mode, hashing, indexing, frame pacing, flight recorders, connections, child processes and decoupled outputs need the ring) */
+    const BOOL lineMode = options.lines || timestamps || tagged || filtered;
+    const DWORD hasherCount = options.hash ? 1U : 0U;
+    const BOOL zeroCopy = (!options.noSplice) && (!options.direct) && (!options.flushInterval) && (!decoupled) && (!compressCount) && (!rotateCount) && (!lineMode) && (!stripped) && (!recorded) && (!connected) && (!options.split) && (!hasherCount) && (!indexed) && (!framed) && (!options.chunkSize) && (!options.buffer) && (!options.delay) && (outputCount <= MAX_THREADS) && (!command) && can_splice(hStdIn);
+    const DWORD processorCount = get_processor_count();
+
+    /* Distribute the output files with the "block" policy over the writer pool, if --writers is given or if there are too many outputs for one thread each; all other outputs need a thread of their own (and so do all outputs in split mode) */
+    if (zeroCopy || options.split || ((!options.writers) && (outputCount + hasherCount + (compressCount ? 1U : 0U) <= MAX_THREADS)))
+    {
+        poolCount = 0U;
+    }
+    else if (poolCount)
+    {
+        writerCount = options.writers ? options.writers : ((processorCount < MAX_WRITERS) ? (processorCount ? processorCount : 1U) : MAX_WRITERS);
+        writerCount = (writerCount < poolCount) ? writerCount : poolCount;
+    }
+
+    if (writerCount + (outputCount - poolCount) + hasherCount > MAX_THREADS)
+    {
+        write_text(hStdErr, L"[tee] Error: Too many outputs that need a writer thread of their own!\n");
+        return 1;
+    }
+
+    /* The compressors are shared by all compressed outputs, they get the threads that are left */
+    if (compressCount)
+    {
+        const DWORD available = MAX_THREADS - (writerCount + (outputCount - poolCount) + hasherCount);
+        compressorCount = options.compressors ? options.compressors : ((processorCount < MAX_COMPRESSORS) ? (processorCount ? processorCount : 1U) : MAX_COMPRESSORS);
+        compressorCount = (compressorCount < available) ? compressorCount : available;
+        if (!compressorCount)
+        {
+            write_text(hStdErr, L"[tee] Error: Too many outputs, no threads are left for the compression!\n");
+            return 1;
+        }
+        jobsPerOutput = ((compressorCount + compressCount - 1U) / compressCount) + 1U; /*keep all compressors busy, plus the block being filled*/
+    }
+
+    /* Check whether the input is a regular file, which is read in larger chunks (or mapped); so are the large pipes of a child process */
+    const BOOL inputFile = (!command) && get_file_range(hStdIn, &inputOffset, &inputSize);
+
+    /* Allocate buffers; with decoupled outputs, the default ring is deep enough to absorb a burst, because the default --max-lag is the ring size minus one */
+    const DWORD bufferSize = options.bufferSize ? options.bufferSize : ((inputFile || command) ? DEFAULT_FILE_BUFFER_SIZE : DEFAULT_BUFFER_SIZE);
+    DWORD bufferCount = options.bufferCount ? options.bufferCount : DEFAULT_BUFFERS;
+    if (decoupled && (!options.bufferCount))
+    {
+        bufferCount = DEFAULT_DECOUPLED_BYTES / bufferSize;
+        bufferCount = (bufferCount < DEFAULT_BUFFERS_DECOUPLED) ? DEFAULT_BUFFERS_DECOUPLED : ((bufferCount > MAX_BUFFERS) ? MAX_BUFFERS : bufferCount);
+    }
+    BOOL largePages = options.largePages;
+    if (!initialize_slots(bufferSize, bufferCount, &largePages))
+    {
+        write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+        return 1;
+    }
+    else if (options.largePages && (!largePages))
+    {
+        write_text(hStdErr, L"[tee] Warning: Large pages are not available, falling back to regular pages!\n");
+    }
+
+    /* Map the input file into memory, or at least enable the read-ahead */
+    if (inputFile)
+    {
+        if (!(mapped = (!options.noMmap) && open_input_map(&inputMap, hStdIn, inputOffset, inputSize)))
+        {
+            advise_sequential(hStdIn);
+        }
+    }
+
+    /* Allocate statistics */
+    if (options.stats || options.statsPeriod || options.statsFile)
+    {
+        if (!initialize_stats())
+        {
+            write_text(hStdErr, L"[tee] Error: Failed to allocate the statistics memory!\n");
+            goto cleanUp;
+        }
+        myStats = GET_STATS(0U);
+    }
+
+    /* Compile the patterns, each distinct pattern is matched only once per chunk */
+    for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+    {
+        thread_t *const output = &threadData[threadId];
+        if (output->match && (!register_pattern(output->match, &output->pattern)))
+        {
+            WRITE_TEXT(L"[tee] Error: Invalid pattern \"", output->match, L"\" encountered!\n");
+            goto cleanUp;
+        }
+        if (output->trigger && (!register_pattern(output->trigger, &output->triggerPattern)))
+        {
+            WRITE_TEXT(L"[tee] Error: Invalid pattern \"", output->trigger, L"\" encountered!\n");
+            goto cleanUp;
+        }
+    }
+    for (DWORD index = 0U; g_patternCount && (index < g_bufferCount); ++index)
+    {
+        if (!(GET_SLOT(index)->matches = (match_t*)alloc_memory(sizeof(match_t) * g_patternCount)))
+        {
+            write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+            goto cleanUp;
+        }
+    }
+
+    /* Synchronize the wall clock for the timestamps (and the seek indices) with the high-resolution timer */
+    if (timestamps || indexed)
+    {
+        initialize_clock();
+    }
+
+    /* Allocate the compression jobs and the compressor states */
+    if (compressCount)
+    {
+        g_compressJobCount = compressCount * jobsPerOutput;
+        if (!(g_compressJobs = (compress_job_t*)alloc_memory(sizeof(compress_job_t) * g_compressJobCount)))
+        {
+            write_text(hStdErr, L"[tee] Error: Failed to allocate the compression memory!\n");
+            g_compressJobCount = 0U;
+            goto cleanUp;
+        }
+        for (DWORD jobId = 0U; jobId < g_compressJobCount; ++jobId)
+        {
+            compress_job_t *const job = &g_compressJobs[jobId];
+            if (!((job->input = (BYTE*)alloc_memory(COMPRESS_BLOCK_SIZE)) && (job->output = (BYTE*)alloc_memory(gzip_bound(COMPRESS_BLOCK_SIZE)))))
+            {
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the compression memory!\n");
+                goto cleanUp;
+            }
+        }
+        for (DWORD compressorId = 0U; compressorId < compressorCount; ++compressorId)
+        {
+            compressors[compressorId].level = options.compressLevel ? options.compressLevel : DEFLATE_DEFAULT_LEVEL;
+            if (!(compressors[compressorId].state = deflate_create(COMPRESS_BLOCK_SIZE)))
+            {
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the compression memory!\n");
+                goto cleanUp;
+            }
+        }
+    }
 
     /* Enable ANSI escape code processing of stdout */
     if (options.escape)
     {
-        DWORD stdOutMode = 0U;
-        if (GetConsoleMode(hStdOut, &stdOutMode))
+        enable_escape_codes(hStdOut);
+    }
+
+    /* Create the completion queues of the writer pool (direct I/O is synchronous), or fall back to one thread per output */
+    BOOL asyncIO = (writerCount > 0U) && (!options.direct);
+    for (DWORD writerId = 0U; asyncIO && (writerId < writerCount); ++writerId)
+    {
+        asyncIO = ((writers[writerId].queue = async_create((poolCount + writerCount - 1U) / writerCount)) != NULL);
+    }
+
+    if (writerCount && (!asyncIO))
+    {
+        for (DWORD writerId = 0U; writerId < writerCount; ++writerId)
+        {
+            async_destroy(writers[writerId].queue);
+            writers[writerId].queue = NULL;
+        }
+        if ((!options.writers) && (outputCount + compressorCount <= MAX_THREADS))
+        {
+            writerCount = poolCount = 0U;
+        }
+    }
+
+    /* Open output file(s) */
+    g_pageMask = get_page_size() - 1U;
+    for (DWORD fileIndex = 0U; fileIndex < fileCount; ++fileIndex)
+    {
+        thread_t *const output = &threadData[fileIndex + 1U];
+        BOOL direct = FALSE;
+        if (output->connection)
+        {
+            output->connectStart = get_tick_count();
+            if ((output->hOutput = open_connection(output->name, CONNECTION_TIMEOUT)) == INVALID_FILE)
+            {
+                WRITE_TEXT(L"[tee] Warning: Failed to connect to \"", output->name, L"\", retrying in the background!\n");
+            }
+            continue;
+        }
+        if (options.direct && (!output->ringSize)) /*the dumps are written in pieces of any size*/
+        {
+            hMyFiles[fileIndex] = open_file_direct(output->name, options.append, &direct);
+        }
+        else
+        {
+            hMyFiles[fileIndex] = (asyncIO && can_pool(output)) ? open_file_async(output->name, options.append) : open_file(output->name, options.append);
+        }
+        if (hMyFiles[fileIndex] == INVALID_FILE)
+        {
+            WRITE_TEXT(L"[tee] Error: Failed to open the output file \"", output->name, L"\" for writing!\n");
+            goto cleanUp;
+        }
+        if (direct)
+        {
+            BOOL noLargePages = FALSE;
+            if (!(output->staging = alloc_pages(g_bufferSize, &noLargePages)))
+            {
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+                goto cleanUp;
+            }
+        }
+        else if (options.direct && (!output->ringSize))
+        {
+            WRITE_TEXT(L"[tee] Warning: Direct I/O is not possible for \"", output->name, L"\", falling back to buffered I/O!\n");
+        }
+        if (options.preallocate && (!preallocate_file(hMyFiles[fileIndex], options.preallocate)))
+        {
+            WRITE_TEXT(L"[tee] Warning: Failed to preallocate disk space for \"", output->name, L"\"!\n");
+        }
+        if (output->indexStep && (!(output->index = create_index(output->name, output->indexStep))))
+        {
+            WRITE_TEXT(L"[tee] Warning: Failed to create the index of \"", output->name, L"\"!\n");
+        }
+        if (output->rotate && options.append)
+        {
+            ULONGLONG position;
+            if (!get_file_range(hMyFiles[fileIndex], &position, &output->segmentBytes))
+            {
+                output->segmentBytes = 0U; /*the first segment continues the existing file*/
+            }
+        }
+    }
+
+    /* Check output file name */
+    if (tooManyFiles)
+    {
+        write_text(hStdErr, L"[tee] Warning: Too many input files, ignoring excess files!\n");
+    }
+
+    /* Start threads */
+    DWORD poolIndex = 0U, compressIndex = 0U;
+    g_compressActive = (LONG)compressCount;
+    for (DWORD threadId = 0; threadId < outputCount; ++threadId)
+    {
+        thread_t *const output = &threadData[threadId];
+        if (!output->connection)
+        {
+            output->hOutput = (threadId > 0U) ? hMyFiles[threadId - 1U] : hStdOut; /*a connection has been opened already*/
+        }
+        output->hError = hStdErr;
+        output->flush = (options.flush || options.flushInterval || options.flushBytes) && (!is_terminal(output->hOutput)) && (!output->ringSize) && (!output->connection);
+        output->flushInterval = options.flushInterval;
+        output->flushBytes = options.flushBytes;
+        output->segmentStart = get_tick_count();
+        output->stats = myStats ? GET_STATS(threadId + 1U) : NULL;
+        if (!output->name)
+        {
+            output->name = L"<stdout>";
+        }
+        if ((!threadId) && framed)
+        {
+            console.hOutput = hStdOut;
+            console.hError = hStdErr;
+            console.stats = output->stats;
+            console.budget = options.frameBudget ? options.frameBudget : DEFAULT_FRAME_BUDGET;
+            console.tailLines = options.frameLines ? options.frameLines : DEFAULT_FRAME_LINES;
+            if (!(console.fill = (BYTE*)alloc_memory(2U * (NOTICE_SIZE + console.budget))))
+            {
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+                goto cleanUp;
+            }
+            console.fill += NOTICE_SIZE;
+            console.spare = console.fill + console.budget + NOTICE_SIZE; /*both frames in one allocation*/
+            output->console = &console;
+            output->flush = TRUE; /*each "flush" presents a frame*/
+            output->flushInterval = options.frame;
+            output->flushBytes = 0U;
+        }
+        if (options.split)
         {
-            SetConsoleMode(hStdOut, stdOutMode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+            if ((!threadId) && fileCount && (!stdOutNamed))
+            {
+                continue; /*the standard output takes a share only if it is named explicitly*/
+            }
+            if (!(output->queue = (DWORD*)alloc_memory(sizeof(DWORD) * g_bufferCount)))
+            {
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+                goto cleanUp;
+            }
         }
-    }
-
-    /* Open output file(s) */
-    while ((argOff < argc) && (fileCount < ARRAYSIZE(hMyFiles)))
-    {
-        const wchar_t* const fileName = argv[argOff++];
-        if (!is_null_device(fileName))
+        if (output->overflow != OVERFLOW_BLOCK)
         {
-            const HANDLE hFile = CreateFileW(fileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, options.append ? OPEN_ALWAYS : CREATE_ALWAYS, 0U, NULL);
-            if ((hMyFiles[fileCount++] = hFile) == INVALID_HANDLE_VALUE)
+            BOOL noLargePages = FALSE;
+            if ((!output->maxLag) || (output->maxLag >= g_bufferCount))
+            {
+                output->maxLag = g_bufferCount - 1U;
+            }
+            if (!(output->buffer = alloc_pages(g_bufferSize, &noLargePages)))
             {
-                WRITE_TEXT(L"[tee] Error: Failed to open the output file \"", fileName, L"\" for writing!\n");
+                write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
                 goto cleanUp;
             }
-            else if (options.append)
+        }
+        if (output->ringSize)
+        {
+            BOOL noLargePages = FALSE;
+            if (!((((SIZE_T)output->ringSize) == output->ringSize) && (output->recorder = (recorder_t*)alloc_memory(sizeof(recorder_t))) && (output->recorder->memory = alloc_pages((SIZE_T)output->ringSize, &noLargePages))))
             {
-                LARGE_INTEGER offset = { .QuadPart = 0LL };
-                if (!SetFilePointerEx(hFile, offset, NULL, FILE_END))
-                {
-                    write_text(hStdErr, L"[tee] Error: Failed to move the file pointer to the end of the file!\n");
-                    goto cleanUp;
-                }
+                WRITE_TEXT(L"[tee] Error: Failed to allocate the memory of the flight recorder \"", output->name, L"\"!\n");
+                goto cleanUp;
+            }
+            output->recorder->capacity = (SIZE_T)output->ringSize;
+        }
+        if ((output->timestamps || output->tagged || output->match || output->strip) && (!(output->lines = (BYTE*)alloc_memory(g_bufferSize + PREFIX_LENGTH))))
+        {
+            write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+            goto cleanUp;
+        }
+        if (output->compress != COMPRESS_NONE)
+        {
+            output->jobs = &g_compressJobs[(compressIndex++) * jobsPerOutput];
+            output->jobCount = jobsPerOutput;
+        }
+        else if (writerCount && (threadId > 0U) && can_pool(output))
+        {
+            ULONGLONG fileSize;
+            if (!get_file_range(output->hOutput, &output->writeOffset, &fileSize))
+            {
+                output->writeOffset = ASYNC_NO_OFFSET;
+            }
+            output->async = asyncIO && async_attach(writers[(poolIndex * writerCount) / poolCount].queue, output->hOutput);
+            poolOutputs[poolIndex++] = output;
+            continue; /*written by the pool*/
+        }
+        if (zeroCopy)
+        {
+            if (can_splice(output->hOutput))
+            {
+                continue; /*the reader feeds this output directly*/
+            }
+            if (!create_pipe(&output->hPipeRead, &output->hPipeWrite, (g_bufferSize <= MAXDWORD / g_bufferCount) ? (g_bufferSize * g_bufferCount) : g_bufferSize))
+            {
+                write_text(hStdErr, L"[tee] Operating system error: Failed to create the pipe!\n");
+                goto cleanUp;
             }
         }
+        if (!create_thread(&hThreads[threadCount], zeroCopy ? splice_thread_start_routine : writer_thread_start_routine, output))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the worker thread!\n");
+            goto cleanUp;
+        }
+        ++threadCount;
+        if (output->queue)
+        {
+            splitOutputs[splitCount++] = output;
+        }
     }
 
-    /* Check output file name */
-    if (argOff < argc)
+    for (DWORD writerId = 0U; writerId < writerCount; ++writerId)
     {
-        write_text(hStdErr, L"[tee] Warning: Too many input files, ignoring excess files!\n");
+        writer_t *const writer = &writers[writerId];
+        const DWORD first = ((writerId * poolCount) + writerCount - 1U) / writerCount;
+        const DWORD last = (((writerId + 1U) * poolCount) + writerCount - 1U) / writerCount;
+        writer->outputs = &poolOutputs[first];
+        writer->outputCount = last - first;
+        writer->hError = hStdErr;
+        writer->timedFlush = (options.flushInterval != 0U);
+        if (!create_thread(&hThreads[threadCount], pool_thread_start_routine, writer))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the worker thread!\n");
+            goto cleanUp;
+        }
+        ++threadCount;
     }
 
-    /* Determine number of outputs */
-    const DWORD outputCount = fileCount + 1U;
+    /* Start the hasher, which consumes the chunks like an output */
+    if (hasherCount)
+    {
+        hasher.algorithms = options.hash;
+        hasher.pieceSize = options.hashPiece;
+        reset_hasher(&hasher);
+        if (!create_thread(&hThreads[threadCount], hasher_thread_start_routine, &hasher))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the worker thread!\n");
+            goto cleanUp;
+        }
+        ++threadCount;
+    }
 
-    /* Start threads */
-    for (DWORD threadId = 0; threadId < outputCount; ++threadId)
+    /* Every thread started so far consumes the chunks, the compressors do not */
+    pendingCount = zeroCopy ? 0U : threadCount;
+    for (DWORD compressorId = 0U; compressorId < compressorCount; ++compressorId)
+    {
+        if (!create_thread(&hThreads[threadCount], compressor_thread_start_routine, &compressors[compressorId]))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the worker thread!\n");
+            goto cleanUp;
+        }
+        ++threadCount;
+    }
+
+    /* Start the rotator, which opens the next segment of each rotated output in advance */
+    if (rotateCount)
     {
-        threadData[threadId].hOutput = (threadId > 0U) ? hMyFiles[threadId - 1U] : hStdOut;
-        threadData[threadId].hError = hStdErr;
-        threadData[threadId].flush = options.flush && (!is_terminal(threadData[threadId].hOutput));
-        if (!(hThreads[threadCount++] = CreateThread(NULL, 0U, writer_thread_start_routine, (LPVOID)&threadData[threadId], 0U, NULL)))
+        rotator.outputs = threadData;
+        rotator.outputCount = outputCount;
+        rotator.append = options.append;
+        rotator.preallocate = options.preallocate;
+        rotator.hError = hStdErr;
+        if (!create_thread(&hRotator, rotator_thread_start_routine, &rotator))
         {
-            write_text(hStdErr, L"[tee] Operating system error: CreateThread() has failed!\n");
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the rotator thread!\n");
+            hRotator = NULL;
             goto cleanUp;
         }
     }
 
-    /* Determine minumum chunk size */
-    const DWORD minimumLength = options.buffer ? (BUFFER_SIZE / 8U) : 1U;
+    /* Start the console renderer */
+    if (framed)
+    {
+        if (!create_thread(&hRenderer, console_thread_start_routine, &console))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the renderer thread!\n");
+            hRenderer = NULL;
+            goto cleanUp;
+        }
+    }
 
-    /* Process all input from STDIN stream */
-    do
+    /* Start the dumper, which writes the contents of the flight recorders to their files */
+    if (recorded)
     {
-        ASSERT(myIndex < BUFFERS, hStdErr, L"Current buffer index is out of range!");
+        dumper.outputs = threadData;
+        dumper.outputCount = outputCount;
+        dumper.append = options.append;
+        dumper.hError = hStdErr;
+        if (!(dumper.buffer = (BYTE*)alloc_memory(DUMP_PIECE_SIZE)))
+        {
+            write_text(hStdErr, L"[tee] Error: Failed to allocate the buffer memory!\n");
+            goto cleanUp;
+        }
+        install_dump_handler(&g_dumpSignals);
+        if (!create_thread(&hDumper, dumper_thread_start_routine, &dumper))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the dumper thread!\n");
+            hDumper = NULL;
+            goto cleanUp;
+        }
+    }
 
-        AcquireSRWLockExclusive(rwLock = &g_rwLocks[myIndex]);
+    /* Determine the write combining parameters */
+    const DWORD targetLength = options.chunkSize ? ((options.chunkSize < g_bufferSize) ? options.chunkSize : g_bufferSize) : (options.buffer ? (g_bufferSize / 8U) : (options.delay ? g_bufferSize : 1U));
+    const DWORD maxDelay = options.maxDelay ? options.maxDelay : (options.delay ? 1U : DEFAULT_MAX_DELAY);
 
-        while (g_pending[myIndex])
+    /* Start the statistics reporter */
+    reporter.outputCount = outputCount;
+    reporter.outputs = threadData;
+    reporter.startTime = get_timestamp();
+    if (myStats && (options.statsPeriod || options.statsFile))
+    {
+        reporter.interval = options.statsPeriod ? options.statsPeriod : DEFAULT_STATS_PERIOD;
+        if (options.statsFile)
         {
-            sleep_condvar_srw(hStdErr, &g_condAllDone[myIndex], rwLock, INFINITE, FALSE);
+            if ((hStatsFile = open_file(options.statsFile, FALSE)) == INVALID_FILE)
+            {
+                WRITE_TEXT(L"[tee] Error: Failed to open the statistics file \"", options.statsFile, L"\" for writing!\n");
+                goto cleanUp;
+            }
+        }
+        reporter.hOutput = (hStatsFile != INVALID_FILE) ? hStatsFile : hStdErr;
+        if (!create_thread(&hReporter, reporter_thread_start_routine, &reporter))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to create the statistics thread!\n");
+            hReporter = NULL;
+            goto cleanUp;
         }
+    }
 
-        BYTE *const ptrBuffer = g_buffer[myIndex];
+    /* Start the command, its standard output and standard error take the place of the standard input */
+    file_handle_t hInput = hStdIn;
+    if (command)
+    {
+        if (!start_process(command, commandCount, options.pipeSize ? options.pipeSize : DEFAULT_PIPE_SIZE, &hStreams[0U], &hStreams[1U], &hChild))
+        {
+            WRITE_TEXT(L"[tee] Error: Failed to start the command \"", command[0U], L"\"!\n");
+            goto cleanUp;
+        }
+        childRunning = TRUE;
+        openStreams = 2U;
+    }
 
-        for (totalBytes = 0U; totalBytes < minimumLength; totalBytes += bytesRead)
+    /* Process all input from STDIN stream */
+    if (zeroCopy)
+    {
+        readErrors = !splice_input(hStdIn, threadData, outputCount, myStats, options.ignore);
+        for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+        {
+            if (threadData[threadId].spliceErrors && (threadData[threadId].hPipeWrite == INVALID_FILE))
+            {
+                write_text(hStdErr, L"[tee] I/O error: Not all data could be written!\n");
+            }
+        }
+    }
+    else
+    {
+        do
         {
-            if (!ReadFile(hStdIn, &ptrBuffer[totalBytes], BUFFER_SIZE - totalBytes, &bytesRead, NULL))
+            ASSERT(myIndex < g_bufferCount, hStdErr, L"Current buffer index is out of range!");
+
+            slot = GET_SLOT(myIndex);
+            if (myStats)
+            {
+                const ULONGLONG waitStart = get_timestamp();
+                wait_for_release(slot);
+                counter_add(&myStats->waitTicks, get_timestamp() - waitStart);
+            }
+            else
             {
-                if (GetLastError() != ERROR_BROKEN_PIPE)
+                wait_for_release(slot);
+            }
+
+            BYTE *ptrBuffer = slot->memory;
+            DWORD firstTick = 0U, lineEnd = 0U, lineTick = 0U;
+            BOOL holdTail = lineMode;
+            const BOOL stopping = g_stop && (!options.ignore);
+            totalBytes = 0U;
+
+            /* Each chunk comes from one stream of the child process, the one that has data; a partial line is completed from the same stream */
+            if (openStreams && (!carry))
+            {
+                if (!wait_for_input(hStreams, 2U, &streamId))
+                {
+                    readErrors = TRUE;
+                    break;
+                }
+                hInput = hStreams[streamId];
+            }
+
+            if (carry)
+            {
+                copy_memory(ptrBuffer, carryFrom, carry); /*the rest of the previous chunk, it counts from the time it was read*/
+                const BYTE *const last = scan_backward(ptrBuffer, ptrBuffer + carry, '\n');
+                lineEnd = last ? ((DWORD)(last - ptrBuffer) + 1U) : 0U;
+                totalBytes = carry;
+                firstTick = lineTick = carryTick;
+                carry = 0U;
+            }
+
+            if (mapped)
+            {
+                const ULONGLONG readStart = myStats ? get_timestamp() : 0U;
+                BYTE *const chunk = next_mapped_chunk(&inputMap, &totalBytes);
+                if (chunk)
+                {
+                    ptrBuffer = chunk;
+                    if (lineMode && (inputMap.position < inputMap.end))
+                    {
+                        const BYTE *const last = scan_backward(chunk, chunk + totalBytes, '\n');
+                        if (last)
+                        {
+                            const DWORD tail = totalBytes - ((DWORD)(last - chunk) + 1U);
+                            inputMap.position -= tail; /*the next chunk starts with the partial line*/
+                            totalBytes -= tail;
+                        }
+                    }
+                    if (myStats)
+                    {
+                        stats_record_read(myStats, readStart, totalBytes);
+                    }
+                }
+                else
+                {
+                    mapped = FALSE; /*continue with regular reads*/
+                    readErrors = !set_file_position(hStdIn, inputMap.position);
+                }
+            }
+
+            for (; (!mapped) && (!readErrors) && (!stopping) && ((totalBytes < targetLength) || (holdTail && (!lineEnd) && (totalBytes < g_bufferSize))); totalBytes += bytesRead)
+            {
+                BOOL timedOut = FALSE, result;
+                const ULONGLONG readStart = myStats ? get_timestamp() : 0U;
+                if (!totalBytes)
+                {
+                    result = read_file(hInput, ptrBuffer, g_bufferSize, &bytesRead);
+                    firstTick = get_tick_count();
+                }
+                else
+                {
+                    const DWORD elapsed = get_tick_count() - firstTick;
+                    if (elapsed >= maxDelay)
+                    {
+                        holdTail = FALSE;
+                        break; /*latency limit reached*/
+                    }
+                    result = read_file_timeout(hInput, &ptrBuffer[totalBytes], g_bufferSize - totalBytes, &bytesRead, maxDelay - elapsed, &timedOut);
+                }
+                if (myStats && result && (!timedOut) && bytesRead)
+                {
+                    stats_record_read(myStats, readStart, bytesRead);
+                }
+                if (!result)
                 {
                     readErrors = TRUE;
+                    break;
+                }
+                if (timedOut || (!bytesRead))
+                {
+                    holdTail = FALSE;
+                    break; /*timeout or end of input*/
+                }
+                if (lineMode)
+                {
+                    const BYTE *const last = scan_backward(&ptrBuffer[totalBytes], &ptrBuffer[totalBytes + bytesRead], '\n');
+                    if (last)
+                    {
+                        lineEnd = (DWORD)(last - ptrBuffer) + 1U;
+                        lineTick = get_tick_count();
+                    }
+                }
+            }
+
+            /* Hold back the partial line at the end, unless the line is too long or has timed out */
+            if (holdTail && (!readErrors) && lineEnd && (lineEnd < totalBytes))
+            {
+                carry = totalBytes - lineEnd;
+                carryFrom = ptrBuffer + lineEnd;
+                carryTick = lineTick;
+                totalBytes = lineEnd;
+            }
+
+            if (!totalBytes)
+            {
+                if (openStreams && (!readErrors))
+                {
+                    CLOSE_FILE(hStreams[streamId]);
+                    if (--openStreams)
+                    {
+                        continue; /*the other stream of the child process is still open*/
+                    }
                 }
                 break;
             }
-            if ((!bytesRead) && (inputType != FILE_TYPE_PIPE))
+
+            /* Classify the lines for the outputs with a pattern, the lines that do not fit are carried over as well */
+            if (g_patternCount)
             {
-                break; /*pipes may return zero bytes, even when more data can become available later!*/
+                const DWORD limit = classify_chunk(slot, ptrBuffer, totalBytes);
+                if (limit < totalBytes)
+                {
+                    if (mapped)
+                    {
+                        inputMap.position -= totalBytes - limit;
+                    }
+                    else
+                    {
+                        carryTick = carry ? carryTick : firstTick;
+                        carry += totalBytes - limit;
+                        carryFrom = ptrBuffer + limit;
+                    }
+                    totalBytes = limit;
+                }
             }
-        }
 
-        if (!totalBytes)
-        {
-            ReleaseSRWLockExclusive(rwLock);
-            break;
-        }
+            slot->buffer = ptrBuffer;
+            slot->stream = command ? (STREAM_STDOUT + streamId) : STREAM_ALL;
+            slot->timestamp = (timestamps || indexed) ? get_timestamp() : 0U;
+            slot->bytesTotal = totalBytes;
+            slot->pending = options.split ? ((LONG)(1U + hasherCount)) : (LONG)pendingCount;
+            publish_chunk(slot, mySequence);
 
-        g_bytesTotal[myIndex] = totalBytes;
-        g_pending[myIndex] = myFlag ? ((LONG)threadCount) : (-((LONG)threadCount));
+            if (options.split)
+            {
+                queue_chunk(select_output(splitOutputs, splitCount, options.split, &splitCursor), myIndex);
+            }
 
-        ReleaseSRWLockExclusive(&g_rwLocks[myIndex]);
-        WakeAllConditionVariable(&g_condIsReady[myIndex]);
+            if (myStats)
+            {
+                counter_add(&myStats->chunks, 1U);
+            }
 
-        INCREMENT_INDEX(myIndex, myFlag);
+            /* Enforce the lag limits */
+            if (decoupled)
+            {
+                for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+                {
+                    thread_t *const output = &threadData[threadId];
+                    if ((output->overflow == OVERFLOW_BLOCK) || output->detached)
+                    {
+                        continue;
+                    }
+                    if ((!atomic_load_acquire(&output->disconnected)) && (SEQUENCE_DIFF(mySequence, atomic_load_acquire(&output->position)) > (LONG)output->maxLag))
+                    {
+                        if (output->overflow == OVERFLOW_DISCONNECT)
+                        {
+                            atomic_exchange(&output->disconnected, TRUE);
+                            WRITE_TEXT(L"[tee] Warning: Output \"", output->name, L"\" has fallen too far behind and has been disconnected!\n");
+                        }
+                        else
+                        {
+                            const DWORD revoked = revoke_chunks(output, myIndex, mySequence, mySequence - output->maxLag);
+                            if (output->overflow == OVERFLOW_DROP)
+                            {
+                                output->dropped += revoked;
+                            }
+                        }
+                    }
+                    if (atomic_load_acquire(&output->disconnected))
+                    {
+                        if (output->overflow == OVERFLOW_SPILL)
+                        {
+                            WRITE_TEXT(L"[tee] I/O error: The spill file of output \"", output->name, L"\" has failed, disconnecting!\n");
+                        }
+                        revoke_chunks(output, myIndex, mySequence, mySequence);
+                        output->detached = TRUE;
+                        --pendingCount;
+                    }
+                }
+            }
 
-        if (readErrors)
-        {
-            break; /*abort on previous read errors*/
-        }
+            INCREMENT_INDEX(myIndex, mySequence);
 
-        if (options.delay)
-        {
-            Sleep(1U);
+            if (readErrors)
+            {
+                break; /*abort on previous read errors*/
+            }
         }
+        while ((!g_stop) || options.ignore || carry);
     }
-    while ((!g_stop) || options.ignore);
 
     /* Check for read errors */
     if (readErrors)
@@ -636,93 +4943,302 @@ int wmain(const int argc, const wchar_t *const argv[])
         goto cleanUp;
     }
 
+    /* Wait for the command to exit, once it has closed both streams (its exit code is passed on at the very end) */
+    if (childRunning)
+    {
+        if (!wait_process(hChild, &childExit))
+        {
+            write_text(hStdErr, L"[tee] Operating system error: Failed to get the exit code of the command!\n");
+            goto cleanUp;
+        }
+    }
+
     exitCode = 0;
 
 cleanUp:
 
+    /* Close the streams of the command, if it has not finished (it then fails to write) */
+    CLOSE_FILE(hStreams[0U]);
+    CLOSE_FILE(hStreams[1U]);
+
     /* Wait for the pending writes */
-    AcquireSRWLockExclusive(&g_rwLocks[myIndex]);
-    while (g_pending[myIndex])
+    slot = GET_SLOT(myIndex);
+    wait_for_release(slot);
+
+    /* Shut down the remaining worker threads */
+    slot->bytesTotal = MAXDWORD;
+    slot->pending = (LONG)pendingCount;
+    publish_chunk(slot, mySequence);
+    for (DWORD splitId = 0U; splitId < splitCount; ++splitId)
     {
-        sleep_condvar_srw(hStdErr, &g_condAllDone[myIndex], &g_rwLocks[myIndex], 25000U, FALSE);
+        queue_chunk(splitOutputs[splitId], myIndex);
     }
 
-    /* Shut down the remaining worker threads */
-    g_bytesTotal[myIndex] = MAXDWORD;
-    g_pending[myIndex] = myFlag ? MAXLONG : MINLONG;
-    ReleaseSRWLockExclusive(&g_rwLocks[myIndex]);
-    WakeAllConditionVariable(&g_condIsReady[myIndex]);
+    /* Close the intermediate pipes, so that the splicing threads see the end of input */
+    for (DWORD threadId = 0U; threadId < MAX_OUTPUTS; ++threadId)
+    {
+        CLOSE_FILE(threadData[threadId].hPipeWrite);
+    }
+
+    /* Wait for worker threads to exit (spilling outputs may need a while to drain) */
+    if (!join_threads(hThreads, threadCount, spill ? INFINITE : 10000U))
+    {
+        for (DWORD threadId = 0U; threadId < threadCount; ++threadId)
+        {
+            if (!join_thread(hThreads[threadId], 125U))
+            {
+                write_text(hStdErr, L"[tee] Internal error: Worker thread did not exit cleanly!\n");
+                terminate_thread(hThreads[threadId]);
+            }
+        }
+    }
+
+    /* Present the final frame, then stop the console renderer */
+    if (hRenderer)
+    {
+        wait_for_console(&console);
+        present_frame(&threadData[0U]);
+        wait_for_console(&console);
+        atomic_exchange(&console.state, CONSOLE_STOP);
+        wake_by_address_all(&console.state);
+        join_thread(hRenderer, INFINITE);
+        close_thread(hRenderer);
+    }
+
+    /* Stop the dumper, once it has written the final dumps */
+    if (hDumper)
+    {
+        atomic_exchange(&dumper.stop, TRUE);
+        atomic_increment(&g_dumpGeneration);
+        wake_by_address_all(&g_dumpGeneration);
+        join_thread(hDumper, INFINITE);
+        close_thread(hDumper);
+    }
+
+    /* Stop the rotator, which closes the previous segments */
+    if (hRotator)
+    {
+        atomic_exchange(&rotator.stop, TRUE);
+        atomic_increment(&g_rotateGeneration);
+        wake_by_address_all(&g_rotateGeneration);
+        join_thread(hRotator, INFINITE);
+        close_thread(hRotator);
+    }
+
+    /* Stop the statistics reporter */
+    if (hReporter)
+    {
+        atomic_exchange(&reporter.stop, TRUE);
+        wake_by_address_all(&reporter.stop);
+        join_thread(hReporter, INFINITE);
+        close_thread(hReporter);
+        write_stats_lines(&reporter);
+    }
+
+    /* Print the statistics summary */
+    if (myStats)
+    {
+        write_stats_summary(hStdErr, &reporter);
+    }
+
+    /* Report dropped and spilled chunks */
+    for (DWORD threadId = 0U; threadId < outputCount; ++threadId)
+    {
+        const thread_t *const output = &threadData[threadId];
+        if (output->dropped)
+        {
+            wchar_t dropped[11U];
+            WRITE_TEXT(L"[tee] Warning: ", format_number(dropped, output->dropped), L" chunk(s) have been dropped for output \"", output->name, L"\"!\n");
+        }
+        if (output->spilledChunks)
+        {
+            wchar_t spilled[11U], peak[11U];
+            const ULONGLONG peakKiB = (output->spillPeak + 1023U) >> 10;
+            WRITE_TEXT(L"[tee] Warning: ", format_number(spilled, output->spilledChunks), L" chunk(s) have been spilled to disk for output \"", output->name, L"\", peak spill size was ", format_number(peak, (peakKiB < MAXDWORD) ? ((DWORD)peakKiB) : MAXDWORD), L" KiB.\n");
+        }
+        if (output->unsentBytes)
+        {
+            wchar_t unsent[21U], reconnects[11U];
+            WRITE_TEXT(L"[tee] Warning: ", format_number64(unsent, output->unsentBytes), L" bytes could not be sent to \"", output->name, L"\" (reconnects: ", format_number(reconnects, output->reconnects), L")!\n");
+        }
+    }
+
+    /* Report the bytes that have been overwritten before they could be dumped */
+    for (DWORD threadId = 1U; threadId < outputCount; ++threadId)
+    {
+        const thread_t *const output = &threadData[threadId];
+        if (output->recorder && output->recorder->lostBytes)
+        {
+            wchar_t lost[21U];
+            WRITE_TEXT(L"[tee] Warning: ", format_number64(lost, output->recorder->lostBytes), L" bytes have been overwritten before they could be dumped for the flight recorder \"", output->name, L"\"!\n");
+        }
+    }
+
+    /* Report the lines that have been skipped on the console */
+    if (console.totalBytes)
+    {
+        wchar_t lines[21U], bytes[21U];
+        WRITE_TEXT(L"[tee] Warning: ", format_number64(lines, console.totalLines), L" line(s) with ", format_number64(bytes, console.totalBytes), L" bytes have been skipped on the console!\n");
+    }
+    if (console.writeErrors)
+    {
+        write_text(hStdErr, L"[tee] I/O error: Not all data could be written to the console!\n");
+    }
+
+    /* Append the remaining entries to the seek indices */
+    for (DWORD threadId = 1U; threadId < outputCount; ++threadId)
+    {
+        const thread_t *const output = &threadData[threadId];
+        if (output->index && (!write_index(output->index)))
+        {
+            WRITE_TEXT(L"[tee] Warning: Failed to write the index of \"", output->name, L"\", it is incomplete!\n");
+        }
+    }
 
-    /* Wait for worker threads to exit */
-    const DWORD pendingThreads = count_handles(hThreads, ARRAYSIZE(hThreads));
-    if (pendingThreads > 0U)
+    /* Write the digests next to each output file that contains the input as it is, or else to stderr */
+    if (hasher.algorithms && (!exitCode))
     {
-        const DWORD result = WaitForMultipleObjects(pendingThreads, hThreads, TRUE, 10000U);
-        if (!((result >= WAIT_OBJECT_0) && (result < WAIT_OBJECT_0 + pendingThreads)))
+        BOOL sidecars = FALSE;
+        if (hasher.outOfMemory)
         {
-            for (DWORD threadId = 0U; threadId < pendingThreads; ++threadId)
+            write_text(hStdErr, L"[tee] Warning: Not all digests of the pieces could be recorded!\n");
+        }
+        for (DWORD threadId = 1U; threadId < outputCount; ++threadId)
+        {
+            const thread_t *const output = &threadData[threadId];
+            if (options.append || options.split || (output->compress != COMPRESS_NONE) || output->rotate || output->timestamps || output->tagged || output->stream || output->match || output->strip || output->ringSize || output->connection || output->dropped || output->disconnected || output->writeErrors)
+            {
+                continue;
+            }
+            for (DWORD algorithm = HASH_XXH3; algorithm <= HASH_SHA256; algorithm <<= 1)
             {
-                if (WaitForSingleObject(hThreads[threadId], 125U) != WAIT_OBJECT_0)
+                if (hasher.algorithms & algorithm)
                 {
-                    write_text(hStdErr, L"[tee] Internal error: Worker thread did not exit cleanly!\n");
-                    TerminateThread(hThreads[threadId], 1U);
+                    wchar_t *const sidecar = CONCAT(output->name, (algorithm == HASH_XXH3) ? L".xxh3" : L".sha256");
+                    const file_handle_t hSidecar = sidecar ? open_file(sidecar, FALSE) : INVALID_FILE;
+                    if ((hSidecar == INVALID_FILE) || (!write_digests(hSidecar, &hasher, algorithm, output->name)))
+                    {
+                        WRITE_TEXT(L"[tee] Warning: Failed to write the digest file \"", sidecar ? sidecar : output->name, L"\"!\n");
+                    }
+                    if (hSidecar != INVALID_FILE)
+                    {
+                        close_file(hSidecar);
+                    }
+                    free_memory(sidecar);
                 }
             }
+            sidecars = TRUE;
+        }
+        for (DWORD algorithm = HASH_XXH3; (!sidecars) && (algorithm <= HASH_SHA256); algorithm <<= 1)
+        {
+            if (hasher.algorithms & algorithm)
+            {
+                write_digests(hStdErr, &hasher, algorithm, L"-");
+            }
         }
     }
 
     /* Flush the output file */
-    if (options.flush)
+    if (options.flush || options.flushInterval || options.flushBytes)
     {
         for (size_t fileIndex = 0U; fileIndex < ARRAYSIZE(hMyFiles); ++fileIndex)
         {
-            if (hMyFiles[fileIndex] != INVALID_HANDLE_VALUE)
+            if (hMyFiles[fileIndex] != INVALID_FILE)
             {
-                FlushFileBuffers(hMyFiles[fileIndex]);
+                flush_file(hMyFiles[fileIndex]);
             }
         }
     }
 
     /* Close worker threads */
-    for (DWORD threadId = 0U; threadId < ARRAYSIZE(hThreads); ++threadId)
+    for (DWORD threadId = 0U; threadId < threadCount; ++threadId)
     {
-        CLOSE_HANDLE(hThreads[threadId]);
+        close_thread(hThreads[threadId]);
     }
 
-    /* Close the output file(s) */
-    for (size_t fileIndex = 0U; fileIndex < ARRAYSIZE(hMyFiles); ++fileIndex)
+    /* Destroy the completion queues */
+    for (DWORD writerId = 0U; writerId < MAX_WRITERS; ++writerId)
     {
-        CLOSE_HANDLE(hMyFiles[fileIndex]);
+        async_destroy(writers[writerId].queue);
     }
 
-    /* Exit */
-    return exitCode;
-}
+    /* Unmap the input file */
+    close_input_map(&inputMap);
 
-// --------------------------------------------------------------------------
-// CRT Startup
-// --------------------------------------------------------------------------
+    /* Close the output file(s) and connections, rotated outputs have moved on to another segment */
+    for (size_t fileIndex = 0U; fileIndex < ARRAYSIZE(hMyFiles); ++fileIndex)
+    {
+        if (threadData[fileIndex + 1U].rotate && (threadData[fileIndex + 1U].hOutput != INVALID_FILE))
+        {
+            hMyFiles[fileIndex] = threadData[fileIndex + 1U].hOutput;
+        }
+        if (threadData[fileIndex + 1U].connection && (threadData[fileIndex + 1U].hOutput != INVALID_FILE))
+        {
+            close_connection(threadData[fileIndex + 1U].hOutput);
+        }
+        CLOSE_FILE(hMyFiles[fileIndex]);
+    }
 
-#ifndef _DEBUG
-#pragma warning(disable: 4702)
+    /* Close the spill file(s) and the intermediate pipes */
+    for (DWORD threadId = 0U; threadId < MAX_OUTPUTS; ++threadId)
+    {
+        CLOSE_FILE(threadData[threadId].hSpill);
+        CLOSE_FILE(threadData[threadId].hPipeRead);
+    }
 
-int _startup(void)
-{
-    SetErrorMode(SEM_FAILCRITICALERRORS);
+    /* Close the statistics file */
+    CLOSE_FILE(hStatsFile);
 
-    int nArgs;
-    LPWSTR *const szArglist = CommandLineToArgvW(GetCommandLineW(), &nArgs);
-    if (!szArglist)
+    /* Release buffer memory */
+    for (DWORD threadId = 0U; threadId < MAX_OUTPUTS; ++threadId)
+    {
+        if (threadData[threadId].buffer)
+        {
+            free_pages(threadData[threadId].buffer, g_bufferSize, FALSE);
+        }
+        if (threadData[threadId].staging)
+        {
+            free_pages(threadData[threadId].staging, g_bufferSize, FALSE);
+        }
+        free_memory(threadData[threadId].lines);
+        free_memory(threadData[threadId].queue);
+        if (threadData[threadId].index)
+        {
+            close_file(threadData[threadId].index->hIndex);
+            free_memory(threadData[threadId].index);
+        }
+        if (threadData[threadId].recorder)
+        {
+            if (threadData[threadId].recorder->memory)
+            {
+                free_pages(threadData[threadId].recorder->memory, threadData[threadId].recorder->capacity, FALSE);
+            }
+            free_memory(threadData[threadId].recorder);
+        }
+    }
+    free_memory(dumper.buffer);
+    free_memory(hasher.pieces);
+    if (console.fill)
     {
-        OutputDebugStringA("[tee-win32] System error: Failed to initialize command-line arguments!\n");
-        ExitProcess((UINT)-1);
+        free_memory(((console.fill < console.spare) ? console.fill : console.spare) - NOTICE_SIZE);
     }
+    for (DWORD jobId = 0U; jobId < g_compressJobCount; ++jobId)
+    {
+        free_memory(g_compressJobs[jobId].input);
+        free_memory(g_compressJobs[jobId].output);
+    }
+    free_memory(g_compressJobs);
+    for (DWORD compressorId = 0U; compressorId < MAX_COMPRESSORS; ++compressorId)
+    {
+        deflate_destroy(compressors[compressorId].state);
+    }
+    for (DWORD patternId = 0U; patternId < g_patternCount; ++patternId)
+    {
+        pattern_destroy(g_patterns[patternId]);
+    }
+    release_slots();
+    release_stats();
 
-    const int retval = wmain(nArgs, szArglist);
-    LocalFree(szArglist);
-    ExitProcess((UINT)retval);
-
-    return 0;
+    /* Exit, with the exit code of the command, unless tee itself has failed */
+    return exitCode ? exitCode : ((int)childExit);
 }
-
-#endif
@@ -0,0 +1,1858 @@
+/*
+ * tee for Windows -- unit tests
+ * Copyright (c) 2024 "dEajL3kA" <Cumpoing79@web.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sub license, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions: The above copyright notice and this
+ * permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+ * OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Unit tests for "make test". The core is included as a whole, so that the tests can reach its
+ * static functions; its "tee_main" is renamed out of the way, and this file provides the one that
+ * the POSIX startup code calls. The address waits of the core are counted on their way into the
+ * platform layer, so that a test can tell whether a thread has really gone to sleep.
+ */
+
+#define tee_main tee_core_main
+#define wait_on_address counted_wait_on_address
+#include "../tee.c"
+#undef wait_on_address
+#undef tee_main
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+BOOL wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout);
+
+#define CHECK(EXPR) do \
+{ \
+    if (!(EXPR)) \
+    { \
+        fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #EXPR); \
+        return FALSE; \
+    } \
+} \
+while (0)
+
+#define TEST_TIMEOUT 60U
+
+// --------------------------------------------------------------------------
+// Address waits
+// --------------------------------------------------------------------------
+
+/*
+ * The reader sleeps on the pending counter of a slot, the writers sleep on its sequence number.
+ */
+
+static volatile LONG g_readerSleeps = 0L, g_writerSleeps = 0L;
+
+BOOL counted_wait_on_address(volatile LONG *const address, const LONG undesired, const DWORD timeout)
+{
+    const SIZE_T offset = ((SIZE_T)(((const BYTE*)address) - g_slots)) % SLOT_SIZE;
+    atomic_increment((offset == offsetof(slot_t, pending)) ? &g_readerSleeps : &g_writerSleeps);
+    return wait_on_address(address, undesired, timeout);
+}
+
+// --------------------------------------------------------------------------
+// Ring buffer
+// --------------------------------------------------------------------------
+
+/*
+ * The first sequence number is chosen, so that the sequence numbers wrap around early in every
+ * test. Each chunk has a different length and starts with its own number, followed by a pattern
+ * that depends on that number, so that a consumer detects a chunk that is stale, torn or missing.
+ */
+
+#define FIRST_SEQUENCE 0xFFFFFFC0U
+#define RING_CHUNK_SIZE 4096U
+
+typedef struct _consumer
+{
+    DWORD chunks, delayEvery;
+    volatile LONG errors;
+    thread_handle_t thread;
+}
+consumer_t;
+
+static BOOL setup_ring(const DWORD bufferCount, const DWORD spinCount)
+{
+    BOOL largePages = FALSE;
+    if (!initialize_slots(RING_CHUNK_SIZE, bufferCount, &largePages))
+    {
+        return FALSE;
+    }
+
+    for (DWORD index = 0U; index < g_bufferCount; ++index)
+    {
+        GET_SLOT(index)->sequence = (LONG)(FIRST_SEQUENCE - 1U);
+    }
+
+    g_spinCount = spinCount;
+    g_readerSleeps = g_writerSleeps = 0L;
+    return TRUE;
+}
+
+static DWORD chunk_length(const DWORD number)
+{
+    return sizeof(DWORD) + (number % (RING_CHUNK_SIZE - sizeof(DWORD)));
+}
+
+static void fill_chunk(slot_t *const slot, const DWORD number)
+{
+    slot->buffer = slot->memory;
+    slot->bytesTotal = chunk_length(number);
+    copy_memory(slot->buffer, &number, sizeof(DWORD));
+    for (DWORD offset = sizeof(DWORD); offset < slot->bytesTotal; ++offset)
+    {
+        slot->buffer[offset] = (BYTE)(number + offset);
+    }
+}
+
+static BOOL verify_chunk(const slot_t *const slot, const DWORD number)
+{
+    DWORD stored;
+    if (slot->bytesTotal != chunk_length(number))
+    {
+        return FALSE;
+    }
+
+    copy_memory(&stored, slot->buffer, sizeof(DWORD));
+    if (stored != number)
+    {
+        return FALSE;
+    }
+
+    for (DWORD offset = sizeof(DWORD); offset < slot->bytesTotal; ++offset)
+    {
+        if (slot->buffer[offset] != (BYTE)(number + offset))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static DWORD THREAD_API consumer_thread_start_routine(void *const lpThreadParameter)
+{
+    consumer_t *const consumer = (consumer_t*)lpThreadParameter;
+    DWORD myIndex = 0U, mySequence = FIRST_SEQUENCE;
+
+    for (DWORD number = 0U; number < consumer->chunks; ++number)
+    {
+        slot_t *const slot = GET_SLOT(myIndex);
+        wait_for_chunk(slot, mySequence);
+        if (!verify_chunk(slot, number))
+        {
+            atomic_increment(&consumer->errors);
+        }
+        if (consumer->delayEvery && (!(number % consumer->delayEvery)))
+        {
+            sleep_millis(1U);
+        }
+        release_chunk(slot);
+        INCREMENT_INDEX(myIndex, mySequence);
+    }
+
+    return 0U;
+}
+
+static BOOL run_handoff(const DWORD bufferCount, const DWORD spinCount, const DWORD consumerCount, const DWORD chunks, const DWORD producerDelayEvery, const DWORD consumerDelayEvery)
+{
+    consumer_t consumers[8U];
+    DWORD myIndex = 0U, mySequence = FIRST_SEQUENCE, started = 0U;
+    BOOL success = TRUE;
+
+    if ((consumerCount > ARRAYSIZE(consumers)) || (!setup_ring(bufferCount, spinCount)))
+    {
+        return FALSE;
+    }
+
+    for (; started < consumerCount; ++started)
+    {
+        zero_memory(&consumers[started], sizeof(consumer_t));
+        consumers[started].chunks = chunks;
+        consumers[started].delayEvery = (started == 0U) ? consumerDelayEvery : 0U; /*only the first consumer is slow*/
+        if (!create_thread(&consumers[started].thread, consumer_thread_start_routine, &consumers[started]))
+        {
+            success = FALSE;
+            break;
+        }
+    }
+
+    for (DWORD number = 0U; success && (number < chunks); ++number)
+    {
+        slot_t *const slot = GET_SLOT(myIndex);
+        wait_for_release(slot);
+        if (producerDelayEvery && (!(number % producerDelayEvery)))
+        {
+            sleep_millis(1U);
+        }
+        fill_chunk(slot, number);
+        slot->pending = (LONG)consumerCount;
+        publish_chunk(slot, mySequence);
+        INCREMENT_INDEX(myIndex, mySequence);
+    }
+
+    for (DWORD index = 0U; success && (index < g_bufferCount); ++index)
+    {
+        wait_for_release(GET_SLOT(index));
+    }
+
+    for (DWORD threadId = 0U; threadId < started; ++threadId)
+    {
+        join_thread(consumers[threadId].thread, INFINITE);
+        close_thread(consumers[threadId].thread);
+        if (consumers[threadId].errors)
+        {
+            fprintf(stderr, "Consumer %u has seen %ld bad chunks!\n", threadId, (long)consumers[threadId].errors);
+            success = FALSE;
+        }
+    }
+
+    release_slots();
+    return success;
+}
+
+static BOOL test_ring_wraparound(void)
+{
+    CHECK(setup_ring(3U, SPIN_COUNT));
+    CHECK(SEQUENCE_DIFF(0U, 0xFFFFFFFFU) == 1L);
+    CHECK(SEQUENCE_DIFF(0xFFFFFFFFU, 0U) == -1L);
+
+    DWORD readerIndex = 0U, readerSequence = FIRST_SEQUENCE, writerIndex = 0U, writerSequence = FIRST_SEQUENCE;
+    for (DWORD number = 0U; number < 256U; ++number)
+    {
+        slot_t *const slot = GET_SLOT(readerIndex);
+        wait_for_release(slot);
+        fill_chunk(slot, number);
+        slot->pending = 1L;
+        publish_chunk(slot, readerSequence);
+        INCREMENT_INDEX(readerIndex, readerSequence);
+
+        slot_t *const next = GET_SLOT(writerIndex);
+        CHECK(next == slot);
+        CHECK(wait_for_chunk_timeout(next, writerSequence, 0U));
+        CHECK(verify_chunk(next, number));
+        release_chunk(next);
+        CHECK(!next->pending);
+        INCREMENT_INDEX(writerIndex, writerSequence);
+
+        CHECK(!wait_for_chunk_timeout(GET_SLOT(writerIndex), writerSequence, 0U)); /*not published yet*/
+    }
+
+    CHECK(readerSequence == FIRST_SEQUENCE + 256U);
+    CHECK(readerIndex == (256U % 3U));
+
+    const DWORD startTick = get_tick_count();
+    CHECK(!wait_for_chunk_timeout(GET_SLOT(writerIndex), writerSequence, 20U));
+    CHECK((get_tick_count() - startTick) >= 20U);
+
+    release_slots();
+    return TRUE;
+}
+
+static BOOL test_ring_handoff(void)
+{
+    CHECK(run_handoff(2U, SPIN_COUNT, 1U, 20000U, 0U, 0U));
+    CHECK(run_handoff(16U, SPIN_COUNT, 4U, 20000U, 0U, 0U));
+    CHECK(run_handoff(5U, 0U, 3U, 20000U, 0U, 0U));
+    return TRUE;
+}
+
+static BOOL test_ring_reader_wakeup(void)
+{
+    CHECK(run_handoff(4U, 0U, 2U, 400U, 0U, 4U));
+    CHECK(g_readerSleeps > 0L);
+    return TRUE;
+}
+
+static BOOL test_ring_writer_wakeup(void)
+{
+    CHECK(run_handoff(4U, 0U, 3U, 400U, 4U, 0U));
+    CHECK(g_writerSleeps > 0L);
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Connections
+// --------------------------------------------------------------------------
+
+/*
+ * A collector on the loopback interface, or on a Unix domain socket, is stopped while tee keeps
+ * sending, and then restarted on the same address. The stream is made of numbered lines, sent in
+ * pieces that cut them, so that the test can check, what the first connection has received is an
+ * exact prefix of the stream, and the second one starts with the gap marker, followed by nothing
+ * but whole, consecutive lines up to the end.
+ */
+
+#define LINE_LENGTH 11U
+#define LINE_COUNT 1000U
+#define PIECE_SIZE 7U
+#define SOCKET_PATH "/tmp/tee_test.sock"
+
+static const char GAP_LINE[] = "[tee] Warning: Data has been lost at this point!\n";
+
+static int open_listener(const BOOL unixSocket, unsigned short *const port)
+{
+    const int listener = socket(unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+    {
+        return -1;
+    }
+
+    int result;
+    if (unixSocket)
+    {
+        struct sockaddr_un address;
+        zero_memory(&address, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, SOCKET_PATH);
+        unlink(SOCKET_PATH);
+        result = bind(listener, (const struct sockaddr*)&address, sizeof(address));
+    }
+    else
+    {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        const int reuse = 1;
+        zero_memory(&address, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(*port);
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        result = bind(listener, (const struct sockaddr*)&address, sizeof(address));
+        if ((!result) && (!(result = getsockname(listener, (struct sockaddr*)&address, &length))))
+        {
+            *port = ntohs(address.sin_port);
+        }
+    }
+
+    if (result || listen(listener, 4))
+    {
+        close(listener);
+        return -1;
+    }
+
+    return listener;
+}
+
+typedef struct _collector
+{
+    int listener;
+    BYTE buffer[LINE_COUNT * LINE_LENGTH];
+    DWORD size;
+    volatile LONG stop;
+    thread_handle_t thread;
+}
+collector_t;
+
+static DWORD THREAD_API collector_thread_start_routine(void *const lpThreadParameter)
+{
+    collector_t *const collector = (collector_t*)lpThreadParameter;
+    const int peer = accept(collector->listener, NULL, NULL);
+    if (peer < 0)
+    {
+        return 1U;
+    }
+
+    struct pollfd pending = { .fd = peer, .events = POLLIN };
+    for (;;)
+    {
+        if (poll(&pending, 1U, 20) <= 0)
+        {
+            if (atomic_load_acquire(&collector->stop))
+            {
+                break; /*the collector goes away, while tee is still connected*/
+            }
+            continue;
+        }
+        const ssize_t count = recv(peer, collector->buffer + collector->size, sizeof(collector->buffer) - collector->size, 0);
+        if (count <= 0)
+        {
+            break;
+        }
+        collector->size += (DWORD)count;
+    }
+
+    close(peer);
+    return 0U;
+}
+
+static BOOL start_collector(collector_t *const collector, const int listener)
+{
+    zero_memory(collector, sizeof(collector_t));
+    collector->listener = listener;
+    return create_thread(&collector->thread, collector_thread_start_routine, collector);
+}
+
+static void stop_collector(collector_t *const collector)
+{
+    atomic_exchange(&collector->stop, TRUE);
+    join_thread(collector->thread, INFINITE);
+    close_thread(collector->thread);
+}
+
+static DWORD send_pieces(thread_t *const output, const BYTE *const stream, const DWORD position, const DWORD end)
+{
+    DWORD offset = position;
+    for (; offset < end; offset += PIECE_SIZE)
+    {
+        write_output(output, stream + offset, (end - offset < PIECE_SIZE) ? (end - offset) : PIECE_SIZE);
+    }
+
+    return (offset < end) ? offset : end;
+}
+
+static BOOL verify_resumed(const BYTE *const stream, const BYTE *const received, const DWORD size)
+{
+    const DWORD markerLength = (DWORD)(sizeof(GAP_LINE) - 1U);
+    CHECK((size > markerLength) && (!memcmp(received, GAP_LINE, markerLength)));
+    CHECK(!((size - markerLength) % LINE_LENGTH));
+
+    const DWORD lineCount = (size - markerLength) / LINE_LENGTH;
+    CHECK((lineCount > 0U) && (lineCount < LINE_COUNT));
+    CHECK(!memcmp(received + markerLength, stream + ((LINE_COUNT - lineCount) * LINE_LENGTH), lineCount * LINE_LENGTH));
+    return TRUE;
+}
+
+static BOOL run_restart(const BOOL unixSocket)
+{
+    static BYTE stream[LINE_COUNT * LINE_LENGTH];
+    static collector_t collector;
+    unsigned short port = 0U;
+    wchar_t name[64U];
+    thread_t output;
+
+    for (DWORD number = 0U; number < LINE_COUNT; ++number)
+    {
+        char line[LINE_LENGTH + 1U];
+        snprintf(line, sizeof(line), "line %05u\n", number);
+        copy_memory(stream + (number * LINE_LENGTH), line, LINE_LENGTH);
+    }
+
+    int listener = open_listener(unixSocket, &port);
+    CHECK(listener >= 0);
+    if (unixSocket)
+    {
+        swprintf(name, ARRAYSIZE(name), L"unix:%s", SOCKET_PATH);
+    }
+    else
+    {
+        swprintf(name, ARRAYSIZE(name), L"tcp://127.0.0.1:%u", (unsigned)port);
+    }
+
+    zero_memory(&output, sizeof(output));
+    output.name = name;
+    output.connection = TRUE;
+    output.connectStart = get_tick_count();
+    CHECK((output.hOutput = open_connection(name, CONNECTION_TIMEOUT)) != INVALID_FILE);
+
+    /* The collector receives the first part of the stream, which ends in the middle of a line */
+    CHECK(start_collector(&collector, listener));
+    DWORD position = send_pieces(&output, stream, 0U, (200U * LINE_LENGTH) + 5U);
+    CHECK(position % LINE_LENGTH);
+    sleep_millis(100U);
+    stop_collector(&collector);
+    close(listener);
+    CHECK((collector.size == position) && (!memcmp(collector.buffer, stream, collector.size)));
+
+    /* The collector has gone away: the next sends fail, and so does the first attempt to reconnect */
+    for (DWORD attempt = 0U; (output.hOutput != INVALID_FILE) && (attempt < 1000U); ++attempt)
+    {
+        position = send_pieces(&output, stream, position, position + PIECE_SIZE);
+        sleep_millis(1U);
+    }
+    CHECK(output.hOutput == INVALID_FILE);
+    sleep_millis(RECONNECT_INTERVAL + 100U);
+    position = send_pieces(&output, stream, position, position + PIECE_SIZE);
+    CHECK((output.hOutput == INVALID_FILE) && (!output.reconnects));
+
+    /* The collector is back: the writer reconnects and resumes at the next line */
+    CHECK((listener = open_listener(unixSocket, &port)) >= 0);
+    CHECK(start_collector(&collector, listener));
+    sleep_millis(RECONNECT_INTERVAL + 100U);
+    send_pieces(&output, stream, position, sizeof(stream));
+    CHECK((output.hOutput != INVALID_FILE) && (output.reconnects == 1U) && output.unsentBytes);
+    close_connection(output.hOutput);
+    join_thread(collector.thread, INFINITE);
+    close_thread(collector.thread);
+    close(listener);
+    if (unixSocket)
+    {
+        unlink(SOCKET_PATH);
+    }
+
+    return verify_resumed(stream, collector.buffer, collector.size);
+}
+
+static BOOL test_connection_tcp_restart(void)
+{
+    return run_restart(FALSE);
+}
+
+static BOOL test_connection_unix_restart(void)
+{
+    return run_restart(TRUE);
+}
+
+// --------------------------------------------------------------------------
+// Matcher
+// --------------------------------------------------------------------------
+
+/*
+ * Each case is a pattern and a buffer of lines, with the lines that are expected to match marked
+ * by a "+" in front; the marks are removed before the buffer is scanned.
+ */
+
+typedef struct _match_case
+{
+    const char *pattern, *lines;
+}
+match_case_t;
+
+static const match_case_t MATCH_CASES[] =
+{
+    { "error",          "+error: x\nwarning\n+an error\n"          },
+    { "^ab*c$",         "+ac\n+abbbc\n abd\n+abc\r\nabcd\n"         },
+    { "a+b?c",          "+ac\n+aabc\n bc\n+xaacy\n"                 },
+    { "\\d+ms",         "+took 15ms\n took ms\n+5ms\n"              },
+    { "^[^#]*=",        "+key=value\n # key=value\n+=\n"           },
+    { "a.*b.*c$",       "+a b c\n+aXbYc\n a b c d\n acb\n"          },
+    { "x*y*z*$",        "+\n+anything\n"                            },
+    { "^a*a*a*a*a*a*b$", " aaaaaaaaaaaaaaaaaaaaaaaaaabx\n+aaab\n+b\n" }
+};
+
+static BOOL run_match_case(const match_case_t *const test)
+{
+    BYTE buffer[256U], expected[256U];
+    range_t ranges[16U];
+    DWORD size = 0U, lineStart = 0U, expectedSize = 0U;
+    BOOL marked = FALSE;
+
+    for (const char *ptr = test->lines; *ptr; ++ptr)
+    {
+        if ((size == lineStart) && ((*ptr == '+') || (*ptr == ' ')) && (!marked))
+        {
+            marked = (*ptr == '+');
+            continue;
+        }
+        buffer[size++] = (BYTE)(*ptr);
+        if (*ptr == '\n')
+        {
+            if (marked)
+            {
+                copy_memory(expected + expectedSize, buffer + lineStart, size - lineStart);
+                expectedSize += size - lineStart;
+            }
+            lineStart = size;
+            marked = FALSE;
+        }
+    }
+
+    pattern_t *const pattern = pattern_create(test->pattern);
+    CHECK(pattern);
+    DWORD limit = size, matchedSize = 0U;
+    const DWORD count = pattern_scan(pattern, buffer, &limit, ranges, ARRAYSIZE(ranges));
+    pattern_destroy(pattern);
+    CHECK(limit == size);
+
+    for (DWORD index = 0U; index < count; ++index)
+    {
+        const DWORD length = ranges[index].end - ranges[index].begin;
+        CHECK((matchedSize + length <= expectedSize) && (!memcmp(expected + matchedSize, buffer + ranges[index].begin, length)));
+        matchedSize += length;
+    }
+
+    CHECK(matchedSize == expectedSize);
+    return TRUE;
+}
+
+static BOOL test_match_cases(void)
+{
+    for (DWORD index = 0U; index < ARRAYSIZE(MATCH_CASES); ++index)
+    {
+        if (!run_match_case(&MATCH_CASES[index]))
+        {
+            fprintf(stderr, "Pattern \"%s\" has failed!\n", MATCH_CASES[index].pattern);
+            return FALSE;
+        }
+    }
+
+    CHECK(!pattern_create("*a"));
+    CHECK(!pattern_create("[abc"));
+    CHECK(!pattern_create("^$"));
+    return TRUE;
+}
+
+static BOOL test_match_linear_time(void)
+{
+    static BYTE line[(1U << 20) + 3U];
+    range_t ranges[1U];
+
+    for (DWORD index = 0U; index < sizeof(line) - 3U; ++index)
+    {
+        line[index] = 'a';
+    }
+    copy_memory(line + sizeof(line) - 3U, "bx\n", 3U);
+
+    pattern_t *const pattern = pattern_create("^a*a*a*a*a*a*a*a*b$");
+    CHECK(pattern);
+    DWORD limit = sizeof(line);
+    const DWORD count = pattern_scan(pattern, line, &limit, ranges, ARRAYSIZE(ranges)); /*backtracking would never finish*/
+    pattern_destroy(pattern);
+    CHECK((!count) && (limit == sizeof(line)));
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Compression
+// --------------------------------------------------------------------------
+
+/*
+ * Every gzip member is decoded again by a minimal inflater, which is written after the letter of
+ * RFC 1951 and RFC 1952, and checked against the input: the stored and the dynamic blocks that the
+ * compressor writes, the CRC-32 and the size in the trailer, and that no match reaches further
+ * back than the window or out of the member. Fixed Huffman blocks are never written, so they are
+ * rejected like any other malformed data.
+ */
+
+#define INFLATE_WINDOW 32768U
+#define INFLATE_MIN_MATCH 3U
+#define INFLATE_MAX_MATCH 258U
+
+static const WORD INFLATE_LENGTH_BASE[29U] = { 3U, 4U, 5U, 6U, 7U, 8U, 9U, 10U, 11U, 13U, 15U, 17U, 19U, 23U, 27U, 31U, 35U, 43U, 51U, 59U, 67U, 83U, 99U, 115U, 131U, 163U, 195U, 227U, 258U };
+static const BYTE INFLATE_LENGTH_EXTRA[29U] = { 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 1U, 1U, 1U, 1U, 2U, 2U, 2U, 2U, 3U, 3U, 3U, 3U, 4U, 4U, 4U, 4U, 5U, 5U, 5U, 5U, 0U };
+static const WORD INFLATE_DIST_BASE[30U] = { 1U, 2U, 3U, 4U, 5U, 7U, 9U, 13U, 17U, 25U, 33U, 49U, 65U, 97U, 129U, 193U, 257U, 385U, 513U, 769U, 1025U, 1537U, 2049U, 3073U, 4097U, 6145U, 8193U, 12289U, 16385U, 24577U };
+static const BYTE INFLATE_DIST_EXTRA[30U] = { 0U, 0U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 8U, 8U, 9U, 9U, 10U, 10U, 11U, 11U, 12U, 12U, 13U, 13U };
+static const BYTE INFLATE_CODELEN_ORDER[19U] = { 16U, 17U, 18U, 0U, 8U, 7U, 9U, 6U, 10U, 5U, 11U, 4U, 12U, 3U, 13U, 2U, 14U, 1U, 15U };
+
+typedef struct _inflater
+{
+    const BYTE *input;
+    DWORD inputSize, position, bitBuffer, bitCount;
+    BYTE *output;
+    DWORD outputSize, outputLimit;
+}
+inflater_t;
+
+typedef struct _huffman
+{
+    WORD counts[16U], symbols[288U];
+}
+huffman_t;
+
+static BOOL get_bits(inflater_t *const inflater, const DWORD count, DWORD *const value)
+{
+    while (inflater->bitCount < count)
+    {
+        if (inflater->position >= inflater->inputSize)
+        {
+            return FALSE;
+        }
+        inflater->bitBuffer |= ((DWORD)inflater->input[inflater->position++]) << inflater->bitCount;
+        inflater->bitCount += 8U;
+    }
+
+    *value = inflater->bitBuffer & ((1U << count) - 1U);
+    inflater->bitBuffer >>= count;
+    inflater->bitCount -= count;
+    return TRUE;
+}
+
+static BOOL build_huffman(huffman_t *const huffman, const BYTE *const lengths, const DWORD count)
+{
+    WORD offsets[16U];
+    LONG left = 1L;
+
+    zero_memory(huffman->counts, sizeof(huffman->counts));
+    for (DWORD symbol = 0U; symbol < count; ++symbol)
+    {
+        ++huffman->counts[lengths[symbol]];
+    }
+
+    offsets[1U] = 0U;
+    for (DWORD length = 1U; length < 16U; ++length)
+    {
+        if ((left = (left << 1) - huffman->counts[length]) < 0L)
+        {
+            return FALSE; /*over-subscribed*/
+        }
+        if (length < 15U)
+        {
+            offsets[length + 1U] = offsets[length] + huffman->counts[length];
+        }
+    }
+
+    for (DWORD symbol = 0U; symbol < count; ++symbol)
+    {
+        if (lengths[symbol])
+        {
+            huffman->symbols[offsets[lengths[symbol]]++] = (WORD)symbol;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL decode_symbol(inflater_t *const inflater, const huffman_t *const huffman, DWORD *const symbol)
+{
+    DWORD code = 0U, first = 0U, index = 0U, bit;
+    for (DWORD length = 1U; length < 16U; ++length)
+    {
+        if (!get_bits(inflater, 1U, &bit))
+        {
+            return FALSE;
+        }
+        code |= bit;
+        if (code - first < huffman->counts[length])
+        {
+            *symbol = huffman->symbols[index + (code - first)];
+            return TRUE;
+        }
+        index += huffman->counts[length];
+        first = (first + huffman->counts[length]) << 1;
+        code <<= 1;
+    }
+
+    return FALSE;
+}
+
+static BOOL inflate_stored(inflater_t *const inflater)
+{
+    inflater->bitBuffer = inflater->bitCount = 0U; /*skip to the next byte boundary*/
+    if (inflater->inputSize - inflater->position < 4U)
+    {
+        return FALSE;
+    }
+
+    const BYTE *const header = inflater->input + inflater->position;
+    const DWORD length = header[0U] | (((DWORD)header[1U]) << 8);
+    if ((length ^ 0xFFFFU) != (header[2U] | (((DWORD)header[3U]) << 8)))
+    {
+        return FALSE;
+    }
+
+    inflater->position += 4U;
+    if ((inflater->inputSize - inflater->position < length) || (inflater->outputLimit - inflater->outputSize < length))
+    {
+        return FALSE;
+    }
+
+    copy_memory(inflater->output + inflater->outputSize, inflater->input + inflater->position, length);
+    inflater->position += length;
+    inflater->outputSize += length;
+    return TRUE;
+}
+
+static BOOL inflate_dynamic(inflater_t *const inflater)
+{
+    static huffman_t litCode, distCode;
+    BYTE lengths[320U];
+    DWORD litCount, distCount, codelenCount, value, symbol;
+
+    if (!(get_bits(inflater, 5U, &litCount) && get_bits(inflater, 5U, &distCount) && get_bits(inflater, 4U, &codelenCount)))
+    {
+        return FALSE;
+    }
+
+    litCount += 257U;
+    distCount += 1U;
+    codelenCount += 4U;
+    if ((litCount > 286U) || (distCount > 30U))
+    {
+        return FALSE;
+    }
+
+    zero_memory(lengths, sizeof(lengths));
+    for (DWORD index = 0U; index < codelenCount; ++index)
+    {
+        if (!get_bits(inflater, 3U, &value))
+        {
+            return FALSE;
+        }
+        lengths[INFLATE_CODELEN_ORDER[index]] = (BYTE)value;
+    }
+
+    if (!build_huffman(&litCode, lengths, 19U))
+    {
+        return FALSE;
+    }
+
+    for (DWORD index = 0U; index < litCount + distCount;)
+    {
+        if (!decode_symbol(inflater, &litCode, &symbol))
+        {
+            return FALSE;
+        }
+        if (symbol < 16U)
+        {
+            lengths[index++] = (BYTE)symbol;
+            continue;
+        }
+        BYTE repeated = 0U;
+        if (symbol == 16U)
+        {
+            if ((!index) || (!get_bits(inflater, 2U, &value)))
+            {
+                return FALSE;
+            }
+            repeated = lengths[index - 1U];
+            value += 3U;
+        }
+        else if (!get_bits(inflater, (symbol == 17U) ? 3U : 7U, &value))
+        {
+            return FALSE;
+        }
+        else
+        {
+            value += (symbol == 17U) ? 3U : 11U;
+        }
+        if (index + value > litCount + distCount)
+        {
+            return FALSE;
+        }
+        while (value--)
+        {
+            lengths[index++] = repeated;
+        }
+    }
+
+    if ((!lengths[256U]) || (!build_huffman(&litCode, lengths, litCount)) || (!build_huffman(&distCode, lengths + litCount, distCount)))
+    {
+        return FALSE;
+    }
+
+    for (;;)
+    {
+        if (!decode_symbol(inflater, &litCode, &symbol))
+        {
+            return FALSE;
+        }
+        if (symbol < 256U)
+        {
+            if (inflater->outputSize >= inflater->outputLimit)
+            {
+                return FALSE;
+            }
+            inflater->output[inflater->outputSize++] = (BYTE)symbol;
+            continue;
+        }
+        if (symbol == 256U)
+        {
+            return TRUE;
+        }
+        if ((symbol -= 257U) >= 29U)
+        {
+            return FALSE;
+        }
+        DWORD length, distance;
+        if (!get_bits(inflater, INFLATE_LENGTH_EXTRA[symbol], &value))
+        {
+            return FALSE;
+        }
+        length = INFLATE_LENGTH_BASE[symbol] + value;
+        if ((!decode_symbol(inflater, &distCode, &symbol)) || (symbol >= 30U) || (!get_bits(inflater, INFLATE_DIST_EXTRA[symbol], &value)))
+        {
+            return FALSE;
+        }
+        distance = INFLATE_DIST_BASE[symbol] + value;
+        if ((distance > inflater->outputSize) || (distance > INFLATE_WINDOW) || (inflater->outputLimit - inflater->outputSize < length))
+        {
+            return FALSE;
+        }
+        for (DWORD offset = 0U; offset < length; ++offset, ++inflater->outputSize)
+        {
+            inflater->output[inflater->outputSize] = inflater->output[inflater->outputSize - distance];
+        }
+    }
+}
+
+static DWORD test_crc32(const BYTE *const data, const DWORD size)
+{
+    DWORD crc = 0xFFFFFFFFU;
+    for (DWORD index = 0U; index < size; ++index)
+    {
+        crc ^= data[index];
+        for (DWORD bit = 0U; bit < 8U; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1U) ? 0xEDB88320U : 0U);
+        }
+    }
+
+    return ~crc;
+}
+
+static DWORD read_le32(const BYTE *const data)
+{
+    return data[0U] | (((DWORD)data[1U]) << 8) | (((DWORD)data[2U]) << 16) | (((DWORD)data[3U]) << 24);
+}
+
+/*
+ * Returns the number of decompressed bytes, or MAXDWORD, if the member is not exactly one valid
+ * gzip member, or does not fit into the output buffer.
+ */
+static DWORD gunzip(const BYTE *const input, const DWORD inputSize, BYTE *const output, const DWORD outputLimit)
+{
+    static const BYTE HEADER[4U] = { 0x1FU, 0x8BU, 0x08U, 0x00U };
+    inflater_t inflater = { input, inputSize, 10U, 0U, 0U, output, 0U, outputLimit };
+    DWORD last = 0U, type;
+
+    if ((inputSize < 18U) || memcmp(input, HEADER, sizeof(HEADER)))
+    {
+        return MAXDWORD;
+    }
+
+    while (!last)
+    {
+        if (!(get_bits(&inflater, 1U, &last) && get_bits(&inflater, 2U, &type)))
+        {
+            return MAXDWORD;
+        }
+        if (!((type == 0U) ? inflate_stored(&inflater) : ((type == 2U) && inflate_dynamic(&inflater))))
+        {
+            return MAXDWORD;
+        }
+    }
+
+    if ((inflater.inputSize - inflater.position != 8U) || (read_le32(input + inflater.position) != test_crc32(output, inflater.outputSize)) || (read_le32(input + inflater.position + 4U) != inflater.outputSize))
+    {
+        return MAXDWORD;
+    }
+
+    return inflater.outputSize;
+}
+
+/*
+ * Each case is an input pattern and a size: the incompressible ones have to fall back to stored
+ * blocks, as has every input that is larger than the block size of the state.
+ */
+
+typedef enum
+{
+    DATA_TEXT,
+    DATA_RUN,
+    DATA_PERIOD,
+    DATA_RANDOM,
+    DATA_FAR_REPEAT
+}
+data_kind_t;
+
+typedef struct _deflate_case
+{
+    data_kind_t kind;
+    DWORD size, maxBlockSize;
+    BOOL stored;
+}
+deflate_case_t;
+
+static const deflate_case_t DEFLATE_CASES[] =
+{
+    { DATA_TEXT,       0U,                         COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_TEXT,       1U,                         COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_TEXT,       INFLATE_MIN_MATCH - 1U,     COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_RUN,        INFLATE_MIN_MATCH,          COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_RUN,        INFLATE_MAX_MATCH,          COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_RUN,        (7U * INFLATE_MAX_MATCH) + 5U, COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_RUN,        COMPRESS_BLOCK_SIZE,        COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_PERIOD,     100000U,                    COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_TEXT,       COMPRESS_BLOCK_SIZE,        COMPRESS_BLOCK_SIZE, FALSE },
+    { DATA_FAR_REPEAT, 2U * (INFLATE_WINDOW + 99U), COMPRESS_BLOCK_SIZE, TRUE  },
+    { DATA_RANDOM,     1000U,                      COMPRESS_BLOCK_SIZE, TRUE  },
+    { DATA_RANDOM,     COMPRESS_BLOCK_SIZE,        COMPRESS_BLOCK_SIZE, TRUE  },
+    { DATA_TEXT,       10000U,                     4096U,               TRUE  },
+    { DATA_RUN,        150000U,                    4096U,               TRUE  }
+};
+
+static DWORD next_random(DWORD *const seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static void generate_data(const data_kind_t kind, BYTE *const data, const DWORD size)
+{
+    static const char *const WORDS[] = { "the ", "ring ", "buffer ", "writer ", "thread ", "output ", "is ", "slow\n", "and ", "fast, " };
+    DWORD seed = 0x2545F491U;
+
+    for (DWORD offset = 0U; offset < size;)
+    {
+        switch (kind)
+        {
+        case DATA_TEXT:
+            for (const char *ptr = WORDS[next_random(&seed) % ARRAYSIZE(WORDS)]; *ptr && (offset < size); ++ptr)
+            {
+                data[offset++] = (BYTE)(*ptr);
+            }
+            break;
+        case DATA_RUN:
+            data[offset++] = 'x';
+            break;
+        case DATA_PERIOD:
+            data[offset] = (BYTE)("abc"[offset % 3U]);
+            ++offset;
+            break;
+        case DATA_FAR_REPEAT:
+            if (offset >= size / 2U)
+            {
+                data[offset] = data[offset - (size / 2U)]; /*a copy of the first half, out of the window's reach*/
+                ++offset;
+                break;
+            }
+            /*fall through*/
+        case DATA_RANDOM:
+            data[offset++] = (BYTE)(next_random(&seed) >> 7);
+            break;
+        }
+    }
+}
+
+static BOOL run_deflate_case(const deflate_case_t *const test, BYTE *const input, BYTE *const output, BYTE *const decoded)
+{
+    deflate_state_t *const state = deflate_create(test->maxBlockSize);
+    CHECK(state);
+    generate_data(test->kind, input, test->size);
+
+    const DWORD bound = gzip_bound(test->size), blocks = test->size ? ((test->size + 65534U) / 65535U) : 1U;
+    for (DWORD level = DEFLATE_MIN_LEVEL; level <= DEFLATE_MAX_LEVEL; ++level)
+    {
+        const DWORD size = gzip_compress(state, input, test->size, output, level);
+        if ((size > bound) || (gunzip(output, size, decoded, test->size) != test->size) || memcmp(decoded, input, test->size))
+        {
+            fprintf(stderr, "Level %u has failed!\n", level);
+            deflate_destroy(state);
+            return FALSE;
+        }
+        if (test->stored)
+        {
+            CHECK(size == 18U + test->size + (5U * blocks));
+        }
+        else if (test->size > INFLATE_MAX_MATCH)
+        {
+            CHECK(size < test->size / 2U);
+        }
+    }
+
+    deflate_destroy(state);
+    return TRUE;
+}
+
+static BOOL test_deflate_round_trip(void)
+{
+    const DWORD maxSize = 150000U + COMPRESS_BLOCK_SIZE;
+    BYTE *const input = (BYTE*)alloc_memory(maxSize), *const output = (BYTE*)alloc_memory(gzip_bound(maxSize)), *const decoded = (BYTE*)alloc_memory(maxSize);
+    BOOL success = input && output && decoded;
+
+    for (DWORD index = 0U; success && (index < ARRAYSIZE(DEFLATE_CASES)); ++index)
+    {
+        if (!(success = run_deflate_case(&DEFLATE_CASES[index], input, output, decoded)))
+        {
+            fprintf(stderr, "Compression case #%u has failed!\n", index);
+        }
+    }
+
+    free_memory(decoded);
+    free_memory(output);
+    free_memory(input);
+    return success;
+}
+
+// --------------------------------------------------------------------------
+// Hashes
+// --------------------------------------------------------------------------
+
+/*
+ * Known answers: the XXH3 ones are those of the xxHash sanity check, whose input is the "sanity
+ * buffer" that is generated from the 32-Bit and 64-Bit primes; there is one for each of the length
+ * classes of XXH3, and for the stripe, buffer and block boundaries of the streaming state. The
+ * SHA-256 ones are those of FIPS 180-2. Every input is also fed in pieces of different sizes, as
+ * the hash thread does, with a digest taken in between, which must not change the state.
+ */
+
+#define SANITY_SIZE 100000U
+
+typedef struct _xxh3_case
+{
+    DWORD size;
+    ULONGLONG digest;
+}
+xxh3_case_t;
+
+static const xxh3_case_t XXH3_CASES[] =
+{
+    { 0U,      0x2D06800538D394C2ULL },
+    { 1U,      0xC44BDFF4074EECDBULL },
+    { 3U,      0x54247382A8D6B94DULL },
+    { 4U,      0xE5DC74BC51848A51ULL },
+    { 8U,      0x24CCC9ACAA9F65E4ULL },
+    { 9U,      0x14D5001C15DD3F2BULL },
+    { 16U,     0x981B17D36C7498C9ULL },
+    { 17U,     0x796F5ACD3A60F862ULL },
+    { 128U,    0xFCFF24126754D861ULL },
+    { 129U,    0x98F1B0A679A2CA29ULL },
+    { 240U,    0x81C3C2B67F568CCFULL },
+    { 241U,    0xC5A639ECD2030E5EULL },
+    { 255U,    0xE98F979F4ED8A197ULL },
+    { 256U,    0x55DE574AD89D0AC5ULL },
+    { 1024U,   0xDD85C9B5C1109C5CULL },
+    { 1025U,   0xD870C0FA13211C6AULL },
+    { 2367U,   0xCB37AEB9E5D361EDULL },
+    { 100000U, 0x34D658192A014311ULL }
+};
+
+typedef struct _sha256_case
+{
+    const char *message;
+    DWORD repeat;
+    const char *digest;
+}
+sha256_case_t;
+
+static const sha256_case_t SHA256_CASES[] =
+{
+    { "",                                                         1U,       "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc",                                                      1U,       "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1U,       "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "a",                                                        1000000U, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" }
+};
+
+static const DWORD PIECE_SIZES[] = { 1U, 3U, 63U, 64U, 65U, 255U, 256U, 257U, 1000U, 4096U };
+
+static void fill_sanity_buffer(BYTE *const buffer, const DWORD size)
+{
+    ULONGLONG generator = 2654435761ULL;
+    for (DWORD index = 0U; index < size; ++index)
+    {
+        buffer[index] = (BYTE)(generator >> 56);
+        generator *= 11400714785074694797ULL;
+    }
+}
+
+static ULONGLONG xxh3_pieces(const BYTE *const input, const DWORD size, const DWORD pieceSize, const DWORD firstPiece)
+{
+    xxh3_state_t state;
+    xxh3_reset(&state);
+    for (DWORD offset = 0U; offset < size;)
+    {
+        const DWORD wanted = offset ? pieceSize : firstPiece, length = (size - offset < wanted) ? (size - offset) : wanted;
+        xxh3_update(&state, input + offset, length);
+        offset += length;
+        (void)xxh3_digest(&state);
+    }
+
+    return xxh3_digest(&state);
+}
+
+static BOOL test_hash_xxh3(void)
+{
+    static BYTE sanity[SANITY_SIZE];
+    fill_sanity_buffer(sanity, SANITY_SIZE);
+
+    for (DWORD index = 0U; index < ARRAYSIZE(XXH3_CASES); ++index)
+    {
+        const xxh3_case_t *const test = &XXH3_CASES[index];
+        BOOL success = (xxh3_pieces(sanity, test->size, MAXDWORD, MAXDWORD) == test->digest);
+        for (DWORD piece = 0U; success && (piece < ARRAYSIZE(PIECE_SIZES)); ++piece)
+        {
+            success = (xxh3_pieces(sanity, test->size, PIECE_SIZES[piece], PIECE_SIZES[piece]) == test->digest);
+        }
+        for (DWORD split = 1U; success && (split < test->size) && (split <= 2048U); ++split)
+        {
+            success = (xxh3_pieces(sanity, test->size, MAXDWORD, split) == test->digest); /*two pieces, cut at every point*/
+        }
+        if (!success)
+        {
+            fprintf(stderr, "XXH3 of %u bytes has failed!\n", test->size);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL sha256_pieces(const sha256_case_t *const test, const BOOL hardware, const DWORD pieceSize, const DWORD firstPiece)
+{
+    static BYTE message[1000000U];
+    const DWORD length = (DWORD)strlen(test->message), size = length * test->repeat;
+    sha256_state_t state;
+    BYTE digest[SHA256_SIZE];
+    char hex[(2U * SHA256_SIZE) + 1U];
+
+    for (DWORD offset = 0U; offset < size; offset += length)
+    {
+        copy_memory(message + offset, test->message, length);
+    }
+
+    sha256_reset(&state);
+    state.hardware = state.hardware && hardware;
+    for (DWORD offset = 0U; offset < size;)
+    {
+        const DWORD wanted = offset ? pieceSize : firstPiece, count = (size - offset < wanted) ? (size - offset) : wanted;
+        sha256_update(&state, message + offset, count);
+        offset += count;
+        sha256_digest(&state, digest);
+    }
+
+    sha256_digest(&state, digest);
+    for (DWORD index = 0U; index < SHA256_SIZE; ++index)
+    {
+        snprintf(hex + (2U * index), 3U, "%02x", digest[index]);
+    }
+
+    return !strcmp(hex, test->digest);
+}
+
+static BOOL test_hash_sha256(void)
+{
+    for (DWORD index = 0U; index < ARRAYSIZE(SHA256_CASES); ++index)
+    {
+        const sha256_case_t *const test = &SHA256_CASES[index];
+        const DWORD size = (DWORD)strlen(test->message) * test->repeat;
+        for (DWORD hardware = 0U; hardware < 2U; ++hardware)
+        {
+            BOOL success = sha256_pieces(test, hardware, MAXDWORD, MAXDWORD);
+            for (DWORD piece = 0U; success && (piece < ARRAYSIZE(PIECE_SIZES)); ++piece)
+            {
+                success = sha256_pieces(test, hardware, PIECE_SIZES[piece], PIECE_SIZES[piece]);
+            }
+            for (DWORD split = 1U; success && (split < size) && (split <= 130U) && (test->repeat == 1U); ++split)
+            {
+                success = sha256_pieces(test, hardware, MAXDWORD, split); /*the million 'a' are only fed in pieces*/
+            }
+            if (!success)
+            {
+                fprintf(stderr, "SHA-256 of %u bytes has failed! (hardware: %u)\n", size, hardware);
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Escape stripping
+// --------------------------------------------------------------------------
+
+/*
+ * Each case is an input and the text that is left of it. The input is also cut in two at every
+ * point, and fed byte by byte, with the parser state carried over like from one chunk to the next,
+ * which must not change the result.
+ */
+
+typedef struct _strip_case
+{
+    const char *input, *expected;
+}
+strip_case_t;
+
+static const strip_case_t STRIP_CASES[] =
+{
+    { "plain text\n",                                         "plain text\n" },
+    { "\x1b[31mred\x1b[0m\n",                                 "red\n"        },
+    { "\x1b[38;5;196mX\x1b[m\x1b[2J\x1b[?25l",                "X"            },
+    { "a\x1b]0;window title\x07" "b",                         "ab"           },
+    { "a\x1b]8;;http://x/\x1b\\link\x1b]8;;\x1b\\" "b",       "alinkb"       },
+    { "\x1bPq#0;2;0;0;0\x1b\\done\x1b_apc\x07!",              "done!"        },
+    { "\x1b(Bx\x1b" "7y\x1b" "8z\x1b#8",                      "xyz"          },
+    { "\x1b[1\n;2mZ\x1b(\rB",                                 "\nZ\r"        },
+    { "\x1b[12\x18" "abc\x1b]0;t\x1a" "def",                  "abcdef"       },
+    { "\x1b\x1b[Kq\x1b\x1b\x1b[0mr",                          "qr"           },
+    { "ok\x1b[1;3",                                           "ok"           }
+};
+
+static DWORD strip_pieces(const BYTE *const input, const DWORD size, BYTE *const output, const DWORD pieceSize, const DWORD firstPiece)
+{
+    BYTE state = ESCAPE_NONE;
+    DWORD outputSize = 0U;
+
+    for (DWORD offset = 0U; offset < size;)
+    {
+        const DWORD wanted = offset ? pieceSize : firstPiece, length = (size - offset < wanted) ? (size - offset) : wanted;
+        outputSize += strip_escapes(&state, output + outputSize, input + offset, length);
+        offset += length;
+    }
+
+    return outputSize;
+}
+
+static BOOL run_strip_case(const strip_case_t *const test)
+{
+    BYTE output[128U];
+    const DWORD size = (DWORD)strlen(test->input), expectedSize = (DWORD)strlen(test->expected);
+
+    DWORD outputSize = strip_pieces((const BYTE*)test->input, size, output, MAXDWORD, MAXDWORD);
+    CHECK((outputSize == expectedSize) && (!memcmp(output, test->expected, expectedSize)));
+
+    outputSize = strip_pieces((const BYTE*)test->input, size, output, 1U, 1U);
+    CHECK((outputSize == expectedSize) && (!memcmp(output, test->expected, expectedSize)));
+
+    for (DWORD split = 1U; split < size; ++split)
+    {
+        outputSize = strip_pieces((const BYTE*)test->input, size, output, MAXDWORD, split);
+        if ((outputSize != expectedSize) || memcmp(output, test->expected, expectedSize))
+        {
+            fprintf(stderr, "Split at offset %u has failed!\n", split);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL test_strip_escapes(void)
+{
+    for (DWORD index = 0U; index < ARRAYSIZE(STRIP_CASES); ++index)
+    {
+        if (!run_strip_case(&STRIP_CASES[index]))
+        {
+            fprintf(stderr, "Escape stripping case #%u has failed!\n", index);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Spilling
+// --------------------------------------------------------------------------
+
+/*
+ * The core runs as a whole, in a child process, and writes to FIFOs that are not read at first:
+ * the outputs fall far behind, beyond --max-lag, and are spilled to disk. Only once the input has
+ * been consumed, the FIFOs are read, so everything that arrives from there on has been drained from
+ * the spill file, and has to be the exact expected data: all of it, the matching lines only, or the
+ * lines of one stream of a command, with the stream tags that the spill file has kept. A line that
+ * is not completed within --max-delay is matched in parts, so the delay is raised for slow runs.
+ */
+
+#define SPILL_LINES 50000U
+#define SPILL_CAPACITY (SPILL_LINES * 48U) /*enough for both streams of the command, with the tags*/
+#define FIFO_COUNT 3U
+#define FIFO_PATH "/tmp/tee_test_%u.fifo"
+#define DONE_PATH "/tmp/tee_test.done"
+#define STDOUT_PATH "/tmp/tee_test.out"
+#define STDERR_PATH "/tmp/tee_test.err"
+
+static const char SPILL_WARNING[] = "have been spilled to disk for output \"";
+
+typedef struct _capture
+{
+    BYTE *data;
+    DWORD size;
+}
+capture_t;
+
+static DWORD make_lines(BYTE *const buffer, const char *const prefix)
+{
+    DWORD size = 0U;
+    for (DWORD number = 0U; number < SPILL_LINES; ++number)
+    {
+        size += (DWORD)sprintf((char*)buffer + size, "%s %06u %s\n", prefix, number, (number % 5U) ? "ok" : "ERR");
+    }
+
+    return size;
+}
+
+static BOOL line_contains(const BYTE *const line, const DWORD length, const char *const text)
+{
+    const DWORD textLength = (DWORD)strlen(text);
+    for (DWORD offset = 0U; offset + textLength <= length; ++offset)
+    {
+        if (!memcmp(line + offset, text, textLength))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static DWORD filter_lines(const BYTE *const input, const DWORD size, BYTE *const output)
+{
+    DWORD outputSize = 0U;
+    for (DWORD lineStart = 0U, offset = 0U; offset < size; ++offset)
+    {
+        if (input[offset] == '\n')
+        {
+            if (line_contains(input + lineStart, offset - lineStart, "ERR"))
+            {
+                copy_memory(output + outputSize, input + lineStart, offset + 1U - lineStart);
+                outputSize += offset + 1U - lineStart;
+            }
+            lineStart = offset + 1U;
+        }
+    }
+
+    return outputSize;
+}
+
+static BOOL write_whole(const int handle, const BYTE *const data, const DWORD size)
+{
+    for (DWORD offset = 0U; offset < size;)
+    {
+        const ssize_t count = write(handle, data + offset, size - offset);
+        if (count <= 0)
+        {
+            return FALSE;
+        }
+        offset += (DWORD)count;
+    }
+
+    return TRUE;
+}
+
+static BOOL open_fifos(int *const fifos)
+{
+    for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+    {
+        char path[64U];
+        snprintf(path, sizeof(path), FIFO_PATH, fifoId);
+        unlink(path);
+        if (mkfifo(path, 0600) || ((fifos[fifoId] = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0))
+        {
+            return FALSE; /*the read end is opened first, so that tee does not block on opening the write end*/
+        }
+    }
+
+    return TRUE;
+}
+
+static pid_t start_tee(const char *const arguments[], const int input, const int error)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid)
+    {
+        return pid;
+    }
+
+    wchar_t *argv[24U];
+    int argc = 0;
+    for (; arguments[argc] && (argc < (int)ARRAYSIZE(argv) - 1); ++argc)
+    {
+        const SIZE_T length = strlen(arguments[argc]) + 1U;
+        argv[argc] = (wchar_t*)alloc_memory(length * sizeof(wchar_t));
+        swprintf(argv[argc], length, L"%s", arguments[argc]);
+    }
+    argv[argc] = NULL;
+
+    const int null = open("/dev/null", O_RDWR);
+    dup2((input >= 0) ? input : null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(error, STDERR_FILENO);
+    for (int handle = STDERR_FILENO + 1; handle < 1024; ++handle)
+    {
+        close(handle); /*e.g. the write end of the input pipe, which would keep the input from ending*/
+    }
+    _exit(tee_core_main(argc, (const wchar_t *const *)argv));
+}
+
+static BOOL collect_fifos(const int *const fifos, capture_t *const captures)
+{
+    struct pollfd pending[FIFO_COUNT];
+    DWORD openCount = FIFO_COUNT;
+
+    for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+    {
+        pending[fifoId].fd = fifos[fifoId];
+        pending[fifoId].events = POLLIN;
+        captures[fifoId].size = 0U;
+    }
+
+    while (openCount)
+    {
+        CHECK(poll(pending, FIFO_COUNT, 10000) > 0);
+        for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+        {
+            if ((pending[fifoId].fd < 0) || (!pending[fifoId].revents))
+            {
+                continue;
+            }
+            const ssize_t count = read(pending[fifoId].fd, captures[fifoId].data + captures[fifoId].size, SPILL_CAPACITY - captures[fifoId].size);
+            if (count > 0)
+            {
+                captures[fifoId].size += (DWORD)count;
+            }
+            else if ((!count) || (errno != EAGAIN))
+            {
+                close(pending[fifoId].fd);
+                pending[fifoId].fd = -1; /*the writer has closed the FIFO*/
+                --openCount;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL finish_tee(const pid_t pid, const int error)
+{
+    static char text[4096U];
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && (!WEXITSTATUS(status)));
+
+    const ssize_t size = pread(error, text, sizeof(text) - 1U, 0);
+    CHECK(size >= 0);
+    text[size] = '\0';
+    for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+    {
+        char expected[128U];
+        snprintf(expected, sizeof(expected), "%s" FIFO_PATH "\"", SPILL_WARNING, fifoId);
+        CHECK(strstr(text, expected)); /*the output has really been spilled*/
+    }
+
+    return TRUE;
+}
+
+static BOOL check_capture(const capture_t *const capture, const BYTE *const expected, const DWORD expectedSize)
+{
+    CHECK((capture->size == expectedSize) && (!memcmp(capture->data, expected, expectedSize)));
+    return TRUE;
+}
+
+static BOOL check_tagged(const capture_t *const capture, const BYTE *const expectedOut, const DWORD outSize, const BYTE *const expectedErr, const DWORD errSize)
+{
+    DWORD outOffset = 0U, errOffset = 0U;
+    for (DWORD lineStart = 0U, offset = 0U; offset < capture->size; ++offset)
+    {
+        if (capture->data[offset] != '\n')
+        {
+            continue;
+        }
+        const BYTE *const line = capture->data + lineStart;
+        const DWORD length = offset + 1U - lineStart;
+        CHECK((length > TAG_LENGTH) && ((!memcmp(line, STREAM_TAGS[0U], TAG_LENGTH)) || (!memcmp(line, STREAM_TAGS[1U], TAG_LENGTH))));
+        if (!memcmp(line, STREAM_TAGS[0U], TAG_LENGTH))
+        {
+            CHECK((outOffset + length - TAG_LENGTH <= outSize) && (!memcmp(expectedOut + outOffset, line + TAG_LENGTH, length - TAG_LENGTH)));
+            outOffset += length - TAG_LENGTH;
+        }
+        else
+        {
+            CHECK((errOffset + length - TAG_LENGTH <= errSize) && (!memcmp(expectedErr + errOffset, line + TAG_LENGTH, length - TAG_LENGTH)));
+            errOffset += length - TAG_LENGTH;
+        }
+        lineStart = offset + 1U;
+    }
+
+    CHECK((outOffset == outSize) && (errOffset == errSize));
+    return TRUE;
+}
+
+static BOOL run_spill_input(BYTE *const input, BYTE *const matching, capture_t *const captures)
+{
+    static const char *const ARGUMENTS[] =
+    {
+        "tee", "--buffer-size=4096", "--buffers=8", "--overflow=spill", "--max-lag=2", "--max-delay=60000",
+        "/tmp/tee_test_0.fifo", "--lines", "/tmp/tee_test_1.fifo", "--match=ERR", "/tmp/tee_test_2.fifo", NULL
+    };
+    int fifos[FIFO_COUNT], pipeEnds[2U];
+    char errorPath[] = "/tmp/tee_test.XXXXXX";
+
+    const DWORD inputSize = make_lines(input, "line"), matchingSize = filter_lines(input, inputSize, matching);
+    const int error = mkstemp(errorPath);
+    CHECK(error >= 0);
+    unlink(errorPath);
+    CHECK(open_fifos(fifos) && (!pipe(pipeEnds)));
+
+    const pid_t pid = start_tee(ARGUMENTS, pipeEnds[0U], error);
+    CHECK(pid > 0);
+    close(pipeEnds[0U]);
+
+    /* The FIFOs are not read, while the whole input is passed */
+    CHECK(write_whole(pipeEnds[1U], input, inputSize));
+    close(pipeEnds[1U]);
+
+    CHECK(collect_fifos(fifos, captures) && finish_tee(pid, error));
+    close(error);
+    CHECK(check_capture(&captures[0U], input, inputSize));
+    CHECK(check_capture(&captures[1U], input, inputSize));
+    CHECK(check_capture(&captures[2U], matching, matchingSize));
+    return TRUE;
+}
+
+static BOOL run_spill_command(BYTE *const output, BYTE *const errors, BYTE *const matching, capture_t *const captures)
+{
+    static const char *const ARGUMENTS[] =
+    {
+        "tee", "--buffer-size=4096", "--buffers=8", "--overflow=spill", "--max-lag=2", "--max-delay=60000", "--pipe-size=65536",
+        "--stream=stdout", "/tmp/tee_test_0.fifo", "--stream=all", "--tag-streams", "/tmp/tee_test_1.fifo", "--match=ERR", "/tmp/tee_test_2.fifo",
+        "--", "sh", "-c", "cat \"$1\"; cat \"$2\" >&2; : > \"$3\"", "sh", STDOUT_PATH, STDERR_PATH, DONE_PATH, NULL
+    };
+    int fifos[FIFO_COUNT];
+    char errorPath[] = "/tmp/tee_test.XXXXXX";
+    struct stat info;
+
+    const DWORD outputSize = make_lines(output, "out"), errorSize = make_lines(errors, "err");
+    const DWORD outMatching = filter_lines(output, outputSize, matching), errMatching = filter_lines(errors, errorSize, matching + outMatching);
+    const int files[2U] = { open(STDOUT_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600), open(STDERR_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) };
+    CHECK((files[0U] >= 0) && (files[1U] >= 0) && write_whole(files[0U], output, outputSize) && write_whole(files[1U], errors, errorSize));
+    close(files[0U]);
+    close(files[1U]);
+
+    const int error = mkstemp(errorPath);
+    CHECK(error >= 0);
+    unlink(errorPath);
+    unlink(DONE_PATH);
+    CHECK(open_fifos(fifos));
+
+    const pid_t pid = start_tee(ARGUMENTS, -1, error);
+    CHECK(pid > 0);
+
+    /* The FIFOs are not read, until the command has written both of its streams */
+    for (DWORD attempt = 0U; stat(DONE_PATH, &info); ++attempt)
+    {
+        CHECK(attempt < 10000U);
+        sleep_millis(1U);
+    }
+
+    CHECK(collect_fifos(fifos, captures) && finish_tee(pid, error));
+    close(error);
+    unlink(STDOUT_PATH);
+    unlink(STDERR_PATH);
+    unlink(DONE_PATH);
+    CHECK(check_capture(&captures[0U], output, outputSize));
+    CHECK(check_tagged(&captures[1U], output, outputSize, errors, errorSize));
+    CHECK(check_tagged(&captures[2U], matching, outMatching, matching + outMatching, errMatching));
+    return TRUE;
+}
+
+static BOOL test_spill_drain(void)
+{
+    capture_t captures[FIFO_COUNT];
+    BYTE *const memory = (BYTE*)alloc_memory(SPILL_CAPACITY * (3U + FIFO_COUNT));
+    CHECK(memory);
+
+    for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+    {
+        captures[fifoId].data = memory + (SPILL_CAPACITY * (3U + fifoId));
+    }
+
+    const BOOL success = run_spill_input(memory, memory + SPILL_CAPACITY, captures) && run_spill_command(memory, memory + SPILL_CAPACITY, memory + (2U * SPILL_CAPACITY), captures);
+    for (DWORD fifoId = 0U; fifoId < FIFO_COUNT; ++fifoId)
+    {
+        char path[64U];
+        snprintf(path, sizeof(path), FIFO_PATH, fifoId);
+        unlink(path);
+    }
+
+    free_memory(memory);
+    return success;
+}
+
+// --------------------------------------------------------------------------
+// Flight recorder
+// --------------------------------------------------------------------------
+
+/*
+ * The recorder is fed in pieces of changing sizes, some of them larger than the whole ring, so
+ * that the head ends up at a different offset for every dump, and the dump window crosses the wrap
+ * point of the ring, as well as the boundary between the pieces that are copied into the dump. The
+ * first dump has to be the exact tail of the input, each later one what has been recorded since the
+ * previous dump, or the tail again, if that is more than the ring holds. A triggered dump ends where
+ * it was requested, and starts at the oldest byte that has not been overwritten in the meantime.
+ */
+
+#define RECORDER_CAPACITY (DUMP_PIECE_SIZE + 12345U)
+#define RECORDER_INPUT (5U * RECORDER_CAPACITY)
+#define RING_PATH "/tmp/tee_test.ring"
+
+static const DWORD RECORD_PIECES[] = { 1U, 7U, 4096U, 65536U, RECORDER_CAPACITY - 1U, RECORDER_CAPACITY, RECORDER_CAPACITY + 1000U, 300000U };
+
+static void record_pieces(recorder_t *const recorder, const BYTE *const input, const DWORD begin, const DWORD end, DWORD *const pieceId)
+{
+    for (DWORD offset = begin; offset < end; *pieceId = (*pieceId + 1U) % ARRAYSIZE(RECORD_PIECES))
+    {
+        const DWORD length = ((end - offset) < RECORD_PIECES[*pieceId]) ? (end - offset) : RECORD_PIECES[*pieceId];
+        record_data(recorder, input + offset, length);
+        offset += length;
+    }
+}
+
+static BOOL check_dump(const thread_t *const output, const DWORD dump, const BYTE *const expected, const DWORD expectedSize, BYTE *const buffer)
+{
+    wchar_t *const name = segment_name(output->name, dump);
+    char *const path = name ? encode_utf8(name) : NULL;
+    FILE *const file = path ? fopen(path, "rb") : NULL;
+    const DWORD size = file ? (DWORD)fread(buffer, 1U, RECORDER_CAPACITY + 1U, file) : MAXDWORD;
+    if (file)
+    {
+        fclose(file);
+        remove(path);
+    }
+
+    free_memory(path);
+    free_memory(name);
+    CHECK((size == expectedSize) && (!memcmp(buffer, expected, expectedSize)));
+    return TRUE;
+}
+
+static BOOL test_recorder_dump(void)
+{
+    BYTE *const input = (BYTE*)alloc_memory(RECORDER_INPUT), *const buffer = (BYTE*)alloc_memory(RECORDER_CAPACITY + 1U);
+    recorder_t recorder;
+    dumper_t dumper;
+    thread_t output;
+    DWORD seed = 0x9E3779B9U, pieceId = 0U;
+
+    zero_memory(&recorder, sizeof(recorder));
+    zero_memory(&dumper, sizeof(dumper));
+    zero_memory(&output, sizeof(output));
+    recorder.capacity = RECORDER_CAPACITY;
+    recorder.memory = (BYTE*)alloc_memory(RECORDER_CAPACITY);
+    dumper.buffer = (BYTE*)alloc_memory(DUMP_PIECE_SIZE);
+    dumper.hError = STDERR_FILENO;
+    output.name = L"" RING_PATH;
+    output.recorder = &recorder;
+    CHECK(input && buffer && recorder.memory && dumper.buffer);
+    CHECK((output.hOutput = open_file(output.name, FALSE)) != INVALID_FILE);
+    for (DWORD offset = 0U; offset < RECORDER_INPUT; ++offset)
+    {
+        input[offset] = (BYTE)(next_random(&seed) >> 11);
+    }
+
+    /* More than the ring holds: the first dump is the tail */
+    const DWORD first = (2U * RECORDER_CAPACITY) + 4321U;
+    record_pieces(&recorder, input, 0U, first, &pieceId);
+    dump_recorder(&dumper, &output, TRUE);
+    CHECK(check_dump(&output, 0U, input + first - RECORDER_CAPACITY, RECORDER_CAPACITY, buffer));
+
+    /* Less than the ring holds: only what has been recorded since */
+    const DWORD second = first + 70000U;
+    record_pieces(&recorder, input, first, second, &pieceId);
+    dump_recorder(&dumper, &output, TRUE);
+    CHECK(check_dump(&output, 1U, input + first, second - first, buffer));
+
+    /* Nothing new: no dump at all */
+    dump_recorder(&dumper, &output, TRUE);
+    CHECK(recorder.dumps == 2U);
+
+    /* A single piece that is larger than the ring: its tail */
+    const DWORD third = second + RECORDER_CAPACITY + 99U;
+    record_data(&recorder, input + second, third - second);
+    dump_recorder(&dumper, &output, TRUE);
+    CHECK(check_dump(&output, 2U, input + third - RECORDER_CAPACITY, RECORDER_CAPACITY, buffer));
+
+    /* Triggered: the dump ends at the request, the bytes that have been recorded after it push the oldest ones out */
+    const DWORD request = third + RECORDER_CAPACITY + 5U, later = 777U;
+    record_pieces(&recorder, input, third, request, &pieceId);
+    request_dump(&recorder);
+    record_pieces(&recorder, input, request, request + later, &pieceId);
+    dump_recorder(&dumper, &output, FALSE);
+    CHECK(check_dump(&output, 3U, input + request + later - RECORDER_CAPACITY, RECORDER_CAPACITY - later, buffer));
+    CHECK(recorder.lostBytes == later);
+
+    close_file(output.hOutput);
+    free_memory(dumper.buffer);
+    free_memory(recorder.memory);
+    free_memory(buffer);
+    free_memory(input);
+    return TRUE;
+}
+
+static BOOL test_recorder_exit(void)
+{
+    static const char *const ARGUMENTS[] = { "tee", "--ring=100000", RING_PATH, NULL };
+    BYTE *const input = (BYTE*)alloc_memory(SPILL_CAPACITY), *const buffer = (BYTE*)alloc_memory(100001U);
+    int pipeEnds[2U], status;
+    CHECK(input && buffer && (!pipe(pipeEnds)));
+
+    /* The ring of 100000 bytes is dumped, when the input ends */
+    const DWORD inputSize = make_lines(input, "line");
+    const int null = open("/dev/null", O_WRONLY);
+    const pid_t pid = start_tee(ARGUMENTS, pipeEnds[0U], null);
+    CHECK(pid > 0);
+    close(pipeEnds[0U]);
+    close(null);
+    CHECK(write_whole(pipeEnds[1U], input, inputSize));
+    close(pipeEnds[1U]);
+    CHECK((waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (!WEXITSTATUS(status)));
+
+    FILE *const file = fopen(RING_PATH, "rb");
+    CHECK(file);
+    const DWORD size = (DWORD)fread(buffer, 1U, 100001U, file);
+    fclose(file);
+    remove(RING_PATH);
+    CHECK((size == 100000U) && (!memcmp(buffer, input + inputSize - size, size)));
+
+    free_memory(buffer);
+    free_memory(input);
+    return TRUE;
+}
+
+// --------------------------------------------------------------------------
+// Test driver
+// --------------------------------------------------------------------------
+
+typedef struct _test
+{
+    const char *name;
+    BOOL (*run)(void);
+}
+test_t;
+
+static const test_t TESTS[] =
+{
+    { "ring_wraparound",         test_ring_wraparound         },
+    { "ring_handoff",            test_ring_handoff            },
+    { "ring_reader_wakeup",      test_ring_reader_wakeup      },
+    { "ring_writer_wakeup",      test_ring_writer_wakeup      },
+    { "connection_tcp_restart",  test_connection_tcp_restart  },
+    { "connection_unix_restart", test_connection_unix_restart },
+    { "match_cases",             test_match_cases             },
+    { "match_linear_time",       test_match_linear_time       },
+    { "deflate_round_trip",      test_deflate_round_trip      },
+    { "hash_xxh3",               test_hash_xxh3               },
+    { "hash_sha256",             test_hash_sha256             },
+    { "strip_escapes",           test_strip_escapes           },
+    { "spill_drain",             test_spill_drain             },
+    { "recorder_dump",           test_recorder_dump           },
+    { "recorder_exit",           test_recorder_exit           }
+};
+
+int tee_main(const int argc, const wchar_t *const argv[])
+{
+    DWORD failed = 0U;
+    (void)argc;
+    (void)argv;
+
+    for (DWORD index = 0U; index < ARRAYSIZE(TESTS); ++index)
+    {
+        alarm(TEST_TIMEOUT); /*a lost wake-up would hang the test forever*/
+        const BOOL success = TESTS[index].run();
+        printf("[%s] %s\n", success ? "PASS" : "FAIL", TESTS[index].name);
+        fflush(stdout);
+        failed += success ? 0U : 1U;
+    }
+
+    printf("%u of %u tests passed\n", (unsigned)(ARRAYSIZE(TESTS) - failed), (unsigned)ARRAYSIZE(TESTS));
+    return failed ? 1 : 0;
+}